@@ -39,6 +39,18 @@ void ABuildableActor::UnplaceItem()
     }
 }
 
+void ABuildableActor::ItemFired()
+{
+    if (!IsPlaced)
+        return;
+    UWorld* world = GetWorld();
+    ATPGameDemoGameState* gameState = (ATPGameDemoGameState*)(world->GetGameState());
+    if (gameState != nullptr)
+    {
+        gameState->BuildableItemFired(AttachmentRoomAndPosition, AttachmentDirection);
+    }
+}
+
 bool ABuildableActor::CanItemBePlaced() const
 {
     return CanBePlaced;
@@ -29,6 +29,10 @@ public:
     UFUNCTION(BlueprintImplementableEvent, Category = "Buildable Items Placement")
         void ItemWasPlaced();
 
+    /* Call when a placed item fires, to raise the danger of its line of fire for enemies. */
+    UFUNCTION(BlueprintCallable, Category = "Buildable Items Placement")
+        void ItemFired();
+
     UFUNCTION(BlueprintCallable, Category = "Buildable Items Placement")
         bool CanItemBePlaced() const;
 
@@ -0,0 +1,318 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "ChaseFlowField.h"
+
+//====================================================================================================
+// Setup
+//====================================================================================================
+
+void ChaseFlowField::Init(int numGridsXY, FIntPoint numGridUnits)
+{
+    NumRoomsXY = FMath::Max(numGridsXY + 1, 0);
+    RoomIndexOffset = numGridsXY / 2;
+    NumGridUnits = numGridUnits;
+    Nodes.Reset();
+    Nodes.SetNum(NumRoomsXY * NumRoomsXY);
+    // Every link is read in the first update.
+    DirtyNodes.Init(true, Nodes.Num());
+    bAnyDirty = Nodes.Num() > 0;
+    bHasPlayerRoom = false;
+    NumRoomsUpdated = 0;
+}
+
+void ChaseFlowField::Reset()
+{
+    Init(-1, FIntPoint(0, 0));
+}
+
+void ChaseFlowField::RoomChanged(FIntPoint roomCoords)
+{
+    const FIntPoint roomIndices = GetRoomIndices(roomCoords);
+    if (!RoomIndicesValid(roomIndices))
+        return;
+    DirtyNodes[GetNodeIndex(roomIndices)] = true;
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+    {
+        const FIntPoint neighbour = LevelBuilderHelpers::GetTargetPointForAction(roomIndices, (EDirectionType)d);
+        if (RoomIndicesValid(neighbour))
+            DirtyNodes[GetNodeIndex(neighbour)] = true;
+    }
+    bAnyDirty = true;
+}
+
+//====================================================================================================
+// Updating
+//====================================================================================================
+
+void ChaseFlowField::Update(const ATPGameDemoGameState& gameState, FRoomPositionPair playerRoomAndPosition)
+{
+    Update(playerRoomAndPosition, [&gameState](FIntPoint roomCoords, int* doorPositionsNESW)
+    {
+        return ReadLinksMask(gameState, roomCoords, doorPositionsNESW);
+    });
+}
+
+void ChaseFlowField::Update(FRoomPositionPair playerRoomAndPosition, const LinksReader& readLinks)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_UpdateChaseFlowField);
+    NumRoomsUpdated = 0;
+    const FIntPoint playerRoomIndices = GetRoomIndices(playerRoomAndPosition.RoomCoords);
+    if (!RoomIndicesValid(playerRoomIndices))
+    {
+        bHasPlayerRoom = false;
+        return;
+    }
+
+    AddedLinks.Reset();
+    RemovedLinks.Reset();
+    if (bAnyDirty)
+    {
+        // All the links are read before any are repaired, so that repairs never route through a link that is about to be removed.
+        for (TConstSetBitIterator<> it(DirtyNodes); it; ++it)
+        {
+            const int nodeIndex = it.GetIndex();
+            RoomNode& node = Nodes[nodeIndex];
+            const uint8 linksMask = readLinks(GetRoomIndices(nodeIndex) - FIntPoint(RoomIndexOffset, RoomIndexOffset), node.DoorPositions);
+            const uint8 changedLinks = linksMask ^ node.LinksMask;
+            node.LinksMask = linksMask;
+            for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+            {
+                if ((changedLinks & (1 << d)) == 0)
+                    continue;
+                if (linksMask & (1 << d))
+                    AddedLinks.Add({ nodeIndex, (EDirectionType)d });
+                else
+                    RemovedLinks.Add({ nodeIndex, (EDirectionType)d });
+            }
+        }
+        DirtyNodes.Init(false, Nodes.Num());
+        bAnyDirty = false;
+    }
+
+    const bool playerRoomChanged = !bHasPlayerRoom || playerRoomAndPosition.RoomCoords != PlayerRoomAndPosition.RoomCoords;
+    PlayerRoomAndPosition = playerRoomAndPosition;
+    bHasPlayerRoom = true;
+    if (playerRoomChanged)
+    {
+        Rebuild();
+        return;
+    }
+    for (const Link& link : RemovedLinks)
+        LinkRemoved(link.NodeIndex, link.Door);
+    for (const Link& link : AddedLinks)
+        LinkAdded(link.NodeIndex, link.Door);
+}
+
+uint8 ChaseFlowField::ReadLinksMask(const ATPGameDemoGameState& gameState, FIntPoint roomCoords, int* doorPositionsNESW)
+{
+    if (!gameState.IsRoomTrained(roomCoords))
+        return 0;
+    const RoomAdjacency& adjacency = gameState.GetRoomAdjacency(roomCoords);
+    uint8 linksMask = 0;
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+    {
+        doorPositionsNESW[d] = adjacency.DoorPositions[d];
+        if (adjacency.GetDoorPositionForExistingNeighbour((EDirectionType)d) > 0 && !adjacency.IsDoorLocked((EDirectionType)d))
+            linksMask |= (1 << d);
+    }
+    return linksMask;
+}
+
+void ChaseFlowField::SetDistance(int nodeIndex, int32 distance, EDirectionType nextDoor)
+{
+    RoomNode& node = Nodes[nodeIndex];
+    if (node.Distance != distance)
+        ++NumRoomsUpdated;
+    node.Distance = distance;
+    node.NextDoor = nextDoor;
+}
+
+void ChaseFlowField::Rebuild()
+{
+    for (int n = 0; n < Nodes.Num(); ++n)
+        SetDistance(n, Unreachable, EDirectionType::NumDirectionTypes);
+    const int playerNode = GetNodeIndex(GetRoomIndices(PlayerRoomAndPosition.RoomCoords));
+    SetDistance(playerNode, 0, EDirectionType::NumDirectionTypes);
+    Queue.Reset();
+    Queue.HeapPush({ 0, playerNode });
+    Propagate();
+}
+
+void ChaseFlowField::LinkAdded(int nodeIndex, EDirectionType door)
+{
+    const int neighbourIndex = GetLinkedNode(nodeIndex, door);
+    // Links are only used once both ends have seen them.
+    if (neighbourIndex == INDEX_NONE)
+        return;
+    Queue.Reset();
+    auto Relax = [this](int from, int to, EDirectionType doorFromTo)
+    {
+        const int32 fromDistance = Nodes[from].Distance;
+        if (fromDistance != Unreachable && fromDistance + 1 < Nodes[to].Distance)
+        {
+            SetDistance(to, fromDistance + 1, DirectionHelpers::GetOppositeDirection(doorFromTo));
+            Queue.HeapPush({ fromDistance + 1, to });
+        }
+    };
+    Relax(nodeIndex, neighbourIndex, door);
+    Relax(neighbourIndex, nodeIndex, DirectionHelpers::GetOppositeDirection(door));
+    Propagate();
+}
+
+void ChaseFlowField::LinkRemoved(int nodeIndex, EDirectionType door)
+{
+    const FIntPoint neighbourIndices = LevelBuilderHelpers::GetTargetPointForAction(GetRoomIndices(nodeIndex), door);
+    if (!RoomIndicesValid(neighbourIndices))
+        return;
+    const int neighbourIndex = GetNodeIndex(neighbourIndices);
+    // Only the room whose path went through the link needs repairing.
+    int childIndex = INDEX_NONE;
+    if (Nodes[nodeIndex].NextDoor == door)
+        childIndex = nodeIndex;
+    else if (Nodes[neighbourIndex].NextDoor == DirectionHelpers::GetOppositeDirection(door))
+        childIndex = neighbourIndex;
+    if (childIndex == INDEX_NONE)
+        return;
+
+    // Clear every room whose path passes through the child.
+    AffectedNodes.Reset();
+    AffectedNodes.Add(childIndex);
+    SetDistance(childIndex, Unreachable, EDirectionType::NumDirectionTypes);
+    for (int i = 0; i < AffectedNodes.Num(); ++i)
+    {
+        const FIntPoint affectedIndices = GetRoomIndices(AffectedNodes[i]);
+        for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        {
+            const FIntPoint neighbour = LevelBuilderHelpers::GetTargetPointForAction(affectedIndices, (EDirectionType)d);
+            if (!RoomIndicesValid(neighbour))
+                continue;
+            const int n = GetNodeIndex(neighbour);
+            if (Nodes[n].Distance != Unreachable && Nodes[n].NextDoor == DirectionHelpers::GetOppositeDirection((EDirectionType)d))
+            {
+                SetDistance(n, Unreachable, EDirectionType::NumDirectionTypes);
+                AffectedNodes.Add(n);
+            }
+        }
+    }
+
+    // Refill the cleared rooms from their best remaining neighbour.
+    Queue.Reset();
+    for (int affectedIndex : AffectedNodes)
+    {
+        int32 bestDistance = Unreachable;
+        EDirectionType bestDoor = EDirectionType::NumDirectionTypes;
+        for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        {
+            const int n = GetLinkedNode(affectedIndex, (EDirectionType)d);
+            if (n != INDEX_NONE && Nodes[n].Distance != Unreachable && Nodes[n].Distance + 1 < bestDistance)
+            {
+                bestDistance = Nodes[n].Distance + 1;
+                bestDoor = (EDirectionType)d;
+            }
+        }
+        if (bestDistance != Unreachable)
+        {
+            SetDistance(affectedIndex, bestDistance, bestDoor);
+            Queue.HeapPush({ bestDistance, affectedIndex });
+        }
+    }
+    Propagate();
+}
+
+void ChaseFlowField::Propagate()
+{
+    while (Queue.Num() > 0)
+    {
+        QueueEntry entry;
+        Queue.HeapPop(entry, false);
+        // Skip entries for rooms that have been lowered again since they were queued.
+        if (entry.Distance != Nodes[entry.NodeIndex].Distance)
+            continue;
+        for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        {
+            const int n = GetLinkedNode(entry.NodeIndex, (EDirectionType)d);
+            if (n != INDEX_NONE && entry.Distance + 1 < Nodes[n].Distance)
+            {
+                SetDistance(n, entry.Distance + 1, DirectionHelpers::GetOppositeDirection((EDirectionType)d));
+                Queue.HeapPush({ entry.Distance + 1, n });
+            }
+        }
+    }
+}
+
+//====================================================================================================
+// Queries
+//====================================================================================================
+
+bool ChaseFlowField::RoomIndicesValid(FIntPoint roomIndices) const
+{
+    return roomIndices.X >= 0 && roomIndices.X < NumRoomsXY && roomIndices.Y >= 0 && roomIndices.Y < NumRoomsXY;
+}
+
+int ChaseFlowField::GetLinkedNode(int nodeIndex, EDirectionType door) const
+{
+    if ((Nodes[nodeIndex].LinksMask & (1 << (int)door)) == 0)
+        return INDEX_NONE;
+    const FIntPoint neighbour = LevelBuilderHelpers::GetTargetPointForAction(GetRoomIndices(nodeIndex), door);
+    if (!RoomIndicesValid(neighbour))
+        return INDEX_NONE;
+    const int neighbourIndex = GetNodeIndex(neighbour);
+    return (Nodes[neighbourIndex].LinksMask & (1 << (int)DirectionHelpers::GetOppositeDirection(door))) != 0 ? neighbourIndex : INDEX_NONE;
+}
+
+int32 ChaseFlowField::GetDistance(FIntPoint roomCoords) const
+{
+    const FIntPoint roomIndices = GetRoomIndices(roomCoords);
+    if (!IsValid() || !RoomIndicesValid(roomIndices))
+        return Unreachable;
+    return Nodes[GetNodeIndex(roomIndices)].Distance;
+}
+
+EDirectionType ChaseFlowField::GetNextDoor(FIntPoint roomCoords) const
+{
+    const FIntPoint roomIndices = GetRoomIndices(roomCoords);
+    if (!IsValid() || !RoomIndicesValid(roomIndices))
+        return EDirectionType::NumDirectionTypes;
+    return Nodes[GetNodeIndex(roomIndices)].NextDoor;
+}
+
+bool ChaseFlowField::GetRoomTarget(FIntPoint roomCoords, FTargetPosition& target) const
+{
+    const FIntPoint roomIndices = GetRoomIndices(roomCoords);
+    if (!IsValid() || !RoomIndicesValid(roomIndices))
+        return false;
+    const RoomNode& node = Nodes[GetNodeIndex(roomIndices)];
+    if (node.Distance == Unreachable)
+        return false;
+    if (node.Distance == 0)
+    {
+        target = { PlayerRoomAndPosition.PositionInRoom, EDirectionType::NumDirectionTypes };
+        return true;
+    }
+    target = { GetDoorCell(node.NextDoor, node.DoorPositions[(int)node.NextDoor], NumGridUnits), node.NextDoor };
+    return true;
+}
+
+FDirectionSet ChaseFlowField::GetChaseActions(ATPGameDemoGameState& gameState, FRoomPositionPair roomAndPosition) const
+{
+    FTargetPosition target;
+    if (!GetRoomTarget(roomAndPosition.RoomCoords, target))
+        return FDirectionSet();
+    if (target.TargetIsDoor() && target.Position == roomAndPosition.PositionInRoom)
+        return FDirectionSet((uint8)(1 << (int)target.DoorAction));
+    return gameState.GetOptimalActions(roomAndPosition.RoomCoords, target.Position, roomAndPosition.PositionInRoom);
+}
+
+FIntPoint ChaseFlowField::GetDoorCell(EDirectionType wall, int doorPositionOnWall, FIntPoint numGridUnits)
+{
+    switch (wall)
+    {
+    case EDirectionType::North: return FIntPoint(numGridUnits.X - 1, doorPositionOnWall);
+    case EDirectionType::East: return FIntPoint(doorPositionOnWall, numGridUnits.Y - 1);
+    case EDirectionType::South: return FIntPoint(0, doorPositionOnWall);
+    case EDirectionType::West: return FIntPoint(doorPositionOnWall, 0);
+    default: ensure(false); return FIntPoint(-1, -1);
+    }
+}
@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+class ATPGameDemoGameState;
+
+/*
+A world-wide flow field towards the player, shared by every chasing enemy.
+
+The field is kept at room level: each room stores its distance, in doors, from the player's room and the door that leads one room
+closer. Inside a room the per-room qvalue tables already hold the way to any cell, so the direction for a cell is the room's optimal
+action towards that door (or towards the player's cell, in the player's room). A chasing enemy costs one lookup per decision,
+however many enemies there are.
+
+Two rooms are linked if both are trained, the door on the wall between them has been generated, and it isn't locked. The game state
+calls RoomChanged whenever a room's adjacency is invalidated. Update then only repairs the distances around the links that changed:
+ - A new link lowers distances outwards from its ends.
+ - A removed link that a room's path used clears the rooms whose path went through it, then refills them from their neighbours.
+The field is rebuilt from scratch when the player moves to a different room. Moving within a room only changes the target cell.
+*/
+class ChaseFlowField
+{
+public:
+    static constexpr int32 Unreachable = MAX_int32;
+
+    /* numGridsXY is the game state's NumGridsXY. The field covers all of its room states (NumGridsXY + 1 along each side). */
+    void Init(int numGridsXY, FIntPoint numGridUnits);
+    void Reset();
+    /* Flags the room, and its links to its neighbours, for the next Update. */
+    void RoomChanged(FIntPoint roomCoords);
+    /* Brings the field up to date for the player's current cell. */
+    void Update(const ATPGameDemoGameState& gameState, FRoomPositionPair playerRoomAndPosition);
+    /* Returns a room's links mask (bit d is set if the room is linked to its neighbour in direction d), and fills in its door positions
+       on each wall (NESW). */
+    typedef TFunction<uint8(FIntPoint roomCoords, int* doorPositionsNESW)> LinksReader;
+    /* Update, with the links of changed rooms read by readLinks rather than from the game state. */
+    void Update(FRoomPositionPair playerRoomAndPosition, const LinksReader& readLinks);
+
+    bool IsValid() const { return NumRoomsXY > 0 && bHasPlayerRoom; }
+    bool Matches(int numGridsXY, FIntPoint numGridUnits) const { return NumRoomsXY == numGridsXY + 1 && NumGridUnits == numGridUnits; }
+    FRoomPositionPair GetPlayerRoomAndPosition() const { return PlayerRoomAndPosition; }
+    /* The number of doors between the room and the player's room, or Unreachable. */
+    int32 GetDistance(FIntPoint roomCoords) const;
+    /* The door to take towards the player, or NumDirectionTypes in the player's room or if the player can't be reached. */
+    EDirectionType GetNextDoor(FIntPoint roomCoords) const;
+    /* The movement target in the room for a chasing enemy: the next door, or the player's cell. Returns false if the player can't be
+       reached from the room. */
+    bool GetRoomTarget(FIntPoint roomCoords, FTargetPosition& target) const;
+    /* The chase directions from a cell: the door action when standing on the next door, otherwise the room's optimal actions
+       towards its target. Empty if the player can't be reached. */
+    FDirectionSet GetChaseActions(ATPGameDemoGameState& gameState, FRoomPositionPair roomAndPosition) const;
+
+    /* The cell of a door at doorPositionOnWall on the given wall of a room. */
+    static FIntPoint GetDoorCell(EDirectionType wall, int doorPositionOnWall, FIntPoint numGridUnits);
+
+    /* The number of rooms whose distance was changed by the last Update. */
+    int GetNumRoomsUpdated() const { return NumRoomsUpdated; }
+
+private:
+    struct RoomNode
+    {
+        int32 Distance = Unreachable;
+        EDirectionType NextDoor = EDirectionType::NumDirectionTypes;
+        /* Bit d is set if the room is linked to its neighbour in direction d. */
+        uint8 LinksMask = 0;
+        int DoorPositions[(int)EDirectionType::NumDirectionTypes] = { -1, -1, -1, -1 };
+    };
+
+    struct QueueEntry
+    {
+        int32 Distance;
+        int32 NodeIndex;
+        bool operator<(const QueueEntry& other) const { return Distance < other.Distance; }
+    };
+
+    int GetNodeIndex(FIntPoint roomIndices) const { return roomIndices.X * NumRoomsXY + roomIndices.Y; }
+    FIntPoint GetRoomIndices(int nodeIndex) const { return FIntPoint(nodeIndex / NumRoomsXY, nodeIndex % NumRoomsXY); }
+    FIntPoint GetRoomIndices(FIntPoint roomCoords) const { return roomCoords + FIntPoint(RoomIndexOffset, RoomIndexOffset); }
+    bool RoomIndicesValid(FIntPoint roomIndices) const;
+    /* The node through the door, or INDEX_NONE if there is no link. */
+    int GetLinkedNode(int nodeIndex, EDirectionType door) const;
+    static uint8 ReadLinksMask(const ATPGameDemoGameState& gameState, FIntPoint roomCoords, int* doorPositionsNESW);
+
+    void SetDistance(int nodeIndex, int32 distance, EDirectionType nextDoor);
+    void LinkAdded(int nodeIndex, EDirectionType door);
+    void LinkRemoved(int nodeIndex, EDirectionType door);
+    void Rebuild();
+    /* Lowers distances outwards from the queued rooms until no neighbour can be improved. */
+    void Propagate();
+
+    int NumRoomsXY = 0;
+    int RoomIndexOffset = 0;
+    FIntPoint NumGridUnits { 0, 0 };
+    bool bHasPlayerRoom = false;
+    FRoomPositionPair PlayerRoomAndPosition { FIntPoint(0, 0), FIntPoint(0, 0) };
+    int NumRoomsUpdated = 0;
+
+    TArray<RoomNode> Nodes;
+    TBitArray<> DirtyNodes;
+    bool bAnyDirty = false;
+    // Reused between updates.
+    struct Link
+    {
+        int NodeIndex;
+        EDirectionType Door;
+    };
+    TArray<Link> AddedLinks;
+    TArray<Link> RemovedLinks;
+    TArray<QueueEntry> Queue;
+    TArray<int> AffectedNodes;
+};
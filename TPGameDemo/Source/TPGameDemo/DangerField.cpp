@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "DangerField.h"
+
+void DangerField::Init(FIntPoint roomDimensions)
+{
+    RoomDimensions = roomDimensions;
+    Rooms.Empty();
+}
+
+//====================================================================================================
+// Turret events
+//====================================================================================================
+
+void DangerField::AddTurret(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, const RoomActionMasks* actionMasks, CellChanges& changes)
+{
+    if (!ensure(IsPositionValid(position) && facing != EDirectionType::NumDirectionTypes))
+        return;
+    RoomDanger* room = Rooms.Find(roomCoords);
+    if (room == nullptr)
+    {
+        room = &Rooms.Add(roomCoords);
+        room->CellDangers.SetNumZeroed(RoomDimensions.X * RoomDimensions.Y);
+    }
+    if (FindTurret(*room, position, facing) != INDEX_NONE)
+        return;
+    Turret turret;
+    turret.Position = position;
+    turret.Facing = facing;
+    turret.Range = actionMasks != nullptr ? GetRange(*actionMasks, position, facing) : 0;
+    AddCoverage(*room, turret, turret.Danger, changes);
+    room->Turrets.Add(turret);
+}
+
+void DangerField::RemoveTurret(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, CellChanges& changes)
+{
+    RoomDanger* room = Rooms.Find(roomCoords);
+    const int turretIndex = room != nullptr ? FindTurret(*room, position, facing) : INDEX_NONE;
+    if (turretIndex == INDEX_NONE)
+        return;
+    const Turret turret = room->Turrets[turretIndex];
+    AddCoverage(*room, turret, -turret.Danger, changes);
+    room->Turrets.RemoveAtSwap(turretIndex);
+    if (room->Turrets.Num() == 0)
+        Rooms.Remove(roomCoords);
+}
+
+void DangerField::TurretFired(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, CellChanges& changes)
+{
+    RoomDanger* room = Rooms.Find(roomCoords);
+    const int turretIndex = room != nullptr ? FindTurret(*room, position, facing) : INDEX_NONE;
+    if (turretIndex == INDEX_NONE)
+        return;
+    Turret& turret = room->Turrets[turretIndex];
+    const float delta = FMath::Min(turret.Danger + FiredTurretDanger, MaxTurretDanger) - turret.Danger;
+    if (delta <= 0.0f)
+        return;
+    turret.Danger += delta;
+    AddCoverage(*room, turret, delta, changes);
+}
+
+void DangerField::RoomStructureChanged(FIntPoint roomCoords, const RoomActionMasks& actionMasks)
+{
+    RoomDanger* room = Rooms.Find(roomCoords);
+    if (room == nullptr)
+        return;
+    for (Turret& turret : room->Turrets)
+        turret.Range = GetRange(actionMasks, turret.Position, turret.Facing);
+    GetCellDangers(actionMasks, room->Turrets, room->CellDangers);
+}
+
+int DangerField::FindTurret(const RoomDanger& room, FIntPoint position, EDirectionType facing) const
+{
+    return room.Turrets.IndexOfByPredicate([position, facing](const Turret& turret)
+    {
+        return turret.Position == position && turret.Facing == facing;
+    });
+}
+
+void DangerField::AddCoverage(RoomDanger& room, const Turret& turret, float danger, CellChanges& changes)
+{
+    FIntPoint position = turret.Position;
+    for (int c = 0; c < turret.Range; ++c)
+    {
+        room.CellDangers[GetCellIndex(position)] += danger;
+        changes.Add({ position, danger });
+        position = LevelBuilderHelpers::GetTargetPointForAction(position, turret.Facing);
+    }
+}
+
+//====================================================================================================
+// Queries
+//====================================================================================================
+
+float DangerField::GetDanger(FIntPoint roomCoords, FIntPoint positionInRoom) const
+{
+    const RoomDanger* room = Rooms.Find(roomCoords);
+    if (room == nullptr || !IsPositionValid(positionInRoom))
+        return 0.0f;
+    return room->CellDangers[GetCellIndex(positionInRoom)];
+}
+
+const TArray<float>* DangerField::GetRoomDangers(FIntPoint roomCoords) const
+{
+    const RoomDanger* room = Rooms.Find(roomCoords);
+    return room != nullptr ? &room->CellDangers : nullptr;
+}
+
+const TArray<DangerField::Turret>* DangerField::GetRoomTurrets(FIntPoint roomCoords) const
+{
+    const RoomDanger* room = Rooms.Find(roomCoords);
+    return room != nullptr ? &room->Turrets : nullptr;
+}
+
+void DangerField::GetCellDangers(const RoomActionMasks& actionMasks, const TArray<Turret>& turrets, TArray<float>& dangers)
+{
+    const int sizeX = actionMasks.GetOpenCells().GetNumX();
+    const int sizeY = actionMasks.GetOpenCells().GetNumY();
+    dangers.Reset();
+    dangers.SetNumZeroed(sizeX * sizeY);
+    for (const Turret& turret : turrets)
+    {
+        FIntPoint position = turret.Position;
+        const int32 range = GetRange(actionMasks, turret.Position, turret.Facing);
+        for (int c = 0; c < range; ++c)
+        {
+            dangers[position.X * sizeY + position.Y] += turret.Danger;
+            position = LevelBuilderHelpers::GetTargetPointForAction(position, turret.Facing);
+        }
+    }
+}
+
+int32 DangerField::GetRange(const RoomActionMasks& actionMasks, FIntPoint position, EDirectionType facing)
+{
+    const int sizeX = actionMasks.GetOpenCells().GetNumX();
+    const int sizeY = actionMasks.GetOpenCells().GetNumY();
+    if (!LevelBuilderHelpers::GridPositionIsValid(position, sizeX, sizeY) || !actionMasks.IsCellOpen(position))
+        return 0;
+    int32 range = 1;
+    // Door exits can move out of the room, so the edge of the room stops the line as well as walls do.
+    while (actionMasks.CanTakeAction(position, facing))
+    {
+        position = LevelBuilderHelpers::GetTargetPointForAction(position, facing);
+        if (!LevelBuilderHelpers::GridPositionIsValid(position, sizeX, sizeY))
+            break;
+        ++range;
+    }
+    return range;
+}
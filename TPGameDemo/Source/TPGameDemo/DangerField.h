@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+/*
+How dangerous each cell of a room is for enemies, from the turrets placed in it.
+
+A turret covers the cells in its line of fire: its own cell, then each cell it faces until a wall or the edge of the room. Every
+covered cell gets the turret's danger, which starts at PlacedTurretDanger and grows by FiredTurretDanger each time the turret fires,
+up to MaxTurretDanger. Overlapping lines add up.
+
+The field is only changed by the turret events themselves. Each event updates the cells of one line and reports the per-cell change,
+so that the game state can adjust the room's qvalues straight away (see ATPGameDemoGameState::ApplyDangerChanges). Danger becomes a
+reward term (GridTrainingConstants::DangerCost per unit) for moving into a cell, both in RoomTraining and in UpdateQValueRealtime.
+
+Rooms only have storage once a turret is placed in them. Cell dangers are in x-major order, as in BuildablePlacementIndex.
+*/
+class DangerField
+{
+public:
+    static constexpr float PlacedTurretDanger = 1.0f;
+    static constexpr float FiredTurretDanger = 0.25f;
+    static constexpr float MaxTurretDanger = 2.0f;
+
+    struct Turret
+    {
+        FIntPoint Position { 0, 0 };
+        EDirectionType Facing = EDirectionType::NumDirectionTypes;
+        float Danger = PlacedTurretDanger;
+        /* The number of cells in the line of fire, or 0 until the room's structure is known. */
+        int32 Range = 0;
+    };
+
+    struct CellChange
+    {
+        FIntPoint Position;
+        float Delta;
+    };
+    typedef TArray<CellChange, TInlineAllocator<RoomBitboard::MaxSide>> CellChanges;
+
+    void Init(FIntPoint roomDimensions);
+    void ClearRoom(FIntPoint roomCoords) { Rooms.Remove(roomCoords); }
+    void Clear() { Rooms.Empty(); }
+
+    /* actionMasks is null if the room hasn't been built yet. The turret then covers nothing until RoomStructureChanged. */
+    void AddTurret(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, const RoomActionMasks* actionMasks, CellChanges& changes);
+    void RemoveTurret(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, CellChanges& changes);
+    void TurretFired(FIntPoint roomCoords, FIntPoint position, EDirectionType facing, CellChanges& changes);
+    /* Recomputes the lines of fire of the room's turrets. A new structure comes with newly trained qvalues, so no changes are
+       reported. */
+    void RoomStructureChanged(FIntPoint roomCoords, const RoomActionMasks& actionMasks);
+
+    float GetDanger(FIntPoint roomCoords, FIntPoint positionInRoom) const;
+    /* The danger of each cell in the room, or null if the room has no turrets. */
+    const TArray<float>* GetRoomDangers(FIntPoint roomCoords) const;
+    /* The turrets placed in the room, or null if it has none. */
+    const TArray<Turret>* GetRoomTurrets(FIntPoint roomCoords) const;
+
+    /* Fills dangers with the coverage of turrets in a room with the given action masks. For rooms built away from the game state. */
+    static void GetCellDangers(const RoomActionMasks& actionMasks, const TArray<Turret>& turrets, TArray<float>& dangers);
+    /* The number of cells covered by a turret at position, facing the given direction. */
+    static int32 GetRange(const RoomActionMasks& actionMasks, FIntPoint position, EDirectionType facing);
+
+private:
+    struct RoomDanger
+    {
+        TArray<float> CellDangers;
+        TArray<Turret> Turrets;
+    };
+
+    int GetCellIndex(FIntPoint positionInRoom) const { return positionInRoom.X * RoomDimensions.Y + positionInRoom.Y; }
+    bool IsPositionValid(FIntPoint positionInRoom) const
+    {
+        return positionInRoom.X >= 0 && positionInRoom.X < RoomDimensions.X && positionInRoom.Y >= 0 && positionInRoom.Y < RoomDimensions.Y;
+    }
+    int FindTurret(const RoomDanger& room, FIntPoint position, EDirectionType facing) const;
+    /* Adds danger to every cell in the turret's line of fire. */
+    void AddCoverage(RoomDanger& room, const Turret& turret, float danger, CellChanges& changes);
+
+    FIntPoint RoomDimensions { 0, 0 };
+    TMap<FIntPoint, RoomDanger> Rooms;
+};
@@ -4,11 +4,9 @@
 #include "TPGameDemo.h"
 #include "MazeActor.h"
 #include "TPGameDemoGameState.h"
+#include "EnemyEventLog.h"
 #include "EnemyActor.generated.h"
 
-
-#define ENEMY_LIFETIME_LOGS 0
-
 /*
 The base class for an enemy actor. Enemies behave according to `level policies' which are action-value tables that have been trained using Q-Learning.
 See https://webdocs.cs.ualberta.ca/~sutton/book/ebook/node1.html for details on reinforcement learning and Q-Learning specifically. 
@@ -20,6 +18,9 @@ When the player character changes position, the UpdatePolicyForPlayerPosition (i
 in the level bueprint in the UE4 editor. The Player Character broadcasts a delegate function when its grid position changes. In the level blueprint in the editor, 
 this delegate is bound to a function that calls UpdatePolicyForPlayerPosition (int playerX, int playerY) on an instance of this class.
 
+Enemies with ChasePlayer set don't need this: they follow the game state's ChaseFlowField, which is kept up to date with the player's cell
+and the door graph for all enemies at once.
+
 See MazeActor.h
 */
 
@@ -32,28 +33,6 @@ enum class ELogEventType : uint8
     NumTypes
 };
 
-USTRUCT()
-struct FTargetPosition
-{
-    GENERATED_BODY()
-    // Invalid initial values to avoid TargetReached miss-fire
-    FIntPoint Position = FIntPoint(-1,-1);
-    EDirectionType DoorAction = EDirectionType::NumDirectionTypes;
-
-    bool TargetIsDoor() const
-    {
-        return DoorAction != EDirectionType::NumDirectionTypes;
-    }
-
-    FString ToInfoString() const
-    {
-        FString positionString = FString::Format(TEXT("Target Position: {0}"), { Position.ToString() });
-        FString actionString = FString::Format(TEXT("Action : {0}"), { DirectionHelpers::GetDisplayString(DoorAction) });
-        return positionString + " | " + actionString;
-    }
-};
-
-
 DECLARE_LOG_CATEGORY_EXTERN(LogEnemyActor, Log, All);
 
 UCLASS()
@@ -103,7 +82,7 @@ public:
     //    void UpdateMovementForActionType(EDirectionType actionType);
 
     /* Choose a door in the current room and update the policy to direct towards that door. 
-        return true if the door chosen is the current position
+        The door is chosen by the EnemyBrain at the end of the frame, so movementTargetUpdated is always false.
     */
     UFUNCTION(BlueprintCallable, Category = "Enemy Behaviour")
         virtual void ChooseDoorTarget(bool& movementTargetUpdated);
@@ -115,12 +94,19 @@ public:
     /** Determines whether the enemy should update the qvalue table after every action */
     UPROPERTY(EditAnywhere, Category = "Enemy Behaviour")
         bool UpdateQValue = true;
+
+    /** Determines whether the enemy should chase the player along the game state's chase flow field, instead of heading for its target room */
+    UPROPERTY(EditAnywhere, Category = "Enemy Behaviour")
+        bool ChasePlayer = false;
     //======================================================================================================
     // Movement
     //====================================================================================================== 
 	UFUNCTION(BlueprintCallable, Category = "Enemy Movement")
 		bool IsPositionValid();
 
+    /* Moves straight towards the MovementTarget, without sweeping, by at most deltaSeconds of walking. Used instead of ticking while dormant. */
+    void StepDormantMovement(float deltaSeconds);
+
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Enemy Movement")
         FVector MovementTarget = FVector::ZeroVector;
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Movement")
@@ -129,53 +115,15 @@ public:
 private:
     ATPGameDemoGameState* GameState;
 
-    FTargetPosition   TargetPositionAndAction; // Intermediate movement target, while navigating to target room.
-    FRoomPositionPair TargetRoomAndPosition = { FIntPoint(0, 0), FIntPoint(4, 4) }; // default to center of central room.
+    FRandomStream ActionRandomStream; // Used to break ties between equally optimal actions.
 
-    void SetTargetPositionAndAction(FTargetPosition);
-    void EnteredTargetRoom();
+    /* The enemy's agent in the game state's EnemyBrain, which makes its navigation decisions and sets its MovementTarget. */
+    EnemyAgentHandle BrainHandle = INDEX_NONE;
+    bool HasBrainAgent() const;
+    /* The intermediate movement target in the current room, while navigating to the target room. */
+    FTargetPosition GetBrainTarget() const;
 
     void ActorDied() override;
-    //======================================================================================================
-    // Behaviour Policy
-    //======================================================================================================
-    void UpdatePolicyForDoorType(EDirectionType doorTypem, int doorPositionOnWall);
-    // Data to store for updating the state-action qvalues. The qvalues are only updated for an action when taking the subsequent action.
-    // This is so that rewards can be accumulated while in a state, and then applied to the qvalue when moving out of that state.
-    // (It's an attempt to introduce variable rewards. For example, getting shot, or dying, will accumulate negative reward).
-    FRoomPositionPair PrevActionStartPos;
-    EDirectionType PrevActionType = EDirectionType::NumDirectionTypes;
-    FIntPoint PrevActionTarget;
-    float PrevActionAccumulatedReward = 0.0f;
-    struct RoomPosition
-    {
-        int RoomSideLength;
-        FIntPoint Position;
-    };
-    struct RoomPosition_ComparePositive
-    {
-        bool operator() (const RoomPosition& lhs, const RoomPosition& rhs) const
-        {
-            return (lhs.Position.X * lhs.RoomSideLength + lhs.Position.Y) < (rhs.Position.X * rhs.RoomSideLength + rhs.Position.Y);
-            if (lhs.Position.X < rhs.Position.X)
-                return lhs.Position.Y < rhs.Position.Y;
-            return false;
-        }
-    };
-    // Used to deter loops - punish repeated positions (for the same destination target position)
-    std::set<RoomPosition, RoomPosition_ComparePositive> VisitedPositions;
-    //======================================================================================================
-    // Movement
-    //====================================================================================================== 
-    void UpdateMovement();
-    // Returns the room coords and position in room indicated by the given movement direction, determined by the actors current position.
-    // If the movement action would cause them to change rooms, roomCoords will indicate which room they would enter.
-    FRoomPositionPair GetTargetRoomAndPositionForDirectionType(EDirectionType actionType);
-    /* Move along the given direction if possible. This may be called recursively if an invalid action is chosen. */
-    void UpdateMovementForActionType(EDirectionType actionType, int numCalls = 0);
-    bool ShouldUpdateQValue() const;
-    /* The door through which the current room was entered */
-    EDirectionType PreviousDoor = EDirectionType::NumDirectionTypes;
 
     //======================================================================================================
     // From AMazeActor
@@ -186,24 +134,12 @@ private:
     //======================================================================================================
     // Logging
     //======================================================================================================
-#if ENEMY_LIFETIME_LOGS
-    FString               LogDir;
-    bool                  LogDirFound = false;
-    bool                  SaveLifetimeLog = false;
-    FString               LifetimeLog;
-
-    void LogLine(const FString& lineString);
-    void LogEvent(const FString& eventInfo, ELogEventType logType);
-    FIntPoint RoomAtLastEventLog;
-    void LogRoom();
-    FIntPoint PositionAtLastEventLog;
-    void LogPosition();
-    FTargetPosition TargetAtLastEventLog;
-    void LogTarget();
-    FVector WorldPosAtLastEventLog;
-    void LogWorldPosition();
-    void LogDetails();
-    void SaveLifetimeString();
-    void AssertWithErrorLog(const bool& condition, FString errorLog);
+#if ENEMY_EVENT_LOGS
+    /* Records an event in the EnemyEventLog, at the enemy's current room and position. */
+    void LogEvent(EEnemyEventType type, EDirectionType action = EDirectionType::NumDirectionTypes, float reward = 0.0f)
+    {
+        if (EnemyEventLog::IsRunning())
+            EnemyEventLog::Log(type, GetUniqueID(), GetRoomAndPosition(), action, reward);
+    }
 #endif
 };
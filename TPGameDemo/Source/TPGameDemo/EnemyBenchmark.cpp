@@ -0,0 +1,181 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "EnemyBrain.h"
+#include "EnemyBenchmark.h"
+
+DEFINE_LOG_CATEGORY(LogEnemyBenchmark);
+
+//====================================================================================================
+// EnemyBenchmark
+//====================================================================================================
+
+FString EnemyBenchmark::Results::ToString() const
+{
+    return FString::Printf(TEXT("Rooms built: %d (%.2fs)\n")
+                           TEXT("Steps: %d, total %.3fs, mean %.3fms, p99 %.3fms, max %.3fms\n")
+                           TEXT("Decisions: %lld (%.0f/s)\n")
+                           TEXT("Realtime qvalue updates: %lld (%.0f/s)\n")
+                           TEXT("Agents replaced: %lld\n")
+                           TEXT("Memory growth: %.2f MB"),
+                           NumRoomsBuilt, RoomBuildSeconds,
+                           NumSteps, TotalStepSeconds, MeanStepSeconds * 1000.0, P99StepSeconds * 1000.0, MaxStepSeconds * 1000.0,
+                           NumDecisions, GetDecisionsPerSecond(),
+                           NumQValueUpdates, GetQValueUpdatesPerSecond(),
+                           NumAgentsReplaced,
+                           MemoryGrowthBytes / (1024.0 * 1024.0));
+}
+
+bool EnemyBenchmark::Run(ATPGameDemoGameState& gameState, const Settings& settings, Results& results)
+{
+    results = Results();
+    const double buildStartTime = FPlatformTime::Seconds();
+    results.NumRoomsBuilt = gameState.BuildHeadlessRooms(settings.Perimeter, settings.Seed, settings.NormedDensity, settings.NormedComplexity).Num();
+    results.RoomBuildSeconds = FPlatformTime::Seconds() - buildStartTime;
+
+    // Agents spawn in the outermost trained rooms, and head for the middle of the central room.
+    const FIntPoint targetRoom(0, 0);
+    FIntPoint targetPosition;
+    if (!gameState.IsRoomTrained(targetRoom) || !gameState.GetMostCentralEmptyTilePosition(targetRoom, targetPosition))
+        return false;
+    TArray<FIntPoint> spawnRooms;
+    TArray<FIntPoint> spawnPositions;
+    for (int perimeter = FMath::Clamp(settings.Perimeter, 0, gameState.GetMaxRoomPerimeter()); perimeter >= 0 && spawnRooms.Num() == 0; --perimeter)
+    {
+        for (int x = -perimeter; x <= perimeter; ++x)
+        {
+            for (int y = -perimeter; y <= perimeter; ++y)
+            {
+                const FIntPoint roomCoords(x, y);
+                FIntPoint spawnPosition;
+                if (FMath::Max(FMath::Abs(x), FMath::Abs(y)) == perimeter && gameState.IsRoomTrained(roomCoords)
+                    && gameState.GetMostCentralEmptyTilePosition(roomCoords, spawnPosition))
+                {
+                    spawnRooms.Add(roomCoords);
+                    spawnPositions.Add(spawnPosition);
+                }
+            }
+        }
+    }
+    if (spawnRooms.Num() == 0)
+        return false;
+
+    FRandomStream randomStream(settings.Seed);
+    EnemyBrain brain;
+    auto SpawnAgent = [&]()
+    {
+        const int spawnIndex = randomStream.RandHelper(spawnRooms.Num());
+        EnemyBrain::AgentSettings agentSettings;
+        agentSettings.UpdateQValue = settings.UpdateQValues;
+        agentSettings.Seed = randomStream.RandHelper(MAX_int32);
+        const EnemyAgentHandle handle = brain.AddAgent({ spawnRooms[spawnIndex], spawnPositions[spawnIndex] }, agentSettings);
+        brain.SetAgentTarget(handle, { targetRoom, targetPosition });
+    };
+    for (int a = 0; a < settings.NumAgents; ++a)
+        SpawnAgent();
+
+    const uint64 startMemory = FPlatformMemory::GetStats().UsedPhysical;
+    TArray<double> stepSeconds;
+    stepSeconds.Reserve(settings.NumSteps);
+    TArray<EnemyAgentHandle> agentsToReplace;
+    TArray<EnemyAgentHandle> agentsReachedTarget;
+    for (int step = 0; step < settings.NumSteps; ++step)
+    {
+        const double stepStartTime = FPlatformTime::Seconds();
+
+        brain.ProcessDecisions(gameState);
+        results.NumDecisions += brain.GetNumDecisions();
+        results.NumQValueUpdates += brain.GetNumQValueUpdates();
+
+        // Agents that reached the target last step have had their final update applied.
+        agentsToReplace = agentsReachedTarget;
+        agentsReachedTarget.Reset();
+        brain.ForEachDecision([&](EnemyAgentHandle handle, EnemyBrain::EDecision decision, FVector2D)
+        {
+            if (decision == EnemyBrain::EDecision::Remove)
+            {
+                agentsToReplace.Add(handle);
+                return;
+            }
+            brain.AgentMoved(handle, brain.GetAgentMovementTarget(handle));
+            if (brain.HasReachedTargetRoom(handle) && brain.HasReachedTargetPosition(handle))
+            {
+                brain.AgentDied(handle);
+                agentsReachedTarget.Add(handle);
+            }
+        });
+        for (EnemyAgentHandle handle : agentsToReplace)
+        {
+            brain.RemoveAgent(handle);
+            SpawnAgent();
+        }
+        results.NumAgentsReplaced += agentsToReplace.Num();
+
+        stepSeconds.Add(FPlatformTime::Seconds() - stepStartTime);
+    }
+    results.MemoryGrowthBytes = (int64)FPlatformMemory::GetStats().UsedPhysical - (int64)startMemory;
+    brain.Reset();
+
+    results.NumSteps = stepSeconds.Num();
+    if (results.NumSteps > 0)
+    {
+        for (double seconds : stepSeconds)
+            results.TotalStepSeconds += seconds;
+        results.MeanStepSeconds = results.TotalStepSeconds / results.NumSteps;
+        stepSeconds.Sort();
+        results.P99StepSeconds = stepSeconds[FMath::Clamp(FMath::CeilToInt(results.NumSteps * 0.99) - 1, 0, results.NumSteps - 1)];
+        results.MaxStepSeconds = stepSeconds.Last();
+    }
+    return true;
+}
+
+//====================================================================================================
+// Console command
+//====================================================================================================
+
+namespace
+{
+    void RunEnemyBenchmarkCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = world != nullptr ? world->GetGameState<ATPGameDemoGameState>() : nullptr;
+        if (gameState == nullptr)
+        {
+            UE_LOG(LogEnemyBenchmark, Warning, TEXT("No TPGameDemo game state in this world."));
+            return;
+        }
+        // The benchmark builds rooms in, and trains, the game state's own tables, which would corrupt a session being played.
+        if (world->WorldType == EWorldType::PIE)
+        {
+            UE_LOG(LogEnemyBenchmark, Warning, TEXT("The enemy benchmark changes the world's rooms and qvalues. Run it on an empty map outside PIE."));
+            return;
+        }
+        EnemyBenchmark::Settings settings;
+        if (args.Num() > 0)
+            settings.NumAgents = FMath::Max(1, FCString::Atoi(*args[0]));
+        if (args.Num() > 1)
+            settings.NumSteps = FMath::Max(1, FCString::Atoi(*args[1]));
+        if (args.Num() > 2)
+            settings.Perimeter = FMath::Max(0, FCString::Atoi(*args[2]));
+        if (args.Num() > 3)
+            settings.Seed = FCString::Atoi(*args[3]);
+
+        UE_LOG(LogEnemyBenchmark, Display, TEXT("Running enemy benchmark: %d agents, %d steps, perimeter %d, seed %d"),
+               settings.NumAgents, settings.NumSteps, settings.Perimeter, settings.Seed);
+        EnemyBenchmark::Results results;
+        if (!EnemyBenchmark::Run(*gameState, settings, results))
+        {
+            UE_LOG(LogEnemyBenchmark, Warning, TEXT("The central room and at least one spawn room need to be trained."));
+            return;
+        }
+        TArray<FString> lines;
+        results.ToString().ParseIntoArrayLines(lines);
+        for (const FString& line : lines)
+            UE_LOG(LogEnemyBenchmark, Display, TEXT("%s"), *line);
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs EnemyBenchmarkCommand(
+        TEXT("TPGameDemo.EnemyBenchmark"),
+        TEXT("Runs the headless enemy navigation benchmark. Arguments: [NumAgents] [NumSteps] [Perimeter] [Seed]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunEnemyBenchmarkCommand));
+};
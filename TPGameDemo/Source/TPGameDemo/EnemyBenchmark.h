@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+class ATPGameDemoGameState;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogEnemyBenchmark, Log, All);
+
+/*
+Measures how many enemies the navigation AI can drive, without rendering or character movement.
+
+A seeded world of trained rooms is built in the game state (see ATPGameDemoGameState::BuildHeadlessRooms), and actor-less agents
+are added to a separate EnemyBrain. They spawn on the outer perimeter and head for the central room, making the same door choices,
+policy decisions and realtime qvalue updates as AEnemyActor. Each step, every agent moves straight to the cell it decided on.
+Agents that reach their target, or are removed, are replaced, so the population stays constant.
+
+The benchmark runs against the game state's own rooms: it adds rooms to the world, and (with UpdateQValues) changes the trained
+qvalues of every room the agents pass through. It is meant for a throwaway world, so the console command refuses to run in PIE.
+
+Run it from the console (e.g. on an empty map with -nullrhi):
+    TPGameDemo.EnemyBenchmark [NumAgents] [NumSteps] [Perimeter] [Seed]
+*/
+namespace EnemyBenchmark
+{
+    struct Settings
+    {
+        int NumAgents = 2000;
+        int NumSteps = 500;
+        int Perimeter = 2;
+        int32 Seed = 1;
+        float NormedDensity = 0.5f;
+        float NormedComplexity = 0.5f;
+        bool UpdateQValues = true;
+    };
+
+    struct Results
+    {
+        int NumRoomsBuilt = 0;
+        double RoomBuildSeconds = 0.0;
+        int NumSteps = 0;
+        int64 NumDecisions = 0;
+        int64 NumQValueUpdates = 0;
+        int64 NumAgentsReplaced = 0;
+        double TotalStepSeconds = 0.0;
+        double MeanStepSeconds = 0.0;
+        double P99StepSeconds = 0.0;
+        double MaxStepSeconds = 0.0;
+        /* Change in used physical memory between the end of the room build and the last step. */
+        int64 MemoryGrowthBytes = 0;
+
+        double GetDecisionsPerSecond() const { return TotalStepSeconds > 0.0 ? NumDecisions / TotalStepSeconds : 0.0; }
+        double GetQValueUpdatesPerSecond() const { return TotalStepSeconds > 0.0 ? NumQValueUpdates / TotalStepSeconds : 0.0; }
+        FString ToString() const;
+    };
+
+    /* Returns false if the world has no trained room to spawn agents in. Changes the game state's rooms and qvalues (see above). */
+    bool Run(ATPGameDemoGameState& gameState, const Settings& settings, Results& results);
+};
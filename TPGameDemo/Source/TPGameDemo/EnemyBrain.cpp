@@ -0,0 +1,380 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "Async/ParallelFor.h"
+#include "EnemyBrain.h"
+
+//====================================================================================================
+// Agents
+//====================================================================================================
+
+EnemyAgentHandle EnemyBrain::AddAgent(FRoomPositionPair roomAndPosition, const AgentSettings& settings)
+{
+    EnemyAgentHandle handle = INDEX_NONE;
+    if (FreeHandles.Num() > 0)
+    {
+        handle = FreeHandles.Pop(false);
+    }
+    else
+    {
+        handle = Active.Num();
+        Active.Add(false);
+        Dead.Add(false);
+        PendingEvents.Add(0);
+        RoomAndPositions.AddDefaulted();
+        PreviousPositions.AddDefaulted();
+        TargetRoomAndPositions.AddDefaulted();
+        Targets.AddDefaulted();
+        Settings.AddDefaulted();
+        RandomStreams.AddDefaulted();
+        PrevActionStarts.AddDefaulted();
+        PrevActionTypes.Add(EDirectionType::NumDirectionTypes);
+        PrevActionTargets.AddDefaulted();
+        PrevActionRewards.Add(0.0f);
+        PendingQValueUpdates.AddDefaulted();
+        Decisions.Add(EDecision::None);
+        MovementTargets.AddDefaulted();
+        MovementTargetsXY.AddDefaulted();
+    }
+
+    Active[handle] = true;
+    Dead[handle] = false;
+    PendingEvents[handle] = 0;
+    RoomAndPositions[handle] = roomAndPosition;
+    PreviousPositions[handle] = roomAndPosition.PositionInRoom;
+    // default to center of central room.
+    TargetRoomAndPositions[handle] = { FIntPoint(0, 0), FIntPoint(4, 4) };
+    Targets[handle] = FTargetPosition();
+    Settings[handle] = settings;
+    RandomStreams[handle].Initialize(settings.Seed);
+    PrevActionTypes[handle] = EDirectionType::NumDirectionTypes;
+    PrevActionRewards[handle] = 0.0f;
+    PendingQValueUpdates[handle].Reset();
+    Decisions[handle] = EDecision::None;
+    ++NumAgents;
+    return handle;
+}
+
+void EnemyBrain::RemoveAgent(EnemyAgentHandle handle)
+{
+    if (!IsAgentValid(handle))
+        return;
+    Active[handle] = false;
+    PendingEvents[handle] = 0;
+    PendingQValueUpdates[handle].Reset();
+    FreeHandles.Add(handle);
+    --NumAgents;
+}
+
+bool EnemyBrain::IsAgentValid(EnemyAgentHandle handle) const
+{
+    return Active.IsValidIndex(handle) && Active[handle];
+}
+
+bool EnemyBrain::IsAgentAlive(EnemyAgentHandle handle) const
+{
+    return IsAgentValid(handle) && !Dead[handle];
+}
+
+void EnemyBrain::Reset()
+{
+    for (EnemyAgentHandle handle = 0; handle < Active.Num(); ++handle)
+        RemoveAgent(handle);
+    DecidedAgents.Reset();
+}
+
+bool EnemyBrain::HasReachedTargetRoom(EnemyAgentHandle handle) const
+{
+    return RoomAndPositions[handle].RoomCoords == TargetRoomAndPositions[handle].RoomCoords;
+}
+
+bool EnemyBrain::HasReachedTargetPosition(EnemyAgentHandle handle) const
+{
+    return Targets[handle].Position == RoomAndPositions[handle].PositionInRoom;
+}
+
+//====================================================================================================
+// Events
+//====================================================================================================
+
+void EnemyBrain::AgentMoved(EnemyAgentHandle handle, FRoomPositionPair roomAndPosition)
+{
+    if (!IsAgentAlive(handle))
+        return;
+    if (roomAndPosition.RoomCoords != RoomAndPositions[handle].RoomCoords)
+        PendingEvents[handle] |= RoomChanged;
+    PreviousPositions[handle] = RoomAndPositions[handle].PositionInRoom;
+    RoomAndPositions[handle] = roomAndPosition;
+    PendingEvents[handle] |= Moved;
+}
+
+void EnemyBrain::SetAgentTarget(EnemyAgentHandle handle, FRoomPositionPair targetRoomAndPosition)
+{
+    if (!IsAgentAlive(handle))
+        return;
+    TargetRoomAndPositions[handle] = targetRoomAndPosition;
+    PendingEvents[handle] |= NewTarget;
+}
+
+void EnemyBrain::RequestDoorChoice(EnemyAgentHandle handle)
+{
+    if (IsAgentAlive(handle))
+        PendingEvents[handle] |= DoorChoice;
+}
+
+void EnemyBrain::AgentDamaged(EnemyAgentHandle handle)
+{
+    // Damage taken after dying doesn't count towards the final update.
+    if (IsAgentAlive(handle) && !(PendingEvents[handle] & Died) && Settings[handle].AccumulateReward && !HasReachedTargetRoom(handle))
+        PrevActionRewards[handle] += GridTrainingConstants::DamageCost;
+}
+
+void EnemyBrain::AgentDied(EnemyAgentHandle handle)
+{
+    if (!IsAgentAlive(handle))
+        return;
+    if (Settings[handle].AccumulateReward)
+        PrevActionRewards[handle] += GridTrainingConstants::DamageCost;
+    PendingEvents[handle] |= Died;
+}
+
+//====================================================================================================
+// Decisions
+//====================================================================================================
+
+void EnemyBrain::ProcessDecisions(ATPGameDemoGameState& gameState)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_EnemyDecisions);
+    DecidedAgents.Reset();
+    NumQValueUpdatesApplied = 0;
+    PendingAgents.Reset();
+    PendingAgentRooms.Reset();
+    BatchRoomIndices.Reset();
+    BatchRooms.Reset();
+
+    for (EnemyAgentHandle handle = 0; handle < Active.Num(); ++handle)
+        if (Active[handle] && PendingEvents[handle] != 0)
+            PendingAgents.Add(handle);
+
+    if (PendingAgents.Num() == 0)
+        return;
+    INC_DWORD_STAT_BY(STAT_EnemyAgentsDecided, PendingAgents.Num());
+
+    // Room lookups, once per room in the batch.
+    for (EnemyAgentHandle handle : PendingAgents)
+    {
+        const FIntPoint roomCoords = RoomAndPositions[handle].RoomCoords;
+        int* roomIndex = BatchRoomIndices.Find(roomCoords);
+        if (roomIndex == nullptr)
+        {
+            // Copied, so that the decisions don't depend on the game state's cache while running on worker threads.
+            const RoomAdjacency& room = gameState.GetRoomAdjacency(roomCoords);
+            roomIndex = &BatchRoomIndices.Add(roomCoords, BatchRooms.Add(room));
+        }
+        PendingAgentRooms.Add(*roomIndex);
+    }
+
+    // Decisions only read shared state, so agents can be decided in any order.
+    ParallelFor(PendingAgents.Num(), [this, &gameState](int32 i)
+    {
+        DecideAgent(gameState, PendingAgents[i], BatchRooms[PendingAgentRooms[i]]);
+    }, PendingAgents.Num() < ParallelDecisionThreshold);
+
+    for (EnemyAgentHandle handle : PendingAgents)
+    {
+        for (QValueUpdate& update : PendingQValueUpdates[handle])
+            gameState.UpdateQValueRealtime(update.StartRoomAndPosition, update.Action, update.Target, update.AccumulatedReward, GridTrainingConstants::ActorLearningRate);
+        NumQValueUpdatesApplied += PendingQValueUpdates[handle].Num();
+        PendingQValueUpdates[handle].Reset();
+
+        const bool died = (PendingEvents[handle] & Died) != 0;
+        PendingEvents[handle] = 0;
+        if (died)
+        {
+            Dead[handle] = true;
+            continue;
+        }
+        if (Decisions[handle] == EDecision::Move)
+            MovementTargetsXY[handle] = gameState.GetWorldXYForRoomAndPosition(MovementTargets[handle]);
+        if (Decisions[handle] != EDecision::None)
+            DecidedAgents.Add(handle);
+    }
+}
+
+void EnemyBrain::DecideAgent(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, const RoomAdjacency& room)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_EnemyDecideAgent);
+    const uint8 events = PendingEvents[handle];
+    Decisions[handle] = EDecision::None;
+    if (events & Died)
+    {
+        QueuePreviousActionUpdate(handle);
+        return;
+    }
+
+    // Chasing agents take their target from the chase flow field. They only choose doors themselves when the player can't be reached.
+    FTargetPosition chaseTarget;
+    if (Settings[handle].ChasePlayer && gameState.GetChaseFlowField().GetRoomTarget(RoomAndPositions[handle].RoomCoords, chaseTarget))
+    {
+        Targets[handle] = chaseTarget;
+    }
+    else
+    {
+        // Work out whether the agent needs a new door target. Several events in one batch only lead to one decision.
+        bool chooseDoor = (events & DoorChoice) != 0;
+        bool enteredTargetRoom = false;
+        if (events & (NewTarget | RoomChanged))
+        {
+            if (HasReachedTargetRoom(handle))
+                enteredTargetRoom = true;
+            else
+                chooseDoor = true;
+        }
+        if ((events & Moved) && !HasReachedTargetRoom(handle))
+        {
+            if (gameState.IsOnGridEdge(RoomAndPositions[handle].PositionInRoom))
+                chooseDoor |= !(HasReachedTargetPosition(handle) && Targets[handle].TargetIsDoor());
+            else
+                chooseDoor |= gameState.IsOnGridEdge(PreviousPositions[handle]);
+        }
+
+        if (enteredTargetRoom)
+            Targets[handle] = { TargetRoomAndPositions[handle].PositionInRoom, EDirectionType::NumDirectionTypes };
+        if (chooseDoor && !ChooseDoorTarget(handle, room, gameState.NumGridUnitsX, gameState.NumGridUnitsY))
+        {
+            Decisions[handle] = EDecision::Remove;
+            return;
+        }
+    }
+
+    const bool positionValid = IsAgentPositionValid(gameState, handle, room);
+    ensure(positionValid);
+    if (!positionValid)
+    {
+        Decisions[handle] = EDecision::Remove;
+        return;
+    }
+
+    // Door targets are crossed as soon as they are reached. Otherwise follow the policy.
+    const FTargetPosition& target = Targets[handle];
+    EDirectionType action = target.DoorAction;
+    if (!(target.TargetIsDoor() && HasReachedTargetPosition(handle)))
+    {
+        const FRoomPositionPair& roomAndPosition = RoomAndPositions[handle];
+        action = gameState.GetOptimalActions(roomAndPosition.RoomCoords, target.Position, roomAndPosition.PositionInRoom).ChooseDirection(RandomStreams[handle]);
+    }
+    MoveAlongAction(gameState, handle, action);
+}
+
+bool EnemyBrain::IsAgentPositionValid(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, const RoomAdjacency& room) const
+{
+    const FRoomPositionPair& roomAndPosition = RoomAndPositions[handle];
+    const FIntPoint position = roomAndPosition.PositionInRoom;
+    if (position.X == 0)
+        return position.Y == room.DoorPositions[(int)EDirectionType::South];
+    if (position.Y == 0)
+        return position.X == room.DoorPositions[(int)EDirectionType::West];
+    if (!(position.X > 0 && position.X < gameState.NumGridUnitsX && position.Y > 0 && position.Y < gameState.NumGridUnitsY))
+        return false;
+    return gameState.GetOptimalActions(roomAndPosition.RoomCoords, Targets[handle].Position, position).IsValid();
+}
+
+bool EnemyBrain::IsAgentOnDoor(EnemyAgentHandle handle, EDirectionType direction, const RoomAdjacency& room, int numGridUnitsX, int numGridUnitsY) const
+{
+    const FIntPoint position = RoomAndPositions[handle].PositionInRoom;
+    const int doorPosition = room.GetDoorPositionForExistingNeighbour(direction);
+    switch (direction)
+    {
+    case EDirectionType::North: return position.X == numGridUnitsX - 1 && position.Y == doorPosition;
+    case EDirectionType::East: return position.Y == numGridUnitsY - 1 && position.X == doorPosition;
+    case EDirectionType::South: return position.X == 0 && position.Y == doorPosition;
+    case EDirectionType::West: return position.Y == 0 && position.X == doorPosition;
+    default: return false;
+    }
+}
+
+bool EnemyBrain::ChooseDoorTarget(EnemyAgentHandle handle, const RoomAdjacency& room, int numGridUnitsX, int numGridUnitsY)
+{
+    // For each quadrant, only the doors that lead towards the centre are considered.
+    bool doorPriorities[(int)EDirectionType::NumDirectionTypes] = { false, false, false, false };
+    switch (room.Quadrant)
+    {
+        case EQuadrantType::NorthEast:
+            doorPriorities[(int)EDirectionType::West] = true;
+            doorPriorities[(int)EDirectionType::South] = true;
+            break;
+        case EQuadrantType::SouthEast:
+            doorPriorities[(int)EDirectionType::West] = true;
+            doorPriorities[(int)EDirectionType::North] = true;
+            break;
+        case EQuadrantType::SouthWest:
+            doorPriorities[(int)EDirectionType::East] = true;
+            doorPriorities[(int)EDirectionType::North] = true;
+            break;
+        case EQuadrantType::NorthWest:
+            doorPriorities[(int)EDirectionType::East] = true;
+            doorPriorities[(int)EDirectionType::South] = true;
+            break;
+        default: break;
+    }
+
+    TArray<EDirectionType, TInlineAllocator<(int)EDirectionType::NumDirectionTypes>> possibleDoors;
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        if (doorPriorities[d] && room.GetDoorPositionForExistingNeighbour((EDirectionType)d) != 0)
+            possibleDoors.Add((EDirectionType)d);
+    if (possibleDoors.Num() > 1)
+    {
+        for (EDirectionType direction : possibleDoors)
+        {
+            if (IsAgentOnDoor(handle, direction, room, numGridUnitsX, numGridUnitsY))
+            {
+                possibleDoors.Remove(direction);
+                break;
+            }
+        }
+    }
+    if (possibleDoors.Num() == 0)
+        return false;
+
+    const EDirectionType doorAction = possibleDoors[RandomStreams[handle].RandRange(0, possibleDoors.Num() - 1)];
+    const int doorPositionOnWall = room.GetDoorPositionForExistingNeighbour(doorAction);
+    Targets[handle] = { ChaseFlowField::GetDoorCell(doorAction, doorPositionOnWall, FIntPoint(numGridUnitsX, numGridUnitsY)), doorAction };
+    return true;
+}
+
+void EnemyBrain::MoveAlongAction(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, EDirectionType action)
+{
+    const FRoomPositionPair start = RoomAndPositions[handle];
+    // If the action is blocked, try the next clockwise action, once per direction.
+    for (int attempt = 0; attempt < (int)EDirectionType::NumDirectionTypes; ++attempt)
+    {
+        FRoomPositionPair simulationResult = start;
+        const bool simulationSuccessful = gameState.SimulateAction(simulationResult, action, Targets[handle].Position);
+        QueuePreviousActionUpdate(handle);
+        if (!simulationSuccessful)
+            action = (EDirectionType)(((int)action + 1) % (int)EDirectionType::NumDirectionTypes);
+        PrevActionStarts[handle] = start;
+        PrevActionTypes[handle] = action;
+        PrevActionTargets[handle] = Targets[handle].Position;
+        PrevActionRewards[handle] = 0.0f;
+        if (simulationSuccessful)
+        {
+            MovementTargets[handle] = gameState.GetTargetRoomAndPositionForDirectionType(start, action);
+            Decisions[handle] = EDecision::Move;
+            return;
+        }
+    }
+    ensure(!"No valid action found for enemy agent");
+}
+
+void EnemyBrain::QueuePreviousActionUpdate(EnemyAgentHandle handle)
+{
+    if (ShouldUpdateQValue(handle))
+        PendingQValueUpdates[handle].Add({ PrevActionStarts[handle], PrevActionTypes[handle], PrevActionTargets[handle], PrevActionRewards[handle] });
+}
+
+bool EnemyBrain::ShouldUpdateQValue(EnemyAgentHandle handle) const
+{
+    return Settings[handle].UpdateQValue && PrevActionTypes[handle] != EDirectionType::NumDirectionTypes;
+}
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+class ATPGameDemoGameState;
+
+/* Index of an agent in the EnemyBrain. Handles are reused once an agent is removed. */
+typedef int32 EnemyAgentHandle;
+
+/*
+Makes the navigation decisions for every enemy in one batched pass per frame.
+
+Agents only report events (moved to a new cell, new target, damaged, died). Events are flagged on the agent and handled together in
+ProcessDecisions, which the game state calls once per tick:
+ 1. The adjacency records of the flagged agents' rooms are copied once per room (door positions, quadrant).
+ 2. Each flagged agent chooses its door target and next action. This only reads from the game state, and writes to the agent's own
+    slot, so it is split across worker threads when there are enough agents.
+ 3. The queued Q-value updates are applied in agent order, and movement targets are converted to world positions.
+
+Agent state is kept in parallel arrays indexed by handle. Agents don't need an actor, so the same brain can drive headless simulations.
+*/
+class EnemyBrain
+{
+public:
+    enum class EDecision : uint8
+    {
+        None,
+        Move,   // The agent should move towards its MovementTarget.
+        Remove  // The agent is in an invalid position or has no way out of its room. Its owner should destroy it.
+    };
+
+    struct AgentSettings
+    {
+        bool UpdateQValue = true;
+        bool AccumulateReward = false;
+        /* Follow the game state's ChaseFlowField towards the player instead of heading for the target room. */
+        bool ChasePlayer = false;
+        int32 Seed = 0;
+    };
+
+    EnemyAgentHandle AddAgent(FRoomPositionPair roomAndPosition, const AgentSettings& settings);
+    void RemoveAgent(EnemyAgentHandle handle);
+    bool IsAgentValid(EnemyAgentHandle handle) const;
+    /* Dead agents stay valid, but no longer make decisions, until their owner removes them. */
+    bool IsAgentAlive(EnemyAgentHandle handle) const;
+    int GetNumAgents() const { return NumAgents; }
+    void Reset();
+
+    // --------------------- events -------------------------------------
+    // These only flag the agent. They are handled in the next ProcessDecisions.
+
+    void AgentMoved(EnemyAgentHandle handle, FRoomPositionPair roomAndPosition);
+    void SetAgentTarget(EnemyAgentHandle handle, FRoomPositionPair targetRoomAndPosition);
+    void RequestDoorChoice(EnemyAgentHandle handle);
+    void AgentDamaged(EnemyAgentHandle handle);
+    /* Applies the agent's final qvalue update in the next ProcessDecisions. */
+    void AgentDied(EnemyAgentHandle handle);
+
+    // --------------------- agent state -------------------------------------
+
+    FRoomPositionPair GetAgentRoomAndPosition(EnemyAgentHandle handle) const { return RoomAndPositions[handle]; }
+    FRoomPositionPair GetAgentTargetRoomAndPosition(EnemyAgentHandle handle) const { return TargetRoomAndPositions[handle]; }
+    /* The intermediate movement target in the current room (a door on the way to the target room, or the target position). */
+    FTargetPosition GetAgentTarget(EnemyAgentHandle handle) const { return Targets[handle]; }
+    /* The cell the agent was last told to move to. */
+    FRoomPositionPair GetAgentMovementTarget(EnemyAgentHandle handle) const { return MovementTargets[handle]; }
+    bool HasReachedTargetRoom(EnemyAgentHandle handle) const;
+    bool HasReachedTargetPosition(EnemyAgentHandle handle) const;
+
+    // --------------------- decisions -------------------------------------
+
+    void ProcessDecisions(ATPGameDemoGameState& gameState);
+
+    /* Calls function(EnemyAgentHandle, EDecision, FVector2D movementTargetXY) for each agent decided in the last ProcessDecisions. */
+    template<typename Function>
+    void ForEachDecision(Function function) const
+    {
+        for (EnemyAgentHandle handle : DecidedAgents)
+            function(handle, Decisions[handle], MovementTargetsXY[handle]);
+    }
+
+    int GetNumDecisions() const { return DecidedAgents.Num(); }
+    int GetNumQValueUpdates() const { return NumQValueUpdatesApplied; }
+
+    /* Agents are decided on worker threads when at least this many are pending. */
+    int ParallelDecisionThreshold = 64;
+
+private:
+    enum EPendingEvent : uint8
+    {
+        Moved       = 1 << 0,
+        RoomChanged = 1 << 1,
+        NewTarget   = 1 << 2,
+        DoorChoice  = 1 << 3,
+        Died        = 1 << 4
+    };
+
+    struct QValueUpdate
+    {
+        FRoomPositionPair StartRoomAndPosition;
+        EDirectionType Action;
+        FIntPoint Target;
+        float AccumulatedReward;
+    };
+    // A move can be retried once per direction, each retry queues an update.
+    typedef TArray<QValueUpdate, TInlineAllocator<(int)EDirectionType::NumDirectionTypes + 2>> QValueUpdateList;
+
+    void DecideAgent(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, const RoomAdjacency& room);
+    bool IsAgentPositionValid(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, const RoomAdjacency& room) const;
+    bool IsAgentOnDoor(EnemyAgentHandle handle, EDirectionType direction, const RoomAdjacency& room, int numGridUnitsX, int numGridUnitsY) const;
+    /* Targets a random door that leads towards the centre of the maze. Returns false if the room has no usable doors. */
+    bool ChooseDoorTarget(EnemyAgentHandle handle, const RoomAdjacency& room, int numGridUnitsX, int numGridUnitsY);
+    void MoveAlongAction(ATPGameDemoGameState& gameState, EnemyAgentHandle handle, EDirectionType action);
+    void QueuePreviousActionUpdate(EnemyAgentHandle handle);
+    bool ShouldUpdateQValue(EnemyAgentHandle handle) const;
+
+    int NumAgents = 0;
+    // In the last ProcessDecisions.
+    int NumQValueUpdatesApplied = 0;
+    TArray<EnemyAgentHandle> FreeHandles;
+    // Reused between batches.
+    TArray<EnemyAgentHandle> PendingAgents;
+    TArray<int> PendingAgentRooms;
+    TArray<EnemyAgentHandle> DecidedAgents;
+    TMap<FIntPoint, int> BatchRoomIndices;
+    // Adjacency records of the rooms in the batch, shared by every agent in the room.
+    TArray<RoomAdjacency> BatchRooms;
+
+    // Per-agent state, indexed by handle.
+    TArray<bool> Active;
+    TArray<bool> Dead;
+    TArray<uint8> PendingEvents;
+    TArray<FRoomPositionPair> RoomAndPositions;
+    TArray<FIntPoint> PreviousPositions;
+    TArray<FRoomPositionPair> TargetRoomAndPositions;
+    TArray<FTargetPosition> Targets;
+    TArray<AgentSettings> Settings;
+    TArray<FRandomStream> RandomStreams;
+    // Qvalues are only updated for an action when the next action is taken, so that rewards can be accumulated while in a state.
+    TArray<FRoomPositionPair> PrevActionStarts;
+    TArray<EDirectionType> PrevActionTypes;
+    TArray<FIntPoint> PrevActionTargets;
+    TArray<float> PrevActionRewards;
+    TArray<QValueUpdateList> PendingQValueUpdates;
+    // Decision results.
+    TArray<EDecision> Decisions;
+    TArray<FRoomPositionPair> MovementTargets;
+    TArray<FVector2D> MovementTargetsXY;
+};
@@ -0,0 +1,302 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/CoreDelegates.h"
+#include "EnemyEventLog.h"
+
+DEFINE_LOG_CATEGORY(LogEnemyEvents);
+
+namespace
+{
+    struct EnemyEventLogFileHeader
+    {
+        uint32 Magic = EnemyEventLog::FileMagic;
+        uint32 Version = EnemyEventLog::FileVersion;
+        uint32 RecordSize = sizeof(EnemyEventRecord);
+        uint32 Padding = 0;
+        double SecondsPerCycle = 0.0;
+        uint64 StartCycles = 0;
+    };
+
+    thread_local EnemyEventRing* ThreadRing = nullptr;
+
+    const TCHAR* GetEventTypeName(EEnemyEventType type)
+    {
+        switch (type)
+        {
+        case EEnemyEventType::Spawned:             return TEXT("Spawned");
+        case EEnemyEventType::Despawned:           return TEXT("Despawned");
+        case EEnemyEventType::PositionChanged:     return TEXT("Position Changed");
+        case EEnemyEventType::RoomChanged:         return TEXT("Room Changed");
+        case EEnemyEventType::TargetChanged:       return TEXT("Target Changed");
+        case EEnemyEventType::DoorChoiceRequested: return TEXT("Door Choice Requested");
+        case EEnemyEventType::ActionSelected:      return TEXT("Action Selected");
+        case EEnemyEventType::Decision:            return TEXT("Decision");
+        case EEnemyEventType::Damaged:             return TEXT("Damaged");
+        case EEnemyEventType::Died:                return TEXT("Died");
+        case EEnemyEventType::Removed:             return TEXT("Removed");
+        default:                                   return TEXT("Unknown");
+        }
+    }
+
+    const TCHAR* GetActionName(uint8 action)
+    {
+        switch ((EDirectionType)action)
+        {
+        case EDirectionType::North: return TEXT("North");
+        case EDirectionType::East:  return TEXT("East");
+        case EDirectionType::South: return TEXT("South");
+        case EDirectionType::West:  return TEXT("West");
+        default:                    return TEXT("-");
+        }
+    }
+};
+
+//====================================================================================================
+// EnemyEventRing
+//====================================================================================================
+
+EnemyEventRing::EnemyEventRing(uint32 threadId)
+    : ThreadId(threadId)
+{
+    Records.SetNum(Capacity);
+}
+
+int32 EnemyEventRing::Drain(TArray<EnemyEventRecord>& records)
+{
+    const int64 readCount = ReadCount;
+    const int64 writeCount = FPlatformAtomics::AtomicRead(&WriteCount);
+    for (int64 i = readCount; i < writeCount; ++i)
+        records.Add(Records[i & (Capacity - 1)]);
+    // Hands the slots back to the producer.
+    FPlatformAtomics::AtomicStore(&ReadCount, writeCount);
+    return (int32)(writeCount - readCount);
+}
+
+//====================================================================================================
+// EnemyEventLog
+//====================================================================================================
+
+volatile int32 EnemyEventLog::RunningFlag = 0;
+
+EnemyEventLog& EnemyEventLog::Get()
+{
+    static EnemyEventLog log;
+    return log;
+}
+
+EnemyEventLog::EnemyEventLog()
+{
+    WaitEvent = FPlatformProcess::GetSynchEventFromPool(false);
+    FCoreDelegates::OnPreExit.AddRaw(this, &EnemyEventLog::Shutdown);
+}
+
+EnemyEventLog::~EnemyEventLog()
+{
+    Shutdown();
+    FPlatformProcess::ReturnSynchEventToPool(WaitEvent);
+    WaitEvent = nullptr;
+}
+
+EnemyEventRing& EnemyEventLog::GetThreadRing()
+{
+    if (ThreadRing == nullptr)
+    {
+        // Rings live as long as the log, so the flusher can still drain the events of threads that have exited.
+        FScopeLock lock(&RingsSection);
+        Rings.Add(MakeUnique<EnemyEventRing>(FPlatformTLS::GetCurrentThreadId()));
+        ThreadRing = Rings.Last().Get();
+    }
+    return *ThreadRing;
+}
+
+void EnemyEventLog::Push(EEnemyEventType type, uint32 enemyId, const FRoomPositionPair& roomAndPosition, EDirectionType action, float reward)
+{
+    EnemyEventRecord record;
+    record.Cycles = FPlatformTime::Cycles64();
+    record.Frame = (uint32)GFrameCounter;
+    record.EnemyId = enemyId;
+    record.Type = type;
+    record.Action = (uint8)action;
+    record.CellX = (uint8)roomAndPosition.PositionInRoom.X;
+    record.CellY = (uint8)roomAndPosition.PositionInRoom.Y;
+    record.RoomX = (int16)roomAndPosition.RoomCoords.X;
+    record.RoomY = (int16)roomAndPosition.RoomCoords.Y;
+    record.Reward = reward;
+    GetThreadRing().Push(record);
+}
+
+bool EnemyEventLog::Start(const FString& filePath)
+{
+    Shutdown();
+    File.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*filePath));
+    if (!File.IsValid())
+    {
+        UE_LOG(LogEnemyEvents, Warning, TEXT("Couldn't open enemy event log %s"), *filePath);
+        return false;
+    }
+    FilePath = filePath;
+    NumRecordsWritten = 0;
+    EnemyEventLogFileHeader header;
+    header.SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+    header.StartCycles = FPlatformTime::Cycles64();
+    File->Write((const uint8*)&header, sizeof(header));
+
+    // Drop anything pushed after the previous log stopped.
+    {
+        FScopeLock lock(&RingsSection);
+        FlushRecords.Reset();
+        for (const TUniquePtr<EnemyEventRing>& ring : Rings)
+            ring->Drain(FlushRecords);
+        FlushRecords.Reset();
+    }
+
+    ThreadShouldExit = false;
+    FlusherThread = FRunnableThread::Create(this, TEXT("EnemyEventLogFlusher"), 0, EThreadPriority::TPri_BelowNormal);
+    FPlatformAtomics::InterlockedExchange(&RunningFlag, 1);
+    UE_LOG(LogEnemyEvents, Display, TEXT("Logging enemy events to %s"), *FilePath);
+    return true;
+}
+
+void EnemyEventLog::Shutdown()
+{
+    FPlatformAtomics::InterlockedExchange(&RunningFlag, 0);
+    if (FlusherThread != nullptr)
+    {
+        Stop();
+        FlusherThread->WaitForCompletion();
+        delete FlusherThread;
+        FlusherThread = nullptr;
+    }
+    if (File.IsValid())
+    {
+        Flush();
+        File.Reset();
+        int64 numDropped = 0;
+        {
+            FScopeLock lock(&RingsSection);
+            for (const TUniquePtr<EnemyEventRing>& ring : Rings)
+                numDropped += ring->GetNumDropped();
+        }
+        UE_LOG(LogEnemyEvents, Display, TEXT("Wrote %lld enemy events to %s (%lld dropped since startup)"), NumRecordsWritten, *FilePath, numDropped);
+    }
+}
+
+void EnemyEventLog::Flush()
+{
+    FScopeLock lock(&RingsSection);
+    FlushRecords.Reset();
+    for (const TUniquePtr<EnemyEventRing>& ring : Rings)
+        ring->Drain(FlushRecords);
+    if (FlushRecords.Num() > 0 && File.IsValid())
+    {
+        File->Write((const uint8*)FlushRecords.GetData(), FlushRecords.Num() * sizeof(EnemyEventRecord));
+        NumRecordsWritten += FlushRecords.Num();
+    }
+}
+
+/* FRunnable interface */
+uint32 EnemyEventLog::Run()
+{
+    while (!ThreadShouldExit)
+    {
+        WaitEvent->Wait(FTimespan::FromSeconds(FlushIntervalSeconds));
+        Flush();
+    }
+    return 0;
+}
+
+void EnemyEventLog::Stop()
+{
+    ThreadShouldExit = true;
+    WaitEvent->Trigger();
+}
+
+bool EnemyEventLog::ConvertToText(const FString& filePath, TArray<FString>& lines, uint32 enemyId)
+{
+    TArray<uint8> bytes;
+    if (!FFileHelper::LoadFileToArray(bytes, *filePath) || bytes.Num() < (int32)sizeof(EnemyEventLogFileHeader))
+        return false;
+    EnemyEventLogFileHeader header;
+    FMemory::Memcpy(&header, bytes.GetData(), sizeof(header));
+    if (header.Magic != FileMagic || header.Version != FileVersion || header.RecordSize != sizeof(EnemyEventRecord))
+        return false;
+
+    TArray<EnemyEventRecord> records;
+    const int32 numRecords = (bytes.Num() - (int32)sizeof(header)) / (int32)sizeof(EnemyEventRecord);
+    records.SetNumUninitialized(numRecords);
+    FMemory::Memcpy(records.GetData(), bytes.GetData() + sizeof(header), numRecords * sizeof(EnemyEventRecord));
+    if (enemyId != 0)
+        records.RemoveAll([enemyId](const EnemyEventRecord& record) { return record.EnemyId != enemyId; });
+    // Each ring is in order, but rings are flushed one after another.
+    records.StableSort([](const EnemyEventRecord& a, const EnemyEventRecord& b) { return a.Cycles < b.Cycles; });
+
+    for (const EnemyEventRecord& record : records)
+    {
+        const double milliseconds = (double)(int64)(record.Cycles - header.StartCycles) * header.SecondsPerCycle * 1000.0;
+        lines.Add(FString::Printf(TEXT("%10.3f ms | frame %u | enemy %u | %-21s | room (%d, %d) cell (%u, %u) | action %-5s | reward %.3f | thread %u"),
+                                  milliseconds, record.Frame, record.EnemyId, GetEventTypeName(record.Type),
+                                  record.RoomX, record.RoomY, record.CellX, record.CellY, GetActionName(record.Action), record.Reward,
+                                  record.ThreadId));
+    }
+    return true;
+}
+
+//====================================================================================================
+// Console commands
+//====================================================================================================
+
+namespace
+{
+    int32 EnemyEventLogEnabled = 0;
+
+    FString GetEnemyEventLogPath(const FString& fileName)
+    {
+        if (FPaths::IsRelative(fileName))
+            return FPaths::ProjectLogDir() / fileName;
+        return fileName;
+    }
+
+    void OnEnemyEventLogEnabledChanged(IConsoleVariable* variable)
+    {
+        if (EnemyEventLogEnabled != 0 && !EnemyEventLog::IsRunning())
+            EnemyEventLog::Get().Start(GetEnemyEventLogPath(FString::Printf(TEXT("EnemyEvents_%s.tpevents"), *FDateTime::Now().ToString())));
+        else if (EnemyEventLogEnabled == 0 && EnemyEventLog::IsRunning())
+            EnemyEventLog::Get().Shutdown();
+    }
+
+    FAutoConsoleVariableRef EnemyEventLogEnabledVariable(
+        TEXT("TPGameDemo.EnemyEventLog"),
+        EnemyEventLogEnabled,
+        TEXT("1 logs enemy events to Saved/Logs, 0 stops logging. See TPGameDemo.ConvertEnemyEventLog."),
+        FConsoleVariableDelegate::CreateStatic(&OnEnemyEventLogEnabledChanged));
+
+    void ConvertEnemyEventLogCommand(const TArray<FString>& args)
+    {
+        if (args.Num() == 0)
+        {
+            UE_LOG(LogEnemyEvents, Warning, TEXT("Usage: TPGameDemo.ConvertEnemyEventLog FileName [OutFileName] [EnemyId]"));
+            return;
+        }
+        const FString filePath = GetEnemyEventLogPath(args[0]);
+        const FString outFilePath = args.Num() > 1 ? GetEnemyEventLogPath(args[1]) : FPaths::ChangeExtension(filePath, TEXT("txt"));
+        const uint32 enemyId = args.Num() > 2 ? (uint32)FCString::Strtoui64(*args[2], nullptr, 10) : 0;
+        TArray<FString> lines;
+        if (!EnemyEventLog::ConvertToText(filePath, lines, enemyId))
+        {
+            UE_LOG(LogEnemyEvents, Warning, TEXT("Couldn't read enemy event log %s"), *filePath);
+            return;
+        }
+        if (!FFileHelper::SaveStringArrayToFile(lines, *outFilePath))
+        {
+            UE_LOG(LogEnemyEvents, Warning, TEXT("Couldn't write %s"), *outFilePath);
+            return;
+        }
+        UE_LOG(LogEnemyEvents, Display, TEXT("Wrote %d enemy events to %s"), lines.Num(), *outFilePath);
+    }
+
+    FAutoConsoleCommand ConvertEnemyEventLogConsoleCommand(
+        TEXT("TPGameDemo.ConvertEnemyEventLog"),
+        TEXT("Converts an enemy event log to text. Arguments: FileName [OutFileName] [EnemyId]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&ConvertEnemyEventLogCommand));
+};
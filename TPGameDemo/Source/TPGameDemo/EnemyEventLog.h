@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+/* Set to 0 to compile enemy event logging out entirely. When compiled in, an event costs one flag check unless the log is running. */
+#define ENEMY_EVENT_LOGS 1
+
+DECLARE_LOG_CATEGORY_EXTERN(LogEnemyEvents, Log, All);
+
+enum class EEnemyEventType : uint8
+{
+    Spawned,
+    Despawned,
+    PositionChanged,
+    RoomChanged,
+    TargetChanged,
+    DoorChoiceRequested,
+    ActionSelected,
+    Decision,
+    Damaged,
+    Died,
+    Removed,
+    NumTypes
+};
+
+/*
+One fixed-size enemy event. Cells are positions in the room. Action is an EDirectionType (NumDirectionTypes if there is none),
+and Reward is event specific (e.g. the damage taken).
+*/
+struct EnemyEventRecord
+{
+    uint64 Cycles = 0;
+    uint32 Frame = 0;
+    uint32 EnemyId = 0;
+    uint32 ThreadId = 0;
+    EEnemyEventType Type = EEnemyEventType::NumTypes;
+    uint8 Action = (uint8)EDirectionType::NumDirectionTypes;
+    uint8 CellX = 0;
+    uint8 CellY = 0;
+    int16 RoomX = 0;
+    int16 RoomY = 0;
+    float Reward = 0.0f;
+};
+static_assert(sizeof(EnemyEventRecord) == 32, "Enemy event records are written to disk as-is.");
+
+/*
+A single producer, single consumer ring of event records. The owning thread pushes, the flusher thread drains.
+Events pushed while the ring is full are dropped and counted, so logging never blocks.
+*/
+class EnemyEventRing
+{
+public:
+    static constexpr int32 Capacity = 1 << 13;
+
+    EnemyEventRing(uint32 threadId);
+
+    void Push(const EnemyEventRecord& record)
+    {
+        const int64 writeCount = WriteCount;
+        if (writeCount - FPlatformAtomics::AtomicRead(&ReadCount) >= Capacity)
+        {
+            FPlatformAtomics::AtomicStore_Relaxed(&NumDropped, NumDropped + 1);
+            return;
+        }
+        EnemyEventRecord& slot = Records[writeCount & (Capacity - 1)];
+        slot = record;
+        slot.ThreadId = ThreadId;
+        // Publishes the record to the flusher.
+        FPlatformAtomics::AtomicStore(&WriteCount, writeCount + 1);
+    }
+
+    /* Appends the pushed records to records. Flusher thread only. */
+    int32 Drain(TArray<EnemyEventRecord>& records);
+    int64 GetNumDropped() const { return FPlatformAtomics::AtomicRead_Relaxed(&NumDropped); }
+
+private:
+    TArray<EnemyEventRecord> Records;
+    uint32 ThreadId = 0;
+    volatile int64 WriteCount = 0;
+    volatile int64 ReadCount = 0;
+    volatile int64 NumDropped = 0;
+};
+
+/*
+Always-available structured event log for enemies, replacing per-enemy string logs.
+
+Each thread that logs gets its own EnemyEventRing the first time it logs. While the log is running, a flusher thread drains the
+rings every FlushIntervalSeconds and appends the raw records to a file in Saved/Logs. ConvertToText turns a file back into
+readable lines, ordered by time.
+
+    TPGameDemo.EnemyEventLog 1                                      starts logging (0 stops it)
+    TPGameDemo.ConvertEnemyEventLog FileName [OutFileName] [EnemyId]
+*/
+class EnemyEventLog : public FRunnable
+{
+public:
+    static constexpr uint32 FileMagic = 0x54504545;
+    static constexpr uint32 FileVersion = 1;
+    static constexpr float FlushIntervalSeconds = 0.05f;
+
+    static EnemyEventLog& Get();
+
+    static bool IsRunning() { return FPlatformAtomics::AtomicRead_Relaxed(&RunningFlag) != 0; }
+
+    /* Records an event on the calling thread, if the log is running. */
+    static void Log(EEnemyEventType type, uint32 enemyId, const FRoomPositionPair& roomAndPosition,
+                    EDirectionType action = EDirectionType::NumDirectionTypes, float reward = 0.0f)
+    {
+        if (IsRunning())
+            Get().Push(type, enemyId, roomAndPosition, action, reward);
+    }
+
+    /* Starts writing events to filePath. Returns false if the file couldn't be opened. */
+    bool Start(const FString& filePath);
+    void Shutdown();
+    FString GetFilePath() const { return FilePath; }
+
+    /* Converts an event log file to text lines. If enemyId is not 0, only that enemy's events are converted. */
+    static bool ConvertToText(const FString& filePath, TArray<FString>& lines, uint32 enemyId = 0);
+
+    // FRunnable interface.
+    virtual uint32 Run()  override;
+    virtual void   Stop() override;
+
+private:
+    EnemyEventLog();
+    ~EnemyEventLog();
+
+    void Push(EEnemyEventType type, uint32 enemyId, const FRoomPositionPair& roomAndPosition, EDirectionType action, float reward);
+    EnemyEventRing& GetThreadRing();
+    /* Drains every ring into the file. */
+    void Flush();
+
+    static volatile int32 RunningFlag;
+
+    FCriticalSection RingsSection;
+    TArray<TUniquePtr<EnemyEventRing>> Rings;
+    TArray<EnemyEventRecord> FlushRecords;
+
+    FString FilePath;
+    TUniquePtr<IFileHandle> File;
+    int64 NumRecordsWritten = 0;
+
+    FThreadSafeBool ThreadShouldExit = false;
+    FEvent* WaitEvent = nullptr;
+    FRunnableThread* FlusherThread = nullptr;
+};
@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "GridCoordinateMapper.h"
+
+void GridCoordinateMapper::Init(FIntPoint numGridUnits, FIntPoint gridUnitLengthCM)
+{
+    ensure(numGridUnits.X > 1 && numGridUnits.Y > 1 && gridUnitLengthCM.X > 0 && gridUnitLengthCM.Y > 0);
+    NumGridUnits = numGridUnits;
+    CellsPerRoom = FIntPoint(FMath::Max(numGridUnits.X - 1, 0), FMath::Max(numGridUnits.Y - 1, 0));
+    CellLength = FVector2D(gridUnitLengthCM.X, gridUnitLengthCM.Y);
+    InvCellLength[0] = gridUnitLengthCM.X > 0 ? 1.0f / gridUnitLengthCM.X : 0.0f;
+    InvCellLength[1] = gridUnitLengthCM.Y > 0 ? 1.0f / gridUnitLengthCM.Y : 0.0f;
+    Origin[0] = (numGridUnits.X / 2) * (float)gridUnitLengthCM.X;
+    Origin[1] = (numGridUnits.Y / 2) * (float)gridUnitLengthCM.Y;
+}
+
+void GridCoordinateMapper::WorldToCells(const float* worldX, const float* worldY, int numPositions, FRoomPositionPair* roomsAndPositions) const
+{
+    if (!IsValid())
+        return;
+    for (int p = 0; p < numPositions; ++p)
+        AxisWorldToCell(worldX[p], 0, roomsAndPositions[p].RoomCoords.X, roomsAndPositions[p].PositionInRoom.X);
+    for (int p = 0; p < numPositions; ++p)
+        AxisWorldToCell(worldY[p], 1, roomsAndPositions[p].RoomCoords.Y, roomsAndPositions[p].PositionInRoom.Y);
+}
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+/*
+Maps between world XY positions and room / cell coordinates. This is the single definition of the maze grid: the game state and
+maze actors both use it.
+
+Rooms are NumGridUnits cells along each axis, and overlap their neighbours by one cell (the shared wall). The centre of cell x in
+room R is at
+
+    ((x - NumGridUnits / 2) + 0.5 + R * (NumGridUnits - 1)) * GridUnitLength
+
+(the same as ATPGameDemoGameState::GetGridCellWorldPosition). A world position maps to the cell that contains it, with cells
+covering [min, max). A position on a shared wall cell belongs to the room to its north / east, where it is cell 0, so cell
+NumGridUnits - 1 is never returned.
+
+Conversions multiply by precomputed reciprocals and floor, so negative coordinates need no special cases.
+*/
+class GridCoordinateMapper
+{
+public:
+    GridCoordinateMapper() {}
+    GridCoordinateMapper(FIntPoint numGridUnits, FIntPoint gridUnitLengthCM) { Init(numGridUnits, gridUnitLengthCM); }
+
+    void Init(FIntPoint numGridUnits, FIntPoint gridUnitLengthCM);
+    bool IsValid() const { return CellsPerRoom.X > 0 && CellsPerRoom.Y > 0 && CellLength.X > 0.0f && CellLength.Y > 0.0f; }
+
+    FIntPoint GetNumGridUnits() const { return NumGridUnits; }
+
+    FRoomPositionPair WorldToCell(FVector2D worldXY) const
+    {
+        FRoomPositionPair roomAndPosition;
+        AxisWorldToCell(worldXY.X, 0, roomAndPosition.RoomCoords.X, roomAndPosition.PositionInRoom.X);
+        AxisWorldToCell(worldXY.Y, 1, roomAndPosition.RoomCoords.Y, roomAndPosition.PositionInRoom.Y);
+        return roomAndPosition;
+    }
+
+    /* Converts numPositions positions, given as separate x and y arrays. */
+    void WorldToCells(const float* worldX, const float* worldY, int numPositions, FRoomPositionPair* roomsAndPositions) const;
+
+    FVector2D CellToWorld(const FRoomPositionPair& roomAndPosition, bool getCentre = true) const
+    {
+        const FVector2D cellMin = GetCellMin(roomAndPosition);
+        return getCentre ? cellMin + CellLength * 0.5f : cellMin;
+    }
+
+    /*
+    The position in grid cells along the whole grid, counting shared wall cells once: grid cell g covers [g, g + 1), and cell 0 of
+    room 0 is grid cell 0. For walking lines across rooms (see GridLineOfSight).
+    */
+    FVector2D WorldToGrid(FVector2D worldXY) const
+    {
+        return FVector2D((worldXY.X + Origin[0]) * InvCellLength[0], (worldXY.Y + Origin[1]) * InvCellLength[1]);
+    }
+
+    FRoomPositionPair GridCellToCell(FIntPoint gridCell) const
+    {
+        FRoomPositionPair roomAndPosition;
+        AxisGridCellToCell(gridCell.X, 0, roomAndPosition.RoomCoords.X, roomAndPosition.PositionInRoom.X);
+        AxisGridCellToCell(gridCell.Y, 1, roomAndPosition.RoomCoords.Y, roomAndPosition.PositionInRoom.Y);
+        return roomAndPosition;
+    }
+
+    /* The world area that maps to the cell. A position is in the cell while min <= position < max on both axes. */
+    FBox2D GetCellBounds(const FRoomPositionPair& roomAndPosition) const
+    {
+        const FVector2D cellMin = GetCellMin(roomAndPosition);
+        return FBox2D(cellMin, cellMin + CellLength);
+    }
+
+private:
+    FORCEINLINE void AxisWorldToCell(float world, int axis, int32& room, int32& cell) const
+    {
+        // The index of the cell along the whole grid, counting shared wall cells once.
+        AxisGridCellToCell(FMath::FloorToInt((world + Origin[axis]) * InvCellLength[axis]), axis, room, cell);
+    }
+
+    FORCEINLINE void AxisGridCellToCell(int32 gridCell, int axis, int32& room, int32& cell) const
+    {
+        const int32 cellsPerRoom = CellsPerRoom[axis];
+        room = gridCell >= 0 ? gridCell / cellsPerRoom : -((cellsPerRoom - 1 - gridCell) / cellsPerRoom);
+        cell = gridCell - room * cellsPerRoom;
+    }
+
+    FVector2D GetCellMin(const FRoomPositionPair& roomAndPosition) const
+    {
+        const int32 gridCellX = roomAndPosition.RoomCoords.X * CellsPerRoom.X + roomAndPosition.PositionInRoom.X;
+        const int32 gridCellY = roomAndPosition.RoomCoords.Y * CellsPerRoom.Y + roomAndPosition.PositionInRoom.Y;
+        return FVector2D(gridCellX * CellLength.X - Origin[0], gridCellY * CellLength.Y - Origin[1]);
+    }
+
+    FIntPoint NumGridUnits { 0, 0 };
+    /* NumGridUnits - 1, the cell distance between the same cell in neighbouring rooms. */
+    FIntPoint CellsPerRoom { 0, 0 };
+    FVector2D CellLength { 0.0f, 0.0f };
+    float InvCellLength[2] = { 0.0f, 0.0f };
+    /* The distance from the min edge of cell 0 in room 0 to the world origin. */
+    float Origin[2] = { 0.0f, 0.0f };
+};
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+/*
+Line of sight on the maze grid, without physics traces.
+
+Trace walks the grid cells that a segment passes through, in order (Amanatides & Woo's grid DDA): each step moves to whichever
+neighbouring cell the segment reaches first, so a trace costs one cell test per cell crossed. Positions are in grid cells along the
+whole world (GridCoordinateMapper::WorldToGrid), so traces run across room boundaries without any special cases. Whether a cell
+blocks sight is up to the caller (see ATPGameDemoGameState::IsGridCellClear).
+*/
+namespace GridLineOfSight
+{
+    /*
+    Returns true if isCellClear(gridCell) holds for every cell between the cells of start and end. The start and end cells themselves
+    aren't tested, since they hold the viewer and the target. Where the segment passes exactly through a cell corner, both cells
+    beside the corner must be clear, so that sight never slips between two diagonal wall cells.
+    */
+    template <typename CellTestType>
+    bool Trace(FVector2D start, FVector2D end, CellTestType&& isCellClear)
+    {
+        FIntPoint cell(FMath::FloorToInt(start.X), FMath::FloorToInt(start.Y));
+        const FIntPoint endCell(FMath::FloorToInt(end.X), FMath::FloorToInt(end.Y));
+        const FVector2D delta = end - start;
+        const FIntPoint step(delta.X > 0.0f ? 1 : -1, delta.Y > 0.0f ? 1 : -1);
+        // The segment parameter (0 at start, 1 at end) of each axis' next cell boundary, and the parameter distance between boundaries.
+        const FVector2D tDelta(delta.X != 0.0f ? FMath::Abs(1.0f / delta.X) : BIG_NUMBER, delta.Y != 0.0f ? FMath::Abs(1.0f / delta.Y) : BIG_NUMBER);
+        FVector2D tMax(delta.X > 0.0f ? (cell.X + 1 - start.X) * tDelta.X : delta.X < 0.0f ? (start.X - cell.X) * tDelta.X : BIG_NUMBER,
+                       delta.Y > 0.0f ? (cell.Y + 1 - start.Y) * tDelta.Y : delta.Y < 0.0f ? (start.Y - cell.Y) * tDelta.Y : BIG_NUMBER);
+        // Every step moves one cell along one axis (or one along each, at a corner), so this bounds the walk against rounding.
+        const int32 numSteps = FMath::Abs(endCell.X - cell.X) + FMath::Abs(endCell.Y - cell.Y);
+        for (int32 s = 0; s < numSteps; ++s)
+        {
+            if (tMax.X < tMax.Y)
+            {
+                cell.X += step.X;
+                tMax.X += tDelta.X;
+            }
+            else if (tMax.Y < tMax.X)
+            {
+                cell.Y += step.Y;
+                tMax.Y += tDelta.Y;
+            }
+            else
+            {
+                const FIntPoint besideX(cell.X + step.X, cell.Y);
+                const FIntPoint besideY(cell.X, cell.Y + step.Y);
+                if ((besideX != endCell && !isCellClear(besideX)) || (besideY != endCell && !isCellClear(besideY)))
+                    return false;
+                cell += step;
+                tMax += tDelta;
+                ++s;
+            }
+            if (cell == endCell)
+                return true;
+            if (!isCellClear(cell))
+                return false;
+        }
+        return true;
+    }
+};
@@ -87,11 +87,11 @@ public:
     UFUNCTION (BlueprintCallable, Category = "Level Building")
         FVector2D GetCellWorldPosition (int x, int y, int RoomOffsetX, int RoomOffsetY, bool getCentre = true);
 
-    /** Starts in centre of grid and winds out clockise looking for empty grid cells. */
+    /** Returns the open grid cell closest to the centre of the grid. */
     UFUNCTION (BlueprintCallable, Category = "Level Building")
         FVector2D FindMostCentralEmptyCell();
 
-    /** Starts in centre of grid and winds out clockise looking for empty grid cells. */
+    /** Returns the world position of the open grid cell closest to the centre of the grid. */
     UFUNCTION (BlueprintCallable, Category = "Level Building")
         FVector2D FindMostCentralSpawnPosition(int RoomOffsetX, int RoomOffsetY);
 
@@ -99,8 +99,6 @@ public:
         void UpdateInnerWallCellActorCounts(FIntPoint roomCoords, bool Increment);
 
 private:
-    FIntPoint           GetRandomEvenCell();
-    bool                IsCellTouchingDoorCell(FIntPoint cellPosition);
     FString             CurrentLevelPath;
     bool                LevelsDirFound = false;
     TArray<TArray<int>> LevelStructure;
@@ -3,6 +3,7 @@
 #include "TPGameDemo.h"
 #include "Engine/World.h"
 #include "TextParserComponent.h"
+#include "RoomPipeline.h"
 #include "LevelTrainerComponent.h"
 
 //====================================================================================================
@@ -41,7 +42,8 @@ uint32 LevelTrainerRunnable::Run()
     {
         if (ShouldTrain)
         {
-            TrainerComponent.TrainNextGoalPosition(NUM_TRAINING_SIMULATIONS, MAX_NUM_MOVEMENTS_PER_SIMULATION);
+            TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_TrainerRun);
+            TrainerComponent.TrainNextGoalPosition();
             if (TrainerComponent.LevelTrained)
                 ThreadShouldExit = true;
         }
@@ -127,6 +129,7 @@ void ULevelTrainerComponent::TickComponent( float DeltaTime, ELevelTick TickType
         while(TrainerRunnable.IsValid() && TrainerRunnable->IsTraining){}            
         OnLevelTrained.Broadcast();
         LevelTrained = false;
+        TrainingRoomData.Reset();
     }
 }
 
@@ -141,6 +144,29 @@ void ULevelTrainerComponent::StartTraining()
     }
     if(TrainerRunnable.IsValid())
         TrainerRunnable.Reset();
+    ATPGameDemoGameState* gameState = GetGameStateChecked();
+    if (!ensure(gameState != nullptr))
+        return;
+    // Rooms trained ahead of time by the game state's pipeline are finished as soon as their qvalues are committed.
+    if (gameState->CommitStagedRoomTraining(RoomCoords))
+    {
+        TrainingPosition.Set(MaxTrainingPosition.GetValue());
+        LevelTrained = true;
+        return;
+    }
+    TrainingRoomData = gameState->GetRoomDataPtr(RoomCoords);
+    if (!TrainingRoomData.IsValid())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Can't train room (%d, %d): it has no room data."), RoomCoords.X, RoomCoords.Y);
+        gameState->RoomTrainingFailed(RoomCoords);
+        return;
+    }
+    TrainingBudget = gameState->GetTrainingBudget();
+    MeasureConvergence = gameState->IsTuningTrainingBudget();
+    const TArray<float>* cellDangers = gameState->GetDangerField().GetRoomDangers(RoomCoords);
+    TrainingCellDangers = cellDangers != nullptr ? *cellDangers : TArray<float>();
+    TrainingSeed = RoomTraining::GetRoomTrainingSeed(gameState->GetActiveWorldSeed(), RoomCoords);
+    gameState->SetRoomTrainingInputs(RoomCoords, TrainingBudget, TrainingCellDangers, TrainingSeed);
     InitTrainerThread();
     TrainerRunnable->StartTraining();
 }
@@ -174,26 +200,9 @@ void ULevelTrainerComponent::UpdateEnvironmentForLevel()
     {
         //This is called from the room builder BP in OnBuildRoom, after the walls have been spawned (BuildGeneratedRoom). The game state should hold the qvalues, so that we can build on them if the room structure changes.
         TArray<TArray<int>> LevelStructure;
-        int sideLength = gameState->NumGridUnitsX;
-        LevelStructure.SetNumZeroed(sideLength);
-        for (int x = 0; x < sideLength; ++x)
-            LevelStructure[x].SetNumZeroed(sideLength);
-        InnerRoomBitmask roomBitmask = gameState->GetRoomInnerStructure(RoomCoords);
-        LevelBuilderHelpers::BitMaskToArray(roomBitmask, LevelStructure);
         TArray<int> neswDoorPositions;
         gameState->GetDoorPositionsNESW(RoomCoords, neswDoorPositions);
-        for (int s = 0; s < sideLength; ++s)
-        {
-            LevelStructure[sideLength - 1][s] = (int)ECellState::Closed;
-            LevelStructure[s][sideLength - 1] = (int)ECellState::Closed;
-            LevelStructure[0][s] = (int)ECellState::Closed;
-            LevelStructure[s][0] = (int)ECellState::Closed;
-        }
-        LevelStructure[sideLength - 1][neswDoorPositions[(int)EDirectionType::North]] = (int)ECellState::Door;
-        LevelStructure[neswDoorPositions[(int)EDirectionType::East]][sideLength - 1] = (int)ECellState::Door;
-        LevelStructure[0][neswDoorPositions[(int)EDirectionType::South]] = (int)ECellState::Door;
-        LevelStructure[neswDoorPositions[(int)EDirectionType::West]][0] = (int)ECellState::Door;
-
+        RoomGeneration::GetRoomStructure(gameState->NumGridUnitsX, gameState->GetRoomInnerStructure(RoomCoords), neswDoorPositions, LevelStructure);
 
         const int sizeX = LevelStructure.Num();
         const int sizeY = LevelStructure[0].Num();
@@ -206,44 +215,26 @@ void ULevelTrainerComponent::UpdateEnvironmentForLevel()
     }
 }
 
-void ULevelTrainerComponent::TrainNextGoalPosition(int numSimulationsPerStartingPosition, int maxNumActionsPerSimulation)
+void ULevelTrainerComponent::TrainNextGoalPosition()
 {
-    ClearEnvironment();
-    float maxGoalDistance = sqrt(pow((GetNavEnvironment().Num() - 1), 2.0f) + pow((GetNavEnvironment()[0].Num() - 1), 2.0f));
-    if (Get_ActionTargets(GetNavEnvironment(), CurrentGoalPosition).IsStateValid())
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_TrainNextGoalPosition);
+    ATPGameDemoGameState* gameState = GetGameStateChecked();
+    ensure(gameState != nullptr);
+    if (gameState != nullptr && TrainingRoomData.IsValid() && Get_ActionTargets(GetNavEnvironment(), CurrentGoalPosition).IsStateValid())
     {
-        ATPGameDemoGameState* gameState = GetGameStateChecked();
-        if (gameState != nullptr)
+        // Train a copy so that actors reading the room's qvalues never see a partially trained goal.
+        QValuesRewardsSet qValuesRewards = Get_QValuesRewardsSet_For_GoalPosition(GetNavSets(), CurrentGoalPosition);
+        RoomTraining::ConvergenceSampleCallback onConvergenceSample;
+        if (MeasureConvergence)
         {
-            gameState->SetPositionIsGoal(RoomCoords, CurrentGoalPosition, true);
-        }
-        for(int x = 0; x < GetNavEnvironment().Num(); ++x)
-        {
-            for(int y = 0; y < GetNavEnvironment()[0].Num(); ++y)
+            onConvergenceSample = [gameState](int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun)
             {
-                if (Get_ActionTargets(GetNavEnvironment(), FIntPoint(x, y)).IsStateValid() && FIntPoint(x, y) != CurrentGoalPosition)
-                {
-                    bool deltaQConverged = false;
-                    int s = 0;
-                    float distanceFromGoal = sqrt(pow((CurrentGoalPosition.X - x), 2.0f) + pow((CurrentGoalPosition.Y - y), 2.0f));
-                    float normedDistanceFromGoal = (distanceFromGoal - 1.0f) / (maxGoalDistance - 1.0f);
-                    int actionsTakenConvergenceThreshold = (int)(normedDistanceFromGoal * (CONVERGENCE_NUM_ACTIONS_MAX - CONVERGENCE_NUM_ACTIONS_MIN)) + CONVERGENCE_NUM_ACTIONS_MIN;
-                    while (/*!deltaQConverged &&*/ s < numSimulationsPerStartingPosition)
-                    {
-                        float averageDeltaQ = 0.0f;
-                        int numActionsTaken = 0;
-                        SimulateRun(FIntPoint(x, y), maxNumActionsPerSimulation, averageDeltaQ, numActionsTaken);
-                        deltaQConverged = numActionsTaken >= actionsTakenConvergenceThreshold && averageDeltaQ <= DELTA_Q_CONVERGENCE_THRESHOLD;
-                        ++s;
-                    }
-                }
-            }
-        }
-        if (gameState != nullptr)
-        {
-            gameState->SetRoomQValuesRewardsSet(RoomCoords, CurrentGoalPosition, Get_QValuesRewardsSet_For_GoalPosition(GetNavSets(), CurrentGoalPosition));
-            gameState->SetPositionIsGoal(RoomCoords, CurrentGoalPosition, false);
+                gameState->AddTrainingConvergenceSample(goalDistance, numSimulationsToOptimal, longestGoalReachingRun);
+            };
         }
+        RoomTraining::TrainGoalPosition(GetNavEnvironment(), qValuesRewards, CurrentGoalPosition, TrainingBudget, TrainingSeed, onConvergenceSample,
+                                        TrainingCellDangers.Num() > 0 ? &TrainingCellDangers : nullptr);
+        TrainingRoomData->SetNavSetForTarget(CurrentGoalPosition, qValuesRewards);
     }
     IncrementGoalPosition();
 }
@@ -275,16 +266,10 @@ BehaviourMap ULevelTrainerComponent::GetBehaviourMap()
     return outArray;
 }
 
-void ULevelTrainerComponent::ClearEnvironment()
-{
-    ATPGameDemoGameState* gameState = GetGameStateChecked();
-    ensure(gameState != nullptr);
-    if (gameState != nullptr)
-        gameState->ClearQValuesAndRewards(RoomCoords, CurrentGoalPosition);
-}
-
 const RoomTargetsQValuesRewardsSets& ULevelTrainerComponent::GetNavSets() const
 {
+    if (TrainingRoomData.IsValid())
+        return TrainingRoomData->QValuesRewardsSets;
     ATPGameDemoGameState* gameState = GetGameStateChecked();
     ensure(gameState != nullptr);
     return gameState->GetRoomQValuesRewardsSets(RoomCoords);
@@ -292,55 +277,23 @@ const RoomTargetsQValuesRewardsSets& ULevelTrainerComponent::GetNavSets() const
 
 const NavigationEnvironment& ULevelTrainerComponent::GetNavEnvironment() const
 {
+    if (TrainingRoomData.IsValid())
+        return TrainingRoomData->NavEnvironment;
     ATPGameDemoGameState* gameState = GetGameStateChecked();
     ensure(gameState != nullptr);
     return gameState->GetNavEnvironment(RoomCoords);
 }
 
-void ULevelTrainerComponent::SimulateRun(FIntPoint startingStatePosition, int maxNumActions, float& averageDeltaQ, int& numActionsTaken)
-{
-    numActionsTaken = 0;
-    averageDeltaQ = 0.0f;
-    bool goalReached = false;
-    if (Get_ActionTargets(GetNavEnvironment(), startingStatePosition).IsGoalState())
-        goalReached = true;
-    FIntPoint currentPosition = startingStatePosition;
-    while (numActionsTaken < maxNumActions && !goalReached)
-    {
-        FDirectionSet optimalActions;
-        const ActionQValuesAndRewards& qValuesRewards = Get_ActionQValuesAndRewards_FromRoom(GetNavSets(), CurrentGoalPosition, currentPosition);
-        const ActionTargets& targets = Get_ActionTargets(GetNavEnvironment(), currentPosition);
-        qValuesRewards.GetOptimalQValueAndActions(optimalActions);
-        ensure(optimalActions.IsValid());
-        EDirectionType actionToTake = optimalActions.ChooseDirection();
-        FDirectionSet dummyNextActions;
-        FRoomPositionPair actionTarget = targets.GetActionTarget(actionToTake);
-        const float maxNextReward = Get_ActionQValuesAndRewards_FromRoom(GetNavSets(), CurrentGoalPosition, actionTarget.PositionInRoom).GetOptimalQValueAndActions(dummyNextActions);
-        const float currentQValue = qValuesRewards.GetQValues()[(int)actionToTake];
-        const float discountedNextReward = GridTrainingConstants::SimDiscountFactor * maxNextReward;
-        const float immediateReward = qValuesRewards.GetRewards()[(int)actionToTake];
-        const float deltaQ = GridTrainingConstants::SimLearningRate * (immediateReward + discountedNextReward - currentQValue);
-        averageDeltaQ += deltaQ;
-        ATPGameDemoGameState* gameState = GetGameStateChecked();
-        if (gameState != nullptr)
-        {
-            gameState->UpdateQValue({ RoomCoords, currentPosition }, CurrentGoalPosition, actionToTake, GridTrainingConstants::SimLearningRate, deltaQ);
-        }
-#pragma message("Careful here! This assumes the room never changes, during training. If we come back and train a room again after the doors have been unlocked, the actionTarget's RoomCoords may be different here!")
-        currentPosition = actionTarget.PositionInRoom;
-        ++numActionsTaken;
-        if (Get_ActionTargets(GetNavEnvironment(), currentPosition).IsGoalState())
-            goalReached = true;
-    }
-    averageDeltaQ /= (float)numActionsTaken;
-}
-
 void ULevelTrainerComponent::IncrementGoalPosition()
 {
     if (CurrentGoalPosition.Y == GetNavEnvironment()[0].Num() - 1)
     {
         if (CurrentGoalPosition.X == GetNavEnvironment().Num() - 1)
         {
+            ATPGameDemoGameState* gameState = GetGameStateChecked();
+            if (MeasureConvergence && gameState != nullptr)
+                gameState->TrainingConvergenceRoomMeasured();
+            MeasureConvergence = false;
             LevelTrained = true;
             //return;
         }
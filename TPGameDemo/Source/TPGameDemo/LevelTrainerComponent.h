@@ -91,18 +91,26 @@ private:
     FCriticalSection ClientSection;
 
     BehaviourMap GetBehaviourMap();
-    void ClearEnvironment();
 
     const NavigationEnvironment& GetNavEnvironment() const;
     const RoomTargetsQValuesRewardsSets& GetNavSets() const;
     void InitTrainerThread();
-    void TrainNextGoalPosition(int numSimulationsPerStartingPosition, int maxNumActionsPerSimulation);
-    // Simulate a run through the while keepting track of the average deltaQ and the num actions taken. (these will be used to measure convergence)
-    void SimulateRun(FIntPoint startingStatePosition, int maxNumActions, float& averageDeltaQ, int& numActionsTaken);
+    void TrainNextGoalPosition();
     void IncrementGoalPosition();
     FThreadSafeCounter TrainingPosition = 0;
     FThreadSafeCounter MaxTrainingPosition = 0;
     FIntPoint CurrentGoalPosition {0,0};
+    // Copied from the game state when training starts.
+    FTrainingBudget TrainingBudget;
+    // True if this room's convergence is being measured for the game state's TrainingBudgetTuner.
+    bool MeasureConvergence = false;
+    // Held while training, so the room's data stays valid on the trainer thread even if the room is disabled.
+    RoomDataPtr TrainingRoomData;
+    // Copied from the game state's DangerField when training starts, since turret events change it on the game thread. Empty if the
+    // room has no turrets.
+    TArray<float> TrainingCellDangers;
+    // The room's training seed (see RoomTraining::GetRoomTrainingSeed), from the world seed and the room coords.
+    int32 TrainingSeed = 0;
 
     LevelTrainedEvent OnLevelTrained;
     //FThreadSafeCounter NumUnfinishedTasks = 0;
@@ -27,10 +27,7 @@ void AMazeActor::BeginPlay()
         {
             UpdateMazeDimensions();
         });
-        CurrentLevelNumGridUnitsX   = gameState->NumGridUnitsX;
-        CurrentLevelNumGridUnitsY   = gameState->NumGridUnitsY;
-        CurrentLevelGridUnitLengthXCM = gameState->GridUnitLengthXCM;
-        CurrentLevelGridUnitLengthYCM = gameState->GridUnitLengthYCM;
+        CoordinateMapper = gameState->GetCoordinateMapper();
         MaxHealth = gameMode->DefaultMaxHealth;
     }
     
@@ -47,6 +44,7 @@ void AMazeActor::SetOccupyCells(bool bShouldOccupy)
 void AMazeActor::InitialisePosition(FIntPoint roomCoords)
 { 
     CurrentRoomCoords = roomCoords;
+    CachedCellBounds = FBox2D(ForceInit);
 }
 
 float AMazeActor::GetHealthPercentage()
@@ -84,38 +82,27 @@ void AMazeActor::UpdateMazeDimensions()
     ATPGameDemoGameState* gameState = (ATPGameDemoGameState*) GetWorld()->GetGameState();
     if (gameState != nullptr)
     {
-        CurrentLevelNumGridUnitsX   = gameState->NumGridUnitsX;
-        CurrentLevelNumGridUnitsY   = gameState->NumGridUnitsY;
-        CurrentLevelGridUnitLengthXCM = gameState->GridUnitLengthXCM;
-        CurrentLevelGridUnitLengthYCM = gameState->GridUnitLengthYCM;
+        CoordinateMapper = gameState->GetCoordinateMapper();
+        CachedCellBounds = FBox2D(ForceInit);
     }
 }
 
 void AMazeActor::UpdatePosition (bool broadcastChange)
 {
-    if (ShouldUpdatePosition)
+    if (ShouldUpdatePosition && CoordinateMapper.IsValid())
     {
-        FVector worldPosition = GetActorLocation();
-        const int totalGridLengthCMX = CurrentLevelGridUnitLengthXCM * CurrentLevelNumGridUnitsX;
-        const int totalGridLengthCMY = CurrentLevelGridUnitLengthYCM * CurrentLevelNumGridUnitsY;
-        const int overlappingGridLengthCMX = totalGridLengthCMX - CurrentLevelGridUnitLengthXCM;
-        const int overlappingGridLengthCMY = totalGridLengthCMY - CurrentLevelGridUnitLengthYCM;
-        // map -gridLength/2 > gridLength/2 to 0 > gridLength.
-        const int mappedX = worldPosition.X + overlappingGridLengthCMX / 2;
-        const int mappedY = worldPosition.Y + overlappingGridLengthCMY / 2;
-        // get current room coords. negative values should start indexed from -1, not 0 (hence the ternary addition).
-        const int roomX = (FMath::Abs(mappedX / overlappingGridLengthCMX) + (mappedX < 0 ? 1 : 0)) * FMath::Sign(mappedX);
-        const int roomY = (FMath::Abs(mappedY / overlappingGridLengthCMY) + (mappedY < 0 ? 1 : 0)) * FMath::Sign(mappedY);
-        CurrentRoomCoords = FIntPoint(roomX, roomY);
-        // divide mappedX and mappedY to get individual cell coordinates within room. If negative, should index backwards.
-        const int numUnitsX = (int)(mappedX /*- CurrentLevelGridUnitLengthXCM * 0.5f*/) / (CurrentLevelGridUnitLengthXCM);
-        const int numUnitsY = (int)(mappedY /*- CurrentLevelGridUnitLengthYCM * 0.5f*/) / (CurrentLevelGridUnitLengthYCM);
-        GridXPosition = numUnitsX % (CurrentLevelNumGridUnitsX - 1);
-        GridYPosition = numUnitsY % (CurrentLevelNumGridUnitsY - 1);
-        if (mappedX < 0)
-            GridXPosition = (CurrentLevelNumGridUnitsX - 2) - FMath::Abs(GridXPosition);
-        if (mappedY < 0)
-            GridYPosition = (CurrentLevelNumGridUnitsY - 2) - FMath::Abs(GridYPosition);
+        const FVector worldPosition = GetActorLocation();
+        // Most ticks the actor is still inside the cell it was in last time.
+        if (worldPosition.X >= CachedCellBounds.Min.X && worldPosition.X < CachedCellBounds.Max.X &&
+            worldPosition.Y >= CachedCellBounds.Min.Y && worldPosition.Y < CachedCellBounds.Max.Y)
+            return;
+
+        const FRoomPositionPair roomAndPosition = CoordinateMapper.WorldToCell(FVector2D(worldPosition));
+        CurrentRoomCoords = roomAndPosition.RoomCoords;
+        GridXPosition = roomAndPosition.PositionInRoom.X;
+        GridYPosition = roomAndPosition.PositionInRoom.Y;
+        // Only cache the cell once it has been broadcast, so that a non-broadcasting update doesn't hide the change from the next one.
+        CachedCellBounds = broadcastChange ? CoordinateMapper.GetCellBounds(roomAndPosition) : FBox2D(ForceInit);
 
         if (broadcastChange && (GridYPosition != PreviousGridYPosition || GridXPosition != PreviousGridXPosition))
         {
@@ -158,6 +145,23 @@ void AMazeActor::Tick( float DeltaTime )
     }
 }
 
+void AMazeActor::SetTickDetail(EMazeActorTickDetail tickDetail, float reducedTickInterval)
+{
+    if (tickDetail == TickDetail)
+        return;
+    TickDetail = tickDetail;
+    const bool tickEnabled = tickDetail != EMazeActorTickDetail::Dormant;
+    const float tickInterval = tickDetail == EMazeActorTickDetail::Reduced ? reducedTickInterval : 0.0f;
+    SetActorTickEnabled(tickEnabled);
+    SetActorTickInterval(tickInterval);
+    // The movement component ticks at the same rate, so that movement input added on each actor tick is consumed once.
+    if (UCharacterMovementComponent* movement = GetCharacterMovement())
+    {
+        movement->SetComponentTickEnabled(tickEnabled);
+        movement->SetComponentTickInterval(tickInterval);
+    }
+}
+
 bool AMazeActor::IsOnGridEdge() const
 {
     if (ATPGameDemoGameState* gameState = (ATPGameDemoGameState*) GetWorld()->GetGameState())
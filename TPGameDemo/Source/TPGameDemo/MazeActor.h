@@ -3,6 +3,7 @@
 #pragma once
 #include "GameFramework/Character.h"
 #include "TPGameDemo.h"
+#include "GridCoordinateMapper.h"
 //#include "TextParserComponent.h"
 #include "MazeActor.generated.h"
 
@@ -11,6 +12,14 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE (FGridPositionChanged);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE (FRoomCoordsChanged);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE (FActorDied);
 
+/* How often a maze actor ticks. The game state lowers the detail of enemies that are far from the player or off-screen. */
+UENUM(BlueprintType)
+enum class EMazeActorTickDetail : uint8
+{
+    Full,       // Ticks every frame.
+    Reduced,    // The actor and its movement tick at a lower rate.
+    Dormant     // No ticking. The game state moves the actor between cells at a coarse rate.
+};
 
 
 /*
@@ -107,20 +116,27 @@ public:
 
     FIntPoint GetPreviousRoomCoords() const { return PreviousRoomCoords; }
 
-private:
+    UFUNCTION(BlueprintCallable, Category = "Maze Actor Tick Detail")
+        EMazeActorTickDetail GetTickDetail() const { return TickDetail; }
+    /* Sets the actor and movement component tick rate for the given detail. reducedTickInterval is used for EMazeActorTickDetail::Reduced. */
+    void SetTickDetail(EMazeActorTickDetail tickDetail, float reducedTickInterval);
+
+protected:
     void UpdatePosition (bool broadcastChange = true);
 
+private:
+
     virtual void PositionChanged();
     virtual void RoomCoordsChanged();
 
-    int CurrentLevelNumGridUnitsX     = 10;
-    int CurrentLevelNumGridUnitsY     = 10;
-    int CurrentLevelGridUnitLengthXCM = 200;
-    int CurrentLevelGridUnitLengthYCM = 200;
+    GridCoordinateMapper CoordinateMapper;
+    // The world area of the last broadcast cell. UpdatePosition only maps the actor's position again once it leaves this box.
+    FBox2D CachedCellBounds { ForceInit };
     int PreviousGridXPosition         = 0;
     int PreviousGridYPosition         = 0;
     FIntPoint PreviousRoomCoords      = FIntPoint(0,0);
     bool bOccupyCells = true;
+    EMazeActorTickDetail TickDetail = EMazeActorTickDetail::Full;
 
     /** An impulse direction that is used to add impulse force every frame when the actor takes impulses */
     FVector ImpulseDirection = FVector::ZeroVector;
@@ -0,0 +1,474 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Async/MappedFileHandle.h"
+#include "TPGameDemoGameState.h"
+#include "PolicyArchive.h"
+
+DEFINE_LOG_CATEGORY(LogPolicyArchive);
+
+using namespace PolicyArchiveFormat;
+
+namespace
+{
+    FIntVector GetEntryKey(FIntPoint roomCoords, EEntryType type) { return FIntVector(roomCoords.X, roomCoords.Y, (int32)type); }
+
+    int64 AlignPayloadOffset(int64 offset) { return Align(offset, PayloadAlignment); }
+
+    int32 GetNumCells(FIntPoint roomSize) { return roomSize.X * roomSize.Y; }
+};
+
+//====================================================================================================
+// PolicyArchiveWriter
+//====================================================================================================
+
+PolicyArchiveWriter::PendingEntry& PolicyArchiveWriter::AddEntry(FIntPoint roomCoords, EEntryType type, uint32 numTargets)
+{
+    Entries.RemoveAll([roomCoords, type](const PendingEntry& pending)
+    {
+        return pending.Entry.GetRoomCoords() == roomCoords && pending.Entry.Type == type;
+    });
+    PendingEntry& pending = Entries.AddDefaulted_GetRef();
+    pending.Entry.RoomX = roomCoords.X;
+    pending.Entry.RoomY = roomCoords.Y;
+    pending.Entry.Type = type;
+    pending.Entry.NumTargets = numTargets;
+    return pending;
+}
+
+void PolicyArchiveWriter::AddBehaviourMaps(FIntPoint roomCoords, const TArray<BehaviourMap>& behaviourMaps)
+{
+    PendingEntry& pending = AddEntry(roomCoords, EEntryType::BehaviourMaps, behaviourMaps.Num());
+    pending.Payload.Reserve(behaviourMaps.Num() * GetNumCells(RoomSize));
+    for (const BehaviourMap& behaviourMap : behaviourMaps)
+    {
+        ensure(behaviourMap.Num() == RoomSize.X);
+        for (int x = 0; x < RoomSize.X; ++x)
+        {
+            for (int y = 0; y < RoomSize.Y; ++y)
+            {
+                const bool inMap = behaviourMap.IsValidIndex(x) && behaviourMap[x].IsValidIndex(y);
+                pending.Payload.Add(inMap ? behaviourMap[x][y].DirectionsMask & DirectionMaskTables::FullMask : 0);
+            }
+        }
+    }
+}
+
+void PolicyArchiveWriter::AddQTables(FIntPoint roomCoords, const RoomTargetsQValuesRewardsSets& qValuesRewards)
+{
+    PendingEntry& pending = AddEntry(roomCoords, EEntryType::QTables, GetNumCells(RoomSize));
+    pending.Payload.SetNumZeroed(GetNumCells(RoomSize) * GetNumCells(RoomSize) * QTableFloatsPerCell * sizeof(float));
+    float* values = (float*)pending.Payload.GetData();
+    for (int tx = 0; tx < RoomSize.X; ++tx)
+    {
+        for (int ty = 0; ty < RoomSize.Y; ++ty)
+        {
+            for (int x = 0; x < RoomSize.X; ++x)
+            {
+                for (int y = 0; y < RoomSize.Y; ++y)
+                {
+                    const ActionQValuesAndRewards& cell = Get_ActionQValuesAndRewards_FromRoom(qValuesRewards, FIntPoint(tx, ty), FIntPoint(x, y));
+                    cell.GetQValuesAndRewards(values, values + (int)EDirectionType::NumDirectionTypes);
+                    values += QTableFloatsPerCell;
+                }
+            }
+        }
+    }
+}
+
+void PolicyArchiveWriter::AddRoomLayout(FIntPoint roomCoords, const ArchivedRoomLayout& layout)
+{
+    RoomLayoutPayload payload;
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        payload.DoorPositionsNESW[d] = layout.DoorPositionsNESW.IsValidIndex(d) ? layout.DoorPositionsNESW[d] : -1;
+    payload.NormedDensity = layout.NormedDensity;
+    payload.NormedComplexity = layout.NormedComplexity;
+    payload.NumX = layout.InnerStructure.GetNumX();
+    payload.NumY = layout.InnerStructure.GetNumY();
+    for (int x = 0; x < layout.InnerStructure.GetNumX(); ++x)
+        payload.Rows[x] = layout.InnerStructure.GetRow(x);
+    PendingEntry& pending = AddEntry(roomCoords, EEntryType::RoomLayout, 0);
+    pending.Payload.SetNumUninitialized(sizeof(payload));
+    FMemory::Memcpy(pending.Payload.GetData(), &payload, sizeof(payload));
+}
+
+void PolicyArchiveWriter::AddEncodedBehaviourMaps(FIntPoint roomCoords, const EncodedRoomPolicy& encodedPolicy)
+{
+    ensure(encodedPolicy.GetRoomSize() == RoomSize);
+    PendingEntry& pending = AddEntry(roomCoords, EEntryType::EncodedBehaviourMaps, encodedPolicy.GetNumTargets());
+    pending.Payload = encodedPolicy.GetBytes();
+}
+
+bool PolicyArchiveWriter::Save(const FString& filePath) const
+{
+    TArray<const PendingEntry*> sortedEntries;
+    for (const PendingEntry& pending : Entries)
+        sortedEntries.Add(&pending);
+    sortedEntries.Sort([](const PendingEntry& a, const PendingEntry& b)
+    {
+        if (a.Entry.RoomX != b.Entry.RoomX)
+            return a.Entry.RoomX < b.Entry.RoomX;
+        if (a.Entry.RoomY != b.Entry.RoomY)
+            return a.Entry.RoomY < b.Entry.RoomY;
+        return a.Entry.Type < b.Entry.Type;
+    });
+
+    FileHeader header;
+    header.NumEntries = sortedEntries.Num();
+    header.RoomSizeX = RoomSize.X;
+    header.RoomSizeY = RoomSize.Y;
+    header.EntriesOffset = sizeof(FileHeader);
+
+    TArray<Entry> entries;
+    int64 payloadOffset = AlignPayloadOffset(header.EntriesOffset + sortedEntries.Num() * sizeof(Entry));
+    for (const PendingEntry* pending : sortedEntries)
+    {
+        Entry& entry = entries.Add_GetRef(pending->Entry);
+        entry.Offset = payloadOffset;
+        entry.Size = pending->Payload.Num();
+        entry.Checksum = FCrc::MemCrc32(pending->Payload.GetData(), pending->Payload.Num());
+        payloadOffset = AlignPayloadOffset(payloadOffset + entry.Size);
+    }
+    header.EntriesChecksum = FCrc::MemCrc32(entries.GetData(), entries.Num() * sizeof(Entry));
+
+    TArray<uint8> bytes;
+    bytes.SetNumZeroed(payloadOffset);
+    FMemory::Memcpy(bytes.GetData(), &header, sizeof(header));
+    FMemory::Memcpy(bytes.GetData() + header.EntriesOffset, entries.GetData(), entries.Num() * sizeof(Entry));
+    for (int e = 0; e < entries.Num(); ++e)
+        FMemory::Memcpy(bytes.GetData() + entries[e].Offset, sortedEntries[e]->Payload.GetData(), entries[e].Size);
+    if (!FFileHelper::SaveArrayToFile(bytes, *filePath))
+    {
+        UE_LOG(LogPolicyArchive, Warning, TEXT("Couldn't write policy archive %s"), *filePath);
+        return false;
+    }
+    return true;
+}
+
+//====================================================================================================
+// PolicyArchive
+//====================================================================================================
+
+PolicyArchive::~PolicyArchive()
+{
+    Close();
+}
+
+bool PolicyArchive::Open(const FString& filePath)
+{
+    Close();
+    IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    MappedFile.Reset(platformFile.OpenMapped(*filePath));
+    if (MappedFile.IsValid())
+        MappedRegion.Reset(MappedFile->MapRegion());
+    if (MappedRegion.IsValid())
+    {
+        Data = MappedRegion->GetMappedPtr();
+        DataSize = MappedRegion->GetMappedSize();
+    }
+    else
+    {
+        // Memory mapping isn't supported everywhere (or for every file system), so fall back to a single read.
+        MappedFile.Reset();
+        if (!FFileHelper::LoadFileToArray(LoadedBytes, *filePath))
+            return false;
+        Data = LoadedBytes.GetData();
+        DataSize = LoadedBytes.Num();
+    }
+
+    FileHeader header;
+    bool valid = DataSize >= (int64)sizeof(FileHeader);
+    if (valid)
+    {
+        FMemory::Memcpy(&header, Data, sizeof(header));
+        valid = header.Magic == FileMagic && header.Version == FileVersion && header.RoomSizeX > 0 && header.RoomSizeY > 0
+                && header.EntriesOffset % alignof(Entry) == 0 && header.EntriesOffset + (uint64)header.NumEntries * sizeof(Entry) <= (uint64)DataSize;
+    }
+    if (valid)
+    {
+        Entries = TArrayView<const Entry>((const Entry*)(Data + header.EntriesOffset), header.NumEntries);
+        valid = FCrc::MemCrc32(Entries.GetData(), Entries.Num() * sizeof(Entry)) == header.EntriesChecksum;
+    }
+    if (!valid)
+    {
+        UE_LOG(LogPolicyArchive, Warning, TEXT("%s is not a valid policy archive"), *filePath);
+        Close();
+        return false;
+    }
+    RoomSize = FIntPoint(header.RoomSizeX, header.RoomSizeY);
+    EntriesChecksum = header.EntriesChecksum;
+    EntryLookup.Reserve(Entries.Num());
+    for (int32 e = 0; e < Entries.Num(); ++e)
+    {
+        const Entry& entry = Entries[e];
+        if (entry.Offset + entry.Size <= (uint64)DataSize)
+            EntryLookup.Add(GetEntryKey(entry.GetRoomCoords(), entry.Type), e);
+    }
+    return true;
+}
+
+void PolicyArchive::Close()
+{
+    EntryLookup.Reset();
+    Entries = TArrayView<const Entry>();
+    MappedRegion.Reset();
+    MappedFile.Reset();
+    LoadedBytes.Empty();
+    Data = nullptr;
+    DataSize = 0;
+    RoomSize = FIntPoint(0, 0);
+    EntriesChecksum = 0;
+}
+
+const Entry* PolicyArchive::FindEntry(FIntPoint roomCoords, EEntryType type) const
+{
+    const int32* index = EntryLookup.Find(GetEntryKey(roomCoords, type));
+    return index != nullptr ? &Entries[*index] : nullptr;
+}
+
+TArrayView<const uint8> PolicyArchive::GetPayload(const Entry& entry) const
+{
+    return TArrayView<const uint8>(Data + entry.Offset, entry.Size);
+}
+
+bool PolicyArchive::VerifyEntry(const Entry& entry) const
+{
+    TArrayView<const uint8> payload = GetPayload(entry);
+    return FCrc::MemCrc32(payload.GetData(), payload.Num()) == entry.Checksum;
+}
+
+FDirectionSet PolicyArchive::GetOptimalActions(const Entry& entry, int targetIndex, FIntPoint cell) const
+{
+    if (entry.Type != EEntryType::BehaviourMaps || targetIndex < 0 || targetIndex >= (int)entry.NumTargets
+        || cell.X < 0 || cell.X >= RoomSize.X || cell.Y < 0 || cell.Y >= RoomSize.Y)
+        return FDirectionSet();
+    const int64 index = (int64)targetIndex * GetNumCells(RoomSize) + cell.X * RoomSize.Y + cell.Y;
+    return index < entry.Size ? FDirectionSet(Data[entry.Offset + index]) : FDirectionSet();
+}
+
+bool PolicyArchive::ReadBehaviourMap(const Entry& entry, int targetIndex, BehaviourMap& behaviourMap) const
+{
+    if (entry.Type != EEntryType::BehaviourMaps || entry.Size != entry.NumTargets * GetNumCells(RoomSize) || !VerifyEntry(entry))
+        return false;
+    InitialiseBehaviourMap(behaviourMap, RoomSize.X, RoomSize.Y);
+    for (int x = 0; x < RoomSize.X; ++x)
+        for (int y = 0; y < RoomSize.Y; ++y)
+            behaviourMap[x][y] = GetOptimalActions(entry, targetIndex, FIntPoint(x, y));
+    return true;
+}
+
+bool PolicyArchive::ReadQTables(const Entry& entry, RoomTargetsQValuesRewardsSets& qValuesRewards) const
+{
+    const int32 numCells = GetNumCells(RoomSize);
+    if (entry.Type != EEntryType::QTables || entry.Size != numCells * numCells * QTableFloatsPerCell * sizeof(float) || !VerifyEntry(entry))
+        return false;
+    if (qValuesRewards.Num() != RoomSize.X || qValuesRewards[0].Num() != RoomSize.Y)
+        return false;
+    // Payloads are aligned, so the floats can be read in place.
+    const float* values = (const float*)(Data + entry.Offset);
+    for (int tx = 0; tx < RoomSize.X; ++tx)
+    {
+        for (int ty = 0; ty < RoomSize.Y; ++ty)
+        {
+            for (int x = 0; x < RoomSize.X; ++x)
+            {
+                for (int y = 0; y < RoomSize.Y; ++y)
+                {
+                    Get_mActionQValuesAndRewards_FromRoom(qValuesRewards, FIntPoint(tx, ty), FIntPoint(x, y))
+                        .SetQValuesAndRewards(values, values + (int)EDirectionType::NumDirectionTypes);
+                    values += QTableFloatsPerCell;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool PolicyArchive::ReadRoomLayout(const Entry& entry, ArchivedRoomLayout& layout) const
+{
+    if (entry.Type != EEntryType::RoomLayout || entry.Size != sizeof(RoomLayoutPayload) || !VerifyEntry(entry))
+        return false;
+    RoomLayoutPayload payload;
+    FMemory::Memcpy(&payload, Data + entry.Offset, sizeof(payload));
+    if (payload.NumX > RoomBitboard::MaxSide || payload.NumY > RoomBitboard::MaxSide)
+        return false;
+    layout.DoorPositionsNESW = TArray<int>(payload.DoorPositionsNESW, (int)EDirectionType::NumDirectionTypes);
+    layout.NormedDensity = payload.NormedDensity;
+    layout.NormedComplexity = payload.NormedComplexity;
+    layout.InnerStructure.Init(payload.NumX, payload.NumY);
+    for (uint32 x = 0; x < payload.NumX; ++x)
+        layout.InnerStructure.SetRow(x, payload.Rows[x]);
+    return true;
+}
+
+bool PolicyArchive::ReadEncodedBehaviourMaps(const Entry& entry, EncodedRoomPolicy& encodedPolicy) const
+{
+    if (entry.Type != EEntryType::EncodedBehaviourMaps || !VerifyEntry(entry))
+        return false;
+    const TArrayView<const uint8> payload = GetPayload(entry);
+    return encodedPolicy.SetBytes(TArray<uint8>(payload.GetData(), payload.Num())) && encodedPolicy.GetRoomSize() == RoomSize &&
+           encodedPolicy.GetNumTargets() == (int)entry.NumTargets;
+}
+
+bool PolicyArchive::ConvertTextBehaviourMaps(const TArray<FString>& textFilePaths, const FString& archivePath, bool invertX)
+{
+    TUniquePtr<PolicyArchiveWriter> writer;
+    int nextUnnamedRoomX = 0;
+    for (const FString& textFilePath : textFilePaths)
+    {
+        TArray<FString> lines;
+        if (!FFileHelper::LoadANSITextFileToStrings(*textFilePath, nullptr, lines))
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("Couldn't read %s"), *textFilePath);
+            return false;
+        }
+        // Same layout as LevelBuilderHelpers::FillArrayFromTextFile. Cells without actions are written as -1.
+        BehaviourMap behaviourMap;
+        const int numRows = lines.Num();
+        for (int row = (invertX ? numRows - 1 : 0); (invertX ? row >= 0 : row < numRows); (invertX ? row-- : row++))
+        {
+            TArray<FString> behaviourStrings;
+            lines[row].ParseIntoArray(behaviourStrings, *Delimiters::DirectionSetStringDelimiter, true);
+            if (behaviourStrings.Num() == 0)
+                continue;
+            TArray<FDirectionSet>& behaviourMapRow = behaviourMap.AddDefaulted_GetRef();
+            for (const FString& behaviourString : behaviourStrings)
+            {
+                TArray<FString> actionStrings;
+                behaviourString.ParseIntoArray(actionStrings, *Delimiters::ActionDelimiter, true);
+                FDirectionSet& directionSet = behaviourMapRow.AddDefaulted_GetRef();
+                for (const FString& actionString : actionStrings)
+                {
+                    const int action = FCString::Atoi(*actionString);
+                    if (action >= 0 && action < (int)EDirectionType::NumDirectionTypes)
+                        directionSet.EnableDirection((EDirectionType)action);
+                }
+            }
+        }
+        if (behaviourMap.Num() == 0)
+            continue;
+        const FIntPoint roomSize(behaviourMap.Num(), behaviourMap[0].Num());
+        if (!writer.IsValid())
+            writer = MakeUnique<PolicyArchiveWriter>(roomSize);
+        else if (roomSize != writer->GetRoomSize())
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("%s has a different size from the other behaviour maps"), *textFilePath);
+            return false;
+        }
+
+        TArray<FString> nameParts;
+        FPaths::GetBaseFilename(textFilePath).ParseIntoArray(nameParts, TEXT("_"), true);
+        FIntPoint roomCoords(nextUnnamedRoomX, 0);
+        if (nameParts.Num() >= 2 && nameParts.Last().IsNumeric() && nameParts.Last(1).IsNumeric())
+            roomCoords = FIntPoint(FCString::Atoi(*nameParts.Last(1)), FCString::Atoi(*nameParts.Last()));
+        else
+            ++nextUnnamedRoomX;
+        writer->AddBehaviourMaps(roomCoords, { behaviourMap });
+    }
+    if (!writer.IsValid())
+        return false;
+    return writer->Save(archivePath);
+}
+
+FString PolicyArchive::GetArchivePath(const FString& fileName)
+{
+    if (FPaths::IsRelative(fileName))
+        return FPaths::ProjectSavedDir() / TEXT("Policies") / fileName;
+    return fileName;
+}
+
+//====================================================================================================
+// Console commands
+//====================================================================================================
+
+namespace
+{
+    ATPGameDemoGameState* GetPolicyGameState(UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = world != nullptr ? world->GetGameState<ATPGameDemoGameState>() : nullptr;
+        if (gameState == nullptr)
+            UE_LOG(LogPolicyArchive, Warning, TEXT("No TPGameDemo game state in this world."));
+        return gameState;
+    }
+
+    void SavePolicyArchiveCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetPolicyGameState(world);
+        if (gameState == nullptr || args.Num() == 0)
+            return;
+        const FString filePath = PolicyArchive::GetArchivePath(args[0]);
+        const int32 numRooms = gameState->SavePolicyArchive(filePath);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Saved the policies of %d rooms to %s"), numRooms, *filePath);
+    }
+
+    void LoadPolicyArchiveCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetPolicyGameState(world);
+        if (gameState == nullptr || args.Num() == 0)
+            return;
+        const FString filePath = PolicyArchive::GetArchivePath(args[0]);
+        const double startTime = FPlatformTime::Seconds();
+        PolicyArchive archive;
+        if (!archive.Open(filePath))
+            return;
+        const int32 numRooms = gameState->LoadPolicyArchive(archive);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Loaded the policies of %d rooms from %s in %.2fms (%s)"), numRooms, *filePath,
+               (FPlatformTime::Seconds() - startTime) * 1000.0, archive.IsMapped() ? TEXT("mapped") : TEXT("read"));
+    }
+
+    void ConvertPolicyTextCommand(const TArray<FString>& args)
+    {
+        if (args.Num() < 2)
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("Usage: TPGameDemo.ConvertPolicyText TextFileOrDirectory ArchiveFileName [InvertX]"));
+            return;
+        }
+        TArray<FString> textFilePaths;
+        if (FPaths::DirectoryExists(args[0]))
+        {
+            IFileManager::Get().FindFiles(textFilePaths, *(args[0] / TEXT("*.txt")), true, false);
+            for (FString& textFilePath : textFilePaths)
+                textFilePath = args[0] / textFilePath;
+            textFilePaths.Sort();
+        }
+        else
+        {
+            textFilePaths.Add(args[0]);
+        }
+        const bool invertX = args.Num() > 2 && FCString::ToBool(*args[2]);
+        const FString archivePath = PolicyArchive::GetArchivePath(args[1]);
+        if (PolicyArchive::ConvertTextBehaviourMaps(textFilePaths, archivePath, invertX))
+            UE_LOG(LogPolicyArchive, Display, TEXT("Converted %d behaviour maps to %s"), textFilePaths.Num(), *archivePath);
+    }
+
+    void StreamPolicyArchiveCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetPolicyGameState(world);
+        if (gameState == nullptr)
+            return;
+        if (args.Num() == 0)
+            gameState->StopRoomStreaming();
+        else if (gameState->StartRoomStreaming(args[0]))
+            UE_LOG(LogPolicyArchive, Display, TEXT("Streaming rooms from %s"), *PolicyArchive::GetArchivePath(args[0]));
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs SavePolicyArchiveConsoleCommand(
+        TEXT("TPGameDemo.SavePolicyArchive"),
+        TEXT("Saves the layouts and qvalue tables of every trained room to Saved/Policies. Arguments: FileName"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SavePolicyArchiveCommand));
+
+    FAutoConsoleCommandWithWorldAndArgs LoadPolicyArchiveConsoleCommand(
+        TEXT("TPGameDemo.LoadPolicyArchive"),
+        TEXT("Loads qvalue tables into the rooms that exist and are in the archive. Arguments: FileName"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LoadPolicyArchiveCommand));
+
+    FAutoConsoleCommandWithWorldAndArgs StreamPolicyArchiveConsoleCommand(
+        TEXT("TPGameDemo.StreamPolicyArchive"),
+        TEXT("Streams archived rooms in around the player as they approach. No arguments stops streaming. Arguments: [FileName]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StreamPolicyArchiveCommand));
+
+    FAutoConsoleCommand ConvertPolicyTextConsoleCommand(
+        TEXT("TPGameDemo.ConvertPolicyText"),
+        TEXT("Converts text behaviour maps to a policy archive. Arguments: TextFileOrDirectory ArchiveFileName [InvertX]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&ConvertPolicyTextCommand));
+};
@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+#include "PolicyCodec.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogPolicyArchive, Log, All);
+
+/*
+A policy archive holds the behaviour maps and / or qvalue tables of many rooms in one binary file that can be memory-mapped and
+read in place.
+
+    FileHeader
+    Entry[NumEntries]           one per room and entry type, sorted by room then type
+    payloads                    each aligned to PayloadAlignment, with a CRC32 in its entry
+
+Behaviour map payloads are one direction mask byte per cell, for NumTargets maps of RoomSize cells.
+RoomLayout payloads are the door positions (NESW), density and complexity, then the inner structure size and bitboard rows (RoomLayoutPayload).
+EncodedBehaviourMaps payloads are the behaviour maps of every target, compressed by EncodedRoomPolicy.
+QTable payloads are the qvalues then the rewards of the four actions (8 floats) per cell, for every target position in the room.
+Targets and cells are in x-major order. All values are little-endian.
+*/
+namespace PolicyArchiveFormat
+{
+    constexpr uint32 FileMagic = 0x41505054;
+    constexpr uint32 FileVersion = 1;
+    constexpr int64 PayloadAlignment = 16;
+
+    enum class EEntryType : uint32
+    {
+        BehaviourMaps,
+        QTables,
+        RoomLayout,
+        EncodedBehaviourMaps,
+        NumEntryTypes
+    };
+
+    struct FileHeader
+    {
+        uint32 Magic = FileMagic;
+        uint32 Version = FileVersion;
+        uint32 NumEntries = 0;
+        uint32 EntriesChecksum = 0;
+        int32 RoomSizeX = 0;
+        int32 RoomSizeY = 0;
+        uint64 EntriesOffset = 0;
+    };
+    static_assert(sizeof(FileHeader) == 32, "Policy archive headers are read in place.");
+
+    struct Entry
+    {
+        int32 RoomX = 0;
+        int32 RoomY = 0;
+        EEntryType Type = EEntryType::NumEntryTypes;
+        uint32 NumTargets = 0;
+        uint64 Offset = 0;
+        uint32 Size = 0;
+        uint32 Checksum = 0;
+
+        FIntPoint GetRoomCoords() const { return FIntPoint(RoomX, RoomY); }
+    };
+    static_assert(sizeof(Entry) == 32, "Policy archive entries are read in place.");
+
+    constexpr int32 QTableFloatsPerCell = 2 * (int32)EDirectionType::NumDirectionTypes;
+
+    struct RoomLayoutPayload
+    {
+        int32 DoorPositionsNESW[(int)EDirectionType::NumDirectionTypes] = { -1, -1, -1, -1 };
+        float NormedDensity = 0.0f;
+        float NormedComplexity = 0.0f;
+        uint32 NumX = 0;
+        uint32 NumY = 0;
+        RoomBitboard::RowType Rows[RoomBitboard::MaxSide] = {};
+    };
+};
+
+/* The layout of an archived room. */
+struct ArchivedRoomLayout
+{
+    TArray<int> DoorPositionsNESW;
+    float NormedDensity = 0.0f;
+    float NormedComplexity = 0.0f;
+    RoomBitboard InnerStructure;
+};
+
+/* Builds a policy archive in memory and writes it out. Adding an entry that already exists replaces it. */
+class PolicyArchiveWriter
+{
+public:
+    PolicyArchiveWriter(FIntPoint roomSize) : RoomSize(roomSize) {}
+
+    /* Every map must be RoomSize. */
+    void AddBehaviourMaps(FIntPoint roomCoords, const TArray<BehaviourMap>& behaviourMaps);
+    void AddQTables(FIntPoint roomCoords, const RoomTargetsQValuesRewardsSets& qValuesRewards);
+    void AddRoomLayout(FIntPoint roomCoords, const ArchivedRoomLayout& layout);
+    /* The policy must be RoomSize. */
+    void AddEncodedBehaviourMaps(FIntPoint roomCoords, const EncodedRoomPolicy& encodedPolicy);
+    int32 GetNumEntries() const { return Entries.Num(); }
+    FIntPoint GetRoomSize() const { return RoomSize; }
+
+    bool Save(const FString& filePath) const;
+
+private:
+    struct PendingEntry
+    {
+        PolicyArchiveFormat::Entry Entry;
+        TArray<uint8> Payload;
+    };
+    PendingEntry& AddEntry(FIntPoint roomCoords, PolicyArchiveFormat::EEntryType type, uint32 numTargets);
+
+    FIntPoint RoomSize;
+    TArray<PendingEntry> Entries;
+};
+
+/*
+Read-only access to a policy archive. The file is memory-mapped where the platform supports it, and loaded into memory otherwise.
+Opening only validates the header and entry table, so it costs the same however many rooms the archive holds. Payload checksums are
+checked when an entry is read (or by VerifyEntry).
+*/
+class PolicyArchive
+{
+public:
+    PolicyArchive() {}
+    ~PolicyArchive();
+
+    bool Open(const FString& filePath);
+    void Close();
+
+    bool IsOpen() const { return Data != nullptr; }
+    bool IsMapped() const { return MappedRegion.IsValid(); }
+    FIntPoint GetRoomSize() const { return RoomSize; }
+    /* The checksum of the entry table. Entries hold the checksums of their payloads, so this identifies the archive's contents. */
+    uint32 GetEntriesChecksum() const { return EntriesChecksum; }
+    TArrayView<const PolicyArchiveFormat::Entry> GetEntries() const { return Entries; }
+    const PolicyArchiveFormat::Entry* FindEntry(FIntPoint roomCoords, PolicyArchiveFormat::EEntryType type) const;
+
+    /* The entry's payload, in place. */
+    TArrayView<const uint8> GetPayload(const PolicyArchiveFormat::Entry& entry) const;
+    bool VerifyEntry(const PolicyArchiveFormat::Entry& entry) const;
+
+    /* Reads one cell of a behaviour map in place. Returns an empty set if the target or cell is out of range. */
+    FDirectionSet GetOptimalActions(const PolicyArchiveFormat::Entry& entry, int targetIndex, FIntPoint cell) const;
+    bool ReadBehaviourMap(const PolicyArchiveFormat::Entry& entry, int targetIndex, BehaviourMap& behaviourMap) const;
+    /* qValuesRewards must already be sized for the room (see InitialiseRoomTargetsQValuesRewardsSets). */
+    bool ReadQTables(const PolicyArchiveFormat::Entry& entry, RoomTargetsQValuesRewardsSets& qValuesRewards) const;
+    bool ReadRoomLayout(const PolicyArchiveFormat::Entry& entry, ArchivedRoomLayout& layout) const;
+    bool ReadEncodedBehaviourMaps(const PolicyArchiveFormat::Entry& entry, EncodedRoomPolicy& encodedPolicy) const;
+
+    /*
+    Converts behaviour maps written by LevelBuilderHelpers::WriteArrayToTextFile. Each file becomes a BehaviourMaps entry with one
+    target. Files named like Name_X_Y.txt are stored for room (X, Y); other files are stored for rooms (0, 0), (1, 0), ... in order.
+    */
+    static bool ConvertTextBehaviourMaps(const TArray<FString>& textFilePaths, const FString& archivePath, bool invertX = false);
+
+    /* Relative file names are resolved against Saved/Policies. */
+    static FString GetArchivePath(const FString& fileName);
+
+private:
+    TUniquePtr<IMappedFileHandle> MappedFile;
+    TUniquePtr<IMappedFileRegion> MappedRegion;
+    TArray<uint8> LoadedBytes;
+    const uint8* Data = nullptr;
+    int64 DataSize = 0;
+
+    FIntPoint RoomSize { 0, 0 };
+    uint32 EntriesChecksum = 0;
+    TArrayView<const PolicyArchiveFormat::Entry> Entries;
+    TMap<FIntVector, int32> EntryLookup;
+};
@@ -0,0 +1,310 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "PolicyCodec.h"
+
+namespace
+{
+    constexpr uint8 MaskBits = 0x0F;
+    constexpr uint32 LongRunCode = 15;
+
+    void AppendRuns(const TArray<uint8>& plane, TArray<uint8>& runs)
+    {
+        for (int cell = 0; cell < plane.Num();)
+        {
+            const uint8 mask = plane[cell];
+            int runLength = 1;
+            while (cell + runLength < plane.Num() && plane[cell + runLength] == mask)
+                ++runLength;
+            cell += runLength;
+            const uint32 lengthCode = runLength - 1;
+            if (lengthCode < LongRunCode)
+            {
+                runs.Add(mask | (uint8)(lengthCode << 4));
+                continue;
+            }
+            runs.Add(mask | (uint8)(LongRunCode << 4));
+            for (uint32 extra = runLength - (LongRunCode + 1);; extra >>= 7)
+            {
+                if (extra < 0x80)
+                {
+                    runs.Add((uint8)extra);
+                    break;
+                }
+                runs.Add((uint8)(extra & 0x7F) | 0x80);
+            }
+        }
+    }
+
+    /* Reads the run at runs and advances past it. Returns false if the run is cut short by end. */
+    FORCEINLINE bool ReadRun(const uint8*& runs, const uint8* end, uint8& mask, int& runLength)
+    {
+        const uint8 run = *runs++;
+        mask = run & MaskBits;
+        runLength = (run >> 4) + 1;
+        if ((run >> 4) != LongRunCode)
+            return true;
+        uint32 extra = 0;
+        for (int shift = 0; shift < 32; shift += 7)
+        {
+            if (runs >= end)
+                return false;
+            const uint8 byte = *runs++;
+            extra |= (uint32)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                runLength += (int)extra;
+                return runLength > 0;
+            }
+        }
+        return false;
+    }
+};
+
+//====================================================================================================
+// EncodedRoomPolicy
+//====================================================================================================
+
+void EncodedRoomPolicy::Encode(FIntPoint roomSize, const TArray<BehaviourMap>& behaviourMaps)
+{
+    Reset();
+    const int numCells = roomSize.X * roomSize.Y;
+    ensure(behaviourMaps.Num() <= MAX_uint16);
+
+    TArray<uint16> planeIndices;
+    TArray<uint32> planeOffsets { 0 };
+    TArray<uint8> runs;
+    TArray<TArray<uint8>> dictionary;
+    TMultiMap<uint32, int> dictionaryLookup;
+    TArray<uint8> plane;
+    plane.SetNumUninitialized(numCells);
+    TArray<int> candidates;
+    for (const BehaviourMap& behaviourMap : behaviourMaps)
+    {
+        ensure(behaviourMap.Num() == roomSize.X);
+        for (int x = 0; x < roomSize.X; ++x)
+        {
+            for (int y = 0; y < roomSize.Y; ++y)
+            {
+                const bool inMap = behaviourMap.IsValidIndex(x) && behaviourMap[x].IsValidIndex(y);
+                plane[x * roomSize.Y + y] = inMap ? behaviourMap[x][y].DirectionsMask & MaskBits : 0;
+            }
+        }
+        const uint32 planeHash = FCrc::MemCrc32(plane.GetData(), plane.Num());
+        candidates.Reset();
+        dictionaryLookup.MultiFind(planeHash, candidates);
+        int planeIndex = INDEX_NONE;
+        for (int candidate : candidates)
+        {
+            if (dictionary[candidate] == plane)
+            {
+                planeIndex = candidate;
+                break;
+            }
+        }
+        if (planeIndex == INDEX_NONE)
+        {
+            planeIndex = dictionary.Add(plane);
+            dictionaryLookup.Add(planeHash, planeIndex);
+            AppendRuns(plane, runs);
+            planeOffsets.Add(runs.Num());
+        }
+        planeIndices.Add((uint16)planeIndex);
+    }
+
+    Header header;
+    header.NumX = roomSize.X;
+    header.NumY = roomSize.Y;
+    header.NumTargets = planeIndices.Num();
+    header.NumPlanes = dictionary.Num();
+    planeIndices.SetNumZeroed(Align(planeIndices.Num(), 2));
+    Bytes.Append((const uint8*)&header, sizeof(header));
+    Bytes.Append((const uint8*)planeIndices.GetData(), planeIndices.Num() * sizeof(uint16));
+    Bytes.Append((const uint8*)planeOffsets.GetData(), planeOffsets.Num() * sizeof(uint32));
+    Bytes.Append(runs);
+}
+
+bool EncodedRoomPolicy::SetBytes(TArray<uint8>&& bytes)
+{
+    Bytes = MoveTemp(bytes);
+    if (IsValid())
+        return true;
+    Reset();
+    return false;
+}
+
+void EncodedRoomPolicy::Reset()
+{
+    Bytes.Empty();
+}
+
+bool EncodedRoomPolicy::IsValid() const
+{
+    if (Bytes.Num() < sizeof(Header))
+        return false;
+    const Header& header = GetHeader();
+    if (header.NumX > MAX_uint16 || header.NumY > MAX_uint16 || header.NumTargets > MAX_uint16 || header.NumPlanes > header.NumTargets)
+        return false;
+    const int64 tablesSize = sizeof(Header) + Align(header.NumTargets, 2) * sizeof(uint16) + (header.NumPlanes + 1) * sizeof(uint32);
+    if (Bytes.Num() < tablesSize)
+        return false;
+    for (uint32 t = 0; t < header.NumTargets; ++t)
+        if (GetPlaneIndices()[t] >= header.NumPlanes)
+            return false;
+    const uint32* planeOffsets = GetPlaneOffsets();
+    if (planeOffsets[0] != 0 || planeOffsets[header.NumPlanes] != Bytes.Num() - tablesSize)
+        return false;
+    for (uint32 p = 0; p < header.NumPlanes; ++p)
+        if (planeOffsets[p] > planeOffsets[p + 1])
+            return false;
+    return true;
+}
+
+bool EncodedRoomPolicy::DecodePlane(int targetIndex, uint8* masks) const
+{
+    if (targetIndex < 0 || targetIndex >= GetNumTargets())
+        return false;
+    const int numCells = GetRoomSize().X * GetRoomSize().Y;
+    const uint16 planeIndex = GetPlaneIndices()[targetIndex];
+    const uint8* runs = GetRuns() + GetPlaneOffsets()[planeIndex];
+    const uint8* end = GetRuns() + GetPlaneOffsets()[planeIndex + 1];
+    int cell = 0;
+    while (runs < end)
+    {
+        uint8 mask;
+        int runLength;
+        if (!ReadRun(runs, end, mask, runLength) || runLength > numCells - cell)
+            return false;
+        FMemory::Memset(masks + cell, mask, runLength);
+        cell += runLength;
+    }
+    return cell == numCells;
+}
+
+bool EncodedRoomPolicy::Decode(TArray<BehaviourMap>& behaviourMaps) const
+{
+    const FIntPoint roomSize = GetRoomSize();
+    TArray<uint8> masks;
+    masks.SetNumUninitialized(roomSize.X * roomSize.Y);
+    behaviourMaps.Reset(GetNumTargets());
+    for (int t = 0; t < GetNumTargets(); ++t)
+    {
+        if (!DecodePlane(t, masks.GetData()))
+            return false;
+        BehaviourMap& behaviourMap = behaviourMaps.AddDefaulted_GetRef();
+        behaviourMap.SetNum(roomSize.X);
+        for (int x = 0; x < roomSize.X; ++x)
+        {
+            behaviourMap[x].SetNumUninitialized(roomSize.Y);
+            for (int y = 0; y < roomSize.Y; ++y)
+                behaviourMap[x][y] = FDirectionSet(masks[x * roomSize.Y + y]);
+        }
+    }
+    return true;
+}
+
+FDirectionSet EncodedRoomPolicy::GetOptimalActions(int targetIndex, FIntPoint cell) const
+{
+    const FIntPoint roomSize = GetRoomSize();
+    if (targetIndex < 0 || targetIndex >= GetNumTargets() || cell.X < 0 || cell.X >= roomSize.X || cell.Y < 0 || cell.Y >= roomSize.Y)
+        return FDirectionSet();
+    const uint16 planeIndex = GetPlaneIndices()[targetIndex];
+    const uint8* runs = GetRuns() + GetPlaneOffsets()[planeIndex];
+    const uint8* end = GetRuns() + GetPlaneOffsets()[planeIndex + 1];
+    int remainingCells = cell.X * roomSize.Y + cell.Y;
+    while (runs < end)
+    {
+        uint8 mask;
+        int runLength;
+        if (!ReadRun(runs, end, mask, runLength))
+            break;
+        if (remainingCells < runLength)
+            return FDirectionSet(mask);
+        remainingCells -= runLength;
+    }
+    return FDirectionSet();
+}
+
+//====================================================================================================
+// Console command
+//====================================================================================================
+
+namespace
+{
+    /*
+    Builds a seeded world of trained rooms (see ATPGameDemoGameState::BuildHeadlessRooms), encodes the behaviour maps of every trained
+    room out to the perimeter, and reports the compression ratio and decode throughput.
+    */
+    void MeasurePolicyCodecCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = world != nullptr ? world->GetGameState<ATPGameDemoGameState>() : nullptr;
+        if (gameState == nullptr)
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("No TPGameDemo game state in this world."));
+            return;
+        }
+        const int perimeter = FMath::Clamp(args.Num() > 0 ? FCString::Atoi(*args[0]) : 2, 0, gameState->GetMaxRoomPerimeter());
+        const int32 seed = args.Num() > 1 ? FCString::Atoi(*args[1]) : 1;
+        const int numDecodes = args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*args[2])) : 10;
+        gameState->BuildHeadlessRooms(perimeter, seed, 0.5f, 0.5f);
+        TArray<FIntPoint> rooms;
+        for (int x = -perimeter; x <= perimeter; ++x)
+            for (int y = -perimeter; y <= perimeter; ++y)
+                rooms.Add(FIntPoint(x, y));
+
+        int numRooms = 0;
+        int64 numTargets = 0;
+        int64 numPlanes = 0;
+        int64 decodedBytes = 0;
+        int64 encodedBytes = 0;
+        int64 qTableBytes = 0;
+        double encodeSeconds = 0.0;
+        double decodeSeconds = 0.0;
+        TArray<BehaviourMap> behaviourMaps;
+        TArray<BehaviourMap> decodedMaps;
+        EncodedRoomPolicy encodedPolicy;
+        EncodedRoomPolicy roundTripPolicy;
+        const FIntPoint roomSize(gameState->NumGridUnitsX, gameState->NumGridUnitsY);
+        for (const FIntPoint& roomCoords : rooms)
+        {
+            if (!gameState->GetRoomBehaviourMaps(roomCoords, behaviourMaps))
+                continue;
+            double startTime = FPlatformTime::Seconds();
+            encodedPolicy.Encode(roomSize, behaviourMaps);
+            encodeSeconds += FPlatformTime::Seconds() - startTime;
+
+            startTime = FPlatformTime::Seconds();
+            for (int d = 0; d < numDecodes; ++d)
+                encodedPolicy.Decode(decodedMaps);
+            decodeSeconds += FPlatformTime::Seconds() - startTime;
+            roundTripPolicy.Encode(roomSize, decodedMaps);
+            if (roundTripPolicy.GetBytes() != encodedPolicy.GetBytes())
+                UE_LOG(LogPolicyArchive, Warning, TEXT("Room %s didn't decode to its behaviour maps."), *roomCoords.ToString());
+
+            ++numRooms;
+            numTargets += encodedPolicy.GetNumTargets();
+            numPlanes += encodedPolicy.GetNumPlanes();
+            decodedBytes += encodedPolicy.GetDecodedSize();
+            encodedBytes += encodedPolicy.GetBytes().Num();
+            qTableBytes += GetRoomTargetsQValuesRewardsSetsAllocatedSize(gameState->GetRoomQValuesRewardsSets(roomCoords));
+        }
+        if (numRooms == 0 || encodedBytes == 0)
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("No trained rooms were built."));
+            return;
+        }
+        const double decodedMB = decodedBytes * (double)numDecodes / (1024.0 * 1024.0);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Policy codec, %d rooms (perimeter %d, seed %d):"), numRooms, perimeter, seed);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Dictionary planes: %lld for %lld targets (%.1f%%)"), numPlanes, numTargets, 100.0 * numPlanes / numTargets);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Behaviour maps: %lld bytes -> %lld bytes (%.1fx). QValue tables: %lld bytes (%.1fx)"),
+               decodedBytes, encodedBytes, (double)decodedBytes / encodedBytes, qTableBytes, (double)qTableBytes / encodedBytes);
+        UE_LOG(LogPolicyArchive, Display, TEXT("Encode: %.3fms per room. Decode: %.3fms per room, %.1f MB/s"),
+               encodeSeconds * 1000.0 / numRooms, decodeSeconds * 1000.0 / (numRooms * numDecodes), decodeSeconds > 0.0 ? decodedMB / decodeSeconds : 0.0);
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs MeasurePolicyCodecConsoleCommand(
+        TEXT("TPGameDemo.MeasurePolicyCodec"),
+        TEXT("Builds a seeded world of trained rooms and measures the policy codec on it. Arguments: [Perimeter] [Seed] [NumDecodes]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&MeasurePolicyCodecCommand));
+};
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+/*
+A compressed copy of a room's behaviour maps (the optimal directions of every cell, for every target position), small enough to keep
+in memory for rooms far from the player and to store in a PolicyArchive.
+
+Each behaviour map is a plane of one direction mask per cell, in x-major order. Planes that are identical for several targets are
+stored once, in a dictionary that the targets index into. Each dictionary plane is run-length encoded, one byte per run:
+
+    low 4 bits      direction mask
+    high 4 bits     run length - 1, or 15 for runs of 16 or more, followed by a varint of (run length - 16)
+
+    Header
+    uint16 PlaneIndex[NumTargets]           padded to a multiple of 2
+    uint32 PlaneOffset[NumPlanes + 1]       run bytes of each plane, relative to the first plane
+    run bytes
+
+Targets are in x-major order. All values are little-endian.
+*/
+class EncodedRoomPolicy
+{
+public:
+    struct Header
+    {
+        uint32 NumX = 0;
+        uint32 NumY = 0;
+        uint32 NumTargets = 0;
+        uint32 NumPlanes = 0;
+    };
+    static_assert(sizeof(Header) == 16, "Encoded policy headers are read in place.");
+
+    EncodedRoomPolicy() {}
+
+    /* Every map must be roomSize. */
+    void Encode(FIntPoint roomSize, const TArray<BehaviourMap>& behaviourMaps);
+    /* Takes bytes written by GetBytes. Returns false, and leaves the policy empty, if they aren't a valid encoding. */
+    bool SetBytes(TArray<uint8>&& bytes);
+    void Reset();
+
+    const TArray<uint8>& GetBytes() const { return Bytes; }
+    bool IsEmpty() const { return Bytes.Num() == 0; }
+    FIntPoint GetRoomSize() const { return FIntPoint(GetHeader().NumX, GetHeader().NumY); }
+    int GetNumTargets() const { return GetHeader().NumTargets; }
+    int GetNumPlanes() const { return GetHeader().NumPlanes; }
+    /* The size of the maps uncompressed, at one mask byte per cell. */
+    int64 GetDecodedSize() const { return (int64)GetNumTargets() * GetRoomSize().X * GetRoomSize().Y; }
+
+    /* Decodes one target's masks (x-major, one per cell). masks must hold NumX * NumY bytes. */
+    bool DecodePlane(int targetIndex, uint8* masks) const;
+    bool Decode(TArray<BehaviourMap>& behaviourMaps) const;
+    /* Reads one cell without decoding the whole plane. Returns an empty set if the target or cell is out of range. */
+    FDirectionSet GetOptimalActions(int targetIndex, FIntPoint cell) const;
+
+private:
+    const Header& GetHeader() const
+    {
+        static const Header emptyHeader;
+        return Bytes.Num() >= sizeof(Header) ? *(const Header*)Bytes.GetData() : emptyHeader;
+    }
+    const uint16* GetPlaneIndices() const { return (const uint16*)(Bytes.GetData() + sizeof(Header)); }
+    const uint32* GetPlaneOffsets() const { return (const uint32*)(GetPlaneIndices() + Align(GetNumTargets(), 2)); }
+    const uint8* GetRuns() const { return (const uint8*)(GetPlaneOffsets() + GetNumPlanes() + 1); }
+    bool IsValid() const;
+
+    TArray<uint8> Bytes;
+};
@@ -0,0 +1,516 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "RoomPipeline.h"
+
+//====================================================================================================
+// RoomGeneration
+//====================================================================================================
+
+namespace
+{
+    FIntPoint GetRandomEvenCell(const TArray<TArray<int>>& structure, FRandomStream& randomStream)
+    {
+        const int sizeX = structure.Num();
+        const int sizeY = structure[0].Num();
+
+        int xPos = randomStream.RandRange(0, sizeX / 2) * 2;
+
+        int yPos = randomStream.RandRange(0, sizeY / 2) * 2;
+
+        return FIntPoint(xPos, yPos);
+    }
+};
+
+void RoomGeneration::InitialiseRoomStructure(int sideLength, const TArray<int>& doorPositionsNESW, TArray<TArray<int>>& structure)
+{
+    ensure(doorPositionsNESW.Num() == (int)EDirectionType::NumDirectionTypes);
+    const FIntPoint northDoor = FIntPoint(sideLength - 1, doorPositionsNESW[(int)EDirectionType::North]);
+    const FIntPoint eastDoor  = FIntPoint(doorPositionsNESW[(int)EDirectionType::East], sideLength - 1);
+    const FIntPoint southDoor = FIntPoint(0, doorPositionsNESW[(int)EDirectionType::South]);
+    const FIntPoint westDoor  = FIntPoint(doorPositionsNESW[(int)EDirectionType::West], 0);
+    structure.Empty(sideLength);
+    for (int x = 0; x < sideLength; ++x)
+    {
+        TArray<int> row;
+        row.Reserve(sideLength);
+        for (int y = 0; y < sideLength; ++y)
+        {
+            // inside
+            int cellState = (int)ECellState::Open;
+            // doors
+            FIntPoint p(x, y);
+            if (p == northDoor || p == eastDoor || p == southDoor || p == westDoor)
+            {
+                cellState = (int)ECellState::Door;
+            } // perimiter walls
+            else if (x == 0 || x == sideLength - 1 || y == 0 || y == sideLength - 1)
+            {
+                cellState = (int)ECellState::Closed;
+            }
+            row.Add(cellState);
+        }
+        structure.Add(row);
+    }
+}
+
+void RoomGeneration::GetRoomStructure(int sideLength, const RoomBitboard& innerStructure, const TArray<int>& doorPositionsNESW, TArray<TArray<int>>& structure)
+{
+    InitialiseRoomStructure(sideLength, doorPositionsNESW, structure);
+    LevelBuilderHelpers::BitMaskToArray(innerStructure, structure);
+}
+
+bool RoomGeneration::IsCellTouchingDoorCell(const TArray<TArray<int>>& structure, FIntPoint cellPosition)
+{
+    const int sizeX = structure.Num();
+    ensure(structure.Num() > 0);
+    const int sizeY = structure[0].Num();
+    for (int action = 0; action < (int)EDirectionType::NumDirectionTypes; ++action)
+    {
+        FIntPoint actionTarget = LevelBuilderHelpers::GetTargetPointForAction(cellPosition, (EDirectionType)action);
+        if (LevelBuilderHelpers::GridPositionIsValid(actionTarget, sizeX, sizeY) &&
+            structure[actionTarget.X][actionTarget.Y] == (int)ECellState::Door)
+            return true;
+    }
+    return false;
+}
+
+TArray<FWallSegmentDescriptor> RoomGeneration::GenerateInnerStructure(TArray<TArray<int>>& structure, float normedDensity, float normedComplexity, FRandomStream& randomStream)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_GenerateRoomStructure);
+    TArray<FWallSegmentDescriptor> wallSegments;
+    if (structure.Num() == 0)
+        return wallSegments;
+
+    const int sideLength = structure.Num();
+    const int complexity = int(normedComplexity * (10 * (sideLength)));
+    const int density = int(normedDensity * (FMath::Pow ((sideLength / 2.0f), 2.0f)));
+
+    FWallSegmentDescriptor currentWallSegment = {FIntPoint(0,0), FIntPoint(0,0), EDirectionType::North};
+    int totalSegmentsStarted = 0;
+
+    // Every island section is checked against the cells that are still open, and rejected if it would cut any of them
+    // (including the doors) off from the rest of the room. This keeps every open cell reachable, so none are trained in vain.
+    RoomBitboard walkableCells = LevelBuilderHelpers::GetWalkableCells(structure);
+
+    for (int island = 0; island < density; ++island)
+    {
+        bool wallSegmentInitialized = false;
+        int numWallSegmentsStarted = 0;
+
+        FIntPoint currentIslandPoint = GetRandomEvenCell(structure, randomStream);
+        if (LevelBuilderHelpers::GridPositionIsValid(currentIslandPoint, sideLength, sideLength) &&
+            structure[currentIslandPoint.X][currentIslandPoint.Y] == (int)ECellState::Open &&
+            !IsCellTouchingDoorCell(structure, currentIslandPoint))
+        {
+            for (int islandSection = 0; islandSection < complexity; ++islandSection)
+            {
+                EDirectionType direction = (EDirectionType)randomStream.RandRange(0, (int)EDirectionType::NumDirectionTypes - 1);
+                FIntPoint islandSectionEndTarget = LevelBuilderHelpers::GetTargetPointForAction(currentIslandPoint, direction, 2);
+                if (LevelBuilderHelpers::GridPositionIsValid(islandSectionEndTarget, sideLength, sideLength) &&
+                    structure[islandSectionEndTarget.X][islandSectionEndTarget.Y] == (int)ECellState::Open)
+                {
+                    FIntPoint islandSectionMiddle = LevelBuilderHelpers::GetTargetPointForAction(currentIslandPoint, direction, 1);
+                    RoomBitboard remainingWalkableCells = walkableCells;
+                    remainingWalkableCells.Set(islandSectionEndTarget, false);
+                    remainingWalkableCells.Set(islandSectionMiddle, false);
+                    remainingWalkableCells.Set(currentIslandPoint, false);
+                    if (!IsCellTouchingDoorCell(structure, islandSectionEndTarget) && !IsCellTouchingDoorCell(structure, islandSectionMiddle) &&
+                        LevelBuilderHelpers::AreCellsConnected(remainingWalkableCells))
+                    {
+                        if (!wallSegmentInitialized)
+                        {
+                            currentWallSegment = {currentIslandPoint, islandSectionEndTarget, direction};
+                            wallSegmentInitialized = true;
+                            ++numWallSegmentsStarted;
+                        }
+                        else if (direction == currentWallSegment.Direction)
+                        {
+                            currentWallSegment.End = islandSectionEndTarget;
+                        }
+                        else
+                        {
+                            wallSegments.Add(currentWallSegment);
+                            currentWallSegment = {islandSectionMiddle, islandSectionEndTarget, direction};
+                            ++numWallSegmentsStarted;
+                        }
+                        structure[islandSectionEndTarget.X][islandSectionEndTarget.Y] = (int)ECellState::Closed;
+                        structure[islandSectionMiddle.X][islandSectionMiddle.Y] = (int)ECellState::Closed;
+                        structure[currentIslandPoint.X][currentIslandPoint.Y] = (int)ECellState::Closed;
+                        walkableCells = remainingWalkableCells;
+                        currentIslandPoint = islandSectionEndTarget;
+                    }
+                }
+            }
+            totalSegmentsStarted += numWallSegmentsStarted;
+            if (wallSegments.Num() != totalSegmentsStarted)
+            {
+                ensure(totalSegmentsStarted == wallSegments.Num() + 1);
+                wallSegments.Add(currentWallSegment);
+            }
+        }
+    }
+
+    return wallSegments;
+}
+
+TArray<FWallSegmentDescriptor> RoomGeneration::GetInnerWallSegments(const TArray<TArray<int>>& structure)
+{
+    TArray<FWallSegmentDescriptor> wallSegments;
+    const int sideLength = structure.Num();
+    if (sideLength < 3)
+        return wallSegments;
+    auto IsInnerCellClosed = [&structure, sideLength](int x, int y)
+    {
+        return x > 0 && x < sideLength - 1 && y > 0 && y < sideLength - 1 && structure[x][y] == (int)ECellState::Closed;
+    };
+    RoomBitboard covered(sideLength, sideLength);
+    for (int x = 1; x < sideLength - 1; ++x)
+    {
+        for (int y = 1; y < sideLength - 1; ++y)
+        {
+            if (!IsInnerCellClosed(x, y) || IsInnerCellClosed(x, y - 1))
+                continue;
+            int endY = y;
+            while (IsInnerCellClosed(x, endY + 1))
+                ++endY;
+            if (endY > y)
+            {
+                wallSegments.Add({ FIntPoint(x, y), FIntPoint(x, endY), EDirectionType::East });
+                for (int runY = y; runY <= endY; ++runY)
+                    covered.Set(FIntPoint(x, runY));
+            }
+        }
+    }
+    for (int y = 1; y < sideLength - 1; ++y)
+    {
+        for (int x = 1; x < sideLength - 1; ++x)
+        {
+            if (!IsInnerCellClosed(x, y) || covered.Get(FIntPoint(x, y)))
+                continue;
+            int endX = x;
+            while (IsInnerCellClosed(endX + 1, y) && !covered.Get(FIntPoint(endX + 1, y)))
+                ++endX;
+            wallSegments.Add({ FIntPoint(x, y), FIntPoint(endX, y), EDirectionType::North });
+            x = endX;
+        }
+    }
+    return wallSegments;
+}
+
+//====================================================================================================
+// RoomTraining
+//====================================================================================================
+
+int32 RoomTraining::GetRoomTrainingSeed(int32 seed, FIntPoint roomCoords)
+{
+    return (int32)HashCombine(GetTypeHash(seed), GetTypeHash(roomCoords));
+}
+
+void RoomTraining::TrainGoalPosition(const NavigationEnvironment& navEnvironment, QValuesRewardsSet& qValuesRewards, FIntPoint goalPosition,
+                                     const FTrainingBudget& budget, int32 roomTrainingSeed, const ConvergenceSampleCallback& onConvergenceSample,
+                                     const TArray<float>* cellDangers)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_TrainGoalPosition);
+    for (int x = 0; x < qValuesRewards.Num(); ++x)
+        for (int y = 0; y < qValuesRewards[x].Num(); ++y)
+            qValuesRewards[x][y].ResetQValues();
+
+    if (!Get_ActionTargets(navEnvironment, goalPosition).IsStateValid())
+        return;
+
+    const float maxGoalDistance = sqrt(pow((navEnvironment.Num() - 1), 2.0f) + pow((navEnvironment[0].Num() - 1), 2.0f));
+    TArray<TArray<int>> goalDistances;
+    TrainingMeasurements::GetGoalDistances(navEnvironment, goalPosition, goalDistances);
+    const int maxNumActionsPerSimulation = budget.MaxNumMovementsPerSimulation;
+    // Seeded per room and goal so that training a room is repeatable and doesn't share the global generator between threads.
+    FRandomStream randomStream((int32)HashCombine((uint32)roomTrainingSeed, GetTypeHash(goalPosition)));
+    for (int x = 0; x < navEnvironment.Num(); ++x)
+    {
+        for (int y = 0; y < navEnvironment[0].Num(); ++y)
+        {
+            if (Get_ActionTargets(navEnvironment, FIntPoint(x, y)).IsStateValid() && FIntPoint(x, y) != goalPosition)
+            {
+                TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_SimulateRunBatch);
+                const int goalDistance = goalDistances[x][y];
+                const int numSimulations = budget.GetNumSimulationsForGoalDistance(goalDistance);
+                const bool measurePosition = onConvergenceSample && goalDistance != INDEX_NONE;
+                int numSimulationsToOptimal = INDEX_NONE;
+                int longestGoalReachingRun = 0;
+                bool deltaQConverged = false;
+                int s = 0;
+                float distanceFromGoal = sqrt(pow((goalPosition.X - x), 2.0f) + pow((goalPosition.Y - y), 2.0f));
+                float normedDistanceFromGoal = (distanceFromGoal - 1.0f) / (maxGoalDistance - 1.0f);
+                int actionsTakenConvergenceThreshold = (int)(normedDistanceFromGoal * (budget.ConvergenceNumActionsMax - budget.ConvergenceNumActionsMin))
+                                                       + budget.ConvergenceNumActionsMin;
+                while (!(budget.bStopOnConvergence && deltaQConverged) && s < numSimulations)
+                {
+                    float averageDeltaQ = 0.0f;
+                    int numActionsTaken = 0;
+                    bool goalReached = false;
+                    SimulateRun(navEnvironment, qValuesRewards, goalPosition, FIntPoint(x, y), maxNumActionsPerSimulation, randomStream, averageDeltaQ, numActionsTaken, goalReached,
+                                cellDangers);
+                    deltaQConverged = numActionsTaken >= actionsTakenConvergenceThreshold && averageDeltaQ <= budget.DeltaQConvergenceThreshold;
+                    ++s;
+                    if (measurePosition && numSimulationsToOptimal == INDEX_NONE)
+                    {
+                        if (goalReached)
+                            longestGoalReachingRun = FMath::Max(longestGoalReachingRun, numActionsTaken);
+                        if (TrainingMeasurements::IsPolicyOptimalFromPosition(navEnvironment, qValuesRewards, FIntPoint(x, y), goalDistances))
+                            numSimulationsToOptimal = s;
+                    }
+                }
+                INC_DWORD_STAT_BY(STAT_SimulatedRuns, s);
+                Get_mActionQValuesAndRewards(qValuesRewards, FIntPoint(x, y)).SetNumExplorations(s);
+                if (measurePosition)
+                    onConvergenceSample(goalDistance, numSimulationsToOptimal, longestGoalReachingRun);
+            }
+        }
+    }
+}
+
+void RoomTraining::SimulateRun(const NavigationEnvironment& navEnvironment, QValuesRewardsSet& qValuesRewards, FIntPoint goalPosition, FIntPoint startingPosition,
+                               int maxNumActions, FRandomStream& randomStream, float& averageDeltaQ, int& numActionsTaken, bool& goalReached,
+                               const TArray<float>* cellDangers)
+{
+    const int sizeY = navEnvironment.Num() > 0 ? navEnvironment[0].Num() : 0;
+    numActionsTaken = 0;
+    averageDeltaQ = 0.0f;
+    goalReached = startingPosition == goalPosition;
+    FIntPoint currentPosition = startingPosition;
+    while (numActionsTaken < maxNumActions && !goalReached)
+    {
+        FDirectionSet optimalActions;
+        ActionQValuesAndRewards& currentQValuesRewards = Get_mActionQValuesAndRewards(qValuesRewards, currentPosition);
+        const ActionTargets& targets = Get_ActionTargets(navEnvironment, currentPosition);
+        currentQValuesRewards.GetOptimalQValueAndActions(optimalActions);
+        ensure(optimalActions.IsValid());
+        EDirectionType actionToTake = optimalActions.ChooseDirection(randomStream);
+        FDirectionSet dummyNextActions;
+        FRoomPositionPair actionTarget = targets.GetActionTarget(actionToTake);
+        const float maxNextReward = Get_ActionQValuesAndRewards(qValuesRewards, actionTarget.PositionInRoom).GetOptimalQValueAndActions(dummyNextActions);
+        const float currentQValue = currentQValuesRewards.GetQValues()[(int)actionToTake];
+        const float discountedNextReward = GridTrainingConstants::SimDiscountFactor * maxNextReward;
+        float immediateReward = currentQValuesRewards.GetRewards()[(int)actionToTake];
+        if (cellDangers != nullptr)
+            immediateReward += GridTrainingConstants::DangerCost * (*cellDangers)[actionTarget.PositionInRoom.X * sizeY + actionTarget.PositionInRoom.Y];
+        const float deltaQ = GridTrainingConstants::SimLearningRate * (immediateReward + discountedNextReward - currentQValue);
+        averageDeltaQ += deltaQ;
+        currentQValuesRewards.UpdateQValue(actionToTake, GridTrainingConstants::SimLearningRate, deltaQ);
+#pragma message("Careful here! This assumes the room never changes, during training. If we come back and train a room again after the doors have been unlocked, the actionTarget's RoomCoords may be different here!")
+        currentPosition = actionTarget.PositionInRoom;
+        ++numActionsTaken;
+        if (currentPosition == goalPosition)
+            goalReached = true;
+    }
+    if (numActionsTaken > 0)
+        averageDeltaQ /= (float)numActionsTaken;
+}
+
+bool RoomTraining::TrainRoom(const NavigationEnvironment& navEnvironment, RoomTargetsQValuesRewardsSets& roomQValuesRewards, const FTrainingBudget& budget,
+                             int32 roomTrainingSeed, const FThreadSafeBool* shouldCancel, const TArray<float>* cellDangers,
+                             const ConvergenceSampleCallback& onConvergenceSample)
+{
+    for (int x = 0; x < roomQValuesRewards.Num(); ++x)
+    {
+        for (int y = 0; y < roomQValuesRewards[x].Num(); ++y)
+        {
+            if (shouldCancel != nullptr && *shouldCancel)
+                return false;
+            TrainGoalPosition(navEnvironment, Get_mQValuesRewardsSet_For_GoalPosition(roomQValuesRewards, FIntPoint(x, y)), FIntPoint(x, y), budget,
+                              roomTrainingSeed, onConvergenceSample, cellDangers);
+        }
+    }
+    return true;
+}
+
+//====================================================================================================
+// RoomPipeline
+//====================================================================================================
+
+static FThreadSafeCounter PipelineThreadCounter;
+
+RoomPipeline::RoomPipeline()
+{
+    WaitEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+RoomPipeline::~RoomPipeline()
+{
+    Shutdown();
+    FPlatformProcess::ReturnSynchEventToPool(WaitEvent);
+    WaitEvent = nullptr;
+}
+
+void RoomPipeline::Start()
+{
+    if (PipelineThread != nullptr)
+        return;
+    ThreadShouldExit = false;
+    FString ThreadName(FString::Printf(TEXT("RoomPipelineThread%i"), PipelineThreadCounter.Increment()));
+    PipelineThread = FRunnableThread::Create(this, *ThreadName, 0, EThreadPriority::TPri_Lowest);
+}
+
+void RoomPipeline::Shutdown()
+{
+    CancelAll();
+    if (PipelineThread != nullptr)
+    {
+        Stop();
+        PipelineThread->WaitForCompletion();
+        delete PipelineThread;
+        PipelineThread = nullptr;
+    }
+}
+
+void RoomPipeline::QueueRoom(const RoomPackageRequest& request)
+{
+    {
+        FScopeLock lock(&PipelineSection);
+        if (FinishedPackages.Contains(request.RoomCoords) || (IsBuilding && CurrentRoomCoords == request.RoomCoords))
+            return;
+        for (const RoomPackageRequest& queued : Requests)
+            if (queued.RoomCoords == request.RoomCoords)
+                return;
+        Requests.Add(request);
+    }
+    WaitEvent->Trigger();
+}
+
+void RoomPipeline::CancelRoom(FIntPoint roomCoords)
+{
+    FScopeLock lock(&PipelineSection);
+    Requests.RemoveAll([roomCoords](const RoomPackageRequest& request) { return request.RoomCoords == roomCoords; });
+    FinishedPackages.Remove(roomCoords);
+    if (IsBuilding && CurrentRoomCoords == roomCoords)
+        CancelCurrent = true;
+}
+
+void RoomPipeline::CancelAll()
+{
+    FScopeLock lock(&PipelineSection);
+    Requests.Empty();
+    FinishedPackages.Empty();
+    if (IsBuilding)
+        CancelCurrent = true;
+}
+
+void RoomPipeline::SetPriorityCenter(FIntPoint center)
+{
+    FScopeLock lock(&PipelineSection);
+    PriorityCenter = center;
+}
+
+bool RoomPipeline::IsRoomStaged(FIntPoint roomCoords)
+{
+    FScopeLock lock(&PipelineSection);
+    return FinishedPackages.Contains(roomCoords);
+}
+
+TSharedPtr<RoomPackage> RoomPipeline::TakeFinishedPackage(FIntPoint roomCoords)
+{
+    FScopeLock lock(&PipelineSection);
+    TSharedPtr<RoomPackage> package;
+    FinishedPackages.RemoveAndCopyValue(roomCoords, package);
+    return package;
+}
+
+/* FRunnable interface */
+bool RoomPipeline::Init()
+{
+    return true;
+}
+
+uint32 RoomPipeline::Run()
+{
+    ensure(!IsInGameThread());
+    while (!ThreadShouldExit)
+    {
+        RoomPackageRequest request;
+        bool hasRequest = false;
+        {
+            FScopeLock lock(&PipelineSection);
+            if (Requests.Num() > 0)
+            {
+                auto GetDistance = [this](const RoomPackageRequest& queued)
+                {
+                    const FIntPoint offset = queued.RoomCoords - PriorityCenter;
+                    return FMath::Max(FMath::Abs(offset.X), FMath::Abs(offset.Y));
+                };
+                int next = 0;
+                for (int r = 1; r < Requests.Num(); ++r)
+                    if (GetDistance(Requests[r]) < GetDistance(Requests[next]))
+                        next = r;
+                request = Requests[next];
+                Requests.RemoveAt(next);
+                CurrentRoomCoords = request.RoomCoords;
+                IsBuilding = true;
+                CancelCurrent = false;
+                hasRequest = true;
+            }
+        }
+        if (!hasRequest)
+        {
+            WaitEvent->Wait();
+            continue;
+        }
+        TSharedPtr<RoomPackage> package = BuildPackage(request, &CancelCurrent);
+        FScopeLock lock(&PipelineSection);
+        if (package.IsValid() && !CancelCurrent)
+            FinishedPackages.Add(request.RoomCoords, package);
+        IsBuilding = false;
+    }
+    return 0;
+}
+
+void RoomPipeline::Stop()
+{
+    ThreadShouldExit = true;
+    CancelCurrent = true;
+    WaitEvent->Trigger();
+}
+
+void RoomPipeline::Exit()
+{
+    ThreadShouldExit = true;
+}
+
+TSharedPtr<RoomPackage> RoomPipeline::BuildPackage(const RoomPackageRequest& request, const FThreadSafeBool* shouldCancel)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_BuildRoomPackage);
+    TSharedPtr<RoomPackage> package = MakeShareable(new RoomPackage());
+    package->Request = request;
+
+    // Generate layout.
+    FRandomStream randomStream(request.Seed);
+    RoomGeneration::InitialiseRoomStructure(request.SideLength, request.DoorPositionsNESW, package->Structure);
+    package->WallSegments = RoomGeneration::GenerateInnerStructure(package->Structure, request.NormedDensity, request.NormedComplexity, randomStream);
+    if (shouldCancel != nullptr && *shouldCancel)
+        return nullptr;
+
+    // Build the nav environment, as UpdateEnvironmentForLevel would once the room is built.
+    RoomActionMasks actionMasks;
+    actionMasks.Initialise(LevelBuilderHelpers::GetWalkableCells(package->Structure));
+    NavigationEnvironment navEnvironment;
+    GetNavigationEnvironmentForActionMasks(actionMasks, request.RoomCoords, navEnvironment);
+
+    // Train.
+    if (request.Turrets.Num() > 0)
+        DangerField::GetCellDangers(actionMasks, request.Turrets, package->CellDangers);
+    InitialiseRoomTargetsQValuesRewardsSets(package->QValuesRewardsSets, request.SideLength, request.SideLength);
+    // Each package is built on one thread, so the samples can be gathered without locking.
+    RoomTraining::ConvergenceSampleCallback onConvergenceSample;
+    if (request.MeasureConvergence)
+    {
+        TArray<TrainingBudgetTuner::ConvergenceSample>& samples = package->ConvergenceSamples;
+        onConvergenceSample = [&samples](int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun)
+        {
+            samples.Add({ goalDistance, numSimulationsToOptimal, longestGoalReachingRun });
+        };
+    }
+    if (!RoomTraining::TrainRoom(navEnvironment, package->QValuesRewardsSets, request.TrainingBudget,
+                                 RoomTraining::GetRoomTrainingSeed(request.Seed, request.RoomCoords), shouldCancel,
+                                 package->CellDangers.Num() > 0 ? &package->CellDangers : nullptr, onConvergenceSample))
+        return nullptr;
+    return package;
+}
@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+#include "Runnable.h"
+#include "LevelBuilderComponent.h"
+#include "DangerField.h"
+#include "TrainingBudgetTuner.h"
+
+//====================================================================================================
+// RoomGeneration
+//====================================================================================================
+
+/* Room layout generation that only depends on its inputs, so it can run on any thread. */
+namespace RoomGeneration
+{
+    /* Fills structure with a sideLength x sideLength room of open cells, closed perimeter walls and doors at the given positions along each wall. */
+    void InitialiseRoomStructure(int sideLength, const TArray<int>& doorPositionsNESW, TArray<TArray<int>>& structure);
+
+    /* Fills structure with a room's perimeter walls and doors, and the inner structure stored for it in the game state. */
+    void GetRoomStructure(int sideLength, const RoomBitboard& innerStructure, const TArray<int>& doorPositionsNESW, TArray<TArray<int>>& structure);
+
+    /* Places random wall islands in the open cells of structure. Islands never touch doors and never disconnect any open cells. */
+    TArray<FWallSegmentDescriptor> GenerateInnerStructure(TArray<TArray<int>>& structure, float normedDensity, float normedComplexity, FRandomStream& randomStream);
+
+    bool IsCellTouchingDoorCell(const TArray<TArray<int>>& structure, FIntPoint cellPosition);
+
+    /* Rebuilds wall segments for the closed inner cells of a structure that wasn't generated here (e.g. one loaded from a PolicyArchive).
+       Closed cells are covered by East runs along each row, then by North runs, then by single cell segments. */
+    TArray<FWallSegmentDescriptor> GetInnerWallSegments(const TArray<TArray<int>>& structure);
+};
+
+//====================================================================================================
+// RoomTraining
+//====================================================================================================
+
+/* The Q-Learning trainer core. Works on a nav environment and qvalues that the caller owns, so it can run on any thread. */
+namespace RoomTraining
+{
+    /* Called once per measured starting position while the training budget is being tuned. See TrainingBudgetTuner. */
+    typedef TFunction<void(int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun)> ConvergenceSampleCallback;
+
+    /* The seed of a room's training, from the seed the room was requested with (or the world seed) and its coords. */
+    int32 GetRoomTrainingSeed(int32 seed, FIntPoint roomCoords);
+
+    /* Resets qValuesRewards and trains them for goalPosition from every valid starting position. cellDangers, if given, is the room's
+       DangerField danger in x-major order. Moving into a cell then costs GridTrainingConstants::DangerCost per unit of danger.
+       Explorations are drawn from roomTrainingSeed combined with the goal, so training is repeatable on any thread. */
+    void TrainGoalPosition(const NavigationEnvironment& navEnvironment, QValuesRewardsSet& qValuesRewards, FIntPoint goalPosition,
+                           const FTrainingBudget& budget, int32 roomTrainingSeed, const ConvergenceSampleCallback& onConvergenceSample = nullptr,
+                           const TArray<float>* cellDangers = nullptr);
+
+    /* Simulate a run through the room, keeping track of the average deltaQ and the num actions taken (these are used to measure convergence). */
+    void SimulateRun(const NavigationEnvironment& navEnvironment, QValuesRewardsSet& qValuesRewards, FIntPoint goalPosition, FIntPoint startingPosition,
+                     int maxNumActions, FRandomStream& randomStream, float& averageDeltaQ, int& numActionsTaken, bool& goalReached,
+                     const TArray<float>* cellDangers = nullptr);
+
+    /* Trains every goal position in the room. Returns false if shouldCancel was set before training finished. */
+    bool TrainRoom(const NavigationEnvironment& navEnvironment, RoomTargetsQValuesRewardsSets& roomQValuesRewards, const FTrainingBudget& budget,
+                   int32 roomTrainingSeed, const FThreadSafeBool* shouldCancel = nullptr, const TArray<float>* cellDangers = nullptr,
+                   const ConvergenceSampleCallback& onConvergenceSample = nullptr);
+};
+
+//====================================================================================================
+// RoomPipeline
+//====================================================================================================
+
+/* Everything needed to generate and train a room ahead of time. Door positions are fixed when the request is made. */
+struct RoomPackageRequest
+{
+    FIntPoint RoomCoords { 0, 0 };
+    int SideLength = 0;
+    TArray<int> DoorPositionsNESW;
+    float NormedDensity = 0.0f;
+    float NormedComplexity = 0.0f;
+    int32 Seed = 0;
+    FTrainingBudget TrainingBudget;
+    /* The turrets already placed in the room. Their danger is trained into the room once its structure has been generated. */
+    TArray<DangerField::Turret> Turrets;
+    /* Set while the training budget is being tuned, so that the room's convergence is measured as the LevelTrainerComponent would. */
+    bool MeasureConvergence = false;
+};
+
+/* A generated and trained room, ready to be committed to the game state when the room is enabled. */
+struct RoomPackage
+{
+    RoomPackageRequest Request;
+    TArray<TArray<int>> Structure;
+    TArray<FWallSegmentDescriptor> WallSegments;
+    RoomTargetsQValuesRewardsSets QValuesRewardsSets;
+    /* The danger of each cell the room was trained against (see DangerField), or empty if it had no turrets. */
+    TArray<float> CellDangers;
+    /* Filled if the request measured convergence. The game state hands these to its TrainingBudgetTuner when the package is used. */
+    TArray<TrainingBudgetTuner::ConvergenceSample> ConvergenceSamples;
+};
+
+/*
+Generates and trains rooms on a background thread before they are opened. Queued requests are handled nearest first to the priority
+center (usually the player's room, by Chebyshev room distance as in RoomStreamer), and in the order they were queued at equal distance.
+Finished packages are kept until they are taken, or until the room is cancelled.
+*/
+class RoomPipeline : public FRunnable
+{
+public:
+    RoomPipeline();
+    ~RoomPipeline();
+
+    void Start();
+    void Shutdown();
+
+    /* Queues a room, unless it is already queued, being built, or finished. */
+    void QueueRoom(const RoomPackageRequest& request);
+    /* Drops any queued, in-progress or finished package for the room. */
+    void CancelRoom(FIntPoint roomCoords);
+    void CancelAll();
+    /* Sets the room that queued requests are built nearest to. The room being built isn't affected. */
+    void SetPriorityCenter(FIntPoint center);
+
+    bool IsRoomStaged(FIntPoint roomCoords);
+    /* Removes and returns the finished package for the room, or nullptr if it is not finished. */
+    TSharedPtr<RoomPackage> TakeFinishedPackage(FIntPoint roomCoords);
+
+    // FRunnable interface.
+    virtual bool   Init() override;
+    virtual uint32 Run()  override;
+    virtual void   Stop() override;
+    virtual void   Exit() override;
+
+    /* Generates and trains a room on the calling thread. Returns nullptr if shouldCancel was set before it finished. */
+    static TSharedPtr<RoomPackage> BuildPackage(const RoomPackageRequest& request, const FThreadSafeBool* shouldCancel = nullptr);
+
+private:
+
+    TArray<RoomPackageRequest> Requests;
+    TMap<FIntPoint, TSharedPtr<RoomPackage>> FinishedPackages;
+    FIntPoint CurrentRoomCoords { 0, 0 };
+    FIntPoint PriorityCenter { 0, 0 };
+    bool IsBuilding = false;
+
+    FCriticalSection PipelineSection;
+    FThreadSafeBool CancelCurrent = false;
+    FThreadSafeBool ThreadShouldExit = false;
+    FEvent* WaitEvent = nullptr;
+    FRunnableThread* PipelineThread = nullptr;
+};
@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "RoomStreamer.h"
+
+static FThreadSafeCounter StreamerThreadCounter;
+
+//====================================================================================================
+// RoomStreamer::Worker
+//====================================================================================================
+RoomStreamer::Worker::Worker(RoomStreamer& owner)
+    : Owner(owner)
+{
+    WaitEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+RoomStreamer::Worker::~Worker()
+{
+    Shutdown();
+    FPlatformProcess::ReturnSynchEventToPool(WaitEvent);
+    WaitEvent = nullptr;
+}
+
+void RoomStreamer::Worker::Start()
+{
+    if (WorkerThread != nullptr)
+        return;
+    ThreadShouldExit = false;
+    FString ThreadName(FString::Printf(TEXT("RoomStreamerThread%i"), StreamerThreadCounter.Increment()));
+    WorkerThread = FRunnableThread::Create(this, *ThreadName, 0, EThreadPriority::TPri_BelowNormal);
+}
+
+void RoomStreamer::Worker::Shutdown()
+{
+    if (WorkerThread != nullptr)
+    {
+        Stop();
+        WorkerThread->WaitForCompletion();
+        delete WorkerThread;
+        WorkerThread = nullptr;
+    }
+}
+
+/* FRunnable interface */
+uint32 RoomStreamer::Worker::Run()
+{
+    ensure(!IsInGameThread());
+    while (!ThreadShouldExit)
+    {
+        FIntPoint roomCoords;
+        if (!Owner.TakeNextRequest(roomCoords))
+        {
+            WaitEvent->Wait();
+            continue;
+        }
+        Owner.FinishRequest(roomCoords, DecodeRoom(*Owner.Archive, roomCoords));
+    }
+    return 0;
+}
+
+void RoomStreamer::Worker::Stop()
+{
+    ThreadShouldExit = true;
+    WaitEvent->Trigger();
+}
+
+//====================================================================================================
+// RoomStreamer
+//====================================================================================================
+RoomStreamer::RoomStreamer()
+{}
+
+RoomStreamer::~RoomStreamer()
+{
+    Shutdown();
+}
+
+bool RoomStreamer::Start(const FString& archivePath, int numWorkers)
+{
+    Shutdown();
+    TSharedPtr<PolicyArchive, ESPMode::ThreadSafe> archive = MakeShared<PolicyArchive, ESPMode::ThreadSafe>();
+    if (!archive->Open(archivePath))
+        return false;
+    Archive = archive;
+    for (int w = 0; w < FMath::Max(numWorkers, 1); ++w)
+    {
+        Workers.Add(MakeUnique<Worker>(*this));
+        Workers.Last()->Start();
+    }
+    return true;
+}
+
+void RoomStreamer::Shutdown()
+{
+    CancelAll();
+    for (TUniquePtr<Worker>& worker : Workers)
+        worker->Shutdown();
+    Workers.Empty();
+    FinishedPackages.Empty();
+    InProgressRooms.Empty();
+    CancelledInProgressRooms.Empty();
+    Archive.Reset();
+}
+
+bool RoomStreamer::IsRoomArchived(FIntPoint roomCoords) const
+{
+    return Archive.IsValid() && Archive->FindEntry(roomCoords, PolicyArchiveFormat::EEntryType::RoomLayout) != nullptr;
+}
+
+void RoomStreamer::QueueRoom(FIntPoint roomCoords, int priority)
+{
+    if (!IsRoomArchived(roomCoords))
+        return;
+    {
+        FScopeLock lock(&StreamerSection);
+        if (InProgressRooms.Contains(roomCoords))
+        {
+            // Wanted again before the cancelled decode finished.
+            CancelledInProgressRooms.Remove(roomCoords);
+            return;
+        }
+        for (StreamRequest& queued : Requests)
+        {
+            if (queued.RoomCoords == roomCoords)
+            {
+                queued.Priority = priority;
+                return;
+            }
+        }
+        Requests.Add({ roomCoords, priority });
+    }
+    for (TUniquePtr<Worker>& worker : Workers)
+        worker->Wake();
+}
+
+void RoomStreamer::CancelRoom(FIntPoint roomCoords)
+{
+    FScopeLock lock(&StreamerSection);
+    Requests.RemoveAll([roomCoords](const StreamRequest& request) { return request.RoomCoords == roomCoords; });
+    if (InProgressRooms.Contains(roomCoords))
+        CancelledInProgressRooms.Add(roomCoords);
+}
+
+void RoomStreamer::CancelOutsideRadius(FIntPoint center, int radius)
+{
+    auto IsOutside = [center, radius](FIntPoint roomCoords)
+    {
+        return FMath::Max(FMath::Abs(roomCoords.X - center.X), FMath::Abs(roomCoords.Y - center.Y)) > radius;
+    };
+    FScopeLock lock(&StreamerSection);
+    Requests.RemoveAll([&IsOutside](const StreamRequest& request) { return IsOutside(request.RoomCoords); });
+    for (FIntPoint roomCoords : InProgressRooms)
+        if (IsOutside(roomCoords))
+            CancelledInProgressRooms.Add(roomCoords);
+}
+
+void RoomStreamer::CancelAll()
+{
+    FScopeLock lock(&StreamerSection);
+    Requests.Empty();
+    CancelledInProgressRooms.Append(InProgressRooms);
+}
+
+bool RoomStreamer::TryTakeFinished(TSharedPtr<RoomPackage>& package)
+{
+    return FinishedPackages.Dequeue(package);
+}
+
+bool RoomStreamer::TakeNextRequest(FIntPoint& roomCoords)
+{
+    FScopeLock lock(&StreamerSection);
+    if (Requests.Num() == 0)
+        return false;
+    int next = 0;
+    for (int r = 1; r < Requests.Num(); ++r)
+        if (Requests[r].Priority < Requests[next].Priority)
+            next = r;
+    roomCoords = Requests[next].RoomCoords;
+    Requests.RemoveAtSwap(next);
+    InProgressRooms.Add(roomCoords);
+    return true;
+}
+
+void RoomStreamer::FinishRequest(FIntPoint roomCoords, TSharedPtr<RoomPackage> package)
+{
+    FScopeLock lock(&StreamerSection);
+    InProgressRooms.Remove(roomCoords);
+    const bool wasCancelled = CancelledInProgressRooms.Remove(roomCoords) > 0;
+    if (package.IsValid() && !wasCancelled)
+        FinishedPackages.Enqueue(package);
+}
+
+TSharedPtr<RoomPackage> RoomStreamer::DecodeRoom(const PolicyArchive& archive, FIntPoint roomCoords)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_DecodeStreamedRoom);
+    const PolicyArchiveFormat::Entry* layoutEntry = archive.FindEntry(roomCoords, PolicyArchiveFormat::EEntryType::RoomLayout);
+    const PolicyArchiveFormat::Entry* qTablesEntry = archive.FindEntry(roomCoords, PolicyArchiveFormat::EEntryType::QTables);
+    const FIntPoint roomSize = archive.GetRoomSize();
+    ArchivedRoomLayout layout;
+    if (layoutEntry == nullptr || qTablesEntry == nullptr || roomSize.X != roomSize.Y || !archive.ReadRoomLayout(*layoutEntry, layout))
+        return nullptr;
+
+    TSharedPtr<RoomPackage> package = MakeShareable(new RoomPackage());
+    RoomPackageRequest& request = package->Request;
+    request.RoomCoords = roomCoords;
+    request.SideLength = roomSize.X;
+    request.DoorPositionsNESW = layout.DoorPositionsNESW;
+    request.NormedDensity = layout.NormedDensity;
+    request.NormedComplexity = layout.NormedComplexity;
+    RoomGeneration::GetRoomStructure(request.SideLength, layout.InnerStructure, request.DoorPositionsNESW, package->Structure);
+    package->WallSegments = RoomGeneration::GetInnerWallSegments(package->Structure);
+
+    InitialiseRoomTargetsQValuesRewardsSets(package->QValuesRewardsSets, roomSize.X, roomSize.Y);
+    if (!archive.ReadQTables(*qTablesEntry, package->QValuesRewardsSets))
+        return nullptr;
+    return package;
+}
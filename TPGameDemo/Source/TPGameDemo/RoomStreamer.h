@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+#include "Runnable.h"
+#include "Containers/Queue.h"
+#include "RoomPipeline.h"
+#include "PolicyArchive.h"
+
+/*
+Streams archived rooms (layout and qvalue tables, see PolicyArchive) in on background threads, so rooms near the player are ready
+before they are opened.
+
+Each request has a priority, and workers always take the queued request with the lowest value (e.g. the room distance from the player).
+Workers read and decode the archive entries into RoomPackages that can be committed like staged rooms, and hand them back to the
+game thread through a queue. Requests can be reprioritised or cancelled at any time; cancelled rooms that are already being decoded
+are dropped when they finish.
+*/
+class RoomStreamer
+{
+public:
+    static constexpr int DefaultNumWorkers = 2;
+
+    RoomStreamer();
+    ~RoomStreamer();
+
+    /* Opens the archive and starts the workers. Returns false if the archive can't be opened. */
+    bool Start(const FString& archivePath, int numWorkers = DefaultNumWorkers);
+    void Shutdown();
+
+    bool IsRunning() const { return Workers.Num() > 0; }
+    /* The room size of the open archive. */
+    FIntPoint GetRoomSize() const { return Archive.IsValid() ? Archive->GetRoomSize() : FIntPoint(0, 0); }
+    /* Whether the archive holds a layout for the room. */
+    bool IsRoomArchived(FIntPoint roomCoords) const;
+
+    /* Queues a room, or updates its priority if it is already queued. Rooms that are being decoded are ignored. */
+    void QueueRoom(FIntPoint roomCoords, int priority);
+    void CancelRoom(FIntPoint roomCoords);
+    /* Cancels every queued or in-progress room further than radius rooms (Chebyshev distance) from center. */
+    void CancelOutsideRadius(FIntPoint center, int radius);
+    void CancelAll();
+
+    /* Pops one finished package. Game thread only. */
+    bool TryTakeFinished(TSharedPtr<RoomPackage>& package);
+
+    /* Decodes an archived room on the calling thread. Returns nullptr if the room isn't archived or its entries are corrupt. */
+    static TSharedPtr<RoomPackage> DecodeRoom(const PolicyArchive& archive, FIntPoint roomCoords);
+
+private:
+    class Worker : public FRunnable
+    {
+    public:
+        Worker(RoomStreamer& owner);
+        ~Worker();
+
+        void Start();
+        void Shutdown();
+        void Wake() { WaitEvent->Trigger(); }
+
+        // FRunnable interface.
+        virtual uint32 Run()  override;
+        virtual void   Stop() override;
+
+    private:
+        RoomStreamer& Owner;
+        FThreadSafeBool ThreadShouldExit = false;
+        FEvent* WaitEvent = nullptr;
+        FRunnableThread* WorkerThread = nullptr;
+    };
+
+    struct StreamRequest
+    {
+        FIntPoint RoomCoords { 0, 0 };
+        int Priority = 0;
+    };
+
+    /* Removes the highest priority request and marks it in progress. Returns false if there are none. */
+    bool TakeNextRequest(FIntPoint& roomCoords);
+    void FinishRequest(FIntPoint roomCoords, TSharedPtr<RoomPackage> package);
+
+    TSharedPtr<PolicyArchive, ESPMode::ThreadSafe> Archive;
+    TArray<TUniquePtr<Worker>> Workers;
+
+    FCriticalSection StreamerSection;
+    TArray<StreamRequest> Requests;
+    TSet<FIntPoint> InProgressRooms;
+    TSet<FIntPoint> CancelledInProgressRooms;
+    TQueue<TSharedPtr<RoomPackage>, EQueueMode::Mpsc> FinishedPackages;
+};
@@ -0,0 +1,555 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "SessionRecording.h"
+
+DEFINE_LOG_CATEGORY(LogSessionRecording);
+
+using namespace SessionRecording;
+
+namespace
+{
+    FString GetSessionFilePath(const FString& fileName)
+    {
+        if (FPaths::IsRelative(fileName))
+            return FPaths::ProjectSavedDir() / TEXT("Sessions") / fileName;
+        return fileName;
+    }
+};
+
+//====================================================================================================
+// SessionRecorder
+//====================================================================================================
+
+SessionRecorder::SessionRecorder(const FString& filePath, const Header& header)
+    : FilePath(filePath)
+{
+    ByteWriter writer(Bytes);
+    writer.WriteVarUInt(FileMagic);
+    writer.WriteVarUInt(FileVersion);
+    writer.WriteVarInt(header.WorldSeed);
+    writer.WriteVarUInt(header.NumGridsXY);
+    writer.WritePosition(header.RoomSize);
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    Finish();
+}
+
+void SessionRecorder::WriteRoomEvent(EEventType type, FIntPoint roomCoords)
+{
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)type);
+    writer.WriteRoomCoords(Deltas, roomCoords);
+}
+
+void SessionRecorder::RoomEnabled(FIntPoint roomCoords, const TArray<int>& doorPositionsNESW, float complexity, float density)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::RoomEnabled, roomCoords);
+    ByteWriter writer(FrameBytes);
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        writer.WriteVarInt(doorPositionsNESW.IsValidIndex(d) ? doorPositionsNESW[d] : -1);
+    writer.WriteFloat(complexity);
+    writer.WriteFloat(density);
+}
+
+void SessionRecorder::RoomDisabled(FIntPoint roomCoords)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::RoomDisabled, roomCoords);
+}
+
+void SessionRecorder::RoomStructureChanged(FIntPoint roomCoords, const RoomBitboard& innerStructure)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::RoomStructure, roomCoords);
+    ByteWriter writer(FrameBytes);
+    writer.WriteVarUInt(innerStructure.GetNumX());
+    writer.WriteVarUInt(innerStructure.GetNumY());
+    for (int x = 0; x < innerStructure.GetNumX(); ++x)
+        writer.WriteVarUInt(innerStructure.GetRow(x));
+}
+
+void SessionRecorder::RoomTrained(FIntPoint roomCoords, const FTrainingBudget& budget, const TArray<float>& cellDangers, int32 trainingSeed)
+{
+    TArray<uint8> budgetBytes;
+    FMemoryWriter budgetWriter(budgetBytes);
+    FTrainingBudget::StaticStruct()->SerializeBin(budgetWriter, const_cast<FTrainingBudget*>(&budget));
+
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::RoomTrained, roomCoords);
+    ByteWriter writer(FrameBytes);
+    writer.WriteBytes(budgetBytes);
+    writer.WriteVarUInt(cellDangers.Num());
+    for (float danger : cellDangers)
+        writer.WriteFloat(danger);
+    writer.WriteVarInt(trainingSeed);
+}
+
+void SessionRecorder::RoomConnected(FIntPoint roomCoords)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::RoomConnected, roomCoords);
+}
+
+void SessionRecorder::DoorOpened(FIntPoint roomCoords, EDirectionType wallDirection)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(EEventType::DoorOpened, roomCoords);
+    ByteWriter(FrameBytes).WriteByte((uint8)wallDirection);
+}
+
+void SessionRecorder::DoorLockChanged(FIntPoint roomCoords, EDirectionType wallDirection, bool locked)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteRoomEvent(locked ? EEventType::DoorLocked : EEventType::DoorUnlocked, roomCoords);
+    ByteWriter(FrameBytes).WriteByte((uint8)wallDirection);
+}
+
+void SessionRecorder::PlayerCellChanged(FRoomPositionPair cell)
+{
+    FScopeLock lock(&RecorderSection);
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)EEventType::PlayerCell);
+    writer.WriteCellDelta(Deltas.PlayerCell, cell);
+    Deltas.PlayerCell = cell;
+}
+
+void SessionRecorder::AgentAdded(EnemyAgentHandle handle, FRoomPositionPair cell)
+{
+    FScopeLock lock(&RecorderSection);
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)EEventType::AgentAdded);
+    writer.WriteVarUInt(handle);
+    writer.WriteRoomCoords(Deltas, cell.RoomCoords);
+    writer.WritePosition(cell.PositionInRoom);
+    Deltas.AgentCells.Add(handle, cell);
+}
+
+void SessionRecorder::AgentRemoved(EnemyAgentHandle handle)
+{
+    FScopeLock lock(&RecorderSection);
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)EEventType::AgentRemoved);
+    writer.WriteVarUInt(handle);
+    Deltas.AgentCells.Remove(handle);
+}
+
+void SessionRecorder::AgentDecision(EnemyAgentHandle handle, EnemyBrain::EDecision decision, FRoomPositionPair movementTarget)
+{
+    FScopeLock lock(&RecorderSection);
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)EEventType::AgentDecision);
+    writer.WriteVarInt(handle - Deltas.PreviousDecisionHandle);
+    Deltas.PreviousDecisionHandle = handle;
+    writer.WriteByte((uint8)decision);
+    if (decision == EnemyBrain::EDecision::Move)
+    {
+        FRoomPositionPair& agentCell = Deltas.GetAgentCell(handle);
+        writer.WriteCellDelta(agentCell, movementTarget);
+        agentCell = movementTarget;
+    }
+}
+
+void SessionRecorder::QValueDelta(const FRoomPositionPair& roomAndPosition, FIntPoint targetPosition, EDirectionType action, float accumulatedReward,
+                                  float learningRate, float deltaQ)
+{
+    FScopeLock lock(&RecorderSection);
+    ByteWriter writer(FrameBytes);
+    writer.WriteByte((uint8)EEventType::QValueDelta);
+    writer.WriteRoomCoords(Deltas, roomAndPosition.RoomCoords);
+    writer.WritePosition(roomAndPosition.PositionInRoom);
+    writer.WritePosition(targetPosition);
+    // Most updates have no accumulated reward, so it is flagged in the action byte.
+    const bool hasReward = accumulatedReward != 0.0f;
+    writer.WriteByte((uint8)action | (hasReward ? 0x80 : 0));
+    if (hasReward)
+        writer.WriteFloat(accumulatedReward);
+    writer.WriteFloat(learningRate);
+    writer.WriteFloat(deltaQ);
+}
+
+void SessionRecorder::WriteTurretEvent(EEventType type, const FRoomPositionPair& roomAndPosition, EDirectionType facing)
+{
+    WriteRoomEvent(type, roomAndPosition.RoomCoords);
+    ByteWriter writer(FrameBytes);
+    writer.WritePosition(roomAndPosition.PositionInRoom);
+    writer.WriteByte((uint8)facing);
+}
+
+void SessionRecorder::TurretPlacementChanged(const FRoomPositionPair& roomAndPosition, EDirectionType facing, bool placed)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteTurretEvent(placed ? EEventType::TurretPlaced : EEventType::TurretRemoved, roomAndPosition, facing);
+}
+
+void SessionRecorder::TurretFired(const FRoomPositionPair& roomAndPosition, EDirectionType facing)
+{
+    FScopeLock lock(&RecorderSection);
+    WriteTurretEvent(EEventType::TurretFired, roomAndPosition, facing);
+}
+
+void SessionRecorder::EndFrame(float deltaSeconds)
+{
+    FScopeLock lock(&RecorderSection);
+    if (bFinished)
+        return;
+    SkippedSeconds += deltaSeconds;
+    if (FrameBytes.Num() == 0)
+    {
+        ++NumFramesSkipped;
+        return;
+    }
+    Bytes.Append(FrameBytes);
+    FrameBytes.Reset();
+    ByteWriter writer(Bytes);
+    writer.WriteByte((uint8)EEventType::FrameEnd);
+    writer.WriteVarUInt(NumFramesSkipped);
+    writer.WriteFloat(SkippedSeconds);
+    NumFramesSkipped = 0;
+    SkippedSeconds = 0.0f;
+    Deltas.PreviousDecisionHandle = 0;
+}
+
+bool SessionRecorder::Finish()
+{
+    {
+        FScopeLock lock(&RecorderSection);
+        if (bFinished)
+            return true;
+    }
+    EndFrame(0.0f);
+    FScopeLock lock(&RecorderSection);
+    bFinished = true;
+    ByteWriter(Bytes).WriteByte((uint8)EEventType::EndOfStream);
+    if (!FFileHelper::SaveArrayToFile(Bytes, *FilePath))
+    {
+        UE_LOG(LogSessionRecording, Warning, TEXT("Couldn't write session recording %s"), *FilePath);
+        return false;
+    }
+    UE_LOG(LogSessionRecording, Display, TEXT("Wrote session recording %s (%d bytes)"), *FilePath, Bytes.Num());
+    return true;
+}
+
+int64 SessionRecorder::GetNumBytes() const
+{
+    FScopeLock lock(&RecorderSection);
+    return Bytes.Num() + FrameBytes.Num();
+}
+
+//====================================================================================================
+// SessionReplayer
+//====================================================================================================
+
+FString SessionReplayer::Results::ToString() const
+{
+    return FString::Printf(TEXT("Frames: %d, events: %lld\n")
+                           TEXT("Rooms enabled: %d, decisions: %lld, qvalue deltas: %lld\n")
+                           TEXT("Recorded %.2fs, replayed in %.2fs (%.1fx)"),
+                           NumFrames, NumEvents,
+                           NumRoomsEnabled, NumDecisions, NumQValueDeltas,
+                           RecordedSeconds, ReplaySeconds, ReplaySeconds > 0.0 ? RecordedSeconds / ReplaySeconds : 0.0);
+}
+
+bool SessionReplayer::Load(const FString& filePath)
+{
+    Bytes.Reset();
+    if (!FFileHelper::LoadFileToArray(Bytes, *filePath))
+        return false;
+    ByteReader reader(Bytes, 0);
+    if (reader.ReadVarUInt() != FileMagic || reader.ReadVarUInt() != FileVersion)
+        return false;
+    FileHeader.WorldSeed = reader.ReadVarInt();
+    FileHeader.NumGridsXY = (int32)reader.ReadVarUInt();
+    FileHeader.RoomSize = reader.ReadPosition();
+    EventsOffset = reader.GetOffset();
+    return !reader.HasError();
+}
+
+bool SessionReplayer::Replay(ATPGameDemoGameState& gameState, Results& results)
+{
+    results = Results();
+    if (Bytes.Num() == 0)
+        return false;
+    if (gameState.RoomStates.Num() == 0)
+        gameState.InitialiseArrays();
+    if (FileHeader.NumGridsXY != gameState.NumGridsXY || FileHeader.RoomSize != FIntPoint(gameState.NumGridUnitsX, gameState.NumGridUnitsY))
+    {
+        UE_LOG(LogSessionRecording, Warning, TEXT("The recording's grid doesn't match the game state's."));
+        return false;
+    }
+    gameState.InitialiseWorldRandomStream(FileHeader.WorldSeed);
+
+    const double replayStartTime = FPlatformTime::Seconds();
+    ByteReader reader(Bytes, EventsOffset);
+    DeltaState deltas;
+    bool endOfStream = false;
+    while (!endOfStream && !reader.HasError() && !reader.IsAtEnd())
+    {
+        const EEventType type = (EEventType)reader.ReadByte();
+        ++results.NumEvents;
+        switch (type)
+        {
+        case EEventType::FrameEnd:
+        {
+            const int32 numFramesSkipped = (int32)reader.ReadVarUInt();
+            results.RecordedSeconds += reader.ReadFloat();
+            results.NumFrames += numFramesSkipped + 1;
+            // The parts of ATPGameDemoGameState::Tick that change the world state.
+            if (gameState.PerimeterDoorsNeedUnlocked)
+            {
+                gameState.UnlockPerimeterDoors();
+                ++gameState.CurrentPerimeter;
+                gameState.NumPerimeterRoomsConnected = 0;
+                gameState.PerimeterDoorsNeedUnlocked = false;
+            }
+            gameState.UpdateFlaggedWalls();
+            deltas.PreviousDecisionHandle = 0;
+            break;
+        }
+        case EEventType::RoomEnabled:
+        {
+            const FIntPoint roomCoords = reader.ReadRoomCoords(deltas);
+            TArray<WallState*> wallStates = gameState.GetWallStatesForRoom(roomCoords);
+            for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+                wallStates[d]->DoorPosition = reader.ReadVarInt();
+            const float complexity = reader.ReadFloat();
+            const float density = reader.ReadFloat();
+            gameState.InvalidateRoomAdjacency(roomCoords);
+            gameState.EnableRoomState(roomCoords, complexity, density);
+            ++results.NumRoomsEnabled;
+            break;
+        }
+        case EEventType::RoomDisabled:
+            gameState.DisableRoomState(reader.ReadRoomCoords(deltas));
+            break;
+        case EEventType::RoomStructure:
+        {
+            const FIntPoint roomCoords = reader.ReadRoomCoords(deltas);
+            const int32 numX = (int32)reader.ReadVarUInt();
+            const int32 numY = (int32)reader.ReadVarUInt();
+            if (numX > RoomBitboard::MaxSide || numY > RoomBitboard::MaxSide)
+                return false;
+            RoomBitboard innerStructure(numX, numY);
+            for (int x = 0; x < numX; ++x)
+                innerStructure.SetRow(x, reader.ReadVarUInt());
+            if (!gameState.DoesRoomExist(roomCoords))
+                break;
+            gameState.SetRoomInnerStructure(roomCoords, innerStructure);
+            TArray<int> doorPositionsNESW;
+            gameState.GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+            TArray<TArray<int>> structure;
+            RoomGeneration::GetRoomStructure(gameState.NumGridUnitsX, innerStructure, doorPositionsNESW, structure);
+            gameState.UpdateRoomNavEnvironmentForStructure(roomCoords, structure);
+            // The exits into neighbouring rooms are set when the walls are updated.
+            gameState.FlagWallsForUpdate(roomCoords);
+            break;
+        }
+        case EEventType::RoomTrained:
+        {
+            const FIntPoint roomCoords = reader.ReadRoomCoords(deltas);
+            TArray<uint8> budgetBytes;
+            reader.ReadBytes(budgetBytes);
+            FTrainingBudget budget;
+            FMemoryReader budgetReader(budgetBytes);
+            FTrainingBudget::StaticStruct()->SerializeBin(budgetReader, &budget);
+            const int32 numCellDangers = (int32)reader.ReadVarUInt();
+            if (numCellDangers > RoomBitboard::MaxSide * RoomBitboard::MaxSide)
+                return false;
+            TArray<float> cellDangers;
+            cellDangers.SetNumUninitialized(numCellDangers);
+            for (float& danger : cellDangers)
+                danger = reader.ReadFloat();
+            const int32 trainingSeed = reader.ReadVarInt();
+            if (!gameState.DoesRoomExist(roomCoords))
+                break;
+            // Train against the room's own cells, as the trainers do.
+            TArray<int> doorPositionsNESW;
+            gameState.GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+            TArray<TArray<int>> structure;
+            RoomGeneration::GetRoomStructure(gameState.NumGridUnitsX, gameState.GetRoomInnerStructure(roomCoords), doorPositionsNESW, structure);
+            NavigationEnvironment navEnvironment;
+            GetNavigationEnvironmentForRoom(structure, roomCoords, navEnvironment);
+            RoomData& roomData = gameState.GetmRoomData(roomCoords);
+            RoomTraining::TrainRoom(navEnvironment, roomData.QValuesRewardsSets, budget, trainingSeed, nullptr, cellDangers.Num() > 0 ? &cellDangers : nullptr);
+            roomData.UpdateQTableMemoryStat();
+            // SetRoomTrained then shifts the room's qvalues by any danger that changed since these inputs, as it did in the session.
+            gameState.SetRoomTrainingInputs(roomCoords, budget, cellDangers, trainingSeed);
+            gameState.SetRoomTrained(roomCoords);
+            break;
+        }
+        case EEventType::RoomConnected:
+            gameState.SetRoomConnected(reader.ReadRoomCoords(deltas));
+            break;
+        case EEventType::DoorOpened:
+        {
+            // Any rooms the door enabled are recorded separately, so only the wall update is needed here.
+            const FIntPoint roomCoords = reader.ReadRoomCoords(deltas);
+            reader.ReadByte();
+            gameState.FlagWallsForUpdate(roomCoords);
+            break;
+        }
+        case EEventType::DoorLocked:
+        case EEventType::DoorUnlocked:
+        {
+            const FIntPoint roomCoords = reader.ReadRoomCoords(deltas);
+            const EDirectionType wallDirection = (EDirectionType)FMath::Min(reader.ReadByte(), (uint8)EDirectionType::West);
+            if (type == EEventType::DoorLocked)
+                gameState.LockDoor(roomCoords, wallDirection);
+            else
+                gameState.UnlockDoor(roomCoords, wallDirection);
+            break;
+        }
+        case EEventType::PlayerCell:
+            deltas.PlayerCell = reader.ReadCellDelta(deltas.PlayerCell);
+            break;
+        case EEventType::AgentAdded:
+        {
+            const int32 handle = (int32)reader.ReadVarUInt();
+            FRoomPositionPair cell;
+            cell.RoomCoords = reader.ReadRoomCoords(deltas);
+            cell.PositionInRoom = reader.ReadPosition();
+            deltas.AgentCells.Add(handle, cell);
+            break;
+        }
+        case EEventType::AgentRemoved:
+            deltas.AgentCells.Remove((int32)reader.ReadVarUInt());
+            break;
+        case EEventType::AgentDecision:
+        {
+            const int32 handle = deltas.PreviousDecisionHandle + reader.ReadVarInt();
+            deltas.PreviousDecisionHandle = handle;
+            const EnemyBrain::EDecision decision = (EnemyBrain::EDecision)reader.ReadByte();
+            if (decision == EnemyBrain::EDecision::Move)
+            {
+                FRoomPositionPair& agentCell = deltas.GetAgentCell(handle);
+                agentCell = reader.ReadCellDelta(agentCell);
+            }
+            ++results.NumDecisions;
+            break;
+        }
+        case EEventType::QValueDelta:
+        {
+            FRoomPositionPair roomAndPosition;
+            roomAndPosition.RoomCoords = reader.ReadRoomCoords(deltas);
+            roomAndPosition.PositionInRoom = reader.ReadPosition();
+            const FIntPoint targetPosition = reader.ReadPosition();
+            const uint8 actionByte = reader.ReadByte();
+            const EDirectionType action = (EDirectionType)FMath::Min((uint8)(actionByte & 0x7F), (uint8)EDirectionType::West);
+            const float accumulatedReward = (actionByte & 0x80) != 0 ? reader.ReadFloat() : 0.0f;
+            const float learningRate = reader.ReadFloat();
+            const float deltaQ = reader.ReadFloat();
+            if (!gameState.DoesRoomExist(roomAndPosition.RoomCoords) || !gameState.InnerRoomPositionValid(roomAndPosition.PositionInRoom)
+                || !gameState.InnerRoomPositionValid(targetPosition))
+                break;
+            ActionQValuesAndRewards& qValuesAndRewards = gameState.GetActionQValuesRewards(roomAndPosition, targetPosition);
+            qValuesAndRewards.AddActionRewardObservation(action, accumulatedReward);
+            qValuesAndRewards.UpdateQValue(action, learningRate, deltaQ);
+            ++results.NumQValueDeltas;
+            break;
+        }
+        case EEventType::TurretPlaced:
+        case EEventType::TurretRemoved:
+        case EEventType::TurretFired:
+        {
+            FRoomPositionPair roomAndPosition;
+            roomAndPosition.RoomCoords = reader.ReadRoomCoords(deltas);
+            roomAndPosition.PositionInRoom = reader.ReadPosition();
+            const EDirectionType facing = (EDirectionType)FMath::Min(reader.ReadByte(), (uint8)EDirectionType::West);
+            if (!gameState.InnerRoomPositionValid(roomAndPosition.PositionInRoom))
+                break;
+            // These go through the game state, so trained rooms get the same qvalue shifts as in the session.
+            if (type == EEventType::TurretFired)
+                gameState.BuildableItemFired(roomAndPosition, facing);
+            else
+                gameState.SetBuildableItemPlaced(roomAndPosition, facing, type == EEventType::TurretPlaced);
+            break;
+        }
+        case EEventType::EndOfStream:
+            endOfStream = true;
+            break;
+        default:
+            UE_LOG(LogSessionRecording, Warning, TEXT("Unknown session event %d"), (int)type);
+            return false;
+        }
+    }
+    results.ReplaySeconds = FPlatformTime::Seconds() - replayStartTime;
+    return endOfStream && !reader.HasError();
+}
+
+//====================================================================================================
+// Console commands
+//====================================================================================================
+
+namespace
+{
+    ATPGameDemoGameState* GetSessionGameState(UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = world != nullptr ? world->GetGameState<ATPGameDemoGameState>() : nullptr;
+        if (gameState == nullptr)
+            UE_LOG(LogSessionRecording, Warning, TEXT("No TPGameDemo game state in this world."));
+        return gameState;
+    }
+
+    void RecordSessionCommand(const TArray<FString>& args, UWorld* world)
+    {
+        if (ATPGameDemoGameState* gameState = GetSessionGameState(world))
+        {
+            const FString fileName = args.Num() > 0 ? args[0] : FString::Printf(TEXT("Session_%s.tpsession"), *FDateTime::Now().ToString());
+            gameState->StartSessionRecording(GetSessionFilePath(fileName));
+        }
+    }
+
+    void StopRecordingCommand(const TArray<FString>& args, UWorld* world)
+    {
+        if (ATPGameDemoGameState* gameState = GetSessionGameState(world))
+            gameState->StopSessionRecording();
+    }
+
+    void ReplaySessionCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetSessionGameState(world);
+        if (gameState == nullptr)
+            return;
+        if (args.Num() == 0)
+        {
+            UE_LOG(LogSessionRecording, Warning, TEXT("Usage: TPGameDemo.ReplaySession FileName"));
+            return;
+        }
+        SessionReplayer replayer;
+        const FString filePath = GetSessionFilePath(args[0]);
+        if (!replayer.Load(filePath))
+        {
+            UE_LOG(LogSessionRecording, Warning, TEXT("Couldn't load session recording %s"), *filePath);
+            return;
+        }
+        SessionReplayer::Results results;
+        const bool replayed = replayer.Replay(*gameState, results);
+        if (!replayed)
+            UE_LOG(LogSessionRecording, Warning, TEXT("Session recording %s is incomplete or malformed. Replayed up to the error."), *filePath);
+        TArray<FString> lines;
+        results.ToString().ParseIntoArrayLines(lines);
+        for (const FString& line : lines)
+            UE_LOG(LogSessionRecording, Display, TEXT("%s"), *line);
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs RecordSessionConsoleCommand(
+        TEXT("TPGameDemo.RecordSession"),
+        TEXT("Starts recording the session to Saved/Sessions. Arguments: [FileName]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RecordSessionCommand));
+
+    FAutoConsoleCommandWithWorldAndArgs StopRecordingConsoleCommand(
+        TEXT("TPGameDemo.StopRecording"),
+        TEXT("Stops recording the session and writes the recording."),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StopRecordingCommand));
+
+    FAutoConsoleCommandWithWorldAndArgs ReplaySessionConsoleCommand(
+        TEXT("TPGameDemo.ReplaySession"),
+        TEXT("Rebuilds a recorded session in this world, headlessly. Arguments: FileName"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ReplaySessionCommand));
+};
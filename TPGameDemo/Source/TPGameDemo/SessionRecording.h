@@ -0,0 +1,310 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+#include "EnemyBrain.h"
+
+class ATPGameDemoGameState;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSessionRecording, Log, All);
+
+/*
+A session recording is a compact binary stream of everything that changes the world state during a session, so that the session
+can be rebuilt without the original actors, randomness or timing.
+
+The stream starts with a header (magic, version, world seed, grid and room sizes), followed by frames. Each frame is the list of events
+that happened in it, ending with a FrameEnd event that holds the number of empty frames skipped before it and the elapsed time.
+Empty frames are not written. Integers are variable-length, signed values are zigzag encoded, and coordinates are written as deltas
+from the previous value of the same kind (see DeltaState), so most events take a few bytes.
+*/
+namespace SessionRecording
+{
+    constexpr uint32 FileMagic = 0x54505352;
+    constexpr uint32 FileVersion = 3;
+
+    enum class EEventType : uint8
+    {
+        FrameEnd,       // frames skipped, delta seconds
+        RoomEnabled,    // room, door positions NESW, complexity, density
+        RoomDisabled,   // room
+        RoomStructure,  // room, inner structure rows
+        RoomTrained,    // room, training budget, cell dangers, training seed
+        RoomConnected,  // room
+        DoorOpened,     // room, wall
+        DoorLocked,     // room, wall
+        DoorUnlocked,   // room, wall
+        PlayerCell,     // room and position, relative to the previous player cell
+        AgentAdded,     // handle, room and position
+        AgentRemoved,   // handle
+        AgentDecision,  // handle (relative to the previous decision in the frame), decision, movement target relative to the agent's cell
+        QValueDelta,    // room, position, target, action, reward, learning rate, delta
+        TurretPlaced,   // room, position, facing
+        TurretRemoved,  // room, position, facing
+        TurretFired,    // room, position, facing
+        EndOfStream,
+        NumEventTypes
+    };
+
+    /* The values that events are delta encoded against. The recorder and the replayer keep identical copies. */
+    struct DeltaState
+    {
+        FIntPoint RoomCoords { 0, 0 };
+        FRoomPositionPair PlayerCell { FIntPoint(0, 0), FIntPoint(0, 0) };
+        int32 PreviousDecisionHandle = 0;
+        TMap<int32, FRoomPositionPair> AgentCells;
+
+        FRoomPositionPair& GetAgentCell(int32 handle)
+        {
+            if (FRoomPositionPair* cell = AgentCells.Find(handle))
+                return *cell;
+            return AgentCells.Add(handle, { FIntPoint(0, 0), FIntPoint(0, 0) });
+        }
+    };
+
+    struct Header
+    {
+        int32 WorldSeed = 0;
+        int32 NumGridsXY = 0;
+        FIntPoint RoomSize { 0, 0 };
+    };
+
+    //====================================================================================================
+    // Encoding
+    //====================================================================================================
+
+    /* Writes the stream's values. Unsigned integers are written 7 bits per byte, low bits first, with the high bit set on every byte
+       but the last. Signed integers are zigzag encoded first, so that small negative values stay small. */
+    class ByteWriter
+    {
+    public:
+        ByteWriter(TArray<uint8>& bytes) : Bytes(bytes) {}
+
+        void WriteByte(uint8 value) { Bytes.Add(value); }
+
+        void WriteVarUInt(uint32 value)
+        {
+            while (value >= 0x80)
+            {
+                Bytes.Add((uint8)(value | 0x80));
+                value >>= 7;
+            }
+            Bytes.Add((uint8)value);
+        }
+
+        void WriteVarInt(int32 value) { WriteVarUInt(((uint32)value << 1) ^ (uint32)(value >> 31)); }
+
+        void WriteFloat(float value)
+        {
+            uint32 bits;
+            FMemory::Memcpy(&bits, &value, sizeof(bits));
+            for (int b = 0; b < 4; ++b)
+                Bytes.Add((uint8)(bits >> (b * 8)));
+        }
+
+        void WriteBytes(const TArray<uint8>& bytes)
+        {
+            WriteVarUInt(bytes.Num());
+            Bytes.Append(bytes);
+        }
+
+        void WriteRoomCoords(DeltaState& deltas, FIntPoint roomCoords)
+        {
+            WriteVarInt(roomCoords.X - deltas.RoomCoords.X);
+            WriteVarInt(roomCoords.Y - deltas.RoomCoords.Y);
+            deltas.RoomCoords = roomCoords;
+        }
+
+        void WritePosition(FIntPoint position)
+        {
+            WriteVarUInt(position.X);
+            WriteVarUInt(position.Y);
+        }
+
+        void WriteCellDelta(const FRoomPositionPair& from, const FRoomPositionPair& to)
+        {
+            WriteVarInt(to.RoomCoords.X - from.RoomCoords.X);
+            WriteVarInt(to.RoomCoords.Y - from.RoomCoords.Y);
+            WriteVarInt(to.PositionInRoom.X - from.PositionInRoom.X);
+            WriteVarInt(to.PositionInRoom.Y - from.PositionInRoom.Y);
+        }
+
+    private:
+        TArray<uint8>& Bytes;
+    };
+
+    /* Reads values written by ByteWriter. Reading past the end, or a varint longer than 5 bytes, sets the error flag and returns 0. */
+    class ByteReader
+    {
+    public:
+        ByteReader(const TArray<uint8>& bytes, int32 offset) : Bytes(bytes), Offset(offset) {}
+
+        bool HasError() const { return bError; }
+        bool IsAtEnd() const { return Offset >= Bytes.Num(); }
+        int32 GetOffset() const { return Offset; }
+
+        uint8 ReadByte()
+        {
+            if (Offset >= Bytes.Num())
+            {
+                bError = true;
+                return 0;
+            }
+            return Bytes[Offset++];
+        }
+
+        uint32 ReadVarUInt()
+        {
+            uint32 value = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                const uint8 byte = ReadByte();
+                value |= (uint32)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            bError = true;
+            return 0;
+        }
+
+        int32 ReadVarInt()
+        {
+            const uint32 value = ReadVarUInt();
+            return (int32)(value >> 1) ^ -(int32)(value & 1);
+        }
+
+        float ReadFloat()
+        {
+            uint32 bits = 0;
+            for (int b = 0; b < 4; ++b)
+                bits |= (uint32)ReadByte() << (b * 8);
+            float value;
+            FMemory::Memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        void ReadBytes(TArray<uint8>& bytes)
+        {
+            const uint32 num = ReadVarUInt();
+            if (bError || num > (uint32)(Bytes.Num() - Offset))
+            {
+                bError = true;
+                return;
+            }
+            bytes.SetNumUninitialized(num);
+            FMemory::Memcpy(bytes.GetData(), Bytes.GetData() + Offset, num);
+            Offset += num;
+        }
+
+        FIntPoint ReadRoomCoords(DeltaState& deltas)
+        {
+            const int32 x = ReadVarInt();
+            const int32 y = ReadVarInt();
+            deltas.RoomCoords += FIntPoint(x, y);
+            return deltas.RoomCoords;
+        }
+
+        FIntPoint ReadPosition()
+        {
+            const int32 x = (int32)ReadVarUInt();
+            const int32 y = (int32)ReadVarUInt();
+            return FIntPoint(x, y);
+        }
+
+        FRoomPositionPair ReadCellDelta(const FRoomPositionPair& from)
+        {
+            FRoomPositionPair to = from;
+            to.RoomCoords.X += ReadVarInt();
+            to.RoomCoords.Y += ReadVarInt();
+            to.PositionInRoom.X += ReadVarInt();
+            to.PositionInRoom.Y += ReadVarInt();
+            return to;
+        }
+
+    private:
+        const TArray<uint8>& Bytes;
+        int32 Offset = 0;
+        bool bError = false;
+    };
+};
+
+/*
+Writes a session recording. Events can be added from any thread. They are buffered per frame, and written to disk by Finish.
+*/
+class SessionRecorder
+{
+public:
+    SessionRecorder(const FString& filePath, const SessionRecording::Header& header);
+    ~SessionRecorder();
+
+    void RoomEnabled(FIntPoint roomCoords, const TArray<int>& doorPositionsNESW, float complexity, float density);
+    void RoomDisabled(FIntPoint roomCoords);
+    void RoomStructureChanged(FIntPoint roomCoords, const RoomBitboard& innerStructure);
+    /* cellDangers is the danger the room was trained against (see DangerField), or empty. */
+    void RoomTrained(FIntPoint roomCoords, const FTrainingBudget& budget, const TArray<float>& cellDangers, int32 trainingSeed);
+    void RoomConnected(FIntPoint roomCoords);
+    void DoorOpened(FIntPoint roomCoords, EDirectionType wallDirection);
+    void DoorLockChanged(FIntPoint roomCoords, EDirectionType wallDirection, bool locked);
+    void PlayerCellChanged(FRoomPositionPair cell);
+    void AgentAdded(EnemyAgentHandle handle, FRoomPositionPair cell);
+    void AgentRemoved(EnemyAgentHandle handle);
+    void AgentDecision(EnemyAgentHandle handle, EnemyBrain::EDecision decision, FRoomPositionPair movementTarget);
+    void QValueDelta(const FRoomPositionPair& roomAndPosition, FIntPoint targetPosition, EDirectionType action, float accumulatedReward,
+                     float learningRate, float deltaQ);
+    void TurretPlacementChanged(const FRoomPositionPair& roomAndPosition, EDirectionType facing, bool placed);
+    void TurretFired(const FRoomPositionPair& roomAndPosition, EDirectionType facing);
+
+    /* Closes the current frame. Frames without events only add to the skipped frame count of the next frame. */
+    void EndFrame(float deltaSeconds);
+    /* Writes the stream to disk. Returns false if it couldn't be written. Nothing is recorded after this. */
+    bool Finish();
+
+    FString GetFilePath() const { return FilePath; }
+    int64 GetNumBytes() const;
+
+private:
+    void WriteRoomEvent(SessionRecording::EEventType type, FIntPoint roomCoords);
+    void WriteTurretEvent(SessionRecording::EEventType type, const FRoomPositionPair& roomAndPosition, EDirectionType facing);
+
+    FString FilePath;
+    mutable FCriticalSection RecorderSection;
+    TArray<uint8> Bytes;
+    TArray<uint8> FrameBytes;
+    SessionRecording::DeltaState Deltas;
+    uint32 NumFramesSkipped = 0;
+    float SkippedSeconds = 0.0f;
+    bool bFinished = false;
+};
+
+/*
+Rebuilds a recorded session in a game state, without room, wall or enemy actors, as fast as the events can be applied.
+Rooms are rebuilt from their recorded door positions and structure, and trained with the recorded budget and seed (training is
+seeded per room and goal, so this gives the same qvalues) against the turret danger they were trained with. Recorded qvalue deltas are then applied on
+top, and turret events shift the trained rooms' qvalues as they did in the session. Meant to be run on an empty map, e.g. with
+-nullrhi, for profiling and regression runs.
+*/
+class SessionReplayer
+{
+public:
+    struct Results
+    {
+        int NumFrames = 0;
+        int64 NumEvents = 0;
+        int NumRoomsEnabled = 0;
+        int64 NumDecisions = 0;
+        int64 NumQValueDeltas = 0;
+        double RecordedSeconds = 0.0;
+        double ReplaySeconds = 0.0;
+        FString ToString() const;
+    };
+
+    bool Load(const FString& filePath);
+    const SessionRecording::Header& GetHeader() const { return FileHeader; }
+    /* Returns false if the stream is malformed, or doesn't match the game state's grid. */
+    bool Replay(ATPGameDemoGameState& gameState, Results& results);
+
+private:
+    TArray<uint8> Bytes;
+    int32 EventsOffset = 0;
+    SessionRecording::Header FileHeader;
+};
@@ -4,6 +4,32 @@
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, TPGameDemo, "TPGameDemo" );
 
+DEFINE_STAT(STAT_TrainerRun);
+DEFINE_STAT(STAT_TrainNextGoalPosition);
+DEFINE_STAT(STAT_TrainGoalPosition);
+DEFINE_STAT(STAT_SimulateRunBatch);
+DEFINE_STAT(STAT_SimulatedRuns);
+DEFINE_STAT(STAT_BuildRoomPackage);
+DEFINE_STAT(STAT_GenerateRoomStructure);
+DEFINE_STAT(STAT_DecodeStreamedRoom);
+DEFINE_STAT(STAT_GameStateTick);
+DEFINE_STAT(STAT_WallUpdates);
+DEFINE_STAT(STAT_WallsUpdated);
+DEFINE_STAT(STAT_EnableRoomState);
+DEFINE_STAT(STAT_UpdateQValueRealtime);
+DEFINE_STAT(STAT_ApplyDangerChanges);
+DEFINE_STAT(STAT_EnemyDecisions);
+DEFINE_STAT(STAT_EnemyDecideAgent);
+DEFINE_STAT(STAT_EnemyAgentsDecided);
+DEFINE_STAT(STAT_ApplyEnemyDecisions);
+DEFINE_STAT(STAT_EnemyTickDetail);
+DEFINE_STAT(STAT_EnemyActorSelectAction);
+DEFINE_STAT(STAT_UpdateChaseFlowField);
+DEFINE_STAT(STAT_GridLineOfSight);
+DEFINE_STAT(STAT_QTableMemory);
+DEFINE_STAT(STAT_RoomStateMemory);
+DEFINE_STAT(STAT_NumAllocatedRooms);
+
 const FString LevelBuilderHelpers::LevelsDir() { return FPaths::/*GameDir*/ProjectDir() + "Content/Levels/"; }
 
 EDirectionType DirectionHelpers::GetOppositeDirection(EDirectionType direction)
@@ -59,44 +85,110 @@ bool LevelBuilderHelpers::GridPositionIsValid(FIntPoint position, int sizeX, int
     return !(position.X < 0 || position.Y < 0 || position.X > sizeX - 1 || position.Y > sizeY -1);
 }
 
-InnerRoomBitmask LevelBuilderHelpers::ArrayToBitmask(TArray<TArray<int>>& arrayRef, int inset /*= 1*/, bool invertX /*= false*/)
+RoomBitboard LevelBuilderHelpers::ArrayToBitmask(const TArray<TArray<int>>& arrayRef, int inset /*= 1*/, bool invertX /*= false*/)
 {
     const int numX = arrayRef.Num();
-    const int numY = arrayRef[0].Num();
-    const int maxSide = InnerRoomMaxSide();
-    ensure(numX - (inset*2) <= maxSide && numY - (inset*2) <= maxSide);
-    InnerRoomBitmask bitmask = 0;
-    int index = InnerRoomBitmask_Size;
-    for (int x = (invertX ? numX - 1 - inset : inset); (invertX ? x >= 0 : x < numX - inset); (invertX ? x-- : x++))
+    const int numY = numX > 0 ? arrayRef[0].Num() : 0;
+    const int innerX = numX - inset * 2;
+    const int innerY = numY - inset * 2;
+    ensure(innerX <= RoomBitboard::MaxSide && innerY <= RoomBitboard::MaxSide);
+    RoomBitboard bitboard(FMath::Clamp(innerX, 0, RoomBitboard::MaxSide), FMath::Clamp(innerY, 0, RoomBitboard::MaxSide));
+    for (int row = 0; row < bitboard.GetNumX(); ++row)
     {
-        for (int y = inset; y < numY - inset; ++y)
+        const int x = invertX ? numX - 1 - inset - row : inset + row;
+        RoomBitboard::RowType rowBits = 0;
+        for (int col = 0; col < bitboard.GetNumY(); ++col)
         {
-            const InnerRoomBitmask cellState = arrayRef[x][y];
+            const int cellState = arrayRef[x][inset + col];
             ensure(cellState == 0 || cellState == 1);
-            bitmask |= (cellState << index);
-            --index;
+            if (cellState == (int)ECellState::Closed)
+                rowBits |= ((RoomBitboard::RowType)1 << col);
         }
+        bitboard.SetRow(row, rowBits);
     }
-    return bitmask;
+    return bitboard;
 }
 
-void LevelBuilderHelpers::BitMaskToArray(InnerRoomBitmask bitmask, TArray<TArray<int>>& arrayRef, int inset /*= 1*/, bool invertX /*= false*/)
+void LevelBuilderHelpers::BitMaskToArray(const RoomBitboard& bitmask, TArray<TArray<int>>& arrayRef, int inset /*= 1*/, bool invertX /*= false*/)
+{
+    const int numX = arrayRef.Num();
+    const int innerX = numX - inset * 2;
+    ensure(!bitmask.IsSizeValid() || bitmask.GetNumX() == innerX);
+    for (int row = 0; row < innerX; ++row)
+    {
+        const int x = invertX ? numX - 1 - inset - row : inset + row;
+        const int innerY = arrayRef[x].Num() - inset * 2;
+        ensure(!bitmask.IsSizeValid() || bitmask.GetNumY() == innerY);
+        for (int col = 0; col < innerY; ++col)
+            arrayRef[x][inset + col] = bitmask.Get(FIntPoint(row, col)) ? (int)ECellState::Closed : (int)ECellState::Open;
+    }
+}
+
+
+RoomBitboard LevelBuilderHelpers::GetCellsInState(const TArray<TArray<int>>& roomStructure, ECellState cellState)
 {
-    const int side = arrayRef.Num();
-    ensure(side - (inset * 2) <= InnerRoomMaxSide());
-    int index = InnerRoomBitmask_Size;
-    for (int x = (invertX ? side - inset - 1 : inset); (invertX ? x >= 0 : x < side - inset); (invertX ? x-- : x++))
+    const int numX = roomStructure.Num();
+    const int numY = numX > 0 ? roomStructure[0].Num() : 0;
+    ensure(numX <= RoomBitboard::MaxSide && numY <= RoomBitboard::MaxSide);
+    RoomBitboard cells(FMath::Min(numX, RoomBitboard::MaxSide), FMath::Min(numY, RoomBitboard::MaxSide));
+    for (int x = 0; x < cells.GetNumX(); ++x)
     {
-        ensure(arrayRef[x].Num() == side);
-        for (int y = inset; y < side - inset; ++y)
+        RoomBitboard::RowType rowBits = 0;
+        for (int y = 0; y < cells.GetNumY(); ++y)
+            if (roomStructure[x][y] == (int)cellState)
+                rowBits |= ((RoomBitboard::RowType)1 << y);
+        cells.SetRow(x, rowBits);
+    }
+    return cells;
+}
+
+RoomBitboard LevelBuilderHelpers::GetWalkableCells(const TArray<TArray<int>>& roomStructure)
+{
+    const int numX = roomStructure.Num();
+    const int numY = numX > 0 ? roomStructure[0].Num() : 0;
+    ensure(numX <= RoomBitboard::MaxSide && numY <= RoomBitboard::MaxSide);
+    RoomBitboard walkableCells(FMath::Min(numX, RoomBitboard::MaxSide), FMath::Min(numY, RoomBitboard::MaxSide));
+    for (int x = 0; x < walkableCells.GetNumX(); ++x)
+    {
+        RoomBitboard::RowType rowBits = 0;
+        for (int y = 0; y < walkableCells.GetNumY(); ++y)
         {
-            const int cellState = (bitmask & ((InnerRoomBitmask)1 << index)) ? (int)ECellState::Closed : (int)ECellState::Open;
-            arrayRef[x][y] = cellState;
-            --index;
+            const int cellState = roomStructure[x][y];
+            if (cellState == (int)ECellState::Open || cellState == (int)ECellState::Door)
+                rowBits |= ((RoomBitboard::RowType)1 << y);
         }
+        walkableCells.SetRow(x, rowBits);
     }
+    return walkableCells;
 }
 
+RoomBitboard LevelBuilderHelpers::GetReachableCells(const RoomBitboard& seeds, const RoomBitboard& passable)
+{
+    RoomBitboard reached = seeds & passable;
+    // Each pass grows the frontier by one step in every direction, so this runs at most once per cell along the longest path.
+    while (true)
+    {
+        RoomBitboard grown = reached;
+        grown |= reached.ShiftedNorth();
+        grown |= reached.ShiftedSouth();
+        grown |= reached.ShiftedEast();
+        grown |= reached.ShiftedWest();
+        grown &= passable;
+        if (grown == reached)
+            return reached;
+        reached = grown;
+    }
+}
+
+bool LevelBuilderHelpers::AreCellsConnected(const RoomBitboard& cells)
+{
+    FIntPoint firstCell;
+    if (!cells.GetFirstSetCell(firstCell))
+        return true;
+    RoomBitboard seed(cells.GetNumX(), cells.GetNumY());
+    seed.Set(firstCell);
+    return GetReachableCells(seed, cells) == cells;
+}
 
 /*
 Takes in a text file and fills an array with FDirectionSets.
@@ -333,6 +425,24 @@ void ActionQValuesAndRewards::ResetQValues()
         ActionQValues[actionType] = 0.0f;
 }
 
+void ActionQValuesAndRewards::GetQValuesAndRewards(float* qValues, float* rewards) const
+{
+    for (int actionType = 0; actionType < (int)EDirectionType::NumDirectionTypes; ++actionType)
+    {
+        qValues[actionType] = ActionQValues[actionType];
+        rewards[actionType] = ActionRewards[actionType];
+    }
+}
+
+void ActionQValuesAndRewards::SetQValuesAndRewards(const float* qValues, const float* rewards)
+{
+    for (int actionType = 0; actionType < (int)EDirectionType::NumDirectionTypes; ++actionType)
+    {
+        ActionQValues[actionType] = qValues[actionType];
+        ActionRewards[actionType] = rewards[actionType];
+    }
+}
+
 void ActionQValuesAndRewards::UpdateQValue(EDirectionType actionType, float learningRate, float deltaQ)
 {
     float currentQValue = ActionQValues[(int)actionType];
@@ -371,4 +481,5 @@ void ActionTargets::SetActionTarget(EDirectionType actionType, FRoomPositionPair
 void RoomState::DisableRoom()
 {
     RoomStatus = RoomState::Status::Dead;
+    Data.Reset();
 }
\ No newline at end of file
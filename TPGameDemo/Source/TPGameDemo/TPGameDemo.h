@@ -2,7 +2,6 @@
 
 #pragma once
 
-#include <set>
 #include <climits>
 #include "Engine.h"
 #include "Runtime/Launch/Resources/Version.h"
@@ -13,11 +12,55 @@
 #define UE_4_25_OR_LATER (ENGINE_MAJOR_VERSION >= 4 && ENGINE_MINOR_VERSION >= 25)
 
 #define ON_SCREEN_DEBUGGING 0
-#define DELTA_Q_CONVERGENCE_THRESHOLD 0.01f
-#define CONVERGENCE_NUM_ACTIONS_MIN 100
-#define CONVERGENCE_NUM_ACTIONS_MAX 300
-#define NUM_TRAINING_SIMULATIONS 50
-#define MAX_NUM_MOVEMENTS_PER_SIMULATION 100
+
+#if UE_4_24_OR_LATER
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#else
+#define TRACE_CPUPROFILER_EVENT_SCOPE(Name)
+#endif
+
+//====================================================================================================
+// Stats
+//====================================================================================================
+
+// "stat TPGameDemo" in game, or the TPGameDemo group in the session frontend.
+DECLARE_STATS_GROUP(TEXT("TPGameDemo"), STATGROUP_TPGameDemo, STATCAT_Advanced);
+
+// Training
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Trainer Run"), STAT_TrainerRun, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Train Next Goal Position"), STAT_TrainNextGoalPosition, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Train Goal Position"), STAT_TrainGoalPosition, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Simulate Run Batch"), STAT_SimulateRunBatch, STATGROUP_TPGameDemo, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Simulated Runs"), STAT_SimulatedRuns, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Build Room Package"), STAT_BuildRoomPackage, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Generate Room Structure"), STAT_GenerateRoomStructure, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode Streamed Room"), STAT_DecodeStreamedRoom, STATGROUP_TPGameDemo, );
+// Game state
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Game State Tick"), STAT_GameStateTick, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Wall Updates"), STAT_WallUpdates, STATGROUP_TPGameDemo, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Walls Updated"), STAT_WallsUpdated, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enable Room State"), STAT_EnableRoomState, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update QValue Realtime"), STAT_UpdateQValueRealtime, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Apply Danger Changes"), STAT_ApplyDangerChanges, STATGROUP_TPGameDemo, );
+// Enemy AI
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enemy Decisions"), STAT_EnemyDecisions, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enemy Decide Agent"), STAT_EnemyDecideAgent, STATGROUP_TPGameDemo, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Enemy Agents Decided"), STAT_EnemyAgentsDecided, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Apply Enemy Decisions"), STAT_ApplyEnemyDecisions, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enemy Tick Detail"), STAT_EnemyTickDetail, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enemy Actor Select Action"), STAT_EnemyActorSelectAction, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Chase Flow Field"), STAT_UpdateChaseFlowField, STATGROUP_TPGameDemo, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Grid Line Of Sight"), STAT_GridLineOfSight, STATGROUP_TPGameDemo, );
+// Memory
+DECLARE_MEMORY_STAT_EXTERN(TEXT("QValue Tables"), STAT_QTableMemory, STATGROUP_TPGameDemo, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Room States"), STAT_RoomStateMemory, STATGROUP_TPGameDemo, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Allocated Rooms"), STAT_NumAllocatedRooms, STATGROUP_TPGameDemo, );
+
+// Times the enclosing scope with a cycle counter, and as a named CPU event in Unreal Insights (-trace=cpu). The trace event is
+// still emitted in builds where stats are compiled out.
+#define TPGAMEDEMO_SCOPE_CYCLE_COUNTER(Stat) \
+    SCOPE_CYCLE_COUNTER(Stat); \
+    TRACE_CPUPROFILER_EVENT_SCOPE(Stat)
 
 UENUM(BlueprintType)
 enum class EDirectionType : uint8
@@ -51,6 +94,24 @@ namespace Delimiters
     const FString ActionDelimiter = "_";
 };
 
+/* Lookup tables for 4-bit direction masks, indexed by the mask. */
+namespace DirectionMaskTables
+{
+    constexpr uint8 NumMaskValues = 1 << 4;
+    constexpr uint8 FullMask = NumMaskValues - 1;
+
+    constexpr uint8 NumSetBits[NumMaskValues] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+    /* NthSetBit[mask][n] is the index of the nth lowest set bit in mask, or 4 if mask has fewer than n+1 bits set. */
+    constexpr uint8 NthSetBit[NumMaskValues][4] =
+    {
+        { 4, 4, 4, 4 }, { 0, 4, 4, 4 }, { 1, 4, 4, 4 }, { 0, 1, 4, 4 },
+        { 2, 4, 4, 4 }, { 0, 2, 4, 4 }, { 1, 2, 4, 4 }, { 0, 1, 2, 4 },
+        { 3, 4, 4, 4 }, { 0, 3, 4, 4 }, { 1, 3, 4, 4 }, { 0, 1, 3, 4 },
+        { 2, 3, 4, 4 }, { 0, 2, 3, 4 }, { 1, 2, 3, 4 }, { 0, 1, 2, 3 }
+    };
+};
+
 USTRUCT(BlueprintType)
 struct FDirectionSet
 {
@@ -66,61 +127,58 @@ struct FDirectionSet
         NumDirectionFlags = 1 << 4
     };
 
-    FDirectionSet()
+    FDirectionSet() {}
+
+    FDirectionSet(uint8 directionsMask) : DirectionsMask(directionsMask & DirectionMaskTables::FullMask) {}
+
+    /* Picks one of the enabled directions uniformly, using randomStream. Returns NumDirectionTypes if no directions are enabled. */
+    EDirectionType ChooseDirection(FRandomStream& randomStream) const
     {
-        DirectionSelectionSet.clear();
+        const int numDirections = GetNumDirections();
+        if (numDirections == 0)
+            return EDirectionType::NumDirectionTypes;
+        return GetNthDirection(randomStream.RandHelper(numDirections));
     }
 
-    FDirectionSet(uint8 directionsMask) : DirectionsMask(directionsMask) 
+    /* Picks one of the enabled directions uniformly, using the global random generator. */
+    EDirectionType ChooseDirection() const
     {
-        UpdateSelectionSet();
+        const int numDirections = GetNumDirections();
+        if (numDirections == 0)
+            return EDirectionType::NumDirectionTypes;
+        return GetNthDirection(FMath::RandHelper(numDirections));
     }
 
-    EDirectionType ChooseDirection() 
+    int GetNumDirections() const { return DirectionMaskTables::NumSetBits[DirectionsMask & DirectionMaskTables::FullMask]; }
+
+    /* Returns the nth enabled direction, in North, East, South, West order. */
+    EDirectionType GetNthDirection(int n) const
     {
-        if (!IsValid())
+        if (n < 0 || n >= GetNumDirections())
             return EDirectionType::NumDirectionTypes;
-
-        float r = rand() / (float)RAND_MAX;
-        int choice = r == 1.0f ? DirectionSelectionSet.size() - 1 : (int)(r * DirectionSelectionSet.size());
-        std::set<EDirectionType>::iterator it = DirectionSelectionSet.begin();
-        advance(it, choice);
-        ensure((int)*it >= (int)EDirectionType::North && (int)*it < (int)EDirectionType::NumDirectionTypes);
-        return *it;
+        return (EDirectionType)DirectionMaskTables::NthSetBit[DirectionsMask & DirectionMaskTables::FullMask][n];
     }
 
-    bool IsValid() { return DirectionsMask & ((uint8)pow(2, (int)EDirectionType::NumDirectionTypes) - 1); }
+    bool IsValid() const { return (DirectionsMask & DirectionMaskTables::FullMask) != 0; }
 
-    bool CheckDirection(EDirectionType direction) { return DirectionsMask & (1 << (int)direction); }
+    bool CheckDirection(EDirectionType direction) const { return DirectionsMask & (1 << (int)direction); }
     
-    void Clear()
-    {
-        DirectionsMask = 0;
-        DirectionSelectionSet.clear();
-    }
+    void Clear() { DirectionsMask = 0; }
 
-    void EnableDirection(EDirectionType direction) 
-    { 
-        DirectionsMask |= (1 << (int)direction);
-        DirectionSelectionSet.insert(direction);
-    }
-    void DisableDirection(EDirectionType direction) 
-    { 
-        DirectionsMask &= (~(1 << (int)direction));
-        DirectionSelectionSet.erase(direction);
-    }
+    void EnableDirection(EDirectionType direction) { DirectionsMask |= (1 << (int)direction); }
+    void DisableDirection(EDirectionType direction) { DirectionsMask &= (~(1 << (int)direction)); }
 
     /** return a copy if all directions are valid. */
-    FDirectionSet GetInverse()
+    FDirectionSet GetInverse() const
     {
-        if (DirectionSelectionSet.size() == (int)EDirectionType::NumDirectionTypes)
+        if (GetNumDirections() == (int)EDirectionType::NumDirectionTypes)
         {
             return FDirectionSet(DirectionsMask);
         }
         return FDirectionSet(~DirectionsMask);
     }
 
-    FString ToString(bool padSpaces = false) 
+    FString ToString(bool padSpaces = false) const
     {
         if (!IsValid())
             return FString("-1");
@@ -140,16 +198,6 @@ struct FDirectionSet
     }
 
     uint8 DirectionsMask = 0;
-    std::set<EDirectionType> DirectionSelectionSet;
-
-private:
-    void UpdateSelectionSet()
-    {
-        DirectionSelectionSet.clear();
-        for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
-            if (CheckDirection((EDirectionType)d))
-                DirectionSelectionSet.insert((EDirectionType)d);
-    }
 };
 
 USTRUCT(Blueprintable)
@@ -162,6 +210,27 @@ struct FRoomPositionPair
         FIntPoint PositionInRoom;
 };
 
+USTRUCT()
+struct FTargetPosition
+{
+    GENERATED_BODY()
+    // Invalid initial values to avoid TargetReached miss-fire
+    FIntPoint Position = FIntPoint(-1,-1);
+    EDirectionType DoorAction = EDirectionType::NumDirectionTypes;
+
+    bool TargetIsDoor() const
+    {
+        return DoorAction != EDirectionType::NumDirectionTypes;
+    }
+
+    FString ToInfoString() const
+    {
+        FString positionString = FString::Format(TEXT("Target Position: {0}"), { Position.ToString() });
+        FString actionString = FString::Format(TEXT("Action : {0}"), { DirectionHelpers::GetDisplayString(DoorAction) });
+        return positionString + " | " + actionString;
+    }
+};
+
 UENUM(BlueprintType)
 enum class EDoorState : uint8
 {
@@ -234,6 +303,11 @@ struct WallState
         DoorPosition = FMath::RandRange(1, doorPositionMax);
     }
 
+    void GenerateRandomDoorPosition(int doorPositionMax, FRandomStream& randomStream)
+    {
+        DoorPosition = randomStream.RandRange(1, doorPositionMax);
+    }
+
     EDoorState DoorState = EDoorState::Closed;
     int DoorPosition = -1;
     bool bWallExists = false;
@@ -266,11 +340,486 @@ namespace
     }
 };
 
-typedef uint64 InnerRoomBitmask;
-namespace
+/*
+A fixed size bitset whose bits can be set from any thread. Bits are set with a compare-and-swap on their word, and consumed on
+the owning thread by swapping each non-zero word with 0, so a bit set while the words are being consumed is never lost.
+The size must only be changed while no other thread is using the set.
+*/
+class AtomicBitset
+{
+public:
+    void Init(int numBits)
+    {
+        NumBits = numBits;
+        Words.Init(0, (numBits + WordBits - 1) / WordBits);
+    }
+
+    int Num() const { return NumBits; }
+
+    /* Returns true if the bit was clear before. */
+    bool SetBit(int index)
+    {
+        if (!ensure(index >= 0 && index < NumBits))
+            return false;
+        volatile int32* word = &Words[index / WordBits];
+        const int32 bit = (int32)(1u << (index % WordBits));
+        int32 expected = *word;
+        while ((expected & bit) == 0)
+        {
+            const int32 previous = FPlatformAtomics::InterlockedCompareExchange(word, expected | bit, expected);
+            if (previous == expected)
+                return true;
+            expected = previous;
+        }
+        return false;
+    }
+
+    /* Sets every bit. Owning thread only. */
+    void SetAll()
+    {
+        for (int w = 0; w < Words.Num(); ++w)
+        {
+            const int numWordBits = FMath::Min(WordBits, NumBits - w * WordBits);
+            FPlatformAtomics::InterlockedExchange(&Words[w], numWordBits == WordBits ? (int32)~0u : (int32)((1u << numWordBits) - 1));
+        }
+    }
+
+    /* Clears every bit, calling function(index) for each bit that was set, in ascending order. */
+    template<typename Function>
+    void ConsumeSetBits(Function function)
+    {
+        for (int w = 0; w < Words.Num(); ++w)
+        {
+            if (Words[w] == 0)
+                continue;
+            uint32 word = (uint32)FPlatformAtomics::InterlockedExchange(&Words[w], 0);
+            while (word != 0)
+            {
+                function(w * WordBits + (int)FMath::CountTrailingZeros(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    static constexpr int WordBits = 32;
+    TArray<int32> Words;
+    int NumBits = 0;
+};
+
+/*
+A bitboard holding one bit per cell of a room (or of a room's inner structure). Row x is stored in its own word, with bit y
+representing cell (x, y). Moving North / South is a shift across rows and moving East / West is a shift within each row,
+so whole-room operations cost one word operation per row. Rooms can be up to MaxSide cells along each side.
+*/
+class RoomBitboard
+{
+public:
+    typedef uint32 RowType;
+    static constexpr int MaxSide = sizeof(RowType) * CHAR_BIT;
+
+    RoomBitboard() {}
+
+    RoomBitboard(int numX, int numY)
+    {
+        Init(numX, numY);
+    }
+
+    /* Resizes the bitboard and clears all cells. */
+    void Init(int numX, int numY)
+    {
+        ensure(numX >= 0 && numX <= MaxSide && numY >= 0 && numY <= MaxSide);
+        NumY = FMath::Clamp(numY, 0, MaxSide);
+        Rows.SetNumZeroed(FMath::Clamp(numX, 0, MaxSide));
+        for (RowType& row : Rows)
+            row = 0;
+    }
+
+    int GetNumX() const { return Rows.Num(); }
+    int GetNumY() const { return NumY; }
+    bool IsSizeValid() const { return Rows.Num() > 0 && NumY > 0; }
+    bool HasSameSize(const RoomBitboard& other) const { return Rows.Num() == other.Rows.Num() && NumY == other.NumY; }
+    bool IsInside(FIntPoint cell) const { return cell.X >= 0 && cell.X < Rows.Num() && cell.Y >= 0 && cell.Y < NumY; }
+
+    /* The bits of a row that correspond to cells. */
+    RowType GetRowMask() const { return NumY >= MaxSide ? ~(RowType)0 : (((RowType)1 << NumY) - 1); }
+
+    RowType GetRow(int x) const { return Rows[x]; }
+    void SetRow(int x, RowType row) { Rows[x] = row & GetRowMask(); }
+
+    bool Get(FIntPoint cell) const { return IsInside(cell) && (Rows[cell.X] & ((RowType)1 << cell.Y)) != 0; }
+    void Set(FIntPoint cell, bool value = true)
+    {
+        if (!IsInside(cell))
+            return;
+        if (value)
+            Rows[cell.X] |= ((RowType)1 << cell.Y);
+        else
+            Rows[cell.X] &= ~((RowType)1 << cell.Y);
+    }
+
+    void Clear()
+    {
+        for (RowType& row : Rows)
+            row = 0;
+    }
+
+    void Fill()
+    {
+        const RowType mask = GetRowMask();
+        for (RowType& row : Rows)
+            row = mask;
+    }
+
+    bool IsEmpty() const
+    {
+        for (RowType row : Rows)
+            if (row != 0)
+                return false;
+        return true;
+    }
+
+    int CountSetBits() const
+    {
+        int count = 0;
+        for (RowType row : Rows)
+            count += (int)FMath::CountBits((uint64)row);
+        return count;
+    }
+
+    /* Finds the first set cell in row-major order. Returns false if no cells are set. */
+    bool GetFirstSetCell(FIntPoint& cell) const
+    {
+        for (int x = 0; x < Rows.Num(); ++x)
+        {
+            if (Rows[x] != 0)
+            {
+                cell = FIntPoint(x, (int)FMath::CountTrailingZeros(Rows[x]));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Calls function(FIntPoint cell) for each set cell, in row-major order. */
+    template<typename Function>
+    void ForEachSetCell(Function function) const
+    {
+        for (int x = 0; x < Rows.Num(); ++x)
+        {
+            RowType row = Rows[x];
+            while (row != 0)
+            {
+                const int y = (int)FMath::CountTrailingZeros(row);
+                function(FIntPoint(x, y));
+                row &= row - 1;
+            }
+        }
+    }
+
+    /* Finds the nth set cell in row-major order (n from 0). Returns false if fewer than n + 1 cells are set. */
+    bool GetNthSetCell(int n, FIntPoint& cell) const
+    {
+        if (n < 0)
+            return false;
+        for (int x = 0; x < Rows.Num(); ++x)
+        {
+            RowType row = Rows[x];
+            const int numInRow = (int)FMath::CountBits((uint64)row);
+            if (n >= numInRow)
+            {
+                n -= numInRow;
+                continue;
+            }
+            for (; n > 0; --n)
+                row &= row - 1;
+            cell = FIntPoint(x, (int)FMath::CountTrailingZeros(row));
+            return true;
+        }
+        return false;
+    }
+
+    /*
+    Finds the set cell closest to origin (by straight line distance). Ties go to the lower row, then the lower column.
+    Each row is checked with two bit scans, one either side of origin.Y. Returns false if no cells are set.
+    */
+    bool GetNearestSetCell(FIntPoint origin, FIntPoint& cell) const
+    {
+        const int originY = FMath::Clamp(origin.Y, 0, FMath::Max(NumY - 1, 0));
+        // Columns at and above originY, and columns below it.
+        const RowType upperMask = GetRowMask() & ~(((RowType)1 << originY) - 1);
+        const RowType lowerMask = ((RowType)1 << originY) - 1;
+        int bestDistanceSq = INT_MAX;
+        for (int x = 0; x < Rows.Num(); ++x)
+        {
+            const int dx = x - origin.X;
+            if (dx * dx >= bestDistanceSq || Rows[x] == 0)
+                continue;
+            int nearestY = INDEX_NONE;
+            int nearestDY = INT_MAX;
+            if (const RowType upper = Rows[x] & upperMask)
+            {
+                nearestY = (int)FMath::CountTrailingZeros(upper);
+                nearestDY = FMath::Abs(nearestY - origin.Y);
+            }
+            if (const RowType lower = Rows[x] & lowerMask)
+            {
+                const int lowerY = (int)FMath::FloorLog2(lower);
+                if (origin.Y - lowerY <= FMath::Abs(nearestDY))
+                {
+                    nearestY = lowerY;
+                    nearestDY = origin.Y - lowerY;
+                }
+            }
+            const int distanceSq = dx * dx + nearestDY * nearestDY;
+            if (distanceSq < bestDistanceSq)
+            {
+                bestDistanceSq = distanceSq;
+                cell = FIntPoint(x, nearestY);
+            }
+        }
+        return bestDistanceSq != INT_MAX;
+    }
+
+    /* Clears the outermost rows and columns. */
+    void ClearBorder()
+    {
+        if (Rows.Num() == 0)
+            return;
+        const RowType innerMask = GetRowMask() & ~(RowType)1 & ~((RowType)1 << FMath::Max(NumY - 1, 0));
+        for (RowType& row : Rows)
+            row &= innerMask;
+        Rows[0] = 0;
+        Rows[Rows.Num() - 1] = 0;
+    }
+
+    // --------------------- shifts -------------------------------------
+    // Each shift moves every cell one step in the given direction. Cells shifted off the edge are dropped.
+
+    /* (x, y) -> (x + 1, y) */
+    RoomBitboard ShiftedNorth() const
+    {
+        RoomBitboard shifted(GetNumX(), NumY);
+        for (int x = 1; x < Rows.Num(); ++x)
+            shifted.Rows[x] = Rows[x - 1];
+        return shifted;
+    }
+
+    /* (x, y) -> (x - 1, y) */
+    RoomBitboard ShiftedSouth() const
+    {
+        RoomBitboard shifted(GetNumX(), NumY);
+        for (int x = 0; x < Rows.Num() - 1; ++x)
+            shifted.Rows[x] = Rows[x + 1];
+        return shifted;
+    }
+
+    /* (x, y) -> (x, y + 1) */
+    RoomBitboard ShiftedEast() const
+    {
+        RoomBitboard shifted(GetNumX(), NumY);
+        const RowType mask = GetRowMask();
+        for (int x = 0; x < Rows.Num(); ++x)
+            shifted.Rows[x] = (Rows[x] << 1) & mask;
+        return shifted;
+    }
+
+    /* (x, y) -> (x, y - 1) */
+    RoomBitboard ShiftedWest() const
+    {
+        RoomBitboard shifted(GetNumX(), NumY);
+        for (int x = 0; x < Rows.Num(); ++x)
+            shifted.Rows[x] = Rows[x] >> 1;
+        return shifted;
+    }
+
+    // --------------------- set operations -------------------------------------
+    // Operands are expected to have the same size.
+
+    RoomBitboard& operator&= (const RoomBitboard& other)
+    {
+        ensure(HasSameSize(other));
+        for (int x = 0; x < Rows.Num() && x < other.Rows.Num(); ++x)
+            Rows[x] &= other.Rows[x];
+        return *this;
+    }
+
+    RoomBitboard& operator|= (const RoomBitboard& other)
+    {
+        ensure(HasSameSize(other));
+        for (int x = 0; x < Rows.Num() && x < other.Rows.Num(); ++x)
+            Rows[x] |= other.Rows[x];
+        return *this;
+    }
+
+    /* Clears every cell that is set in other. */
+    RoomBitboard& AndNot(const RoomBitboard& other)
+    {
+        ensure(HasSameSize(other));
+        for (int x = 0; x < Rows.Num() && x < other.Rows.Num(); ++x)
+            Rows[x] &= ~other.Rows[x];
+        return *this;
+    }
+
+    RoomBitboard operator& (const RoomBitboard& other) const { RoomBitboard result = *this; result &= other; return result; }
+    RoomBitboard operator| (const RoomBitboard& other) const { RoomBitboard result = *this; result |= other; return result; }
+
+    RoomBitboard operator~ () const
+    {
+        RoomBitboard result = *this;
+        const RowType mask = GetRowMask();
+        for (RowType& row : result.Rows)
+            row = ~row & mask;
+        return result;
+    }
+
+    bool operator== (const RoomBitboard& other) const
+    {
+        if (!HasSameSize(other))
+            return false;
+        for (int x = 0; x < Rows.Num(); ++x)
+            if (Rows[x] != other.Rows[x])
+                return false;
+        return true;
+    }
+
+    bool operator!= (const RoomBitboard& other) const { return !(*this == other); }
+
+private:
+    TArray<RowType, TInlineAllocator<16>> Rows;
+    int NumY = 0;
+};
+
+/*
+Per-direction movement masks for a whole room. A cell is set in CanMove[direction] if an agent standing on it can take that
+action. Moves inside the room are derived from the room's open cells (Open and Door cells) with one shift and one AND per
+direction. Door cells whose door is open to a trained neighbouring room additionally have the exit move set, until the door is locked
+or the neighbour is disabled.
+*/
+class RoomActionMasks
+{
+public:
+    void Initialise(const RoomBitboard& openCells)
+    {
+        OpenCells = openCells;
+        CanMove[(int)EDirectionType::North] = openCells & openCells.ShiftedSouth();
+        CanMove[(int)EDirectionType::East]  = openCells & openCells.ShiftedWest();
+        CanMove[(int)EDirectionType::South] = openCells & openCells.ShiftedNorth();
+        CanMove[(int)EDirectionType::West]  = openCells & openCells.ShiftedEast();
+    }
+
+    /* Enables the move out of the room through the door at doorPosition. */
+    void EnableExit(FIntPoint doorPosition, EDirectionType direction)
+    {
+        CanMove[(int)direction].Set(doorPosition);
+    }
+
+    /* Disables the move out of the room through the door at doorPosition, e.g. when the door is locked or the next room is gone. */
+    void DisableExit(FIntPoint doorPosition, EDirectionType direction)
+    {
+        CanMove[(int)direction].Set(doorPosition, false);
+    }
+
+    bool IsCellOpen(FIntPoint position) const { return OpenCells.Get(position); }
+    bool CanTakeAction(FIntPoint position, EDirectionType direction) const { return CanMove[(int)direction].Get(position); }
+
+    uint8 GetValidActionsMask(FIntPoint position) const
+    {
+        uint8 mask = 0;
+        for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
+            mask |= CanMove[a].Get(position) ? (uint8)(1 << a) : 0;
+        return mask;
+    }
+
+    const RoomBitboard& GetOpenCells() const { return OpenCells; }
+    const RoomBitboard& GetActionMask(EDirectionType direction) const { return CanMove[(int)direction]; }
+
+private:
+    RoomBitboard OpenCells;
+    RoomBitboard CanMove[(int)EDirectionType::NumDirectionTypes];
+};
+
+/*
+Records which directions of each cell have a buildable item (e.g. a wall turret) placed, as one nibble per cell. A room is only
+given storage once something is placed in it, and loses it again when its last item is removed.
+*/
+class BuildablePlacementIndex
 {
-    constexpr int InnerRoomBitmask_Size = sizeof(InnerRoomBitmask) * CHAR_BIT;
-    int InnerRoomMaxSide() { return (int)FMath::Sqrt(InnerRoomBitmask_Size); }
+public:
+    void Init(FIntPoint roomDimensions)
+    {
+        RoomDimensions = roomDimensions;
+        RoomPlacements.Empty();
+    }
+
+    uint8 GetPlacedMask(FIntPoint roomCoords, FIntPoint positionInRoom) const
+    {
+        const TArray<uint8>* nibbles = RoomPlacements.Find(roomCoords);
+        if (nibbles == nullptr || !IsPositionValid(positionInRoom))
+            return 0;
+        const int cellIndex = GetCellIndex(positionInRoom);
+        return ((*nibbles)[cellIndex / 2] >> ((cellIndex % 2) * 4)) & 0xF;
+    }
+
+    bool IsPlaced(FIntPoint roomCoords, FIntPoint positionInRoom, EDirectionType direction) const
+    {
+        return (GetPlacedMask(roomCoords, positionInRoom) & (1 << (int)direction)) != 0;
+    }
+
+    void SetPlaced(FIntPoint roomCoords, FIntPoint positionInRoom, EDirectionType direction, bool placed)
+    {
+        if (!ensure(IsPositionValid(positionInRoom) && direction != EDirectionType::NumDirectionTypes))
+            return;
+        TArray<uint8>* nibbles = RoomPlacements.Find(roomCoords);
+        if (nibbles == nullptr)
+        {
+            if (!placed)
+                return;
+            nibbles = &RoomPlacements.Add(roomCoords);
+            nibbles->SetNumZeroed(GetNumPackedBytes());
+        }
+        const int cellIndex = GetCellIndex(positionInRoom);
+        const uint8 bit = (uint8)(1 << ((int)direction + (cellIndex % 2) * 4));
+        if (placed)
+            (*nibbles)[cellIndex / 2] |= bit;
+        else
+            (*nibbles)[cellIndex / 2] &= ~bit;
+
+        if (!placed)
+        {
+            for (uint8 byte : *nibbles)
+                if (byte != 0)
+                    return;
+            RoomPlacements.Remove(roomCoords);
+        }
+    }
+
+    /* Replaces a room's placements with packed nibbles laid out as in GetRoomPlacements. */
+    void SetRoomPlacements(FIntPoint roomCoords, const uint8* nibbles)
+    {
+        TArray<uint8>& roomNibbles = RoomPlacements.FindOrAdd(roomCoords);
+        roomNibbles.SetNumUninitialized(GetNumPackedBytes());
+        FMemory::Memcpy(roomNibbles.GetData(), nibbles, roomNibbles.Num());
+    }
+    /* The size of one room's packed nibbles. */
+    int GetNumPackedBytes() const { return (RoomDimensions.X * RoomDimensions.Y + 1) / 2; }
+
+    void ClearRoom(FIntPoint roomCoords) { RoomPlacements.Remove(roomCoords); }
+    void Clear() { RoomPlacements.Empty(); }
+
+    FIntPoint GetRoomDimensions() const { return RoomDimensions; }
+    /* The packed nibbles of each room that has items placed, two cells per byte in row-major (x, then y) order. */
+    const TMap<FIntPoint, TArray<uint8>>& GetRoomPlacements() const { return RoomPlacements; }
+
+private:
+    bool IsPositionValid(FIntPoint positionInRoom) const
+    {
+        return positionInRoom.X >= 0 && positionInRoom.X < RoomDimensions.X && positionInRoom.Y >= 0 && positionInRoom.Y < RoomDimensions.Y;
+    }
+    int GetCellIndex(FIntPoint positionInRoom) const { return positionInRoom.X * RoomDimensions.Y + positionInRoom.Y; }
+
+    FIntPoint RoomDimensions { 0, 0 };
+    TMap<FIntPoint, TArray<uint8>> RoomPlacements;
 };
 
 namespace LevelBuilderHelpers
@@ -281,10 +830,18 @@ namespace LevelBuilderHelpers
 
     bool GridPositionIsValid(FIntPoint position, int sizeX, int sizeY);
 
-    /* Packs an array of binary-valued ints into a uint64 bitmask. inset = num border units. Expected max side-minus-border of 8.*/
-    InnerRoomBitmask ArrayToBitmask(TArray<TArray<int>>& arrayRef, int inset = 1, bool invertX = false);
-    /* Unpacks a uint64 bitmask into an array of binary-valued ints. inset = num border units. Expected max side-minus-border of 8. Expects pre-sized array. */
-    void BitMaskToArray(InnerRoomBitmask bitmask, TArray<TArray<int>>& arrayRef, int inset = 1, bool invertX = false);
+    /* Packs an array of binary-valued ints into a bitboard (1 = Closed). inset = num border units. Expected max side-minus-border of RoomBitboard::MaxSide.*/
+    RoomBitboard ArrayToBitmask(const TArray<TArray<int>>& arrayRef, int inset = 1, bool invertX = false);
+    /* Unpacks a bitboard into an array of binary-valued ints. inset = num border units. Expects pre-sized array. An empty bitboard unpacks as all Open. */
+    void BitMaskToArray(const RoomBitboard& bitmask, TArray<TArray<int>>& arrayRef, int inset = 1, bool invertX = false);
+    /* Returns a bitboard of the cells in a full room structure that are in the given state. */
+    RoomBitboard GetCellsInState(const TArray<TArray<int>>& roomStructure, ECellState cellState);
+    /* Returns a bitboard of the cells in a full room structure that can be stood on (Open and Door cells). */
+    RoomBitboard GetWalkableCells(const TArray<TArray<int>>& roomStructure);
+    /* Flood fills from seeds through passable, moving North, East, South and West. Returns every passable cell that was reached. */
+    RoomBitboard GetReachableCells(const RoomBitboard& seeds, const RoomBitboard& passable);
+    /* Returns true if every set cell can be reached from every other set cell. */
+    bool AreCellsConnected(const RoomBitboard& cells);
 
     /*
     Takes in a text file and fills an array with FDirectionSets.
@@ -330,6 +887,8 @@ namespace GridTrainingConstants
     static const float MovementCost = -0.04f;
     static const float LoopCost = -1.0f;
     static const float DamageCost = -1.0f;
+    /* The reward for moving into a cell, per unit of DangerField danger. */
+    static const float DangerCost = -0.5f;
     static const float SimLearningRate = 0.5f;
     static const float ActorLearningRate = 0.5f;
     static const float SimDiscountFactor = 0.9f;
@@ -337,6 +896,60 @@ namespace GridTrainingConstants
     /* The chances of exploration from a certain position for a certain target will get smaller and smaller until this many explorations have been carried out, 
     at which point exploration will never occur.*/
     static const float ExploreCount = 100.0f;
+    /* Number of simulations run from each starting position when no tuned budget is available. */
+    static const int DefaultNumTrainingSimulations = 50;
+};
+
+/* 
+Training budget used by the LevelTrainerComponent. This lives on the game state so that it can be changed without a rebuild.
+If bAutoTune is set, the first NumTuningRooms rooms are trained with the full budget while measuring how many simulations each
+starting position needs before its greedy policy is optimal. The smallest simulation counts that reach OptimalityTarget are then
+used for all following rooms (bucketed by the starting position's distance from the goal). See TrainingBudgetTuner.
+*/
+USTRUCT(BlueprintType)
+struct FTrainingBudget
+{
+    GENERATED_USTRUCT_BODY()
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        int NumTrainingSimulations = GridTrainingConstants::DefaultNumTrainingSimulations;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        int MaxNumMovementsPerSimulation = 100;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        int ConvergenceNumActionsMin = 100;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        int ConvergenceNumActionsMax = 300;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        float DeltaQConvergenceThreshold = 0.01f;
+
+    /* Stop simulating from a starting position once the average deltaQ has converged. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget")
+        bool bStopOnConvergence = false;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget Tuning")
+        bool bAutoTune = true;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget Tuning", meta = (ClampMin = "1", UIMin = "1"))
+        int NumTuningRooms = 2;
+
+    /* The fraction of measured starting positions that must have an optimal policy within the tuned number of simulations. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Training Budget Tuning", meta = (ClampMin = "0.0", ClampMax = "1.0", UIMin = "0.0", UIMax = "1.0"))
+        float OptimalityTarget = 0.95f;
+
+    /* Tuned simulation counts, indexed by distance from the goal. Empty until tuning has finished. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Training Budget Tuning")
+        TArray<int32> NumSimulationsForGoalDistance;
+
+    int GetNumSimulationsForGoalDistance(int goalDistance) const
+    {
+        if (goalDistance <= 0 || NumSimulationsForGoalDistance.Num() == 0)
+            return NumTrainingSimulations;
+        return NumSimulationsForGoalDistance[FMath::Min(goalDistance, NumSimulationsForGoalDistance.Num() - 1)];
+    }
 };
 
 /* Action targets for actions taken from a given position. Action targets are FIntPoint positions. Actions are North, East, South, West. */
@@ -399,6 +1012,9 @@ public:
 
     void UpdateQValue(EDirectionType actionType, float learningRate, float deltaQ);
     void ResetQValues();
+    /* Copies the qvalues and rewards of the four actions out of / into arrays of NumDirectionTypes floats (see PolicyArchive). */
+    void GetQValuesAndRewards(float* qValues, float* rewards) const;
+    void SetQValuesAndRewards(const float* qValues, const float* rewards);
 
     void SetActionReward(EDirectionType movementDirection, float reward)
     {
@@ -416,7 +1032,14 @@ public:
         ActionRewardTrackers[(int)action].AddObservation(reward);
     }
 
+    SIZE_T GetAllocatedSize() const
+    {
+        return ActionQValues.GetAllocatedSize() + ActionRewards.GetAllocatedSize() + ActionRewardTrackers.GetAllocatedSize();
+    }
+
     void IncrementExplorations() { ++NumExplorations; }
+    /* Called by the trainer with the number of simulations it ran from this position, so that actors explore less in well trained rooms. */
+    void SetNumExplorations(int numExplorations) { NumExplorations = (float)numExplorations; }
     float GetExploreProbability() const { return FMath::Clamp(1.0f - (NumExplorations / GridTrainingConstants::ExploreCount), 0.0f, 1.0f); }
 private:
     TArray<float> ActionQValues{ 0.0f, 0.0f, 0.0f, 0.0f };
@@ -424,7 +1047,7 @@ private:
                                  GridTrainingConstants::MovementCost, GridTrainingConstants::MovementCost };
 
     TArray<RewardTracker> ActionRewardTrackers{RewardTracker(), RewardTracker(), RewardTracker(), RewardTracker()};
-    float NumExplorations = (float)NUM_TRAINING_SIMULATIONS;
+    float NumExplorations = (float)GridTrainingConstants::DefaultNumTrainingSimulations;
 };
 
 namespace
@@ -490,43 +1113,201 @@ namespace
         }
     }
 
-    void GetNavigationEnvironmentForRoom(TArray<TArray<int>> roomStructure, FIntPoint roomCoords, NavigationEnvironment& navEnvironment)
+    /* Heap memory held by a room's qvalue tables. */
+    SIZE_T GetRoomTargetsQValuesRewardsSetsAllocatedSize(const RoomTargetsQValuesRewardsSets& targetsSets)
     {
-        const int sizeX = roomStructure.Num();
-        const int sizeY = roomStructure[0].Num();
-        navEnvironment.Empty();
+        SIZE_T size = targetsSets.GetAllocatedSize();
+        for (const TArray<QValuesRewardsSet>& targetsRow : targetsSets)
+        {
+            size += targetsRow.GetAllocatedSize();
+            for (const QValuesRewardsSet& navSet : targetsRow)
+            {
+                size += navSet.GetAllocatedSize();
+                for (const TArray<ActionQValuesAndRewards>& row : navSet)
+                {
+                    size += row.GetAllocatedSize();
+                    for (const ActionQValuesAndRewards& qValuesAndRewards : row)
+                        size += qValuesAndRewards.GetAllocatedSize();
+                }
+            }
+        }
+        return size;
+    }
+
+    /* Fills navEnvironment from a room's action masks. A blocked action targets the position it is taken from. */
+    void GetNavigationEnvironmentForActionMasks(const RoomActionMasks& actionMasks, FIntPoint roomCoords, NavigationEnvironment& navEnvironment)
+    {
+        const RoomBitboard& openCells = actionMasks.GetOpenCells();
+        const int sizeX = openCells.GetNumX();
+        const int sizeY = openCells.GetNumY();
+        navEnvironment.SetNum(sizeX);
         for (int x = 0; x < sizeX; ++x)
         {
-            navEnvironment.Add(TArray<ActionTargets>());
             TArray<ActionTargets>& row = navEnvironment[x];
-            for (int y = 0; y < sizeY; ++y)
+            row.Reset(sizeY);
+            row.AddDefaulted(sizeY);
+        }
+        // Closed cells are never stood on, so only the open cells need their targets filled.
+        openCells.ForEachSetCell([&](FIntPoint position)
+        {
+            ActionTargets& state = navEnvironment[position.X][position.Y];
+            for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
             {
-                row.Add(ActionTargets());
-                ActionTargets& state = row[y];
-                state.SetValid(roomStructure[x][y] == (int)ECellState::Open || roomStructure[x][y] == (int)ECellState::Door);
-                if (state.IsStateValid())
-                {
-                    for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
-                    {
-                        EDirectionType actionType = EDirectionType(a);
-                        FIntPoint targetPoint = LevelBuilderHelpers::GetTargetPointForAction(FIntPoint(x, y), actionType);
+                EDirectionType actionType = EDirectionType(a);
+                const FIntPoint targetPoint = actionMasks.CanTakeAction(position, actionType) ? LevelBuilderHelpers::GetTargetPointForAction(position, actionType)
+                                                                                             : position;
+                state.SetActionTarget(actionType, { roomCoords, targetPoint });
+            }
+        });
+        for (int x = 0; x < sizeX; ++x)
+            for (int y = 0; y < sizeY; ++y)
+                navEnvironment[x][y].SetValid(openCells.Get(FIntPoint(x, y)));
+    }
 
-                        FRoomPositionPair actionTarget = {roomCoords, targetPoint};
+    void GetNavigationEnvironmentForRoom(const TArray<TArray<int>>& roomStructure, FIntPoint roomCoords, NavigationEnvironment& navEnvironment)
+    {
+        RoomActionMasks actionMasks;
+        actionMasks.Initialise(LevelBuilderHelpers::GetWalkableCells(roomStructure));
+        GetNavigationEnvironmentForActionMasks(actionMasks, roomCoords, navEnvironment);
+    }
+};
 
-                        const bool targetValid = LevelBuilderHelpers::GridPositionIsValid(targetPoint, sizeX, sizeY) &&
-                            (roomStructure[targetPoint.X][targetPoint.Y] == (int)ECellState::Open || roomStructure[targetPoint.X][targetPoint.Y] == (int)ECellState::Door);
+/*
+The per-room data that is only needed while a room exists: occupancy, navigation and qvalues. The game state allocates it when a
+room is enabled and releases it when the room is disabled, so memory scales with the rooms that have been opened. Trainer threads
+keep a reference while they train, so it is shared thread-safely.
+*/
+struct RoomData
+{
+    RoomData()
+    {}
 
-                        if (!targetValid)
-                            actionTarget = {roomCoords, FIntPoint(x, y) };
-                        
-                        state.SetActionTarget(actionType, actionTarget);
-                    }
-                }
-            }
+    RoomData(FIntPoint roomDimensions)
+    {
+        InitialiseRoomTargetsQValuesRewardsSets(QValuesRewardsSets, roomDimensions.X, roomDimensions.Y);
+        for (int x = 0; x < roomDimensions.X; ++x)
+        {
+            TArray<int32> states;
+            states.AddZeroed(roomDimensions.Y);
+            TileActorCounters.Add(states);
         }
+        ActorOccupancy.Init(roomDimensions.X, roomDimensions.Y);
+        WallOccupancy.Init(roomDimensions.X, roomDimensions.Y);
+        INC_DWORD_STAT(STAT_NumAllocatedRooms);
+        bCountedInStats = true;
+        UpdateQTableMemoryStat();
+    }
+
+    ~RoomData()
+    {
+        DEC_MEMORY_STAT_BY(STAT_QTableMemory, QTableMemory);
+        if (bCountedInStats)
+            DEC_DWORD_STAT(STAT_NumAllocatedRooms);
+    }
+
+    /* Call after replacing QValuesRewardsSets. */
+    void UpdateQTableMemoryStat()
+    {
+        DEC_MEMORY_STAT_BY(STAT_QTableMemory, QTableMemory);
+        QTableMemory = GetRoomTargetsQValuesRewardsSetsAllocatedSize(QValuesRewardsSets);
+        INC_MEMORY_STAT_BY(STAT_QTableMemory, QTableMemory);
+    }
+
+    bool TileIsEmpty(FIntPoint TilePosition) const
+    {
+        return !ActorOccupancy.Get(TilePosition) && !WallOccupancy.Get(TilePosition);
+    }
+
+    void ActorEnteredTilePosition(FIntPoint TilePosition)
+    {
+        if (++TileActorCounters[TilePosition.X][TilePosition.Y] == 1)
+            ActorOccupancy.Set(TilePosition);
+    }
+
+    void ActorExitedTilePosition(FIntPoint TilePosition)
+    {
+        if (--TileActorCounters[TilePosition.X][TilePosition.Y] == 0)
+            ActorOccupancy.Set(TilePosition, false);
+    }
+
+    /* Marks (or unmarks) every set cell in walls as occupied by an inner wall. */
+    void SetWallOccupancy(const RoomBitboard& walls, bool occupied)
+    {
+        if (occupied)
+            WallOccupancy |= walls;
+        else
+            WallOccupancy.AndNot(walls);
+    }
+
+    /* Inner cells that can be stood on and are not occupied by an actor or a wall. */
+    RoomBitboard GetEmptyCells() const
+    {
+        RoomBitboard emptyCells = ~(ActorOccupancy | WallOccupancy);
+        if (ActionMasks.GetOpenCells().HasSameSize(emptyCells))
+            emptyCells &= ActionMasks.GetOpenCells();
+        emptyCells.ClearBorder();
+        return emptyCells;
+    }
+
+    void SetNavSetForTarget(FIntPoint targetPosition, const QValuesRewardsSet& navSet)
+    {
+        QValuesRewardsSets[targetPosition.X][targetPosition.Y] = navSet;
     }
+
+    void SetTargetPosition(FIntPoint targetPosition)
+    {
+        if (PrevTargetPos != FIntPoint(-1, -1))
+        {
+
+            NavEnvironment[targetPosition.X][targetPosition.Y].SetIsGoal(false);
+        }
+        NavEnvironment[targetPosition.X][targetPosition.Y].SetIsGoal(true);
+        PrevTargetPos = targetPosition;
+    }
+
+    /** Count of the number of actors occupying each grid position in the room. Actors enter and exit positions on the game thread only. */
+    TArray<TArray<int32>> TileActorCounters;
+    /** Cells with a non-zero actor count. Kept in sync with TileActorCounters, so also game thread only. */
+    RoomBitboard ActorOccupancy;
+    /** Inner wall cells placed by the level builder. */
+    RoomBitboard WallOccupancy;
+    /** Action rewards and targets for each of the positions in the room. */
+    NavigationEnvironment NavEnvironment;
+    /** The valid actions for each of the positions in the room. Kept in sync with NavEnvironment. */
+    RoomActionMasks ActionMasks;
+    /** QValues and rewards for each target position in room */
+    RoomTargetsQValuesRewardsSets QValuesRewardsSets;
+    FIntPoint PrevTargetPos = FIntPoint(-1, -1);
+
+private:
+    SIZE_T QTableMemory = 0;
+    bool bCountedInStats = false;
+};
+
+typedef TSharedPtr<RoomData, ESPMode::ThreadSafe> RoomDataPtr;
+
+/*
+Cached facts about a room's neighbours and doors, for door queries. The game state rebuilds it on demand, and invalidates it when the
+room or one of its neighbours is enabled, disabled, trained or connected, or when one of its doors is generated, locked or unlocked.
+*/
+struct RoomAdjacency
+{
+    bool IsNeighbourTrained(EDirectionType direction) const { return (TrainedNeighboursMask & (1 << (int)direction)) != 0; }
+    bool IsDoorLocked(EDirectionType direction) const { return (LockedDoorsMask & (1 << (int)direction)) != 0; }
+    /* The door position on the given wall if the neighbour through it is trained, otherwise 0. */
+    int GetDoorPositionForExistingNeighbour(EDirectionType direction) const { return IsNeighbourTrained(direction) ? DoorPositions[(int)direction] : 0; }
+
+    bool bValid = false;
+    /* Bit d is set if the neighbour in direction d is trained or connected. */
+    uint8 TrainedNeighboursMask = 0;
+    /* Bit d is set if the door on wall d is locked. */
+    uint8 LockedDoorsMask = 0;
+    /* The door position on each wall (North, East, South, West), or -1 if it hasn't been generated. */
+    int DoorPositions[(int)EDirectionType::NumDirectionTypes] = { -1, -1, -1, -1 };
+    EQuadrantType Quadrant = EQuadrantType::NumQuadrants;
 };
 
+/* The state of a room grid position. This covers the whole grid, so only lightweight state lives here directly. */
 struct RoomState
 {
     enum Status : uint8
@@ -540,27 +1321,17 @@ struct RoomState
     RoomState() 
     {}
 
-    RoomState(FIntPoint roomDimensions)
-    {
-        InitialiseRoomTargetsQValuesRewardsSets(QValuesRewardsSets, roomDimensions.X, roomDimensions.Y);
-        for (int x = 0; x < roomDimensions.X; ++x)
-        {
-            TArray<FThreadSafeCounter> states;
-            states.AddDefaulted(roomDimensions.Y);
-            TileActorCounters.Add(states);
-        }
-    }
-
     ~RoomState()
     {}
 
-    void InitializeRoom(float health, float complexity = 0.0f, float density = 0.0f)
+    void InitializeRoom(FIntPoint roomDimensions, float health, float complexity = 0.0f, float density = 0.0f)
     {
         RoomStatus = Training;
         TrainingProgress = 0.0f;
         RoomHealth = health;
         Complexity = complexity;
         Density = density;
+        Data = MakeShareable(new RoomData(roomDimensions));
     }
 
     void SetRoomTrained()
@@ -588,33 +1359,19 @@ struct RoomState
 
     bool TileIsEmpty(FIntPoint TilePosition) const
     {
-        return TileActorCounters[TilePosition.X][TilePosition.Y].GetValue() == 0;
+        return !Data.IsValid() || Data->TileIsEmpty(TilePosition);
     }
 
     void ActorEnteredTilePosition(FIntPoint TilePosition)
     {
-        TileActorCounters[TilePosition.X][TilePosition.Y].Increment();
+        if (Data.IsValid())
+            Data->ActorEnteredTilePosition(TilePosition);
     }
 
     void ActorExitedTilePosition(FIntPoint TilePosition)
     {
-        TileActorCounters[TilePosition.X][TilePosition.Y].Decrement();
-    }
-
-    void SetNavSetForTarget(FIntPoint targetPosition, const QValuesRewardsSet& navSet)
-    {
-        QValuesRewardsSets[targetPosition.X][targetPosition.Y] = navSet;
-    }
-
-    void SetTargetPosition(FIntPoint targetPosition)
-    {
-        if (PrevTargetPos != FIntPoint(-1, -1))
-        {
-
-            NavEnvironment[targetPosition.X][targetPosition.Y].SetIsGoal(false);
-        }
-        NavEnvironment[targetPosition.X][targetPosition.Y].SetIsGoal(true);
-        PrevTargetPos = targetPosition;
+        if (Data.IsValid())
+            Data->ActorExitedTilePosition(TilePosition);
     }
 
     float RoomHealth = 100.0f;
@@ -622,19 +1379,16 @@ struct RoomState
     float Density = 0.0f;
     Status RoomStatus = Dead;
     float TrainingProgress = 0.0f;
-    /* A bit mask representing the inner 8x8 square structure of the room (unrolled). */
-    InnerRoomBitmask InnerStructure = 0;
+    /* A bitboard representing the inner structure of the room (the room without its perimeter walls). Set cells are closed. */
+    RoomBitboard InnerStructure;
     /* Rooms have only south and west walls. North and east are the south and west walls of neighbouring rooms. */
     WallState SouthWall;
     /* Rooms have only south and west walls. North and east are the south and west walls of neighbouring rooms. */
     WallState WestWall;
     /* The point that must be reached in order to unlock/connect the room. */
     FIntPoint SignalPoint = FIntPoint(-1, -1);
-    /** Count of the number of actors occupying each grid position in the room. */
-    TArray<TArray<FThreadSafeCounter>> TileActorCounters;
-    /** Action rewards and targets for each of the positions in the room. */
-    NavigationEnvironment NavEnvironment;
-    /** QValues and rewards for each target position in room */
-    RoomTargetsQValuesRewardsSets QValuesRewardsSets;
-    FIntPoint PrevTargetPos = FIntPoint(-1, -1);
-};
\ No newline at end of file
+    /* Rebuilt on demand by the game state. See RoomAdjacency. */
+    mutable RoomAdjacency Adjacency;
+    /* Only allocated while the room exists. */
+    RoomDataPtr Data;
+};
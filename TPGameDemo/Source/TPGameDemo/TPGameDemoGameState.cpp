@@ -3,6 +3,10 @@
 #include "TPGameDemo.h"
 #include <functional>
 #include "TPGameDemoGameState.h"
+#include "EnemyActor.h"
+#include "Async/ParallelFor.h"
+#include "WorldSnapshot.h"
+#include "GridLineOfSight.h"
 
 //====================================================================================================
 // ATPGameDemoGameState
@@ -15,6 +19,7 @@ ATPGameDemoGameState::ATPGameDemoGameState(const FObjectInitializer& ObjectIniti
     FString LevelPoliciesDir = FPaths::ProjectDir();
     LevelPoliciesDir += "Content/Levels/GeneratedRooms/";
     LevelPoliciesDirFound = FPlatformFileManager::Get().GetPlatformFile().DirectoryExists (*LevelPoliciesDir);
+    SpawnRandomStream.Initialize(FMath::Rand());
 }
 
 ATPGameDemoGameState::~ATPGameDemoGameState()
@@ -44,7 +49,11 @@ void ATPGameDemoGameState::InitialiseArrays()
 {
     ATPGameDemoGameMode* gameMode = (ATPGameDemoGameMode*) GetWorld()->GetAuthGameMode();
 
-    MazePositionBuildableStates.SetNum(NumGridsXY * NumGridsXY * GridUnitLengthXCM * GridUnitLengthYCM);
+    BudgetTuner.Reset(TrainingBudget);
+    InitialiseWorldRandomStream(WorldSeed != 0 ? WorldSeed : FMath::Rand());
+    BuildablePlacements.Init(FIntPoint(NumGridUnitsX, NumGridUnitsY));
+    Dangers.Init(FIntPoint(NumGridUnitsX, NumGridUnitsY));
+    UpdateCoordinateMapper();
     // Add one extra row of room states (where the south wall will be the north wall of the final room, and the west wall will be ignored).
     for (int x = 0; x < NumGridsXY + 1; ++x)
     {
@@ -54,7 +63,7 @@ void ATPGameDemoGameState::InitialiseArrays()
         // Add one extra column of room states (where the west wall will be the east wall of the final room, and the south wall will be ignored).
         for (int y = 0; y < NumGridsXY + 1; ++y)
         {
-            roomsRow.Add(RoomState(FIntPoint(NumGridUnitsX, NumGridUnitsY)));
+            roomsRow.Add(RoomState());
 
             roomBuilderRow.Add(nullptr);
             wallBuilderRow.Add(nullptr);
@@ -63,58 +72,576 @@ void ATPGameDemoGameState::InitialiseArrays()
         RoomBuilders.Add(roomBuilderRow);
         WallBuilders.Add(wallBuilderRow);
     }
+    SIZE_T roomStatesMemory = RoomStates.GetAllocatedSize();
+    for (const TArray<RoomState>& roomsRow : RoomStates)
+        roomStatesMemory += roomsRow.GetAllocatedSize();
+    SET_MEMORY_STAT(STAT_RoomStateMemory, roomStatesMemory);
+    // Two walls (south, west) per wall couple.
+    WallsToUpdate.Init(RoomStates.Num() * RoomStates[0].Num() * 2);
+    if (!StreamedPolicyArchive.IsEmpty())
+        StartRoomStreaming(StreamedPolicyArchive);
 }
 
 void ATPGameDemoGameState::Tick( float DeltaTime )
 {
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_GameStateTick);
     if (PerimeterDoorsNeedUnlocked)
     {
         UnlockPerimeterDoors();
         ++CurrentPerimeter;
         NumPerimeterRoomsConnected = 0;
         PerimeterDoorsNeedUnlocked = false;
+        if (bStageNextPerimeter)
+            StageRoomsOnPerimeter(CurrentPerimeter + 1);
         ATPGameDemoGameMode* gameMode = (ATPGameDemoGameMode*)GetWorld()->GetAuthGameMode();
         UpdateSignalStrength(gameMode->DefaultSignalStrength);
         OnPerimeterComplete.Broadcast();
     }
 
-    for (auto wallPosition : WallsToUpdate)
+    UpdateFlaggedWalls();
+
+    UpdateEnemyTickDetail(DeltaTime);
+    UpdateChaseFlowField();
+    EnemyAI.ProcessDecisions(*this);
+    ApplyEnemyDecisions();
+
+    if (Pipeline.IsValid())
+        UpdatePipelinePriority();
+    if (Streamer.IsValid())
+        UpdateRoomStreaming();
+
+    if (Recorder.IsValid())
+    {
+        RecordPlayerCell();
+        Recorder->EndFrame(DeltaTime);
+    }
+}
+
+void ATPGameDemoGameState::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    StopSessionRecording();
+    EnemyAI.Reset();
+    EnemyAgentActors.Empty();
+    ChaseField.Reset();
+    if (Pipeline.IsValid())
     {
-        auto roomCoords = wallPosition.WallCoupleCoords;
-        auto wallType = wallPosition.WallType;
-        auto wallState = GetWallState(roomCoords, wallType);
-        auto neighbourCoords = GetRoomCoords(GetNeighbouringRoomIndices(roomCoords, wallType));
-        bool roomExists = DoesRoomExist(roomCoords);
-        bool neighbourExists = DoesRoomExist(neighbourCoords); 
+        Pipeline->Shutdown();
+        Pipeline.Reset();
+    }
+    CommittedRoomPackages.Empty();
+    RestoredRoomPackages.Empty();
+    StopRoomStreaming();
+    Super::EndPlay(EndPlayReason);
+}
 
-        if (!(roomExists || neighbourExists))
+//============================================================================
+// World Seed & Session Recording
+//============================================================================
+void ATPGameDemoGameState::InitialiseWorldRandomStream(int32 seed)
+{
+    ActiveWorldSeed = seed;
+    WorldRandomStream.Initialize(seed);
+    SpawnRandomStream.Initialize(WorldRandomStream.RandHelper(MAX_int32));
+}
+
+bool ATPGameDemoGameState::StartSessionRecording(const FString& filePath)
+{
+    if (RoomStates.Num() == 0)
+        return false;
+    StopSessionRecording();
+    SessionRecording::Header header;
+    header.WorldSeed = ActiveWorldSeed;
+    header.NumGridsXY = NumGridsXY;
+    header.RoomSize = FIntPoint(NumGridUnitsX, NumGridUnitsY);
+    Recorder = MakeUnique<SessionRecorder>(filePath, header);
+    // Placed turrets come before the rooms, so that the replay's danger field is complete when the rooms are retrained.
+    for (const TPair<FIntPoint, TArray<uint8>>& roomPlacements : BuildablePlacements.GetRoomPlacements())
+    {
+        for (int x = 0; x < NumGridUnitsX; ++x)
+        {
+            for (int y = 0; y < NumGridUnitsY; ++y)
+            {
+                const uint8 placedMask = BuildablePlacements.GetPlacedMask(roomPlacements.Key, FIntPoint(x, y));
+                for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+                    if (placedMask & (1 << d))
+                        Recorder->TurretPlacementChanged({ roomPlacements.Key, FIntPoint(x, y) }, (EDirectionType)d, true);
+            }
+        }
+    }
+    // Rooms that already exist are recorded next, so the replay starts from the same world.
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < RoomStates[x].Num(); ++y)
+        {
+            const RoomState& room = RoomStates[x][y];
+            if (!room.RoomExists())
+                continue;
+            const FIntPoint roomCoords = GetRoomCoords(FIntPoint(x, y));
+            TArray<int> doorPositionsNESW;
+            GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+            Recorder->RoomEnabled(roomCoords, doorPositionsNESW, room.Complexity, room.Density);
+            Recorder->RoomStructureChanged(roomCoords, room.InnerStructure);
+            if (room.RoomStatus == RoomState::Status::Trained || room.RoomStatus == RoomState::Status::Connected)
+            {
+                const RoomTrainingInputs* trainedInputs = TrainedRoomInputsMap.Find(roomCoords);
+                const RoomTrainingInputs inputs = trainedInputs != nullptr ? *trainedInputs : GetCurrentTrainingInputs(roomCoords);
+                Recorder->RoomTrained(roomCoords, inputs.Budget, inputs.CellDangers, inputs.TrainingSeed);
+            }
+            if (room.RoomStatus == RoomState::Status::Connected)
+                Recorder->RoomConnected(roomCoords);
+        }
+    }
+    UE_LOG(LogSessionRecording, Display, TEXT("Recording session to %s (world seed %d)"), *filePath, ActiveWorldSeed);
+    return true;
+}
+
+void ATPGameDemoGameState::StopSessionRecording()
+{
+    if (Recorder.IsValid())
+    {
+        Recorder->Finish();
+        Recorder.Reset();
+    }
+}
+
+void ATPGameDemoGameState::RecordPlayerCell()
+{
+    AMazeActor* player = Cast<AMazeActor>(UGameplayStatics::GetPlayerPawn(this, 0));
+    if (player == nullptr)
+        return;
+    const FRoomPositionPair cell = { player->CurrentRoomCoords, FIntPoint(player->GridXPosition, player->GridYPosition) };
+    if (cell.RoomCoords != RecordedPlayerCell.RoomCoords || cell.PositionInRoom != RecordedPlayerCell.PositionInRoom)
+    {
+        Recorder->PlayerCellChanged(cell);
+        RecordedPlayerCell = cell;
+    }
+}
+
+//============================================================================
+// Policy Archives
+//============================================================================
+int32 ATPGameDemoGameState::SavePolicyArchive(const FString& filePath)
+{
+    PolicyArchiveWriter writer(FIntPoint(NumGridUnitsX, NumGridUnitsY));
+    int32 numRooms = 0;
+    TArray<BehaviourMap> behaviourMaps;
+    EncodedRoomPolicy encodedPolicy;
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < RoomStates[x].Num(); ++y)
+        {
+            const RoomState& room = RoomStates[x][y];
+            if (!room.Data.IsValid() || (room.RoomStatus != RoomState::Status::Trained && room.RoomStatus != RoomState::Status::Connected))
+                continue;
+            const FIntPoint roomCoords = GetRoomCoords(FIntPoint(x, y));
+            ArchivedRoomLayout layout;
+            GetDoorPositionsNESW(roomCoords, layout.DoorPositionsNESW);
+            layout.NormedDensity = room.Density;
+            layout.NormedComplexity = room.Complexity;
+            layout.InnerStructure = room.InnerStructure;
+            writer.AddRoomLayout(roomCoords, layout);
+            writer.AddQTables(roomCoords, room.Data->QValuesRewardsSets);
+            if (GetRoomBehaviourMaps(roomCoords, behaviourMaps))
+            {
+                encodedPolicy.Encode(FIntPoint(NumGridUnitsX, NumGridUnitsY), behaviourMaps);
+                writer.AddEncodedBehaviourMaps(roomCoords, encodedPolicy);
+            }
+            ++numRooms;
+        }
+    }
+    return writer.Save(filePath) ? numRooms : 0;
+}
+
+int32 ATPGameDemoGameState::LoadPolicyArchive(const PolicyArchive& archive)
+{
+    if (archive.GetRoomSize() != FIntPoint(NumGridUnitsX, NumGridUnitsY))
+    {
+        UE_LOG(LogPolicyArchive, Warning, TEXT("The policy archive's room size doesn't match the game state's."));
+        return 0;
+    }
+    int32 numRoomsLoaded = 0;
+    for (const PolicyArchiveFormat::Entry& entry : archive.GetEntries())
+    {
+        const FIntPoint roomCoords = entry.GetRoomCoords();
+        const FIntPoint roomIndices = roomCoords + FIntPoint(NumGridsXY / 2, NumGridsXY / 2);
+        if (entry.Type != PolicyArchiveFormat::EEntryType::QTables || !RoomXYIndicesValid(roomIndices) || !DoesRoomExist(roomCoords))
+            continue;
+        if (RoomStates[roomIndices.X][roomIndices.Y].RoomStatus == RoomState::Training)
+        {
+            UE_LOG(LogPolicyArchive, Log, TEXT("Skipped room %s, which is still being trained."), *roomCoords.ToString());
+            continue;
+        }
+        // The tables only apply to the layout they were trained on.
+        const PolicyArchiveFormat::Entry* layoutEntry = archive.FindEntry(roomCoords, PolicyArchiveFormat::EEntryType::RoomLayout);
+        ArchivedRoomLayout layout;
+        TArray<int> doorPositionsNESW;
+        GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+        if (layoutEntry == nullptr || !archive.ReadRoomLayout(*layoutEntry, layout) || layout.DoorPositionsNESW != doorPositionsNESW
+            || layout.InnerStructure != GetRoomInnerStructure(roomCoords))
         {
-            DisableWallState(roomCoords, wallType);
+            UE_LOG(LogPolicyArchive, Warning, TEXT("Skipped room %s, whose archived layout is missing or doesn't match the room."), *roomCoords.ToString());
             continue;
         }
+        RoomData& roomData = GetmRoomData(roomCoords);
+        if (!archive.ReadQTables(entry, roomData.QValuesRewardsSets))
+        {
+            UE_LOG(LogPolicyArchive, Warning, TEXT("The policy archive's qvalue tables for room %s are corrupt."), *roomCoords.ToString());
+            continue;
+        }
+        roomData.UpdateQTableMemoryStat();
+        SetRoomTrained(roomCoords);
+        ++numRoomsLoaded;
+    }
+    return numRoomsLoaded;
+}
 
-        // Door Spawned State:
-        const bool roomTrained = IsRoomTrained(roomCoords);
-        const bool neighbourTrained = IsRoomTrained(neighbourCoords);
-
-        EnableWallState(roomCoords, wallType);
-		if (roomTrained && neighbourTrained)
-		{
-			DisableDoorState(roomCoords, wallType);
-			// Movement action targets: Update the action targets in the nav position states.
-			FRoomPositionPair doorPos = GetDoorPosition(roomCoords, wallType);
-			FRoomPositionPair targetPos = GetTargetRoomAndPositionForDirectionType(doorPos, wallType);
-			Get_mActionTargets(GetmNavEnvironment(roomCoords), doorPos.PositionInRoom).SetActionTarget(wallType, targetPos);
-		}
-		else
-		{
-			EnableDoorState(roomCoords, wallType);
-		}
-        // Door Locked State:
-        UpdateDoorLockedStateForNeighbouringRooms(roomCoords, neighbourCoords, wallType);
-        LockDoorIfOnPerimeter(roomCoords);
-    }
-    WallsToUpdate.Empty();
+bool ATPGameDemoGameState::GetRoomBehaviourMaps(FIntPoint roomCoords, TArray<BehaviourMap>& behaviourMaps)
+{
+    if (!IsRoomTrained(roomCoords))
+        return false;
+    behaviourMaps.Reset(NumGridUnitsX * NumGridUnitsY);
+    for (int tx = 0; tx < NumGridUnitsX; ++tx)
+    {
+        for (int ty = 0; ty < NumGridUnitsY; ++ty)
+        {
+            BehaviourMap& behaviourMap = behaviourMaps.AddDefaulted_GetRef();
+            InitialiseBehaviourMap(behaviourMap, NumGridUnitsX, NumGridUnitsY);
+            for (int x = 0; x < NumGridUnitsX; ++x)
+                for (int y = 0; y < NumGridUnitsY; ++y)
+                    if (GetValidActions({ roomCoords, FIntPoint(x, y) }).IsValid())
+                        behaviourMap[x][y] = GetOptimalActions(roomCoords, FIntPoint(tx, ty), FIntPoint(x, y));
+        }
+    }
+    return true;
+}
+
+bool ATPGameDemoGameState::StartRoomStreaming(const FString& archiveFileName)
+{
+    StopRoomStreaming();
+    TUniquePtr<RoomStreamer> streamer = MakeUnique<RoomStreamer>();
+    if (!streamer->Start(PolicyArchive::GetArchivePath(archiveFileName)))
+        return false;
+    if (streamer->GetRoomSize() != FIntPoint(NumGridUnitsX, NumGridUnitsY))
+    {
+        UE_LOG(LogPolicyArchive, Warning, TEXT("The streamed policy archive's room size doesn't match the game state's."));
+        return false;
+    }
+    Streamer = MoveTemp(streamer);
+    StreamingCenter = FIntPoint(MAX_int32, MAX_int32);
+    return true;
+}
+
+void ATPGameDemoGameState::StopRoomStreaming()
+{
+    if (Streamer.IsValid())
+    {
+        Streamer->Shutdown();
+        Streamer.Reset();
+    }
+    StreamedRoomPackages.Empty();
+}
+
+void ATPGameDemoGameState::UpdateRoomStreaming()
+{
+    AMazeActor* player = Cast<AMazeActor>(UGameplayStatics::GetPlayerPawn(this, 0));
+    if (player != nullptr && player->CurrentRoomCoords != StreamingCenter && RoomStates.Num() > 0)
+    {
+        // Queue the rooms around the player nearest first, and drop the ones the player has moved away from.
+        StreamingCenter = player->CurrentRoomCoords;
+        const int maxCoord = GetMaxRoomPerimeter();
+        Streamer->CancelOutsideRadius(StreamingCenter, StreamingRadiusRooms);
+        for (int x = -StreamingRadiusRooms; x <= StreamingRadiusRooms; ++x)
+        {
+            for (int y = -StreamingRadiusRooms; y <= StreamingRadiusRooms; ++y)
+            {
+                const FIntPoint roomCoords = StreamingCenter + FIntPoint(x, y);
+                if (FMath::Abs(roomCoords.X) > maxCoord || FMath::Abs(roomCoords.Y) > maxCoord || DoesRoomExist(roomCoords) ||
+                    StreamedRoomPackages.Contains(roomCoords) || CommittedRoomPackages.Contains(roomCoords))
+                    continue;
+                Streamer->QueueRoom(roomCoords, FMath::Max(FMath::Abs(x), FMath::Abs(y)));
+            }
+        }
+        // Keep finished rooms one room further out, so turning back and forth at the edge doesn't reload them.
+        for (auto it = StreamedRoomPackages.CreateIterator(); it; ++it)
+        {
+            const FIntPoint offset = it.Key() - StreamingCenter;
+            if (FMath::Max(FMath::Abs(offset.X), FMath::Abs(offset.Y)) > StreamingRadiusRooms + 1)
+                it.RemoveCurrent();
+        }
+    }
+    TSharedPtr<RoomPackage> package;
+    while (Streamer->TryTakeFinished(package))
+    {
+        const FIntPoint roomCoords = package->Request.RoomCoords;
+        if (FMath::Max(FMath::Abs(roomCoords.X), FMath::Abs(roomCoords.Y)) > GetMaxRoomPerimeter() || DoesRoomExist(roomCoords) ||
+            !ApplyStreamedDoorPositions(*package))
+            continue;
+        StreamedRoomPackages.Add(roomCoords, package);
+    }
+}
+
+bool ATPGameDemoGameState::ApplyStreamedDoorPositions(const RoomPackage& package)
+{
+    const TArray<int>& doorPositionsNESW = package.Request.DoorPositionsNESW;
+    TArray<WallState*> wallStates = GetWallStatesForRoom(package.Request.RoomCoords);
+    for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
+        if (wallStates[p]->HasDoor() && wallStates[p]->DoorPosition != doorPositionsNESW[p])
+            return false;
+    for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
+        wallStates[p]->DoorPosition = doorPositionsNESW[p];
+    InvalidateRoomAdjacency(package.Request.RoomCoords);
+    return true;
+}
+
+//============================================================================
+// World Snapshots
+//============================================================================
+bool ATPGameDemoGameState::SaveWorldSnapshot(const FString& fileName)
+{
+    using namespace WorldSnapshotFormat;
+    const FString filePath = GetSnapshotPath(fileName);
+    if (RoomStates.Num() == 0)
+        return false;
+    const double startTime = FPlatformTime::Seconds();
+    FileHeader header;
+    header.NumGridUnitsX = NumGridUnitsX;
+    header.NumGridUnitsY = NumGridUnitsY;
+    header.NumGridsXY = NumGridsXY;
+    header.WorldSeed = ActiveWorldSeed;
+    header.CurrentPerimeter = CurrentPerimeter;
+    header.NumPerimeterRoomsConnected = NumPerimeterRoomsConnected;
+    header.SignalStrength = SignalStrength;
+    header.MaxSignalStrength = MaxSignalStrength;
+
+    // Trained tables are stored by reference, in a policy archive beside the snapshot.
+    const FString archiveName = FPaths::GetBaseFilename(filePath) + TEXT(".policies");
+    const FString archivePath = FPaths::GetPath(filePath) / archiveName;
+    const auto ansiArchiveName = StringCast<ANSICHAR>(*archiveName);
+    if (ansiArchiveName.Length() >= MaxArchiveNameLength)
+    {
+        UE_LOG(LogWorldSnapshot, Warning, TEXT("Couldn't save world snapshot %s: its policy archive name is longer than %d characters."), *filePath,
+               MaxArchiveNameLength - 1);
+        return false;
+    }
+    header.NumTrainedRooms = SavePolicyArchive(archivePath);
+    if (header.NumTrainedRooms > 0)
+    {
+        PolicyArchive archive;
+        if (!archive.Open(archivePath))
+            return false;
+        header.PolicyArchiveChecksum = archive.GetEntriesChecksum();
+    }
+    FCStringAnsi::Strncpy(header.PolicyArchiveName, ansiArchiveName.Get(), MaxArchiveNameLength);
+
+    TArray<RoomRecord> roomRecords;
+    roomRecords.SetNum(RoomStates.Num() * RoomStates[0].Num());
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < RoomStates[x].Num(); ++y)
+        {
+            const RoomState& room = RoomStates[x][y];
+            RoomRecord& record = roomRecords[x * RoomStates[x].Num() + y];
+            record.Status = (uint8)room.RoomStatus;
+            record.SouthWall = ToWallRecord(room.SouthWall);
+            record.WestWall = ToWallRecord(room.WestWall);
+            record.Health = room.RoomHealth;
+            record.Complexity = room.Complexity;
+            record.Density = room.Density;
+            record.TrainingProgress = room.TrainingProgress;
+            record.SignalPointX = room.SignalPoint.X;
+            record.SignalPointY = room.SignalPoint.Y;
+            record.InnerNumX = room.InnerStructure.GetNumX();
+            record.InnerNumY = room.InnerStructure.GetNumY();
+            for (int r = 0; r < room.InnerStructure.GetNumX(); ++r)
+                record.InnerRows[r] = room.InnerStructure.GetRow(r);
+        }
+    }
+    header.NumRoomRecords = roomRecords.Num();
+
+    const TMap<FIntPoint, TArray<uint8>>& placements = BuildablePlacements.GetRoomPlacements();
+    header.NumPlacementRooms = placements.Num();
+    header.PlacementBytesPerRoom = BuildablePlacements.GetNumPackedBytes();
+
+    TArray<uint8> bytes;
+    bytes.Reserve(sizeof(FileHeader) + roomRecords.Num() * sizeof(RoomRecord) + placements.Num() * (sizeof(PlacementRoom) + header.PlacementBytesPerRoom));
+    bytes.AddZeroed(sizeof(FileHeader));
+    bytes.Append((const uint8*)roomRecords.GetData(), roomRecords.Num() * sizeof(RoomRecord));
+    for (const TPair<FIntPoint, TArray<uint8>>& roomPlacements : placements)
+    {
+        const PlacementRoom placementRoom { roomPlacements.Key.X, roomPlacements.Key.Y };
+        bytes.Append((const uint8*)&placementRoom, sizeof(placementRoom));
+        bytes.Append(roomPlacements.Value);
+    }
+    header.BodyChecksum = FCrc::MemCrc32(bytes.GetData() + sizeof(FileHeader), bytes.Num() - sizeof(FileHeader));
+    FMemory::Memcpy(bytes.GetData(), &header, sizeof(header));
+    if (!FFileHelper::SaveArrayToFile(bytes, *filePath))
+    {
+        UE_LOG(LogWorldSnapshot, Warning, TEXT("Couldn't write world snapshot %s"), *filePath);
+        return false;
+    }
+    UE_LOG(LogWorldSnapshot, Display, TEXT("Saved world snapshot %s (%d bytes, %d trained rooms) in %.2fms"), *filePath, bytes.Num(),
+           header.NumTrainedRooms, (FPlatformTime::Seconds() - startTime) * 1000.0);
+    return true;
+}
+
+bool ATPGameDemoGameState::LoadWorldSnapshot(const FString& fileName)
+{
+    using namespace WorldSnapshotFormat;
+    const FString filePath = GetSnapshotPath(fileName);
+    const double startTime = FPlatformTime::Seconds();
+    TArray<uint8> bytes;
+    if (!FFileHelper::LoadFileToArray(bytes, *filePath))
+    {
+        UE_LOG(LogWorldSnapshot, Warning, TEXT("Couldn't read world snapshot %s"), *filePath);
+        return false;
+    }
+    if (RoomStates.Num() == 0)
+        InitialiseArrays();
+    FileHeader header;
+    bool valid = bytes.Num() >= sizeof(FileHeader);
+    if (valid)
+    {
+        FMemory::Memcpy(&header, bytes.GetData(), sizeof(header));
+        const int64 expectedSize = sizeof(FileHeader) + (int64)header.NumRoomRecords * sizeof(RoomRecord) +
+                                   (int64)header.NumPlacementRooms * (sizeof(PlacementRoom) + header.PlacementBytesPerRoom);
+        valid = header.Magic == FileMagic && header.Version == FileVersion && bytes.Num() == expectedSize &&
+                FCrc::MemCrc32(bytes.GetData() + sizeof(FileHeader), bytes.Num() - sizeof(FileHeader)) == header.BodyChecksum;
+    }
+    if (!valid)
+    {
+        UE_LOG(LogWorldSnapshot, Warning, TEXT("%s is not a valid world snapshot"), *filePath);
+        return false;
+    }
+    if (header.NumGridUnitsX != NumGridUnitsX || header.NumGridUnitsY != NumGridUnitsY || header.NumGridsXY != NumGridsXY ||
+        header.NumRoomRecords != (uint32)(RoomStates.Num() * RoomStates[0].Num()) || header.PlacementBytesPerRoom != (uint32)BuildablePlacements.GetNumPackedBytes())
+    {
+        UE_LOG(LogWorldSnapshot, Warning, TEXT("The world snapshot's grid doesn't match the game state's."));
+        return false;
+    }
+    PolicyArchive archive;
+    if (header.NumTrainedRooms > 0)
+    {
+        header.PolicyArchiveName[MaxArchiveNameLength - 1] = 0;
+        const FString archivePath = FPaths::GetPath(filePath) / ANSI_TO_TCHAR(header.PolicyArchiveName);
+        if (!archive.Open(archivePath) || archive.GetEntriesChecksum() != header.PolicyArchiveChecksum)
+        {
+            UE_LOG(LogWorldSnapshot, Warning, TEXT("The world snapshot's policy archive %s is missing or has changed."), *archivePath);
+            return false;
+        }
+    }
+
+    // Clear the current world. The room builders of rooms that no longer exist are torn down with their rooms.
+    StopSessionRecording();
+    if (Pipeline.IsValid())
+        Pipeline->CancelAll();
+    CommittedRoomPackages.Empty();
+    StreamedRoomPackages.Empty();
+    RestoredRoomPackages.Empty();
+    RoomTrainingInputsMap.Empty();
+    TrainedRoomInputsMap.Empty();
+    Dangers.Clear();
+    for (int x = 0; x < RoomStates.Num(); ++x)
+        for (int y = 0; y < RoomStates[x].Num(); ++y)
+            if (RoomStates[x][y].RoomExists())
+                DisableRoomState(GetRoomCoords(FIntPoint(x, y)));
+
+    InitialiseWorldRandomStream(header.WorldSeed);
+    CurrentPerimeter = header.CurrentPerimeter;
+    NumPerimeterRoomsConnected = header.NumPerimeterRoomsConnected;
+    MaxSignalStrength = header.MaxSignalStrength;
+    SignalStrength = header.SignalStrength;
+    PerimeterDoorsNeedUnlocked = false;
+
+    // Walls first, so that every room's doors are in place before any room is rebuilt.
+    TArray<RoomRecord> roomRecords;
+    roomRecords.SetNumUninitialized(header.NumRoomRecords);
+    FMemory::Memcpy(roomRecords.GetData(), bytes.GetData() + sizeof(FileHeader), header.NumRoomRecords * sizeof(RoomRecord));
+    const int numY = RoomStates[0].Num();
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < numY; ++y)
+        {
+            const RoomRecord& record = roomRecords[x * numY + y];
+            FromWallRecord(record.SouthWall, RoomStates[x][y].SouthWall);
+            FromWallRecord(record.WestWall, RoomStates[x][y].WestWall);
+        }
+    }
+
+    int numRoomsRestored = 0;
+    TArray<TArray<int>> structure;
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < numY; ++y)
+        {
+            const RoomRecord& record = roomRecords[x * numY + y];
+            const RoomState::Status status = (RoomState::Status)FMath::Min(record.Status, (uint8)RoomState::Connected);
+            if (status == RoomState::Dead || record.InnerNumX > RoomBitboard::MaxSide || record.InnerNumY > RoomBitboard::MaxSide)
+                continue;
+            const FIntPoint roomCoords = GetRoomCoords(FIntPoint(x, y));
+            TArray<int> doorPositionsNESW;
+            GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+            RoomBitboard innerStructure(record.InnerNumX, record.InnerNumY);
+            for (uint32 r = 0; r < record.InnerNumX; ++r)
+                innerStructure.SetRow(r, record.InnerRows[r]);
+            RoomGeneration::GetRoomStructure(NumGridUnitsX, innerStructure, doorPositionsNESW, structure);
+
+            // The room builder takes the restored structure rather than generating a new one.
+            TSharedPtr<RoomPackage> package = MakeShareable(new RoomPackage());
+            package->Request.RoomCoords = roomCoords;
+            package->Request.SideLength = NumGridUnitsX;
+            package->Request.DoorPositionsNESW = doorPositionsNESW;
+            package->Request.NormedDensity = record.Density;
+            package->Request.NormedComplexity = record.Complexity;
+            package->Structure = structure;
+            package->WallSegments = RoomGeneration::GetInnerWallSegments(structure);
+            if (RoomBuilders[x][y] != nullptr)
+                RestoredRoomPackages.Add(roomCoords, package);
+
+            EnableRoomStateWith(roomCoords, record.Health, record.Complexity, record.Density, [&](RoomState& room)
+            {
+                room.SignalPoint = FIntPoint(record.SignalPointX, record.SignalPointY);
+                room.InnerStructure = innerStructure;
+                UpdateRoomNavEnvironmentForStructure(roomCoords, structure);
+                // Rooms that were still training start again from scratch.
+                const PolicyArchiveFormat::Entry* qTablesEntry = archive.IsOpen() ? archive.FindEntry(roomCoords, PolicyArchiveFormat::EEntryType::QTables) : nullptr;
+                if (status != RoomState::Training && qTablesEntry != nullptr && archive.ReadQTables(*qTablesEntry, room.Data->QValuesRewardsSets))
+                {
+                    room.Data->UpdateQTableMemoryStat();
+                    room.RoomStatus = status;
+                    room.TrainingProgress = record.TrainingProgress;
+                }
+            });
+            ++numRoomsRestored;
+        }
+    }
+
+    BuildablePlacements.Clear();
+    const uint8* placementBytes = bytes.GetData() + sizeof(FileHeader) + header.NumRoomRecords * sizeof(RoomRecord);
+    for (uint32 p = 0; p < header.NumPlacementRooms; ++p)
+    {
+        PlacementRoom placementRoom;
+        FMemory::Memcpy(&placementRoom, placementBytes, sizeof(placementRoom));
+        BuildablePlacements.SetRoomPlacements(FIntPoint(placementRoom.RoomX, placementRoom.RoomY), placementBytes + sizeof(placementRoom));
+        placementBytes += sizeof(placementRoom) + header.PlacementBytesPerRoom;
+    }
+    // The archived qvalues already include the turrets' danger, so restored trained rooms count as trained with the current dangers.
+    RebuildDangerField();
+    for (int x = 0; x < RoomStates.Num(); ++x)
+    {
+        for (int y = 0; y < numY; ++y)
+        {
+            const FIntPoint roomCoords = GetRoomCoords(FIntPoint(x, y));
+            if (RoomStates[x][y].RoomExists() && IsRoomTrained(roomCoords))
+                TrainedRoomInputsMap.Add(roomCoords, GetCurrentTrainingInputs(roomCoords));
+        }
+    }
+
+    // One pass over every wall brings the wall builders, doors and exit action targets in line with the restored rooms.
+    WallsToUpdate.SetAll();
+    UpdateFlaggedWalls();
+    UE_LOG(LogWorldSnapshot, Display, TEXT("Loaded world snapshot %s (%d rooms) in %.2fms"), *filePath, numRoomsRestored,
+           (FPlatformTime::Seconds() - startTime) * 1000.0);
+    return true;
 }
 
 //============================================================================
@@ -122,8 +649,12 @@ void ATPGameDemoGameState::Tick( float DeltaTime )
 //============================================================================
 const RoomTargetsQValuesRewardsSets& ATPGameDemoGameState::GetRoomQValuesRewardsSets(FIntPoint roomCoords)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    return RoomStates[roomIndices.X][roomIndices.Y].QValuesRewardsSets;
+    return GetRoomData(roomCoords).QValuesRewardsSets;
+}
+
+RoomDataPtr ATPGameDemoGameState::GetRoomDataPtr(FIntPoint roomCoords) const
+{
+    return GetRoomStateChecked(roomCoords).Data;
 }
 
 const QValuesRewardsSet& ATPGameDemoGameState::GetRoomQValuesRewardsSetForTargetPosition(FIntPoint roomCoords, FIntPoint targetPosition)
@@ -143,7 +674,7 @@ bool ATPGameDemoGameState::IsRoomConnected(FIntPoint roomCoords) const
 
 bool ATPGameDemoGameState::IsRoomTrained(FIntPoint roomCoords) const
 {
-    auto room = GetRoomStateChecked(roomCoords);
+    const RoomState& room = GetRoomStateChecked(roomCoords);
     return room.RoomStatus == RoomState::Status::Trained || room.RoomStatus == RoomState::Connected;
 }
 
@@ -208,17 +739,15 @@ FRoomPositionPair ATPGameDemoGameState::GetDoorPosition(FIntPoint roomCoords, ED
 
 void ATPGameDemoGameState::GetDoorPositionsNESW(FIntPoint roomCoords, TArray<int>& doorPositionsNESW)
 {
-    auto wallStates = GetWallStatesForRoom(roomCoords);
-    doorPositionsNESW.SetNum((int)EDirectionType::NumDirectionTypes, true);
-    doorPositionsNESW = { wallStates[(int)EDirectionType::North]->DoorPosition,
-                         wallStates[(int)EDirectionType::East]->DoorPosition ,
-                         wallStates[(int)EDirectionType::South]->DoorPosition ,
-                         wallStates[(int)EDirectionType::West]->DoorPosition };
+    const RoomAdjacency& adjacency = GetRoomAdjacency(roomCoords);
+    doorPositionsNESW.SetNum((int)EDirectionType::NumDirectionTypes, false);
+    for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+        doorPositionsNESW[d] = adjacency.DoorPositions[d];
 }
 
 bool ATPGameDemoGameState::IsDoorUnlocked(FIntPoint roomCoords, EDirectionType wallDirection)
 {
-    return GetWallStatesForRoom(roomCoords)[(int)wallDirection]->DoorState != EDoorState::Locked;
+    return !GetRoomAdjacency(roomCoords).IsDoorLocked(wallDirection);
 }
 
 FIntPoint ATPGameDemoGameState::GetSignalPointPositionInRoom(FIntPoint roomCoords) const
@@ -236,6 +765,31 @@ bool ATPGameDemoGameState::RoomTilePositionIsEmpty(FRoomPositionPair roomAndPosi
     return TilePositionIsEmpty(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom);
 }
 
+bool ATPGameDemoGameState::GetClosestEmptyTilePosition(FIntPoint roomCoords, FIntPoint tilePosition, FIntPoint& emptyTilePosition) const
+{
+    return GetRoomData(roomCoords).GetEmptyCells().GetNearestSetCell(tilePosition, emptyTilePosition);
+}
+
+bool ATPGameDemoGameState::GetMostCentralEmptyTilePosition(FIntPoint roomCoords, FIntPoint& emptyTilePosition) const
+{
+    return GetClosestEmptyTilePosition(roomCoords, FIntPoint(NumGridUnitsX / 2, NumGridUnitsY / 2), emptyTilePosition);
+}
+
+bool ATPGameDemoGameState::GetRandomEmptyTilePosition(FIntPoint roomCoords, FIntPoint& emptyTilePosition)
+{
+    const RoomBitboard emptyCells = GetRoomData(roomCoords).GetEmptyCells();
+    const int numEmptyCells = emptyCells.CountSetBits();
+    if (numEmptyCells == 0)
+        return false;
+    return emptyCells.GetNthSetCell(SpawnRandomStream.RandHelper(numEmptyCells), emptyTilePosition);
+}
+
+void ATPGameDemoGameState::SetRoomWallOccupancy(FIntPoint roomCoords, const RoomBitboard& walls, bool occupied)
+{
+    if (GetRoomStateChecked(roomCoords).RoomExists())
+        GetmRoomData(roomCoords).SetWallOccupancy(walls, occupied);
+}
+
 bool ATPGameDemoGameState::RoomIsWithinPerimeter(FIntPoint roomCoords) const
 {
     return FMath::Abs(roomCoords.X) < CurrentPerimeter && FMath::Abs(roomCoords.Y) < CurrentPerimeter;
@@ -314,32 +868,59 @@ FRoomPositionPair ATPGameDemoGameState::GetNeighbouringCell(FRoomPositionPair ro
 
 TArray<bool> ATPGameDemoGameState::GetNeighbouringRoomStates(FIntPoint roomCoords) const
 {
-    TArray<bool> neighbouringRoomStates{false, false, false, false};
-    
+    const RoomAdjacency& adjacency = GetRoomAdjacency(roomCoords);
+    TArray<bool> neighbouringRoomStates;
+    for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
+        neighbouringRoomStates.Add(adjacency.IsNeighbourTrained((EDirectionType)p));
+    return neighbouringRoomStates;
+}
+
+TArray<int> ATPGameDemoGameState::GetDoorPositionsForExistingNeighbours(FIntPoint roomCoords)
+{
+    const RoomAdjacency& adjacency = GetRoomAdjacency(roomCoords);
+    TArray<int> doorPositions;
+    for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
+        doorPositions.Add(adjacency.GetDoorPositionForExistingNeighbour((EDirectionType)p));
+    return doorPositions;
+}
+
+const RoomAdjacency& ATPGameDemoGameState::GetRoomAdjacency(FIntPoint roomCoords) const
+{
+    const RoomState& room = GetRoomStateChecked(roomCoords);
+    RoomAdjacency& adjacency = room.Adjacency;
+    if (adjacency.bValid)
+        return adjacency;
+
+    adjacency.TrainedNeighboursMask = 0;
+    adjacency.LockedDoorsMask = 0;
     for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
     {
-        FIntPoint neighbour = GetNeighbouringRoomIndices(roomCoords, (EDirectionType)p);
+        const EDirectionType direction = (EDirectionType)p;
+        const FIntPoint neighbour = GetNeighbouringRoomIndices(roomCoords, direction);
         if (RoomXYIndicesValid(neighbour) && (RoomStates[neighbour.X][neighbour.Y].RoomStatus == RoomState::Trained 
             || RoomStates[neighbour.X][neighbour.Y].RoomStatus == RoomState::Connected))
-            neighbouringRoomStates[p] = true;
+            adjacency.TrainedNeighboursMask |= (1 << p);
+        const WallState& wallState = GetWallState(roomCoords, direction);
+        adjacency.DoorPositions[p] = wallState.DoorPosition;
+        if (wallState.DoorState == EDoorState::Locked)
+            adjacency.LockedDoorsMask |= (1 << p);
     }
-    return neighbouringRoomStates;
+    adjacency.Quadrant = GetQuadrantTypeForRoomCoords(roomCoords);
+    adjacency.bValid = true;
+    return adjacency;
 }
 
-TArray<int> ATPGameDemoGameState::GetDoorPositionsForExistingNeighbours(FIntPoint roomCoords)
+void ATPGameDemoGameState::InvalidateRoomAdjacency(FIntPoint roomCoords)
 {
-    TArray<bool> neighbourStates = GetNeighbouringRoomStates(roomCoords);
-    TArray<int> doorPositions = {0,0,0,0};
-    for (EDirectionType p = EDirectionType::North; p < EDirectionType::NumDirectionTypes; p = (EDirectionType)((int)p + 1))
+    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
+    RoomStates[roomIndices.X][roomIndices.Y].Adjacency.bValid = false;
+    ChaseField.RoomChanged(roomCoords);
+    for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
     {
-        if (neighbourStates[(int)p])
-        {
-            EDirectionType direction = (EDirectionType)p;
-            WallState& wallState = GetWallState(roomCoords, direction);
-            doorPositions[(int)p] = wallState.DoorPosition;
-        }
+        const FIntPoint neighbour = GetNeighbouringRoomIndices(roomCoords, (EDirectionType)p);
+        if (RoomXYIndicesValid(neighbour))
+            RoomStates[neighbour.X][neighbour.Y].Adjacency.bValid = false;
     }
-    return doorPositions;
 }
 
 ARoomBuilder* ATPGameDemoGameState::GetRoomBuilder(FIntPoint roomCoords)
@@ -397,7 +978,8 @@ void ATPGameDemoGameState::SetRoomHealth(FIntPoint roomCoords, float health)
 {
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     RoomStates[roomIndices.X][roomIndices.Y].RoomHealth = health;
-    RoomBuilders[roomIndices.X][roomIndices.Y]->HealthChanged(health);
+    if (ARoomBuilder* roomBuilder = RoomBuilders[roomIndices.X][roomIndices.Y])
+        roomBuilder->HealthChanged(health);
     if (RoomStates[roomIndices.X][roomIndices.Y].RoomHealth <= 0.0f && 
         RoomStates[roomIndices.X][roomIndices.Y].RoomExists())
         DisableRoomState(roomCoords);
@@ -407,7 +989,8 @@ void ATPGameDemoGameState::UpdateRoomHealth(FIntPoint roomCoords, float healthDe
 {
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     RoomStates[roomIndices.X][roomIndices.Y].RoomHealth += healthDelta;
-    RoomBuilders[roomIndices.X][roomIndices.Y]->HealthChanged(RoomStates[roomIndices.X][roomIndices.Y].RoomHealth);
+    if (ARoomBuilder* roomBuilder = RoomBuilders[roomIndices.X][roomIndices.Y])
+        roomBuilder->HealthChanged(RoomStates[roomIndices.X][roomIndices.Y].RoomHealth);
     if (RoomStates[roomIndices.X][roomIndices.Y].RoomHealth <= 0.0f && 
         RoomStates[roomIndices.X][roomIndices.Y].RoomExists())
         DisableRoomState(roomCoords);
@@ -424,11 +1007,117 @@ void ATPGameDemoGameState::UpdateSignalStrength(float delta)
 
 void ATPGameDemoGameState::SetBuildableItemPlaced(FRoomPositionPair roomAndPosition, EDirectionType direction, bool placed)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomAndPosition.RoomCoords);
-    int unwrappedRoomIndex = roomIndices.Y * NumGridsXY + roomIndices.X;
-    int roomSize = NumGridUnitsX * NumGridUnitsY;
-    int unwrappedPositionInRoom = roomAndPosition.PositionInRoom.Y * NumGridUnitsX + roomAndPosition.PositionInRoom.X;
-    MazePositionBuildableStates[unwrappedRoomIndex * roomSize + unwrappedPositionInRoom].EnableDirection(direction);
+    BuildablePlacements.SetPlaced(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom, direction, placed);
+    if (Recorder.IsValid())
+        Recorder->TurretPlacementChanged(roomAndPosition, direction, placed);
+    DangerField::CellChanges changes;
+    if (placed)
+    {
+        const RoomActionMasks* actionMasks = DoesRoomExist(roomAndPosition.RoomCoords) ? &GetRoomActionMasks(roomAndPosition.RoomCoords) : nullptr;
+        Dangers.AddTurret(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom, direction, actionMasks, changes);
+    }
+    else
+    {
+        Dangers.RemoveTurret(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom, direction, changes);
+    }
+    ApplyDangerChanges(roomAndPosition.RoomCoords, changes);
+}
+
+void ATPGameDemoGameState::BuildableItemFired(FRoomPositionPair roomAndPosition, EDirectionType direction)
+{
+    if (Recorder.IsValid())
+        Recorder->TurretFired(roomAndPosition, direction);
+    DangerField::CellChanges changes;
+    Dangers.TurretFired(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom, direction, changes);
+    ApplyDangerChanges(roomAndPosition.RoomCoords, changes);
+}
+
+void ATPGameDemoGameState::ApplyDangerChanges(FIntPoint roomCoords, const DangerField::CellChanges& changes)
+{
+    // Rooms that aren't trained yet get the changes once they are, from the dangers they were trained with (see SetRoomTrained).
+    if (changes.Num() == 0 || !TrainedRoomInputsMap.Contains(roomCoords))
+        return;
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_ApplyDangerChanges);
+    // The immediate reward of moving into a changed cell changes by the same amount for every target, so the qvalues of those moves can
+    // be shifted straight away instead of waiting for enemies to relearn them.
+    // The shifts aren't recorded. A replay makes them again from the recorded turret events.
+    struct MoveShift
+    {
+        FIntPoint From;
+        EDirectionType Action;
+        float DeltaQ;
+    };
+    TArray<MoveShift, TInlineAllocator<RoomBitboard::MaxSide * 4>> shifts;
+    const RoomActionMasks& actionMasks = GetRoomActionMasks(roomCoords);
+    for (const DangerField::CellChange& change : changes)
+    {
+        for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
+        {
+            const EDirectionType action = (EDirectionType)a;
+            const FIntPoint from = LevelBuilderHelpers::GetTargetPointForAction(change.Position, DirectionHelpers::GetOppositeDirection(action));
+            if (LevelBuilderHelpers::GridPositionIsValid(from, NumGridUnitsX, NumGridUnitsY) && actionMasks.CanTakeAction(from, action))
+                shifts.Add({ from, action, GridTrainingConstants::DangerCost * change.Delta });
+        }
+    }
+    if (shifts.Num() == 0)
+        return;
+    // Goal cells that aren't open are never trained or targeted, so only the open cells' tables are shifted. Each goal's table is
+    // separate, so they can be shifted in parallel.
+    RoomTargetsQValuesRewardsSets& roomQValuesRewards = GetmRoomData(roomCoords).QValuesRewardsSets;
+    TArray<FIntPoint> goalPositions;
+    for (int x = 0; x < NumGridUnitsX; ++x)
+        for (int y = 0; y < NumGridUnitsY; ++y)
+            if (actionMasks.IsCellOpen(FIntPoint(x, y)))
+                goalPositions.Add(FIntPoint(x, y));
+    ParallelFor(goalPositions.Num(), [&roomQValuesRewards, &goalPositions, &shifts](int32 i)
+    {
+        QValuesRewardsSet& qValuesRewards = Get_mQValuesRewardsSet_For_GoalPosition(roomQValuesRewards, goalPositions[i]);
+        for (const MoveShift& shift : shifts)
+        {
+            // As in UpdateQValueRealtime, moves away from the target are never updated.
+            if (shift.From != goalPositions[i])
+                Get_mActionQValuesAndRewards(qValuesRewards, shift.From).UpdateQValue(shift.Action, 0.0f, shift.DeltaQ);
+        }
+    }, goalPositions.Num() * shifts.Num() < ParallelDangerShiftThreshold);
+}
+
+void ATPGameDemoGameState::ApplyDangerChangesSinceTraining(FIntPoint roomCoords, const TArray<float>& trainedCellDangers)
+{
+    const TArray<float>* currentCellDangers = Dangers.GetRoomDangers(roomCoords);
+    DangerField::CellChanges changes;
+    for (int x = 0; x < NumGridUnitsX; ++x)
+    {
+        for (int y = 0; y < NumGridUnitsY; ++y)
+        {
+            const int cellIndex = x * NumGridUnitsY + y;
+            const float trainedDanger = trainedCellDangers.IsValidIndex(cellIndex) ? trainedCellDangers[cellIndex] : 0.0f;
+            const float currentDanger = currentCellDangers != nullptr && currentCellDangers->IsValidIndex(cellIndex) ? (*currentCellDangers)[cellIndex] : 0.0f;
+            if (!FMath::IsNearlyEqual(trainedDanger, currentDanger))
+                changes.Add({ FIntPoint(x, y), currentDanger - trainedDanger });
+        }
+    }
+    ApplyDangerChanges(roomCoords, changes);
+}
+
+void ATPGameDemoGameState::RebuildDangerField()
+{
+    Dangers.Clear();
+    DangerField::CellChanges changes;
+    for (const TPair<FIntPoint, TArray<uint8>>& roomPlacements : BuildablePlacements.GetRoomPlacements())
+    {
+        const FIntPoint roomCoords = roomPlacements.Key;
+        const RoomActionMasks* actionMasks = DoesRoomExist(roomCoords) ? &GetRoomActionMasks(roomCoords) : nullptr;
+        for (int x = 0; x < NumGridUnitsX; ++x)
+        {
+            for (int y = 0; y < NumGridUnitsY; ++y)
+            {
+                const uint8 placedMask = BuildablePlacements.GetPlacedMask(roomCoords, FIntPoint(x, y));
+                for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+                    if (placedMask & (1 << d))
+                        Dangers.AddTurret(roomCoords, FIntPoint(x, y), (EDirectionType)d, actionMasks, changes);
+            }
+        }
+    }
 }
 
 void ATPGameDemoGameState::SetRoomBuilder(FIntPoint roomCoords, ARoomBuilder* roomBuilderActor)
@@ -451,8 +1140,12 @@ void ATPGameDemoGameState::SetRoomConnected(FIntPoint roomCoords)
         if (RoomStates[roomIndices.X][roomIndices.Y].RoomStatus != RoomState::Status::Connected)
         {
             RoomStates[roomIndices.X][roomIndices.Y].SetRoomConnected();
+            InvalidateRoomAdjacency(roomCoords);
+            if (Recorder.IsValid())
+                Recorder->RoomConnected(roomCoords);
             RoomWasConnected(roomCoords);
-            GetRoomBuilder(roomCoords)->RoomWasConnected();
+            if (ARoomBuilder* roomBuilder = GetRoomBuilder(roomCoords))
+                roomBuilder->RoomWasConnected();
         }
     }
 }
@@ -463,26 +1156,28 @@ void ATPGameDemoGameState::SetSignalPointInRoom(FIntPoint roomCoords, FIntPoint
     RoomStates[roomIndices.X][roomIndices.Y].SignalPoint = signalPointInRoom;
 }
 
-void ATPGameDemoGameState::SetRoomInnerStructure(FIntPoint roomCoords, InnerRoomBitmask roomStructure)
+void ATPGameDemoGameState::SetRoomInnerStructure(FIntPoint roomCoords, const RoomBitboard& roomStructure)
 {
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     if (DoesRoomExist(roomCoords))
     {
         RoomStates[roomIndices.X][roomIndices.Y].InnerStructure = roomStructure;
+        if (Recorder.IsValid())
+            Recorder->RoomStructureChanged(roomCoords, roomStructure);
     }
 }
 
-InnerRoomBitmask ATPGameDemoGameState::GetRoomInnerStructure(FIntPoint roomCoords)
+RoomBitboard ATPGameDemoGameState::GetRoomInnerStructure(FIntPoint roomCoords)
 {
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     if (DoesRoomExist(roomCoords))
     {
         return RoomStates[roomIndices.X][roomIndices.Y].InnerStructure;
     }
-    return 0;
+    return RoomBitboard();
 }
 
-void ATPGameDemoGameState::EnableRoomState(FIntPoint roomCoords, float complexity, float density)
+void ATPGameDemoGameState::GenerateMissingDoorPositions(FIntPoint roomCoords, FRandomStream* randomStream /*= nullptr*/)
 {
     // initialize random door positions for walls that haven't yet generated their door positions....
     auto wallStates = GetWallStatesForRoom(roomCoords);
@@ -495,16 +1190,37 @@ void ATPGameDemoGameState::EnableRoomState(FIntPoint roomCoords, float complexit
             EDirectionType direction = (EDirectionType)p;
             int maxDoorPosition = (direction == EDirectionType::North || direction == EDirectionType::South) ? NumGridUnitsY - 2
                                                                                                                 : NumGridUnitsX - 2;
-            wallState->GenerateRandomDoorPosition(maxDoorPosition);
+            wallState->GenerateRandomDoorPosition(maxDoorPosition, randomStream != nullptr ? *randomStream : WorldRandomStream);
         }
     }
+    InvalidateRoomAdjacency(roomCoords);
+}
+
+void ATPGameDemoGameState::EnableRoomState(FIntPoint roomCoords, float complexity, float density)
+{
+    EnableRoomStateWith(roomCoords, MaxRoomHealth, complexity, density, [](RoomState&) {});
+}
+
+void ATPGameDemoGameState::EnableRoomStateWith(FIntPoint roomCoords, float health, float complexity, float density, const TFunction<void(RoomState&)>& prepareRoom)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_EnableRoomState);
+    GenerateMissingDoorPositions(roomCoords);
 
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     if (!DoesRoomExist(roomCoords))
     {
-        RoomStates[roomIndices.X][roomIndices.Y].InitializeRoom(MaxRoomHealth, complexity, density);
+        RoomStates[roomIndices.X][roomIndices.Y].InitializeRoom(FIntPoint(NumGridUnitsX, NumGridUnitsY), health, complexity, density);
+        prepareRoom(RoomStates[roomIndices.X][roomIndices.Y]);
+        InvalidateRoomAdjacency(roomCoords);
+        if (Recorder.IsValid())
+        {
+            TArray<int> doorPositionsNESW;
+            GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+            Recorder->RoomEnabled(roomCoords, doorPositionsNESW, complexity, density);
+        }
 
-        RoomBuilders[roomIndices.X][roomIndices.Y]->BuildRoom(complexity, density);
+        if (ARoomBuilder* roomBuilder = RoomBuilders[roomIndices.X][roomIndices.Y])
+            roomBuilder->BuildRoom(complexity, density);
         FlagWallsForUpdate(roomCoords);
     }
 }
@@ -515,7 +1231,17 @@ void ATPGameDemoGameState::DisableRoomState(FIntPoint roomCoords)
     if (DoesRoomExist(roomCoords))
     {
         RoomStates[roomIndices.X][roomIndices.Y].DisableRoom();
-        RoomBuilders[roomIndices.X][roomIndices.Y]->DestroyRoom();
+        RoomTrainingInputsMap.Remove(roomCoords);
+        TrainedRoomInputsMap.Remove(roomCoords);
+        // Turrets go with the room, so that a room later built in its place starts without their placements or danger.
+        BuildablePlacements.ClearRoom(roomCoords);
+        Dangers.ClearRoom(roomCoords);
+        InvalidateRoomAdjacency(roomCoords);
+        if (Recorder.IsValid())
+            Recorder->RoomDisabled(roomCoords);
+        CommittedRoomPackages.Remove(roomCoords);
+        if (ARoomBuilder* roomBuilder = RoomBuilders[roomIndices.X][roomIndices.Y])
+            roomBuilder->DestroyRoom();
         FlagWallsForUpdate(roomCoords);
     }
 }
@@ -528,24 +1254,255 @@ void ATPGameDemoGameState::SetRoomTrained(FIntPoint roomCoords)
         // Slight hack: When generating an entire perimeter of rooms, their status will be 'connected' before the complete training.
         if (RoomStates[roomIndices.X][roomIndices.Y].RoomStatus != RoomState::Status::Connected)
             RoomStates[roomIndices.X][roomIndices.Y].SetRoomTrained();
+        InvalidateRoomAdjacency(roomCoords);
+        // Rooms whose tables were loaded rather than trained have no inputs of their own, and are recorded with the current budget
+        // and dangers.
+        RoomTrainingInputs inputs;
+        if (!RoomTrainingInputsMap.RemoveAndCopyValue(roomCoords, inputs))
+            inputs = GetCurrentTrainingInputs(roomCoords);
+        if (Recorder.IsValid())
+            Recorder->RoomTrained(roomCoords, inputs.Budget, inputs.CellDangers, inputs.TrainingSeed);
+        // Turrets placed or fired while the room was training didn't reach its qvalues.
+        const RoomTrainingInputs& trainedInputs = TrainedRoomInputsMap.Add(roomCoords, MoveTemp(inputs));
+        ApplyDangerChangesSinceTraining(roomCoords, trainedInputs.CellDangers);
         FlagWallsForUpdate(roomCoords);
     }
 }
 
+void ATPGameDemoGameState::RoomTrainingFailed(FIntPoint roomCoords)
+{
+    RoomTrainingInputsMap.Remove(roomCoords);
+    CommittedRoomPackages.Remove(roomCoords);
+    if (Pipeline.IsValid())
+        Pipeline->CancelRoom(roomCoords);
+    if (DoesRoomExist(roomCoords))
+        DisableRoomState(roomCoords);
+}
+
+ATPGameDemoGameState::RoomTrainingInputs ATPGameDemoGameState::GetCurrentTrainingInputs(FIntPoint roomCoords) const
+{
+    RoomTrainingInputs inputs;
+    inputs.Budget = GetTrainingBudget();
+    if (const TArray<float>* cellDangers = Dangers.GetRoomDangers(roomCoords))
+        inputs.CellDangers = *cellDangers;
+    inputs.TrainingSeed = RoomTraining::GetRoomTrainingSeed(ActiveWorldSeed, roomCoords);
+    return inputs;
+}
+
+void ATPGameDemoGameState::SetTrainingBudget(const FTrainingBudget& budget)
+{
+    TrainingBudget = budget;
+    BudgetTuner.Reset(TrainingBudget);
+}
+
+FTrainingBudget ATPGameDemoGameState::GetTrainingBudget() const
+{
+    return BudgetTuner.GetBudget();
+}
+
+bool ATPGameDemoGameState::IsTuningTrainingBudget() const
+{
+    return BudgetTuner.IsTuning();
+}
+
+void ATPGameDemoGameState::StageRoomsOnPerimeter(int perimeter)
+{
+    if (perimeter <= 0 || perimeter > GetMaxRoomPerimeter() || RoomStates.Num() == 0)
+        return;
+    if (!Pipeline.IsValid())
+    {
+        Pipeline = MakeShareable(new RoomPipeline());
+        Pipeline->Start();
+        PipelineCenter = FIntPoint(MAX_int32, MAX_int32);
+        UpdatePipelinePriority();
+    }
+    const FTrainingBudget budget = GetTrainingBudget();
+    const bool measureConvergence = IsTuningTrainingBudget();
+    auto StageRoom = [this, &budget, measureConvergence](FIntPoint roomCoords)
+    {
+        if (DoesRoomExist(roomCoords) || CommittedRoomPackages.Contains(roomCoords))
+            return;
+        GenerateMissingDoorPositions(roomCoords);
+        RoomPackageRequest request;
+        request.RoomCoords = roomCoords;
+        request.SideLength = NumGridUnitsX;
+        GetDoorPositionsNESW(roomCoords, request.DoorPositionsNESW);
+        request.NormedDensity = StagedRoomDensity;
+        request.NormedComplexity = StagedRoomComplexity;
+        request.Seed = GenerateWorldSeededValue();
+        request.TrainingBudget = budget;
+        request.MeasureConvergence = measureConvergence;
+        if (const TArray<DangerField::Turret>* turrets = Dangers.GetRoomTurrets(roomCoords))
+            request.Turrets = *turrets;
+        Pipeline->QueueRoom(request);
+    };
+    for (int p = -perimeter; p < perimeter; ++p)
+    {
+        StageRoom(FIntPoint(perimeter, p));
+        StageRoom(FIntPoint(-p, perimeter));
+        StageRoom(FIntPoint(-perimeter, -p));
+        StageRoom(FIntPoint(p, -perimeter));
+    }
+}
+
+void ATPGameDemoGameState::UpdatePipelinePriority()
+{
+    AMazeActor* player = Cast<AMazeActor>(UGameplayStatics::GetPlayerPawn(this, 0));
+    if (player != nullptr && player->CurrentRoomCoords != PipelineCenter)
+    {
+        PipelineCenter = player->CurrentRoomCoords;
+        Pipeline->SetPriorityCenter(PipelineCenter);
+    }
+}
+
+TSharedPtr<RoomPackage> ATPGameDemoGameState::TakeStagedRoomStructure(FIntPoint roomCoords, int sideLength, float normedDensity, float normedComplexity)
+{
+    TSharedPtr<RoomPackage> package;
+    const bool isPrepared = RestoredRoomPackages.RemoveAndCopyValue(roomCoords, package) || StreamedRoomPackages.RemoveAndCopyValue(roomCoords, package);
+    if (Pipeline.IsValid())
+    {
+        if (!isPrepared)
+            package = Pipeline->TakeFinishedPackage(roomCoords);
+        // If the room is still queued or in progress, it's being built now, so the background work is no longer needed.
+        if (!package.IsValid() || isPrepared)
+            Pipeline->CancelRoom(roomCoords);
+    }
+    if (!package.IsValid())
+        return nullptr;
+    TArray<int> doorPositionsNESW;
+    GetDoorPositionsNESW(roomCoords, doorPositionsNESW);
+    const RoomPackageRequest& request = package->Request;
+    if (request.SideLength != sideLength || request.DoorPositionsNESW != doorPositionsNESW)
+        return nullptr;
+    // Restored and streamed rooms keep their saved layout, whatever density and complexity are asked for.
+    if (!isPrepared && (!FMath::IsNearlyEqual(request.NormedDensity, normedDensity) || !FMath::IsNearlyEqual(request.NormedComplexity, normedComplexity)))
+        return nullptr;
+    CommittedRoomPackages.Add(roomCoords, package);
+    return package;
+}
+
+bool ATPGameDemoGameState::CommitStagedRoomTraining(FIntPoint roomCoords)
+{
+    TSharedPtr<RoomPackage> package;
+    if (!CommittedRoomPackages.RemoveAndCopyValue(roomCoords, package) || !DoesRoomExist(roomCoords))
+        return false;
+    // The structure may have been regenerated since the package was taken, in which case the qvalues don't apply.
+    if (LevelBuilderHelpers::ArrayToBitmask(package->Structure) != GetRoomInnerStructure(roomCoords))
+        return false;
+    // Restored rooms have no qvalues in their package. Their tables were loaded straight into the room state.
+    if (package->QValuesRewardsSets.Num() == 0)
+        return IsRoomTrained(roomCoords);
+    RoomData& roomData = GetmRoomData(roomCoords);
+    roomData.QValuesRewardsSets = MoveTemp(package->QValuesRewardsSets);
+    roomData.UpdateQTableMemoryStat();
+    SetRoomTrainingInputs(roomCoords, package->Request.TrainingBudget, package->CellDangers,
+                          RoomTraining::GetRoomTrainingSeed(package->Request.Seed, roomCoords));
+    ReportPackageConvergence(*package);
+    return true;
+}
+
+TArray<FIntPoint> ATPGameDemoGameState::BuildHeadlessRooms(int perimeter, int32 seed, float normedDensity, float normedComplexity)
+{
+    TArray<FIntPoint> builtRooms;
+    if (RoomStates.Num() == 0)
+        InitialiseArrays();
+    perimeter = FMath::Clamp(perimeter, 0, GetMaxRoomPerimeter());
+
+    // Door positions are fixed first, so that every room is generated against its final doors.
+    FRandomStream randomStream(seed);
+    const FTrainingBudget budget = GetTrainingBudget();
+    const bool measureConvergence = IsTuningTrainingBudget();
+    TArray<RoomPackageRequest> requests;
+    for (int x = -perimeter; x <= perimeter; ++x)
+    {
+        for (int y = -perimeter; y <= perimeter; ++y)
+        {
+            const FIntPoint roomCoords(x, y);
+            if (DoesRoomExist(roomCoords))
+                continue;
+            GenerateMissingDoorPositions(roomCoords, &randomStream);
+            RoomPackageRequest request;
+            request.RoomCoords = roomCoords;
+            request.SideLength = NumGridUnitsX;
+            GetDoorPositionsNESW(roomCoords, request.DoorPositionsNESW);
+            request.NormedDensity = normedDensity;
+            request.NormedComplexity = normedComplexity;
+            request.Seed = randomStream.RandHelper(MAX_int32);
+            request.TrainingBudget = budget;
+            request.MeasureConvergence = measureConvergence;
+            if (const TArray<DangerField::Turret>* turrets = Dangers.GetRoomTurrets(roomCoords))
+                request.Turrets = *turrets;
+            requests.Add(request);
+        }
+    }
+
+    TArray<TSharedPtr<RoomPackage>> packages;
+    packages.SetNum(requests.Num());
+    ParallelFor(requests.Num(), [&requests, &packages](int32 i)
+    {
+        packages[i] = RoomPipeline::BuildPackage(requests[i]);
+    });
+
+    for (int i = 0; i < requests.Num(); ++i)
+    {
+        const FIntPoint roomCoords = requests[i].RoomCoords;
+        const TSharedPtr<RoomPackage>& package = packages[i];
+        if (!ensure(package.IsValid()))
+            continue;
+        const FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
+        RoomStates[roomIndices.X][roomIndices.Y].InitializeRoom(FIntPoint(NumGridUnitsX, NumGridUnitsY), MaxRoomHealth, normedComplexity, normedDensity);
+        InvalidateRoomAdjacency(roomCoords);
+        SetRoomInnerStructure(roomCoords, LevelBuilderHelpers::ArrayToBitmask(package->Structure));
+        UpdateRoomNavEnvironmentForStructure(roomCoords, package->Structure);
+        RoomData& roomData = GetmRoomData(roomCoords);
+        roomData.QValuesRewardsSets = MoveTemp(package->QValuesRewardsSets);
+        roomData.UpdateQTableMemoryStat();
+        SetRoomTrainingInputs(roomCoords, requests[i].TrainingBudget, package->CellDangers,
+                              RoomTraining::GetRoomTrainingSeed(requests[i].Seed, roomCoords));
+        ReportPackageConvergence(*package);
+        SetRoomTrained(roomCoords);
+        builtRooms.Add(roomCoords);
+    }
+    // Opens the doors between the new rooms, and sets their exit action targets.
+    UpdateFlaggedWalls();
+    return builtRooms;
+}
+
+void ATPGameDemoGameState::AddTrainingConvergenceSample(int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun)
+{
+    BudgetTuner.AddSample(goalDistance, numSimulationsToOptimal, longestGoalReachingRun);
+}
+
+void ATPGameDemoGameState::TrainingConvergenceRoomMeasured()
+{
+    BudgetTuner.RoomMeasured();
+}
+
+void ATPGameDemoGameState::ReportPackageConvergence(const RoomPackage& package)
+{
+    // If tuning finished while the package was being built, the tuner ignores these.
+    if (!package.Request.MeasureConvergence)
+        return;
+    for (const TrainingBudgetTuner::ConvergenceSample& sample : package.ConvergenceSamples)
+        BudgetTuner.AddSample(sample.GoalDistance, sample.NumSimulationsToOptimal, sample.LongestGoalReachingRun);
+    BudgetTuner.RoomMeasured();
+}
+
 void ATPGameDemoGameState::SetRoomTrainingProgress(FIntPoint roomCoords, float progress)
 {
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
     if (DoesRoomExist(roomCoords))
     {
         RoomStates[roomIndices.X][roomIndices.Y].TrainingProgress = progress;
-        RoomBuilders[roomIndices.X][roomIndices.Y]->TrainingProgressUpdated(progress);
+        if (ARoomBuilder* roomBuilder = RoomBuilders[roomIndices.X][roomIndices.Y])
+            roomBuilder->TrainingProgressUpdated(progress);
         TArray<bool> neighbourStates = GetNeighbouringRoomStates(roomCoords);
         for (int i = 0; i < (int)EDirectionType::NumDirectionTypes; ++i)
         {
             EDirectionType direction = (EDirectionType) i;
-            if(neighbourStates[i])
+            AWallBuilder* wallBuilder = GetWallBuilder(roomCoords, direction);
+            if(neighbourStates[i] && wallBuilder != nullptr)
             {
-                AWallBuilder* wallBuilder = GetWallBuilder(roomCoords, direction);
                 EDirectionType relativeDirection = (direction == EDirectionType::North) ? EDirectionType::South :
                                                    (direction == EDirectionType::East ) ? EDirectionType::West : direction;
                 wallBuilder->TrainingProgressUpdatedForDoor(relativeDirection, progress);
@@ -556,6 +1513,9 @@ void ATPGameDemoGameState::SetRoomTrainingProgress(FIntPoint roomCoords, float p
 
 bool ATPGameDemoGameState::SimulateAction(FRoomPositionPair& roomAndPosition, EDirectionType actionToTake, FIntPoint targetPosition)
 {
+    // Disabled rooms have no navigation environment to move through.
+    if (!DoesRoomExist(roomAndPosition.RoomCoords))
+        return false;
     ActionTargets& currentPosState = GetActionTargets(roomAndPosition);
     FRoomPositionPair actionTarget = currentPosState.GetActionTarget(actionToTake);
     WrapRoomPositionPair(actionTarget);
@@ -577,6 +1537,10 @@ bool ATPGameDemoGameState::SimulateAction(FRoomPositionPair& roomAndPosition, ED
 
 void ATPGameDemoGameState::UpdateQValueRealtime(FRoomPositionPair& roomAndPosition, EDirectionType actionToTake, FIntPoint targetPosition, float accumulatedReward, float learningRate)
 {
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_UpdateQValueRealtime);
+    // Agents can still report moves in a room after it has been disabled. Its tables are gone, so there is nothing to update.
+    if (!DoesRoomExist(roomAndPosition.RoomCoords))
+        return;
     ActionTargets& currentPosState = GetActionTargets(roomAndPosition);
     FRoomPositionPair actionTarget = currentPosState.GetActionTarget(actionToTake);
     WrapRoomPositionPair(actionTarget);
@@ -600,38 +1564,63 @@ void ATPGameDemoGameState::UpdateQValueRealtime(FRoomPositionPair& roomAndPositi
         currentNavState.AddActionRewardObservation(actionToTake, accumulatedReward);
         const float currentQValue = currentNavState.GetQValues()[(int)actionToTake];
         const float discountedNextReward = GridTrainingConstants::ActorDiscountFactor * maxNextReward;
-        const float immediateReward = currentNavState.GetRewards()[(int)actionToTake] + accumulatedReward;
+        const float dangerReward = GridTrainingConstants::DangerCost * Dangers.GetDanger(actionTarget.RoomCoords, actionTarget.PositionInRoom);
+        const float immediateReward = currentNavState.GetRewards()[(int)actionToTake] + accumulatedReward + dangerReward;
         const float deltaQ = learningRate * (immediateReward + discountedNextReward - currentQValue);
         currentNavState.UpdateQValue(actionToTake, learningRate, deltaQ);
+        if (Recorder.IsValid())
+            Recorder->QValueDelta(roomAndPosition, targetPosition, actionToTake, accumulatedReward, learningRate, deltaQ);
     }
 }
 
 void ATPGameDemoGameState::UpdateQValue(const FRoomPositionPair& roomAndPosition, FIntPoint goalPosition, EDirectionType actionToTake, float learningRate, float deltaQ)
 {
+    if (!DoesRoomExist(roomAndPosition.RoomCoords))
+        return;
     ActionQValuesAndRewards& currentNavState = GetActionQValuesRewards(roomAndPosition, goalPosition);
     currentNavState.UpdateQValue(actionToTake, learningRate, deltaQ);
 }
 
-void ATPGameDemoGameState::UpdateRoomNavEnvironmentForStructure(FIntPoint roomCoords, TArray<TArray<int>> roomStructure)
+void ATPGameDemoGameState::UpdateRoomNavEnvironmentForStructure(FIntPoint roomCoords, const TArray<TArray<int>>& roomStructure)
 {
-    GetNavigationEnvironmentForRoom(roomStructure, roomCoords, GetmNavEnvironment(roomCoords));
+    RoomActionMasks& actionMasks = GetmRoomActionMasks(roomCoords);
+    actionMasks.Initialise(LevelBuilderHelpers::GetWalkableCells(roomStructure));
+    GetNavigationEnvironmentForActionMasks(actionMasks, roomCoords, GetmNavEnvironment(roomCoords));
+    Dangers.RoomStructureChanged(roomCoords, actionMasks);
 }
 
 void ATPGameDemoGameState::UpdateRoomNavEnvironment(FIntPoint roomCoords, const NavigationEnvironment& navEnvironment)
 {
     GetmNavEnvironment(roomCoords) = navEnvironment;
+    // Rebuild the action masks from the given targets, including any exits into neighbouring rooms.
+    const int sizeX = navEnvironment.Num();
+    const int sizeY = sizeX > 0 ? navEnvironment[0].Num() : 0;
+    RoomBitboard openCells(sizeX, sizeY);
+    for (int x = 0; x < sizeX; ++x)
+        for (int y = 0; y < sizeY; ++y)
+            openCells.Set(FIntPoint(x, y), navEnvironment[x][y].IsStateValid());
+    RoomActionMasks& actionMasks = GetmRoomActionMasks(roomCoords);
+    actionMasks.Initialise(openCells);
+    openCells.ForEachSetCell([&](FIntPoint position)
+    {
+        for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
+        {
+            const FRoomPositionPair target = navEnvironment[position.X][position.Y].GetActionTarget((EDirectionType)a);
+            if (target.RoomCoords != roomCoords)
+                actionMasks.EnableExit(position, (EDirectionType)a);
+        }
+    });
+    Dangers.RoomStructureChanged(roomCoords, actionMasks);
 }
 
 void ATPGameDemoGameState::SetRoomQValuesRewardsSet(FIntPoint roomCoords, FIntPoint targetPosition, const QValuesRewardsSet& navSet)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    RoomStates[roomIndices.X][roomIndices.Y].SetNavSetForTarget(targetPosition, navSet);
+    GetmRoomData(roomCoords).SetNavSetForTarget(targetPosition, navSet);
 }
 
 void ATPGameDemoGameState::ClearQValuesAndRewards(FIntPoint RoomCoords, FIntPoint GoalPosition)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(RoomCoords);
-    QValuesRewardsSet& set = RoomStates[roomIndices.X][roomIndices.Y].QValuesRewardsSets[GoalPosition.X][GoalPosition.Y];
+    QValuesRewardsSet& set = GetQValuesRewardsSet(RoomCoords, GoalPosition);
     for (int x = 0; x < set.Num(); ++x)
     {
         for (int y = 0; y < set[0].Num(); ++y)
@@ -739,6 +1728,8 @@ void ATPGameDemoGameState::GeneratePerimeterRooms()
 		DoorOpened(FIntPoint(-cornerRoom, i), EDirectionType::North, 0.2f, 0.2f);
 		DoorOpened(FIntPoint(cornerRoom, i), EDirectionType::South, 0.2f, 0.2f);
 	}
+	if (bStageNextPerimeter)
+		StageRoomsOnPerimeter(CurrentPerimeter + 1);
 }
 
 void ATPGameDemoGameState::ConnectPerimeterRooms()
@@ -778,6 +1769,114 @@ void ATPGameDemoGameState::ActorExitedTilePosition(FIntPoint roomCoords, FIntPoi
     RoomStates[roomIndices.X][roomIndices.Y].ActorExitedTilePosition(tilePosition);
 }
 
+EnemyAgentHandle ATPGameDemoGameState::RegisterEnemyActor(AEnemyActor* enemy, const EnemyBrain::AgentSettings& settings)
+{
+    EnemyAgentHandle handle = EnemyAI.AddAgent(enemy->GetRoomAndPosition(), settings);
+    if (EnemyAgentActors.Num() <= handle)
+        EnemyAgentActors.SetNum(handle + 1);
+    EnemyAgentActors[handle] = enemy;
+    if (Recorder.IsValid())
+        Recorder->AgentAdded(handle, enemy->GetRoomAndPosition());
+    return handle;
+}
+
+void ATPGameDemoGameState::UnregisterEnemyActor(EnemyAgentHandle handle)
+{
+    EnemyAI.RemoveAgent(handle);
+    if (EnemyAgentActors.IsValidIndex(handle))
+        EnemyAgentActors[handle] = nullptr;
+    if (Recorder.IsValid())
+        Recorder->AgentRemoved(handle);
+}
+
+void ATPGameDemoGameState::ApplyEnemyDecisions()
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_ApplyEnemyDecisions);
+    EnemyAI.ForEachDecision([this](EnemyAgentHandle handle, EnemyBrain::EDecision decision, FVector2D movementTargetXY)
+    {
+        AEnemyActor* enemy = EnemyAgentActors.IsValidIndex(handle) ? EnemyAgentActors[handle].Get() : nullptr;
+        if (Recorder.IsValid())
+            Recorder->AgentDecision(handle, decision, EnemyAI.GetAgentMovementTarget(handle));
+#if ENEMY_EVENT_LOGS
+        if (enemy != nullptr && EnemyEventLog::IsRunning())
+        {
+            const EEnemyEventType eventType = decision == EnemyBrain::EDecision::Remove ? EEnemyEventType::Removed : EEnemyEventType::Decision;
+            EnemyEventLog::Log(eventType, enemy->GetUniqueID(), EnemyAI.GetAgentMovementTarget(handle));
+        }
+#endif
+        if (decision == EnemyBrain::EDecision::Move)
+        {
+            if (enemy != nullptr)
+                enemy->MovementTarget = FVector(movementTargetXY.X, movementTargetXY.Y, enemy->GetActorLocation().Z);
+        }
+        else if (decision == EnemyBrain::EDecision::Remove)
+        {
+            // Destroying the enemy unregisters it.
+            if (enemy != nullptr)
+                enemy->Destroy();
+            else
+                EnemyAI.RemoveAgent(handle);
+        }
+    });
+}
+
+void ATPGameDemoGameState::UpdateChaseFlowField()
+{
+    AMazeActor* player = Cast<AMazeActor>(UGameplayStatics::GetPlayerPawn(this, 0));
+    if (player == nullptr || RoomStates.Num() == 0)
+        return;
+    if (!ChaseField.Matches(NumGridsXY, FIntPoint(NumGridUnitsX, NumGridUnitsY)))
+        ChaseField.Init(NumGridsXY, FIntPoint(NumGridUnitsX, NumGridUnitsY));
+    ChaseField.Update(*this, player->GetRoomAndPosition());
+}
+
+void ATPGameDemoGameState::UpdateEnemyTickDetail(float deltaTime)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_EnemyTickDetail);
+    SecondsSinceTickDetailUpdate += deltaTime;
+    if (SecondsSinceTickDetailUpdate >= TickDetailUpdateInterval)
+    {
+        SecondsSinceTickDetailUpdate = 0.0f;
+        if (APawn* player = UGameplayStatics::GetPlayerPawn(this, 0))
+            PlayerLocation = player->GetActorLocation();
+        const float roomLengthCM = (float)(GridUnitLengthXCM * (NumGridUnitsX - 1));
+        const float fullRadiusSquared = FMath::Square(FullTickDetailRadiusRooms * roomLengthCM);
+        const float reducedRadiusSquared = FMath::Square(ReducedTickDetailRadiusRooms * roomLengthCM);
+        for (const TWeakObjectPtr<AEnemyActor>& enemyPtr : EnemyAgentActors)
+        {
+            AEnemyActor* enemy = enemyPtr.Get();
+            if (enemy == nullptr)
+                continue;
+            EMazeActorTickDetail tickDetail = EMazeActorTickDetail::Full;
+            if (bEnableEnemyTickDetail)
+            {
+                const float distanceSquared = FVector::DistSquaredXY(enemy->GetActorLocation(), PlayerLocation);
+                if (distanceSquared > fullRadiusSquared)
+                {
+                    const bool onScreen = enemy->WasRecentlyRendered(TickDetailUpdateInterval);
+                    tickDetail = distanceSquared <= reducedRadiusSquared || onScreen ? EMazeActorTickDetail::Reduced : EMazeActorTickDetail::Dormant;
+                }
+            }
+            enemy->SetTickDetail(tickDetail, ReducedTickInterval);
+        }
+    }
+
+    SecondsSinceDormantStep += deltaTime;
+    if (SecondsSinceDormantStep >= DormantStepInterval)
+    {
+        if (!EnemyMovementPaused)
+        {
+            for (const TWeakObjectPtr<AEnemyActor>& enemyPtr : EnemyAgentActors)
+            {
+                AEnemyActor* enemy = enemyPtr.Get();
+                if (enemy != nullptr && enemy->GetTickDetail() == EMazeActorTickDetail::Dormant)
+                    enemy->StepDormantMovement(SecondsSinceDormantStep);
+            }
+        }
+        SecondsSinceDormantStep = 0.0f;
+    }
+}
+
 void ATPGameDemoGameState::DestroyNeighbouringDoors(FIntPoint roomCoords, TArray<bool> positionsToDestroy)
 {
     for (int p = 0; p < (int)EDirectionType::NumDirectionTypes; ++p)
@@ -794,6 +1893,8 @@ void ATPGameDemoGameState::DoorOpened(FIntPoint roomCoords, EDirectionType wallD
 {
     if (IsDoorUnlocked(roomCoords, wallDirection))
     {
+        if (Recorder.IsValid())
+            Recorder->DoorOpened(roomCoords, wallDirection);
         if (!DoesRoomExist(roomCoords))
         {
             EnableRoomState(roomCoords, complexity, density);
@@ -813,6 +1914,10 @@ void ATPGameDemoGameState::LockDoor(FIntPoint roomCoords, EDirectionType wallDir
 {
     auto wallState = GetWallStatesForRoom(roomCoords)[(int)wallDirection];
     wallState->LockDoor();
+    InvalidateRoomAdjacency(roomCoords);
+    if (Recorder.IsValid())
+        Recorder->DoorLockChanged(roomCoords, wallDirection, true);
+    UpdateDoorExit(roomCoords, wallDirection);
     auto wallBuilder = GetWallBuilder(roomCoords, wallDirection);
     if (wallBuilder != nullptr)
     {
@@ -827,6 +1932,10 @@ void ATPGameDemoGameState::UnlockDoor(FIntPoint roomCoords, EDirectionType wallD
 {
     auto wallState = GetWallStatesForRoom(roomCoords)[(int)wallDirection];
     wallState->UnlockDoor();
+    InvalidateRoomAdjacency(roomCoords);
+    if (Recorder.IsValid())
+        Recorder->DoorLockChanged(roomCoords, wallDirection, false);
+    UpdateDoorExit(roomCoords, wallDirection);
     auto wallBuilder = GetWallBuilder(roomCoords, wallDirection);
     if (wallBuilder != nullptr)
     {
@@ -869,16 +1978,43 @@ void ATPGameDemoGameState::SetEnemyMovementPaused(bool MovementPaused)
 }
 //============================================================================
 //============================================================================
-const NavigationEnvironment& ATPGameDemoGameState::GetNavEnvironment(FIntPoint roomCoords) const
+const RoomData& ATPGameDemoGameState::GetRoomData(FIntPoint roomCoords) const
 {
+    // Rooms that don't exist have no data. They read as empty: no valid positions and no valid actions.
+    static const RoomData EmptyRoomData;
+    const RoomDataPtr& data = GetRoomStateChecked(roomCoords).Data;
+    return data.IsValid() ? *data : EmptyRoomData;
+}
+
+RoomData& ATPGameDemoGameState::GetmRoomData(FIntPoint roomCoords)
+{
+    static RoomData DiscardedRoomData;
     FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    return RoomStates[roomIndices.X][roomIndices.Y].NavEnvironment;
+    const RoomDataPtr& data = RoomStates[roomIndices.X][roomIndices.Y].Data;
+    // Writes to rooms that don't exist are discarded.
+    if (!ensure(data.IsValid()))
+        return DiscardedRoomData;
+    return *data;
+}
+
+const NavigationEnvironment& ATPGameDemoGameState::GetNavEnvironment(FIntPoint roomCoords) const
+{
+    return GetRoomData(roomCoords).NavEnvironment;
 }
 
 NavigationEnvironment& ATPGameDemoGameState::GetmNavEnvironment(FIntPoint roomCoords)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    return RoomStates[roomIndices.X][roomIndices.Y].NavEnvironment;
+    return GetmRoomData(roomCoords).NavEnvironment;
+}
+
+const RoomActionMasks& ATPGameDemoGameState::GetRoomActionMasks(FIntPoint roomCoords) const
+{
+    return GetRoomData(roomCoords).ActionMasks;
+}
+
+RoomActionMasks& ATPGameDemoGameState::GetmRoomActionMasks(FIntPoint roomCoords)
+{
+    return GetmRoomData(roomCoords).ActionMasks;
 }
 
 ActionTargets& ATPGameDemoGameState::GetActionTargets(FRoomPositionPair roomAndPosition)
@@ -888,8 +2024,7 @@ ActionTargets& ATPGameDemoGameState::GetActionTargets(FRoomPositionPair roomAndP
 
 QValuesRewardsSet& ATPGameDemoGameState::GetQValuesRewardsSet(FIntPoint roomCoords, FIntPoint targetPosition)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    return Get_mQValuesRewardsSet_For_GoalPosition(RoomStates[roomIndices.X][roomIndices.Y].QValuesRewardsSets, targetPosition);
+    return Get_mQValuesRewardsSet_For_GoalPosition(GetmRoomData(roomCoords).QValuesRewardsSets, targetPosition);
 }
 
 ActionQValuesAndRewards& ATPGameDemoGameState::GetActionQValuesRewards(const FRoomPositionPair& roomAndPosition, FIntPoint targetPosition)
@@ -982,34 +2117,94 @@ EDirectionType ATPGameDemoGameState::GetWallTypeForPosition(const FIntPoint& pos
 
 FRoomPositionPair ATPGameDemoGameState::GetRoomAndPositionForWorldXY(FVector2D worldXY)
 {
-    const float roomLengthX = NumGridUnitsX * GridUnitLengthXCM;
-    const float roomLengthY = NumGridUnitsY * GridUnitLengthYCM;
-    
-    float worldX = worldXY.X;
-    float worldY = worldXY.Y;
-    if (worldX > 0.0f)
-        worldX += roomLengthX / 2.0f;
-    else if (worldX < 0)
-        worldX -= roomLengthX / 2.0f;
-    if (worldY > 0.0f)
-        worldY += roomLengthY / 2.0f;
-    else if (worldY < 0)
-        worldY -= roomLengthY / 2.0f;
-    FIntPoint roomCoords = FIntPoint((int)(worldX / roomLengthX), (int)(worldY / roomLengthY));
-    FVector2D roomWorldBottomLeft = FVector2D(roomCoords.X, roomCoords.Y) * FVector2D(roomLengthX, roomLengthY) - FVector2D(roomLengthX / 2.0f, roomLengthY / 2.0f);
-    int positionX = (int)((worldXY.X - (GridUnitLengthXCM / 2.0f) - roomWorldBottomLeft.X) / (float)GridUnitLengthXCM);
-    int positionY = (int)((worldXY.Y - (GridUnitLengthYCM / 2.0f) - roomWorldBottomLeft.Y) / (float)GridUnitLengthYCM);
-    FIntPoint positionInRoom(positionX, positionY);
-    return  { roomCoords, positionInRoom };
+    return GetCoordinateMapper().WorldToCell(worldXY);
+}
+
+const GridCoordinateMapper& ATPGameDemoGameState::GetCoordinateMapper()
+{
+    if (!CoordinateMapper.IsValid())
+        UpdateCoordinateMapper();
+    return CoordinateMapper;
+}
+
+void ATPGameDemoGameState::UpdateCoordinateMapper()
+{
+    CoordinateMapper.Init(FIntPoint(NumGridUnitsX, NumGridUnitsY), FIntPoint(GridUnitLengthXCM, GridUnitLengthYCM));
+}
+
+bool ATPGameDemoGameState::HasGridLineOfSight(FVector from, FVector to)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_GridLineOfSight);
+    const GridCoordinateMapper& mapper = GetCoordinateMapper();
+    return GridLineOfSight::Trace(mapper.WorldToGrid(FVector2D(from)), mapper.WorldToGrid(FVector2D(to)),
+                                  [this](FIntPoint gridCell) { return IsGridCellClear(gridCell); });
+}
+
+void ATPGameDemoGameState::GetGridLinesOfSight(FVector from, const TArray<FVector>& targets, TArray<bool>& visible)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_GridLineOfSight);
+    const GridCoordinateMapper& mapper = GetCoordinateMapper();
+    const FVector2D gridFrom = mapper.WorldToGrid(FVector2D(from));
+    visible.SetNumUninitialized(targets.Num());
+    for (int t = 0; t < targets.Num(); ++t)
+    {
+        visible[t] = GridLineOfSight::Trace(gridFrom, mapper.WorldToGrid(FVector2D(targets[t])),
+                                            [this](FIntPoint gridCell) { return IsGridCellClear(gridCell); });
+    }
+}
+
+void ATPGameDemoGameState::GetEnemiesInGridLineOfSight(FVector from, float range, TArray<AEnemyActor*>& visibleEnemies)
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_GridLineOfSight);
+    visibleEnemies.Reset();
+    const GridCoordinateMapper& mapper = GetCoordinateMapper();
+    const FVector2D gridFrom = mapper.WorldToGrid(FVector2D(from));
+    const float rangeSquared = range * range;
+    for (int handle = 0; handle < EnemyAgentActors.Num(); ++handle)
+    {
+        AEnemyActor* enemy = EnemyAgentActors[handle].Get();
+        if (enemy == nullptr || !EnemyAI.IsAgentAlive(handle))
+            continue;
+        const FVector enemyLocation = enemy->GetActorLocation();
+        // The range test is much cheaper than a trace, so it goes first.
+        if (range > 0.0f && FVector::DistSquaredXY(from, enemyLocation) > rangeSquared)
+            continue;
+        if (GridLineOfSight::Trace(gridFrom, mapper.WorldToGrid(FVector2D(enemyLocation)),
+                                   [this](FIntPoint gridCell) { return IsGridCellClear(gridCell); }))
+            visibleEnemies.Add(enemy);
+    }
+}
+
+bool ATPGameDemoGameState::IsGridCellClear(FIntPoint gridCell) const
+{
+    const FRoomPositionPair cell = CoordinateMapper.GridCellToCell(gridCell);
+    const FIntPoint roomIndices(cell.RoomCoords.X + NumGridsXY / 2, cell.RoomCoords.Y + NumGridsXY / 2);
+    if (!RoomXYIndicesValid(roomIndices))
+        return false;
+    const RoomState& room = RoomStates[roomIndices.X][roomIndices.Y];
+    // Grid cells never map to the north / east walls of a room (see GridCoordinateMapper), so cell 0 is the room's own south / west
+    // wall. Sight only passes a wall through a doorway that is open, which needs both rooms to be trained (see UpdateFlaggedWall).
+    const bool onSouthWall = cell.PositionInRoom.X == 0;
+    const bool onWestWall = cell.PositionInRoom.Y == 0;
+    if (onSouthWall && onWestWall)
+        return false;
+    if (onSouthWall || onWestWall)
+    {
+        const WallState& wall = onSouthWall ? room.SouthWall : room.WestWall;
+        const int positionOnWall = onSouthWall ? cell.PositionInRoom.Y : cell.PositionInRoom.X;
+        return wall.bWallExists && !wall.bDoorExists && wall.DoorState == EDoorState::Open && wall.DoorPosition == positionOnWall;
+    }
+    return room.RoomExists() && !room.InnerStructure.Get(cell.PositionInRoom - FIntPoint(1, 1));
 }
 
 bool ATPGameDemoGameState::IsBuildableItemPlaced(FRoomPositionPair roomAndPosition, EDirectionType direction)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomAndPosition.RoomCoords);
-    int unwrappedRoomIndex = roomIndices.Y * NumGridsXY + roomIndices.X;
-    int roomSize = NumGridUnitsX * NumGridUnitsY;
-    int unwrappedPositionInRoom = roomAndPosition.PositionInRoom.Y * NumGridUnitsX + roomAndPosition.PositionInRoom.X;
-    return MazePositionBuildableStates[unwrappedRoomIndex * roomSize + unwrappedPositionInRoom].CheckDirection(direction);
+    return BuildablePlacements.IsPlaced(roomAndPosition.RoomCoords, roomAndPosition.PositionInRoom, direction);
+}
+
+const WallState& ATPGameDemoGameState::GetWallState(FIntPoint roomCoords, EDirectionType direction) const
+{
+    return const_cast<ATPGameDemoGameState*>(this)->GetWallState(roomCoords, direction);
 }
 
 WallState& ATPGameDemoGameState::GetWallState(FIntPoint roomCoords, EDirectionType direction)
@@ -1037,32 +2232,111 @@ WallState& ATPGameDemoGameState::GetWallState(FIntPoint roomCoords, EDirectionTy
     }
 }
 
-bool ATPGameDemoGameState::IsWallInUpdateList(FIntPoint coords, EDirectionType wallType)
+int ATPGameDemoGameState::GetWallUpdateBit(FIntPoint roomIndices, EDirectionType wallType) const
 {
-    for(auto wallDescriptor : WallsToUpdate)
-        if(wallDescriptor.WallCoupleCoords == coords && wallDescriptor.WallType == wallType)
-            return true;
-    return false;
+    return (roomIndices.X * RoomStates[0].Num() + roomIndices.Y) * 2 + (wallType == EDirectionType::West ? 1 : 0);
 }
 
 void ATPGameDemoGameState::FlagWallsForUpdate(FIntPoint roomCoords)
 {
-    FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
-    auto northNeighbourCoords = GetRoomCoords(GetNeighbouringRoomIndices(roomCoords, EDirectionType::North));
-    auto eastNeighbourCoords = GetRoomCoords(GetNeighbouringRoomIndices(roomCoords, EDirectionType::East));
-
-    AsyncTask(ENamedThreads::GameThread, [this, roomCoords, northNeighbourCoords, eastNeighbourCoords]()
-    {
-        if(!IsWallInUpdateList(roomCoords, EDirectionType::South))
-            WallsToUpdate.Add({roomCoords, EDirectionType::South});
-        if(!IsWallInUpdateList(roomCoords, EDirectionType::West))
-            WallsToUpdate.Add({roomCoords, EDirectionType::West});
-        if(!IsWallInUpdateList(northNeighbourCoords, EDirectionType::South))
-            WallsToUpdate.Add({northNeighbourCoords, EDirectionType::South});
-        if(!IsWallInUpdateList(eastNeighbourCoords, EDirectionType::West))
-            WallsToUpdate.Add({eastNeighbourCoords, EDirectionType::West});
+    const FIntPoint roomIndices = GetRoomXYIndicesChecked(roomCoords);
+    const FIntPoint northNeighbourIndices(roomIndices.X + 1, roomIndices.Y);
+    const FIntPoint eastNeighbourIndices(roomIndices.X, roomIndices.Y + 1);
+    WallsToUpdate.SetBit(GetWallUpdateBit(roomIndices, EDirectionType::South));
+    WallsToUpdate.SetBit(GetWallUpdateBit(roomIndices, EDirectionType::West));
+    if (WallXYIndicesValid(northNeighbourIndices))
+        WallsToUpdate.SetBit(GetWallUpdateBit(northNeighbourIndices, EDirectionType::South));
+    if (WallXYIndicesValid(eastNeighbourIndices))
+        WallsToUpdate.SetBit(GetWallUpdateBit(eastNeighbourIndices, EDirectionType::West));
+}
+
+void ATPGameDemoGameState::UpdateFlaggedWalls()
+{
+    TPGAMEDEMO_SCOPE_CYCLE_COUNTER(STAT_WallUpdates);
+    WallsToUpdate.ConsumeSetBits([this](int wallUpdateBit)
+    {
+        INC_DWORD_STAT(STAT_WallsUpdated);
+        UpdateFlaggedWall(wallUpdateBit);
     });
-    
+}
+
+void ATPGameDemoGameState::UpdateFlaggedWall(int wallUpdateBit)
+{
+    const int wallCouple = wallUpdateBit / 2;
+    const EDirectionType wallType = (wallUpdateBit % 2) == 0 ? EDirectionType::South : EDirectionType::West;
+    const FIntPoint roomIndices(wallCouple / RoomStates[0].Num(), wallCouple % RoomStates[0].Num());
+    const FIntPoint neighbourIndices = wallType == EDirectionType::South ? FIntPoint(roomIndices.X - 1, roomIndices.Y)
+                                                                        : FIntPoint(roomIndices.X, roomIndices.Y - 1);
+    const FIntPoint roomCoords = GetRoomCoords(roomIndices);
+    const RoomState& room = RoomStates[roomIndices.X][roomIndices.Y];
+    // Walls on the south / west edge of the grid have no neighbour.
+    const RoomState* neighbour = RoomXYIndicesValid(neighbourIndices) ? &RoomStates[neighbourIndices.X][neighbourIndices.Y] : nullptr;
+    const bool roomExists = room.RoomExists();
+    const bool neighbourExists = neighbour != nullptr && neighbour->RoomExists();
+
+    if (!(roomExists || neighbourExists))
+    {
+        DisableWallState(roomCoords, wallType);
+        return;
+    }
+
+    // Door Spawned State:
+    const bool roomTrained = room.RoomStatus == RoomState::Trained || room.RoomStatus == RoomState::Connected;
+    const bool neighbourTrained = neighbour != nullptr && (neighbour->RoomStatus == RoomState::Trained || neighbour->RoomStatus == RoomState::Connected);
+
+    EnableWallState(roomCoords, wallType);
+    if (roomTrained && neighbourTrained)
+        DisableDoorState(roomCoords, wallType);
+    else
+        EnableDoorState(roomCoords, wallType);
+    // Door Locked State:
+    UpdateDoorLockedStateForNeighbouringRooms(roomCoords, wallType, room, neighbour);
+    LockDoorIfOnPerimeter(roomCoords);
+    // Movement action targets: Update the exit through the door in the nav position states, now that its lock state is known.
+    UpdateDoorExit(roomCoords, wallType);
+}
+
+void ATPGameDemoGameState::UpdateDoorExit(FIntPoint roomCoords, EDirectionType wallDirection)
+{
+    // The exit is kept by the room that owns the wall (its south or west wall), as the wall states are.
+    FIntPoint ownerIndices = GetRoomXYIndicesChecked(roomCoords);
+    EDirectionType wallType = wallDirection;
+    if (wallDirection == EDirectionType::North || wallDirection == EDirectionType::East)
+    {
+        ownerIndices = GetNeighbouringRoomIndices(roomCoords, wallDirection);
+        wallType = DirectionHelpers::GetOppositeDirection(wallDirection);
+    }
+    const FIntPoint neighbourIndices = wallType == EDirectionType::South ? FIntPoint(ownerIndices.X - 1, ownerIndices.Y)
+                                                                        : FIntPoint(ownerIndices.X, ownerIndices.Y - 1);
+    if (!RoomXYIndicesValid(ownerIndices) || !RoomStates[ownerIndices.X][ownerIndices.Y].RoomExists())
+        return;
+    const FIntPoint ownerCoords = GetRoomCoords(ownerIndices);
+    auto IsTrained = [](const RoomState& room) { return room.RoomStatus == RoomState::Trained || room.RoomStatus == RoomState::Connected; };
+    // The door has to be gone (see DisableDoorState) and unlocked for the way through to be open.
+    const WallState& wall = GetWallState(ownerCoords, wallType);
+    const bool exitOpen = RoomXYIndicesValid(neighbourIndices) && IsTrained(RoomStates[ownerIndices.X][ownerIndices.Y])
+                          && IsTrained(RoomStates[neighbourIndices.X][neighbourIndices.Y])
+                          && wall.bWallExists && !wall.bDoorExists && wall.DoorState != EDoorState::Locked;
+
+    const FRoomPositionPair doorPos = GetDoorPosition(ownerCoords, wallType);
+    if (!InnerRoomPositionValid(doorPos.PositionInRoom))
+        return;
+    RoomActionMasks& actionMasks = GetmRoomActionMasks(ownerCoords);
+    if (actionMasks.CanTakeAction(doorPos.PositionInRoom, wallType) == exitOpen)
+        return;
+    ActionTargets& doorTargets = Get_mActionTargets(GetmNavEnvironment(ownerCoords), doorPos.PositionInRoom);
+    if (exitOpen)
+    {
+        doorTargets.SetActionTarget(wallType, GetTargetRoomAndPositionForDirectionType(doorPos, wallType));
+        actionMasks.EnableExit(doorPos.PositionInRoom, wallType);
+    }
+    else
+    {
+        // A blocked action targets the position it is taken from, as in GetNavigationEnvironmentForActionMasks.
+        doorTargets.SetActionTarget(wallType, doorPos);
+        actionMasks.DisableExit(doorPos.PositionInRoom, wallType);
+    }
+    InvalidateRoomAdjacency(ownerCoords);
 }
 
 // ----------------------- Inner Grid Properties -------------------------------------
@@ -1070,24 +2344,42 @@ void ATPGameDemoGameState::FlagWallsForUpdate(FIntPoint roomCoords)
 void ATPGameDemoGameState::SetGridUnitLengthXCM (int x)
 {
     GridUnitLengthXCM = x;
+    UpdateCoordinateMapper();
     OnMazeDimensionsChanged.Broadcast();
 }
 
 void ATPGameDemoGameState::SetGridUnitLengthYCM (int y)
 {
     GridUnitLengthYCM = y;
+    UpdateCoordinateMapper();
     OnMazeDimensionsChanged.Broadcast();
 }
 
 void ATPGameDemoGameState::SetNumGridUnitsX (int numUnitsX)
 {
+    // Each room, including its perimeter walls, has to fit in a RoomBitboard.
+    if (numUnitsX > RoomBitboard::MaxSide)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignored NumGridUnitsX of %d. Rooms can be at most %d units along each side, including their walls."),
+               numUnitsX, RoomBitboard::MaxSide);
+        return;
+    }
     NumGridUnitsX = numUnitsX;
+    UpdateCoordinateMapper();
     OnMazeDimensionsChanged.Broadcast();
 }
 
 void ATPGameDemoGameState::SetNumGridUnitsY (int numUnitsY)
 {
+    // Each room, including its perimeter walls, has to fit in a RoomBitboard.
+    if (numUnitsY > RoomBitboard::MaxSide)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignored NumGridUnitsY of %d. Rooms can be at most %d units along each side, including their walls."),
+               numUnitsY, RoomBitboard::MaxSide);
+        return;
+    }
     NumGridUnitsY = numUnitsY;
+    UpdateCoordinateMapper();
     OnMazeDimensionsChanged.Broadcast();
 }
 
@@ -1103,12 +2395,7 @@ FVector2D ATPGameDemoGameState::GetCellWorldPosition(UObject* worldContextObject
 
 FVector2D ATPGameDemoGameState::GetGridCellWorldPosition (int x, int y, int RoomOffsetX, int RoomOffsetY, bool getCentre /* = true */)
 {
-    float centreOffset = getCentre ? 0.5f : 0.0f;
-    float positionX = ((x - NumGridUnitsX / 2) + centreOffset) * GridUnitLengthXCM;
-    float positionY = ((y - NumGridUnitsY / 2) + centreOffset) * GridUnitLengthYCM;
-    positionX += RoomOffsetX * NumGridUnitsX * GridUnitLengthXCM - RoomOffsetX * GridUnitLengthXCM;
-    positionY += RoomOffsetY * NumGridUnitsY * GridUnitLengthYCM - RoomOffsetY * GridUnitLengthYCM;
-    return FVector2D (positionX, positionY);
+    return GetCoordinateMapper().CellToWorld({ FIntPoint(RoomOffsetX, RoomOffsetY), FIntPoint(x, y) }, getCentre);
 }
 
 // -------------------------- Perimeter Mechanic ----------------------------------
@@ -1151,12 +2438,12 @@ void ATPGameDemoGameState::RoomWasConnected(FIntPoint roomCoords)
     FlagWallsForUpdate(roomCoords);
 }
 
-void ATPGameDemoGameState::UpdateDoorLockedStateForNeighbouringRooms(FIntPoint roomCoords, FIntPoint neighbourCoords, EDirectionType wallType)
+void ATPGameDemoGameState::UpdateDoorLockedStateForNeighbouringRooms(FIntPoint roomCoords, EDirectionType wallType, const RoomState& room, const RoomState* neighbour)
 {
-    const bool roomExists = DoesRoomExist(roomCoords);
-    const bool neighbourExists = DoesRoomExist(neighbourCoords); 
-    const bool roomConnected = IsRoomConnected(roomCoords);
-    const bool neighbourConnected = IsRoomConnected(neighbourCoords);
+    const bool roomExists = room.RoomExists();
+    const bool neighbourExists = neighbour != nullptr && neighbour->RoomExists();
+    const bool roomConnected = room.RoomStatus == RoomState::Connected;
+    const bool neighbourConnected = neighbour != nullptr && neighbour->RoomStatus == RoomState::Connected;
     const EDoorState doorState = GetWallState(roomCoords, wallType).DoorState;
     const bool doorOnPerimeter = DoorIsOnPerimeter(roomCoords, wallType);
     if (roomConnected || neighbourConnected)
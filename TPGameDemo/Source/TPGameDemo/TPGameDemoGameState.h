@@ -3,6 +3,15 @@
 #pragma once
 
 #include "TPGameDemo.h"
+#include "TrainingBudgetTuner.h"
+#include "RoomPipeline.h"
+#include "EnemyBrain.h"
+#include "ChaseFlowField.h"
+#include "DangerField.h"
+#include "SessionRecording.h"
+#include "PolicyArchive.h"
+#include "RoomStreamer.h"
+#include "GridCoordinateMapper.h"
 #include "CoreMinimal.h"
 #include "TPGameDemoGameMode.h"
 #include "GameFramework/GameStateBase.h"
@@ -91,12 +100,15 @@ DECLARE_DYNAMIC_DELEGATE(FOnPerimeterComplete);
 DECLARE_EVENT(ATPGameDemoGameState, EnemiesPausedChangedEvent);
 DECLARE_DYNAMIC_DELEGATE(FOnEnemiesPausedChanged);
 
+class AEnemyActor;
+
 /**
  * 
  */
 UCLASS()
 class TPGAMEDEMO_API ATPGameDemoGameState : public AGameState
 {
+    friend class SessionReplayer;
 public:
 	GENERATED_BODY()
 	
@@ -112,6 +124,7 @@ public:
     //============================================================================
 
     void Tick( float DeltaTime ) override;
+    void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
     
     //============================================================================
     // Acessors
@@ -153,12 +166,18 @@ public:
     UFUNCTION(BlueprintCallable, Category = "Room Grid Positions")
         FRoomPositionPair GetRoomAndPositionForWorldXY(FVector2D worldXY);
 
+    /* The world / grid mapping for the current grid dimensions. Maze actors keep a copy, refreshed on OnMazeDimensionsChanged. */
+    const GridCoordinateMapper& GetCoordinateMapper();
+
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         bool IsBuildableItemPlaced(FRoomPositionPair roomAndPosition, EDirectionType direction);
 
     // --------------------- room properties -------------------------------------
     const NavigationEnvironment& GetNavEnvironment(FIntPoint roomCoords) const;
+    const RoomActionMasks& GetRoomActionMasks(FIntPoint roomCoords) const;
     const RoomTargetsQValuesRewardsSets& GetRoomQValuesRewardsSets(FIntPoint roomCoords);
+    /* Returns a reference to the room's data, which keeps it alive after the room is disabled. Invalid if the room doesn't exist. */
+    RoomDataPtr GetRoomDataPtr(FIntPoint roomCoords) const;
     const QValuesRewardsSet& GetRoomQValuesRewardsSetForTargetPosition(FIntPoint roomCoords, FIntPoint targetPosition);
 
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
@@ -198,13 +217,26 @@ public:
     UFUNCTION(BlueprintCallable, Category = "World Room States")
         FIntPoint GetSignalPointPositionInRoom(FIntPoint roomCoords) const;
 
-    /** Counts MazeActors only (so doesnt count walls) */
+    /** Counts MazeActors and the inner walls registered with UpdateInnerWallCellActorCounts. */
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         bool TilePositionIsEmpty(FIntPoint roomCoords, FIntPoint tilePosition) const;
-    /** Counts MazeActors only (so doesnt count walls) */
+    /** Counts MazeActors and the inner walls registered with UpdateInnerWallCellActorCounts. */
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         bool RoomTilePositionIsEmpty(FRoomPositionPair roomAndPosition) const;
 
+    /** Finds the empty inner tile closest to tilePosition. Returns false if the room has no empty tiles. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms States")
+        bool GetClosestEmptyTilePosition(FIntPoint roomCoords, FIntPoint tilePosition, FIntPoint& emptyTilePosition) const;
+    /** Finds the empty inner tile closest to the centre of the room. Returns false if the room has no empty tiles. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms States")
+        bool GetMostCentralEmptyTilePosition(FIntPoint roomCoords, FIntPoint& emptyTilePosition) const;
+    /** Picks an empty inner tile uniformly at random, for spawning. Returns false if the room has no empty tiles. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms States")
+        bool GetRandomEmptyTilePosition(FIntPoint roomCoords, FIntPoint& emptyTilePosition);
+
+    /* Marks (or unmarks) the set cells of walls as occupied, in one update. */
+    void SetRoomWallOccupancy(FIntPoint roomCoords, const RoomBitboard& walls, bool occupied);
+
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         bool RoomIsWithinPerimeter(FIntPoint roomCoords) const;
     // --------------------- neighbouring rooms -------------------------------------
@@ -224,6 +256,9 @@ public:
     UFUNCTION(BlueprintCallable, Category = "World Room States")
         TArray<int> GetDoorPositionsForExistingNeighbours(FIntPoint roomCoords);
 
+    /* Neighbour states, door positions, door locks and the quadrant of the room, rebuilt only when one of them changes. */
+    const RoomAdjacency& GetRoomAdjacency(FIntPoint roomCoords) const;
+
     // --------------------- Builders -------------------------------------
 
     UFUNCTION(BlueprintCallable, Category = "World Room Builders")
@@ -234,20 +269,31 @@ public:
     
     // --------------------- Behaviour -------------------------------------
 
+    /* Rooms that have been disabled have no tables, so enemies still in them (or heading for them) get no actions. */
     FDirectionSet GetOptimalActions(FIntPoint roomCoords, FIntPoint targetGridPosition, FIntPoint currentGridPosition)
     {
+        if (!DoesRoomExist(roomCoords))
+            return FDirectionSet();
         FDirectionSet directionSet = GetValidActions({roomCoords, currentGridPosition});
         GetActionQValuesRewards({ roomCoords, currentGridPosition }, targetGridPosition).GetOptimalQValueAndActions_Valid(directionSet);
         return directionSet;
     }
 
+    /* Fills one behaviour map per target position (in x-major order) with the room's current optimal actions. Cells that can't be
+       stood on have no actions. Returns false if the room isn't trained. */
+    bool GetRoomBehaviourMaps(FIntPoint roomCoords, TArray<BehaviourMap>& behaviourMaps);
+
     float GetExploreProbability(FIntPoint roomCoords, FIntPoint targetGridPosition, FIntPoint currentGridPosition)
     {
+        if (!DoesRoomExist(roomCoords))
+            return 0.0f;
         return GetActionQValuesRewards({ roomCoords, currentGridPosition }, targetGridPosition).GetExploreProbability();
     }
 
     void IncrementExploreCount(FIntPoint roomCoords, FIntPoint targetGridPosition, FIntPoint currentGridPosition)
     {
+        if (!DoesRoomExist(roomCoords))
+            return;
         GetActionQValuesRewards({ roomCoords, currentGridPosition }, targetGridPosition).IncrementExplorations();
     }
 
@@ -256,20 +302,17 @@ public:
 
     FDirectionSet GetValidActions(FRoomPositionPair roomAndPosition)
     {
-        const NavigationEnvironment& environment = GetNavEnvironment(roomAndPosition.RoomCoords);
-        FDirectionSet directions;
-        directions.Clear();
-        for (int i = (int)EDirectionType::North; i < (int)EDirectionType::NumDirectionTypes; ++i)
-        {
-            FIntPoint position = roomAndPosition.PositionInRoom;
-            FRoomPositionPair actionTarget = environment[position.X][position.Y].GetActionTarget((EDirectionType)i);
-            WrapRoomPositionPair(actionTarget);
-            FIntPoint targetPos = actionTarget.PositionInRoom;
-            if (targetPos != roomAndPosition.PositionInRoom || actionTarget.RoomCoords != roomAndPosition.RoomCoords)
-                directions.EnableDirection((EDirectionType)i);
-        }
-        return directions;
+        return FDirectionSet(GetRoomActionMasks(roomAndPosition.RoomCoords).GetValidActionsMask(roomAndPosition.PositionInRoom));
     }
+
+    /* Adds an agent to the EnemyBrain for the enemy. The brain's decisions are sent to the enemy at the end of each tick. */
+    EnemyAgentHandle RegisterEnemyActor(AEnemyActor* enemy, const EnemyBrain::AgentSettings& settings);
+    void UnregisterEnemyActor(EnemyAgentHandle handle);
+    EnemyBrain& GetEnemyBrain() { return EnemyAI; }
+    /* Room-level directions towards the player's cell, for chasing enemies. Updated each tick before enemy decisions. */
+    const ChaseFlowField& GetChaseFlowField() const { return ChaseField; }
+    /* Per-cell turret danger, used as a reward term by training and by UpdateQValueRealtime. */
+    const DangerField& GetDangerField() const { return Dangers; }
     //============================================================================
     // Modifiers
     //============================================================================
@@ -282,9 +325,11 @@ public:
     UFUNCTION (BlueprintCallable, Category = "Inner Grid Size")
         void SetGridUnitLengthYCM (int y);
 
+    /* Rooms are stored in RoomBitboards, so values above RoomBitboard::MaxSide (32, i.e. 30 inner cells plus the walls) are rejected. */
     UFUNCTION (BlueprintCallable, Category = "Inner Grid Size")
         void SetNumGridUnitsX (int numUnitsX);
 
+    /* Rooms are stored in RoomBitboards, so values above RoomBitboard::MaxSide (32, i.e. 30 inner cells plus the walls) are rejected. */
     UFUNCTION (BlueprintCallable, Category = "Inner Grid Size")
         void SetNumGridUnitsY (int numUnitsY);
     
@@ -325,9 +370,13 @@ public:
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         void SetBuildableItemPlaced(FRoomPositionPair roomAndPosition, EDirectionType direction, bool placed);
 
+    /** Raises the danger of a placed turret's line of fire (see DangerField). */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms States")
+        void BuildableItemFired(FRoomPositionPair roomAndPosition, EDirectionType direction);
+
     // --------------------- Room & Wall Initialization / Destruction -------------------------------------
-    void SetRoomInnerStructure(FIntPoint roomCoords, InnerRoomBitmask roomBitmask);
-    InnerRoomBitmask GetRoomInnerStructure(FIntPoint roomCoords);
+    void SetRoomInnerStructure(FIntPoint roomCoords, const RoomBitboard& roomBitmask);
+    RoomBitboard GetRoomInnerStructure(FIntPoint roomCoords);
 
     UFUNCTION(BlueprintCallable, Category = "World Rooms States")
         void EnableRoomState(FIntPoint roomCoords, float complexity = 0.0f, float density = 0.0f);
@@ -347,6 +396,52 @@ public:
     UFUNCTION(BlueprintCallable, Category = "World Rooms Training")
         void SetRoomTrained(FIntPoint roomCoords);
 
+    /* Replaces the training budget and restarts tuning if the new budget has bAutoTune set. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms Training")
+        void SetTrainingBudget(const FTrainingBudget& budget);
+
+    /* Returns the tuned training budget if tuning has finished, otherwise the TrainingBudget property. Safe to call from any thread. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms Training")
+        FTrainingBudget GetTrainingBudget() const;
+
+    bool IsTuningTrainingBudget() const;
+    /* Notes the budget, cell dangers and seed (see RoomTraining::GetRoomTrainingSeed) a room's training was started with, so that its
+       RoomTrained recording event carries them. cellDangers is empty if the room has no turrets. Game thread only. */
+    void SetRoomTrainingInputs(FIntPoint roomCoords, const FTrainingBudget& budget, const TArray<float>& cellDangers, int32 trainingSeed)
+    {
+        // The room is being (re)trained, so danger changes wait until SetRoomTrained.
+        TrainedRoomInputsMap.Remove(roomCoords);
+        RoomTrainingInputs& inputs = RoomTrainingInputsMap.Add(roomCoords);
+        inputs.Budget = budget;
+        inputs.CellDangers = cellDangers;
+        inputs.TrainingSeed = trainingSeed;
+    }
+    /* Called by a room's trainer when it can't start. Drops the room's pending training and disables the room if it still exists, so
+       that it isn't left in training with no trainer. Game thread only. */
+    void RoomTrainingFailed(FIntPoint roomCoords);
+
+    // --------------------- Room pipeline -------------------------------------
+
+    /* Queues every room on the given perimeter that doesn't exist yet to be generated and trained in the background. Door positions for those rooms are fixed now. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms Pipeline")
+        void StageRoomsOnPerimeter(int perimeter);
+
+    /* Returns the staged room for roomCoords if it was generated with matching parameters and doors, otherwise nullptr. 
+       Rooms restored from a snapshot and streamed rooms (see StartRoomStreaming) are used first, and only need matching doors.
+       The room's trained qvalues are kept until CommitStagedRoomTraining is called.
+       Taking a room always cancels any pipeline work still queued or in progress for it, since the caller builds the room now. A package
+       that doesn't match is dropped, so the caller should generate and train the room itself when nullptr is returned. */
+    TSharedPtr<RoomPackage> TakeStagedRoomStructure(FIntPoint roomCoords, int sideLength, float normedDensity, float normedComplexity);
+    /* Moves the pretrained qvalues of a room taken with TakeStagedRoomStructure into the room state. Returns false if there are none, or if the room structure has since changed. */
+    bool CommitStagedRoomTraining(FIntPoint roomCoords);
+    /* Generates, trains and enables every room out to the given perimeter on the calling thread, without using room or wall builders
+       (e.g. for headless benchmarks). Door positions and room layouts are taken from seed. Rooms that already exist are kept.
+       Returns the coords of the rooms that were built. */
+    TArray<FIntPoint> BuildHeadlessRooms(int perimeter, int32 seed, float normedDensity, float normedComplexity);
+    /* Called by trainer threads while tuning. See TrainingBudgetTuner. */
+    void AddTrainingConvergenceSample(int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun);
+    void TrainingConvergenceRoomMeasured();
+
     /* Return true if the action leads somewhere. */
     bool SimulateAction(FRoomPositionPair& roomAndPosition, EDirectionType actionToTake, FIntPoint targetPosition);
     /* A realtime version of UpdateQValue. This is to be performed by actors as they navigate the level.*/
@@ -356,7 +451,7 @@ public:
     /* Update the qvalue for an action from a given position in a given room.*/
     void UpdateQValueForCurrentNavState(EDirectionType actionType, float learningRate, float deltaQ);
     /* Set the action targets for the room, given the cell state structure */
-    void UpdateRoomNavEnvironmentForStructure(FIntPoint roomCoords, TArray<TArray<int>> roomStructure);
+    void UpdateRoomNavEnvironmentForStructure(FIntPoint roomCoords, const TArray<TArray<int>>& roomStructure);
     void UpdateRoomNavEnvironment(FIntPoint roomCoords, const NavigationEnvironment& navEnvironment);
     /* Set the qvalues and rewards set for a target position in a room. */
     void SetRoomQValuesRewardsSet(FIntPoint RoomCoords, FIntPoint targetPosition, const QValuesRewardsSet& navSet);
@@ -394,6 +489,9 @@ public:
     UFUNCTION(BlueprintCallable, Category = "World Perimeter State")
     int GetPerimeterSideLength();
 
+    /* The outermost perimeter that rooms can be built on. Rooms further out would have north / east walls outside the room states. */
+    int GetMaxRoomPerimeter() const { return NumGridsXY / 2 - 1; }
+
     // --------------------- Door Interaction -------------------------------------
 
     UFUNCTION(BlueprintCallable, Category = "Door Interaction")
@@ -424,10 +522,12 @@ public:
     UPROPERTY (BlueprintReadOnly, VisibleAnywhere, Category = "Inner Grid Size")
         int GridUnitLengthYCM = 200;
 
-    UPROPERTY (BlueprintReadOnly, VisibleAnywhere, Category = "Inner Grid Size")
+    /* Room side length in grid units, including the perimeter walls. At most RoomBitboard::MaxSide. */
+    UPROPERTY (BlueprintReadOnly, VisibleAnywhere, Category = "Inner Grid Size", meta = (ClampMax = "32"))
         int NumGridUnitsX = 10;
 
-    UPROPERTY (BlueprintReadOnly, VisibleAnywhere, Category = "Inner Grid Size")
+    /* Room side length in grid units, including the perimeter walls. At most RoomBitboard::MaxSide. */
+    UPROPERTY (BlueprintReadOnly, VisibleAnywhere, Category = "Inner Grid Size", meta = (ClampMax = "32"))
         int NumGridUnitsY = 10;
 
     UPROPERTY (BlueprintReadWrite, EditAnywhere, Category = "World Grid Size")
@@ -442,6 +542,20 @@ public:
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Room Health")
         float MaxSignalStrength = 100.0f;
 
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "World Rooms Training")
+        FTrainingBudget TrainingBudget;
+
+    /* When a perimeter starts, generate and train the rooms of the following perimeter in the background. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Rooms Pipeline")
+        bool bStageNextPerimeter = true;
+
+    /* Staged rooms are only used if they are built with the same density and complexity. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Rooms Pipeline", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+        float StagedRoomDensity = 0.2f;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Rooms Pipeline", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+        float StagedRoomComplexity = 0.2f;
+
     //============================================================================
     // Enemy Movement
     //============================================================================        
@@ -451,39 +565,231 @@ public:
     UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Enemy Movement")
         bool EnemyMovementPaused = false;
 
+    /** Lowers the tick rate of enemies that are far from the player or off-screen. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        bool bEnableEnemyTickDetail = true;
+    /** Enemies within this many room lengths of the player tick every frame. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        float FullTickDetailRadiusRooms = 1.0f;
+    /** Enemies within this many room lengths of the player, or on screen, tick at ReducedTickInterval. Others are dormant. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        float ReducedTickDetailRadiusRooms = 3.0f;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        float ReducedTickInterval = 0.1f;
+    /** How often dormant enemies are moved towards their movement target. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        float DormantStepInterval = 0.35f;
+    /** How often the tick detail of each enemy is re-evaluated. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Enemy Tick Detail")
+        float TickDetailUpdateInterval = 0.25f;
+
+    /** The player location at the last tick detail update. */
+    UFUNCTION(BlueprintCallable, Category = "Enemy Tick Detail")
+        FVector GetPlayerLocation() const { return PlayerLocation; }
+
+    //============================================================================
+    // Grid Line Of Sight
+    //============================================================================
+
+    /**
+    True if nothing on the maze grid blocks the line between two world positions: inner structure, walls, closed or locked doors, and
+    rooms that don't exist all block it. Runs on the room states (see GridLineOfSight), so it needs no physics trace, but actors don't
+    block it.
+    */
+    UFUNCTION(BlueprintCallable, Category = "Grid Line Of Sight")
+        bool HasGridLineOfSight(FVector from, FVector to);
+
+    /** Tests the grid line of sight from one position to each of the targets. visible[t] is the result for targets[t]. */
+    UFUNCTION(BlueprintCallable, Category = "Grid Line Of Sight")
+        void GetGridLinesOfSight(FVector from, const TArray<FVector>& targets, TArray<bool>& visible);
+
+    /** The live enemies within range (in cm, or any distance if 0) that have a grid line of sight to the position, e.g. a turret's targets. */
+    UFUNCTION(BlueprintCallable, Category = "Grid Line Of Sight")
+        void GetEnemiesInGridLineOfSight(FVector from, float range, TArray<AEnemyActor*>& visibleEnemies);
+
+    //============================================================================
+    // World Seed & Session Recording
+    //============================================================================
+
+    /** Seeds door positions, room layouts, staged rooms, spawn positions and enemy decisions. 0 picks a random seed each session. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Seed")
+        int32 WorldSeed = 0;
+
+    /** The seed the current session was started with. */
+    UFUNCTION(BlueprintCallable, Category = "World Seed")
+        int32 GetActiveWorldSeed() const { return ActiveWorldSeed; }
+
+    /* Draws a seed from the world random stream. Game thread only. */
+    int32 GenerateWorldSeededValue() { return WorldRandomStream.RandHelper(MAX_int32); }
+
+    /** Records every change to the world state to filePath, until StopSessionRecording is called or play ends. See SessionRecorder. */
+    UFUNCTION(BlueprintCallable, Category = "Session Recording")
+        bool StartSessionRecording(const FString& filePath);
+
+    UFUNCTION(BlueprintCallable, Category = "Session Recording")
+        void StopSessionRecording();
+
+    UFUNCTION(BlueprintCallable, Category = "Session Recording")
+        bool IsRecordingSession() const { return Recorder.IsValid(); }
+
+    //============================================================================
+    // Policy Archives
+    //============================================================================
+
+    /* Writes the layout, qvalue tables and encoded behaviour maps of every trained room to a PolicyArchive. Returns the number of rooms written. */
+    int32 SavePolicyArchive(const FString& filePath);
+    /*
+    Copies the archived qvalue tables into every trained room whose archived layout (inner structure and door positions) matches the
+    live room, and marks those rooms as trained. Rooms that are still being trained are skipped, so that their trainer can't overwrite
+    the loaded tables, as are rooms without an archived layout. Returns the number of rooms loaded.
+    */
+    int32 LoadPolicyArchive(const PolicyArchive& archive);
+
+    /** Archive to stream rooms in from while playing (relative names are in Saved/Policies). Empty disables streaming. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Rooms Streaming")
+        FString StreamedPolicyArchive;
+
+    /** Archived rooms within this many rooms of the player are streamed in, nearest first. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "World Rooms Streaming", meta = (ClampMin = "0"))
+        int StreamingRadiusRooms = 2;
+
+    /** Starts streaming archived rooms around the player. Streamed rooms are used by TakeStagedRoomStructure when their room is built. */
+    UFUNCTION(BlueprintCallable, Category = "World Rooms Streaming")
+        bool StartRoomStreaming(const FString& archiveFileName);
+
+    UFUNCTION(BlueprintCallable, Category = "World Rooms Streaming")
+        void StopRoomStreaming();
+
+    //============================================================================
+    // World Snapshots
+    //============================================================================
+
+    /**
+    Saves the whole world (room states, walls and doors, perimeter progress, signal strength and buildable placements) to a
+    WorldSnapshot file (relative names are in Saved/Snapshots). The qvalue tables of trained rooms go to a PolicyArchive beside it,
+    which the snapshot refers to.
+    */
+    UFUNCTION(BlueprintCallable, Category = "World Snapshots")
+        bool SaveWorldSnapshot(const FString& fileName);
+
+    /**
+    Replaces the world with a snapshot written by SaveWorldSnapshot. Rooms come back trained from the snapshot's policy archive, and
+    room builders rebuild them with their saved structures. Rooms that were still training when the snapshot was saved start training again.
+    Enemies are not saved.
+    */
+    UFUNCTION(BlueprintCallable, Category = "World Snapshots")
+        bool LoadWorldSnapshot(const FString& fileName);
+
 private:
     TArray<TArray<ARoomBuilder*>> RoomBuilders;
     TArray<TArray<AWallBuilder*>> WallBuilders;
 	TArray<TArray<RoomState>> RoomStates;
 
+    const RoomData& GetRoomData(FIntPoint roomCoords) const;
+    RoomData& GetmRoomData(FIntPoint roomCoords);
     NavigationEnvironment& GetmNavEnvironment(FIntPoint roomCoords);
+    RoomActionMasks& GetmRoomActionMasks(FIntPoint roomCoords);
     ActionTargets& GetActionTargets(FRoomPositionPair roomAndPosition);
     QValuesRewardsSet& GetQValuesRewardsSet(FIntPoint roomCoords, FIntPoint targetPosition);
     ActionQValuesAndRewards& GetActionQValuesRewards(const FRoomPositionPair& roomAndPosition, FIntPoint targetPosition);
 
     bool LevelPoliciesDirFound = false;
 
+    FRandomStream SpawnRandomStream;
+    FRandomStream WorldRandomStream;
+    int32 ActiveWorldSeed = 0;
+    void InitialiseWorldRandomStream(int32 seed);
+
+    TUniquePtr<SessionRecorder> Recorder;
+    FRoomPositionPair RecordedPlayerCell { FIntPoint(MAX_int32, MAX_int32), FIntPoint(0, 0) };
+    void RecordPlayerCell();
+
+    TrainingBudgetTuner BudgetTuner;
+    /* Hands the convergence samples measured while a pipeline package was trained to the BudgetTuner, as one measured room. */
+    void ReportPackageConvergence(const RoomPackage& package);
+    struct RoomTrainingInputs
+    {
+        FTrainingBudget Budget;
+        TArray<float> CellDangers;
+        int32 TrainingSeed = 0;
+    };
+    /* What each room in training was started with (see SetRoomTrainingInputs). Removed when the room is trained or disabled. */
+    TMap<FIntPoint, RoomTrainingInputs> RoomTrainingInputsMap;
+    /* The current budget, the room's current dangers and its world seeded training seed, for rooms whose tables were loaded rather than trained. */
+    RoomTrainingInputs GetCurrentTrainingInputs(FIntPoint roomCoords) const;
+    /* What each trained room was trained with, so that a recording started later can retrain it the same way. Removed when the room is disabled. */
+    TMap<FIntPoint, RoomTrainingInputs> TrainedRoomInputsMap;
+
+    EnemyBrain EnemyAI;
+    /* The actor for each EnemyBrain agent, indexed by handle. Agents without actors are null here. */
+    TArray<TWeakObjectPtr<AEnemyActor>> EnemyAgentActors;
+    void ApplyEnemyDecisions();
+
+    ChaseFlowField ChaseField;
+    void UpdateChaseFlowField();
+
+    FVector PlayerLocation = FVector::ZeroVector;
+    float SecondsSinceTickDetailUpdate = 0.0f;
+    float SecondsSinceDormantStep = 0.0f;
+    void UpdateEnemyTickDetail(float deltaTime);
+
+    /* Door positions come from randomStream if it is given, otherwise from the world random stream. */
+    void GenerateMissingDoorPositions(FIntPoint roomCoords, FRandomStream* randomStream = nullptr);
+    /* EnableRoomState, with the given health. prepareRoom is called on the new room state before its room builder builds it. */
+    void EnableRoomStateWith(FIntPoint roomCoords, float health, float complexity, float density, const TFunction<void(RoomState&)>& prepareRoom);
+    TSharedPtr<RoomPipeline> Pipeline;
+    FIntPoint PipelineCenter { MAX_int32, MAX_int32 };
+    /* Keeps the pipeline building the staged rooms nearest the player first. */
+    void UpdatePipelinePriority();
+    /* Staged rooms whose structure has been built, waiting for their trainer to start. */
+    TMap<FIntPoint, TSharedPtr<RoomPackage>> CommittedRoomPackages;
+
+    TUniquePtr<RoomStreamer> Streamer;
+    /* Streamed rooms near the player, waiting for their room to be built. */
+    TMap<FIntPoint, TSharedPtr<RoomPackage>> StreamedRoomPackages;
+    /* Rooms restored by LoadWorldSnapshot, waiting for their room builders. Their qvalues are already in the room states. */
+    TMap<FIntPoint, TSharedPtr<RoomPackage>> RestoredRoomPackages;
+    FIntPoint StreamingCenter { MAX_int32, MAX_int32 };
+    void UpdateRoomStreaming();
+    /* Fixes the missing door positions of a streamed room to its archived ones. Returns false if a door that is already fixed doesn't match. */
+    bool ApplyStreamedDoorPositions(const RoomPackage& package);
+
     EnemiesPausedChangedEvent EnemiesPausedChanged;
     
-    // An unwrapped '2d' array containing An FDirectionSet for each space in the maze,
-    // indicating if a buildable has been placed facing each direction.
+    // Indicates if a buildable has been placed facing each direction, for each space in the maze.
     // (This is mainly applicable to turrets attached to walls).
-    TArray<FDirectionSet> MazePositionBuildableStates;
+    BuildablePlacementIndex BuildablePlacements;
+    DangerField Dangers;
+    /* Moves the qvalues of every move into the changed cells by the change in their danger cost, for every target. Only trained rooms
+       are changed. */
+    void ApplyDangerChanges(FIntPoint roomCoords, const DangerField::CellChanges& changes);
+    /* Applies the difference between the room's current dangers and the dangers its qvalues were trained with. */
+    void ApplyDangerChangesSinceTraining(FIntPoint roomCoords, const TArray<float>& trainedCellDangers);
+    /* Below this many qvalue shifts, ApplyDangerChanges runs on the game thread alone. */
+    static constexpr int ParallelDangerShiftThreshold = 4096;
+    /* Adds a turret to the danger field for every placement, without touching qvalues (e.g. after loading a snapshot). */
+    void RebuildDangerField();
+    void UpdateCoordinateMapper();
+    GridCoordinateMapper CoordinateMapper;
+    /* Whether sight passes through a cell, given in grid cells along the whole world (see GridCoordinateMapper::WorldToGrid). */
+    bool IsGridCellClear(FIntPoint gridCell) const;
     
-    // Struct containing the coordinates of a west/south wall state couple and the specific wall type.
-    struct WallPosition
-    {
-        FIntPoint WallCoupleCoords;
-        EDirectionType WallType;
-    };
-    // This is added to during a frame when rooms are created / destroyed. It is consumed during the tick function and cleared.
-    TArray<WallPosition> WallsToUpdate;
-    // Checks if the list of WallsToUpdate already contains the given wall.
-    bool IsWallInUpdateList(FIntPoint coords, EDirectionType wallType);
-    // Adds all of the walls of a room to the WallsToUpate list.
+    // One bit per south / west wall of each wall couple (see GetWallUpdateBit), set when the wall's room or neighbour changes.
+    // Bits can be set from any thread. They are consumed and cleared in the tick function.
+    AtomicBitset WallsToUpdate;
+    int GetWallUpdateBit(FIntPoint roomIndices, EDirectionType wallType) const;
+    // Flags the south and west walls of the room, and the south / west walls of its north / east neighbours.
     void FlagWallsForUpdate(FIntPoint roomCoords);
+    void UpdateFlaggedWalls();
+    // Updates the wall, door, door lock and exit action target states of a flagged wall.
+    void UpdateFlaggedWall(int wallUpdateBit);
+    /* Opens the exit through a door if both rooms beside it are trained and the door is open and unlocked, and closes it otherwise. */
+    void UpdateDoorExit(FIntPoint roomCoords, EDirectionType wallDirection);
 
     WallState& GetWallState(FIntPoint roomCoords, EDirectionType direction);
+    const WallState& GetWallState(FIntPoint roomCoords, EDirectionType direction) const;
+    /* Marks the adjacency records of the room and its neighbours for rebuilding. */
+    void InvalidateRoomAdjacency(FIntPoint roomCoords);
     // Indexed as North, East, South, West
     TArray<WallState*> GetWallStatesForRoom(FIntPoint roomCoords);
     
@@ -502,7 +808,7 @@ private:
     void RoomWasConnected(FIntPoint roomCoords);
     void LockDoorIfOnPerimeter(FIntPoint roomCoords);
     void UnlockPerimeterDoors();
-    void UpdateDoorLockedStateForNeighbouringRooms(FIntPoint roomCoords, FIntPoint neighbourCoords, EDirectionType wallType);
+    void UpdateDoorLockedStateForNeighbouringRooms(FIntPoint roomCoords, EDirectionType wallType, const RoomState& room, const RoomState* neighbour);
     bool DoorIsOnPerimeter(FIntPoint roomCoords, EDirectionType doorDirection);
     FThreadSafeBool PerimeterDoorsNeedUnlocked = false;
 };
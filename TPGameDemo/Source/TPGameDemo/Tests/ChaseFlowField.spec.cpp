@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/AutomationTest.h"
+#include "ChaseFlowField.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/*
+The field is run on a 7x7 grid of rooms (coords -3 to 3) whose links are read from a set of closed walls and missing rooms, and is
+checked against a breadth-first search of the same links after every change.
+*/
+BEGIN_DEFINE_SPEC(FChaseFlowFieldSpec, "TPGameDemo.ChaseFlowField", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+    typedef TPair<FIntPoint, int32> WallKey;
+
+    const int NumGridsXY = 6;
+    const int Perimeter = 3;
+    const FIntPoint NumGridUnits { 9, 9 };
+    ChaseFlowField Field;
+    FRoomPositionPair PlayerCell;
+    TSet<WallKey> ClosedWalls;
+    TSet<FIntPoint> MissingRooms;
+
+    bool IsRoomInGrid(FIntPoint roomCoords) const { return FMath::Abs(roomCoords.X) <= Perimeter && FMath::Abs(roomCoords.Y) <= Perimeter; }
+
+    /* Each wall is keyed by the room to its south / west, as the game state stores them. */
+    static WallKey GetWallKey(FIntPoint roomCoords, EDirectionType wall)
+    {
+        if (wall == EDirectionType::North || wall == EDirectionType::East)
+            return WallKey(LevelBuilderHelpers::GetTargetPointForAction(roomCoords, wall), (int32)DirectionHelpers::GetOppositeDirection(wall));
+        return WallKey(roomCoords, (int32)wall);
+    }
+
+    bool IsLinked(FIntPoint roomCoords, EDirectionType door) const
+    {
+        const FIntPoint neighbour = LevelBuilderHelpers::GetTargetPointForAction(roomCoords, door);
+        return IsRoomInGrid(roomCoords) && IsRoomInGrid(neighbour) && !MissingRooms.Contains(roomCoords) && !MissingRooms.Contains(neighbour) &&
+               !ClosedWalls.Contains(GetWallKey(roomCoords, door));
+    }
+
+    void UpdateField()
+    {
+        Field.Update(PlayerCell, [this](FIntPoint roomCoords, int* doorPositionsNESW)
+        {
+            uint8 linksMask = 0;
+            for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+            {
+                doorPositionsNESW[d] = NumGridUnits.X / 2;
+                // A room only reports its own side of each link, so missing neighbours are left for the field to notice.
+                const bool wallOpen = !MissingRooms.Contains(roomCoords) && !ClosedWalls.Contains(GetWallKey(roomCoords, (EDirectionType)d));
+                linksMask |= wallOpen ? (1 << d) : 0;
+            }
+            return linksMask;
+        });
+    }
+
+    void SetWallClosed(FIntPoint roomCoords, EDirectionType wall, bool closed)
+    {
+        if (closed)
+            ClosedWalls.Add(GetWallKey(roomCoords, wall));
+        else
+            ClosedWalls.Remove(GetWallKey(roomCoords, wall));
+        Field.RoomChanged(roomCoords);
+    }
+
+    void SetRoomMissing(FIntPoint roomCoords, bool missing)
+    {
+        if (missing)
+            MissingRooms.Add(roomCoords);
+        else
+            MissingRooms.Remove(roomCoords);
+        Field.RoomChanged(roomCoords);
+    }
+
+    /* Checks every room's distance against a breadth-first search, and that each room's next door leads one room closer. */
+    bool MatchesSearch(const FString& what)
+    {
+        TMap<FIntPoint, int32> distances;
+        TArray<FIntPoint> queue { PlayerCell.RoomCoords };
+        distances.Add(PlayerCell.RoomCoords, 0);
+        for (int i = 0; i < queue.Num(); ++i)
+        {
+            for (int d = 0; d < (int)EDirectionType::NumDirectionTypes; ++d)
+            {
+                const FIntPoint neighbour = LevelBuilderHelpers::GetTargetPointForAction(queue[i], (EDirectionType)d);
+                if (IsLinked(queue[i], (EDirectionType)d) && !distances.Contains(neighbour))
+                {
+                    distances.Add(neighbour, distances[queue[i]] + 1);
+                    queue.Add(neighbour);
+                }
+            }
+        }
+
+        bool matches = true;
+        for (int x = -Perimeter; x <= Perimeter; ++x)
+        {
+            for (int y = -Perimeter; y <= Perimeter; ++y)
+            {
+                const FIntPoint roomCoords(x, y);
+                const int32* searchDistance = distances.Find(roomCoords);
+                const int32 expectedDistance = searchDistance != nullptr ? *searchDistance : ChaseFlowField::Unreachable;
+                const int32 distance = Field.GetDistance(roomCoords);
+                if (distance != expectedDistance)
+                {
+                    AddError(FString::Printf(TEXT("%s: room %s has distance %d, expected %d."), *what, *roomCoords.ToString(), distance, expectedDistance));
+                    matches = false;
+                    continue;
+                }
+                if (distance == 0 || distance == ChaseFlowField::Unreachable)
+                    continue;
+                const EDirectionType nextDoor = Field.GetNextDoor(roomCoords);
+                if (nextDoor == EDirectionType::NumDirectionTypes || !IsLinked(roomCoords, nextDoor) ||
+                    Field.GetDistance(LevelBuilderHelpers::GetTargetPointForAction(roomCoords, nextDoor)) != distance - 1)
+                {
+                    AddError(FString::Printf(TEXT("%s: room %s's next door doesn't lead one room closer."), *what, *roomCoords.ToString()));
+                    matches = false;
+                }
+            }
+        }
+        return matches;
+    }
+END_DEFINE_SPEC(FChaseFlowFieldSpec)
+
+void FChaseFlowFieldSpec::Define()
+{
+    BeforeEach([this]()
+    {
+        ClosedWalls.Reset();
+        MissingRooms.Reset();
+        PlayerCell = { FIntPoint(0, 0), FIntPoint(2, 5) };
+        Field.Init(NumGridsXY, NumGridUnits);
+        UpdateField();
+    });
+
+    It("should build the distances from the player's room", [this]()
+    {
+        TestTrue(TEXT("Valid"), Field.IsValid());
+        TestEqual(TEXT("Corner distance"), Field.GetDistance(FIntPoint(-3, 3)), 6);
+        MatchesSearch(TEXT("Full build"));
+    });
+
+    It("should reroute around links that are removed, and back when they are restored", [this]()
+    {
+        // A barrier between x = 0 and x = 1, open only at y = 3.
+        for (int y = -Perimeter; y < Perimeter; ++y)
+            SetWallClosed(FIntPoint(0, y), EDirectionType::North, true);
+        UpdateField();
+        TestTrue(TEXT("Rooms repaired"), Field.GetNumRoomsUpdated() > 0);
+        TestEqual(TEXT("Distance across the barrier"), Field.GetDistance(FIntPoint(1, 0)), 7);
+        MatchesSearch(TEXT("Barrier closed"));
+
+        SetWallClosed(FIntPoint(0, -1), EDirectionType::North, false);
+        UpdateField();
+        TestEqual(TEXT("Distance through the reopened door"), Field.GetDistance(FIntPoint(1, 0)), 3);
+        MatchesSearch(TEXT("Barrier reopened"));
+    });
+
+    It("should cut off rooms that lose every link, and reach them again when they return", [this]()
+    {
+        SetRoomMissing(FIntPoint(-3, -2), true);
+        SetRoomMissing(FIntPoint(-2, -3), true);
+        UpdateField();
+        TestEqual(TEXT("Enclosed corner"), Field.GetDistance(FIntPoint(-3, -3)), ChaseFlowField::Unreachable);
+        TestEqual(TEXT("Missing room"), Field.GetDistance(FIntPoint(-3, -2)), ChaseFlowField::Unreachable);
+        MatchesSearch(TEXT("Rooms missing"));
+
+        SetRoomMissing(FIntPoint(-2, -3), false);
+        UpdateField();
+        MatchesSearch(TEXT("Room returned"));
+    });
+
+    It("should repair only the rooms whose path used a removed link", [this]()
+    {
+        // The corner room keeps another path of the same length, and no room's path passes through it, so at most the corner room is
+        // cleared and refilled.
+        SetWallClosed(FIntPoint(-3, -3), EDirectionType::North, true);
+        UpdateField();
+        TestTrue(TEXT("Only the corner room repaired"), Field.GetNumRoomsUpdated() <= 2);
+        TestEqual(TEXT("Corner distance"), Field.GetDistance(FIntPoint(-3, -3)), 6);
+        MatchesSearch(TEXT("Corner wall closed"));
+    });
+
+    It("should match a search after any sequence of changes", [this]()
+    {
+        FRandomStream randomStream(5);
+        for (int change = 0; change < 300; ++change)
+        {
+            const FIntPoint roomCoords(randomStream.RandRange(-Perimeter, Perimeter), randomStream.RandRange(-Perimeter, Perimeter));
+            if (randomStream.RandHelper(8) == 0)
+            {
+                SetRoomMissing(roomCoords, !MissingRooms.Contains(roomCoords));
+            }
+            else
+            {
+                const EDirectionType wall = (EDirectionType)randomStream.RandHelper((int)EDirectionType::NumDirectionTypes);
+                SetWallClosed(roomCoords, wall, !ClosedWalls.Contains(GetWallKey(roomCoords, wall)));
+            }
+            // The player moves to another room now and then, which rebuilds the field.
+            if (randomStream.RandHelper(20) == 0)
+                PlayerCell.RoomCoords = FIntPoint(randomStream.RandRange(-Perimeter, Perimeter), randomStream.RandRange(-Perimeter, Perimeter));
+            UpdateField();
+            if (!MatchesSearch(FString::Printf(TEXT("Change %d"), change)))
+                return;
+        }
+    });
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/AutomationTest.h"
+#include "GridCoordinateMapper.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+BEGIN_DEFINE_SPEC(FGridCoordinateMapperSpec, "TPGameDemo.GridCoordinateMapper", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+    GridCoordinateMapper Mapper;
+    /* The rooms either side of room 0 on both axes, so that every test crosses negative coordinates. */
+    const int32 NumRoomsEachSide = 3;
+
+    bool CellsMatch(const FString& what, const FRoomPositionPair& actual, const FRoomPositionPair& expected)
+    {
+        if (actual.RoomCoords == expected.RoomCoords && actual.PositionInRoom == expected.PositionInRoom)
+            return true;
+        AddError(FString::Printf(TEXT("%s: expected room %s cell %s, got room %s cell %s."), *what, *expected.RoomCoords.ToString(),
+                                 *expected.PositionInRoom.ToString(), *actual.RoomCoords.ToString(), *actual.PositionInRoom.ToString()));
+        return false;
+    }
+
+    /* Calls test on every cell a mapper returns (cell NumGridUnits - 1 is the next room's cell 0) in the tested rooms. */
+    template <typename CellTestType>
+    void ForEachCell(CellTestType&& test)
+    {
+        const FIntPoint numGridUnits = Mapper.GetNumGridUnits();
+        for (int rx = -NumRoomsEachSide; rx <= NumRoomsEachSide; ++rx)
+            for (int ry = -NumRoomsEachSide; ry <= NumRoomsEachSide; ++ry)
+                for (int x = 0; x < numGridUnits.X - 1; ++x)
+                    for (int y = 0; y < numGridUnits.Y - 1; ++y)
+                        test(FRoomPositionPair { FIntPoint(rx, ry), FIntPoint(x, y) });
+    }
+END_DEFINE_SPEC(FGridCoordinateMapperSpec)
+
+void FGridCoordinateMapperSpec::Define()
+{
+    BeforeEach([this]()
+    {
+        // Odd and even room sizes, and cells that aren't square, so that each axis uses its own reciprocal and origin.
+        Mapper.Init(FIntPoint(9, 8), FIntPoint(100, 75));
+    });
+
+    Describe("WorldToCell", [this]()
+    {
+        It("should map each cell's centre back to the cell", [this]()
+        {
+            ForEachCell([this](const FRoomPositionPair& cell)
+            {
+                CellsMatch(TEXT("Centre"), Mapper.WorldToCell(Mapper.CellToWorld(cell)), cell);
+            });
+        });
+
+        It("should map positions just inside each edge of a cell's bounds to the cell", [this]()
+        {
+            ForEachCell([this](const FRoomPositionPair& cell)
+            {
+                const FBox2D bounds = Mapper.GetCellBounds(cell);
+                const FVector2D inset(0.01f, 0.01f);
+                CellsMatch(TEXT("Min corner"), Mapper.WorldToCell(bounds.Min), cell);
+                CellsMatch(TEXT("Max corner"), Mapper.WorldToCell(bounds.Max - inset), cell);
+            });
+        });
+
+        It("should give the room to the north / east the shared wall cells", [this]()
+        {
+            const FIntPoint numGridUnits = Mapper.GetNumGridUnits();
+            const FRoomPositionPair lastCell { FIntPoint(-1, -1), numGridUnits - FIntPoint(1, 1) };
+            const FRoomPositionPair firstCell { FIntPoint(0, 0), FIntPoint(0, 0) };
+            CellsMatch(TEXT("Shared wall cell"), Mapper.WorldToCell(Mapper.CellToWorld(lastCell)), firstCell);
+        });
+
+        It("should place cell centres as the game state does", [this]()
+        {
+            const FIntPoint numGridUnits = Mapper.GetNumGridUnits();
+            const FRoomPositionPair cell { FIntPoint(-2, 1), FIntPoint(3, 5) };
+            const FVector2D centre = Mapper.CellToWorld(cell);
+            TestEqual(TEXT("Centre X"), centre.X, ((3 - numGridUnits.X / 2) + 0.5f + -2 * (numGridUnits.X - 1)) * 100.0f);
+            TestEqual(TEXT("Centre Y"), centre.Y, ((5 - numGridUnits.Y / 2) + 0.5f + 1 * (numGridUnits.Y - 1)) * 75.0f);
+        });
+    });
+
+    Describe("WorldToCells", [this]()
+    {
+        It("should match WorldToCell for every position", [this]()
+        {
+            TArray<float> worldX;
+            TArray<float> worldY;
+            FRandomStream randomStream(3);
+            const FVector2D extent = Mapper.CellToWorld({ FIntPoint(NumRoomsEachSide, NumRoomsEachSide), FIntPoint(0, 0) });
+            for (int p = 0; p < 1000; ++p)
+            {
+                worldX.Add(randomStream.FRandRange(-extent.X, extent.X));
+                worldY.Add(randomStream.FRandRange(-extent.Y, extent.Y));
+            }
+            TArray<FRoomPositionPair> cells;
+            cells.SetNum(worldX.Num());
+            Mapper.WorldToCells(worldX.GetData(), worldY.GetData(), worldX.Num(), cells.GetData());
+            for (int p = 0; p < worldX.Num(); ++p)
+                CellsMatch(TEXT("Batch"), cells[p], Mapper.WorldToCell(FVector2D(worldX[p], worldY[p])));
+        });
+    });
+
+    Describe("WorldToGrid", [this]()
+    {
+        It("should floor to the grid cell of the position's cell", [this]()
+        {
+            ForEachCell([this](const FRoomPositionPair& cell)
+            {
+                const FVector2D grid = Mapper.WorldToGrid(Mapper.CellToWorld(cell));
+                const FIntPoint gridCell(FMath::FloorToInt(grid.X), FMath::FloorToInt(grid.Y));
+                CellsMatch(TEXT("Grid cell"), Mapper.GridCellToCell(gridCell), cell);
+            });
+        });
+    });
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/AutomationTest.h"
+#include "GridLineOfSight.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+BEGIN_DEFINE_SPEC(FGridLineOfSightSpec, "TPGameDemo.GridLineOfSight", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+    TSet<FIntPoint> BlockedCells;
+    /* The cells each trace tested, in order. */
+    TArray<FIntPoint> TestedCells;
+
+    bool Trace(FVector2D start, FVector2D end)
+    {
+        TestedCells.Reset();
+        return GridLineOfSight::Trace(start, end, [this](FIntPoint cell)
+        {
+            TestedCells.Add(cell);
+            return !BlockedCells.Contains(cell);
+        });
+    }
+
+    static FIntPoint GetCell(FVector2D position) { return FIntPoint(FMath::FloorToInt(position.X), FMath::FloorToInt(position.Y)); }
+END_DEFINE_SPEC(FGridLineOfSightSpec)
+
+void FGridLineOfSightSpec::Define()
+{
+    BeforeEach([this]()
+    {
+        BlockedCells.Reset();
+        TestedCells.Reset();
+    });
+
+    Describe("Trace", [this]()
+    {
+        It("should test the cells between the start and end cells, in order", [this]()
+        {
+            TestTrue(TEXT("Clear"), Trace(FVector2D(0.5f, -1.5f), FVector2D(5.5f, -1.5f)));
+            const TArray<FIntPoint> expectedCells { FIntPoint(1, -2), FIntPoint(2, -2), FIntPoint(3, -2), FIntPoint(4, -2) };
+            TestTrue(TEXT("Tested cells"), TestedCells == expectedCells);
+
+            TestTrue(TEXT("Clear backwards"), Trace(FVector2D(5.5f, -1.5f), FVector2D(0.5f, -1.5f)));
+            TestTrue(TEXT("Tested cells backwards"), TestedCells == TArray<FIntPoint> { FIntPoint(4, -2), FIntPoint(3, -2), FIntPoint(2, -2), FIntPoint(1, -2) });
+        });
+
+        It("should be blocked by a cell on the line, but not by the start or end cells", [this]()
+        {
+            BlockedCells = { FIntPoint(0, 0), FIntPoint(5, 0) };
+            TestTrue(TEXT("Start and end blocked"), Trace(FVector2D(0.5f, 0.5f), FVector2D(5.5f, 0.5f)));
+            BlockedCells.Add(FIntPoint(3, 0));
+            TestFalse(TEXT("Middle blocked"), Trace(FVector2D(0.5f, 0.5f), FVector2D(5.5f, 0.5f)));
+            TestEqual(TEXT("Stopped at the blocking cell"), TestedCells.Last(), FIntPoint(3, 0));
+        });
+
+        It("should test nothing within one cell", [this]()
+        {
+            TestTrue(TEXT("Same cell"), Trace(FVector2D(2.1f, 2.1f), FVector2D(2.9f, 2.7f)));
+            TestEqual(TEXT("Tested cells"), TestedCells.Num(), 0);
+        });
+
+        It("should need both cells beside a corner that the line passes through", [this]()
+        {
+            const FVector2D start(0.5f, 0.5f);
+            const FVector2D end(3.5f, 3.5f);
+            TestTrue(TEXT("Clear diagonal"), Trace(start, end));
+            BlockedCells = { FIntPoint(1, 0) };
+            TestFalse(TEXT("Blocked beside the first corner on X"), Trace(start, end));
+            BlockedCells = { FIntPoint(1, 2) };
+            TestFalse(TEXT("Blocked beside the second corner on Y"), Trace(start, end));
+            BlockedCells = { FIntPoint(3, 1) };
+            TestTrue(TEXT("Blocked away from the line"), Trace(start, end));
+        });
+
+        It("should walk a 4-connected path through every cell the segment crosses", [this]()
+        {
+            FRandomStream randomStream(11);
+            for (int t = 0; t < 200; ++t)
+            {
+                const FVector2D start(randomStream.FRandRange(-20.0f, 20.0f), randomStream.FRandRange(-20.0f, 20.0f));
+                const FVector2D end(randomStream.FRandRange(-20.0f, 20.0f), randomStream.FRandRange(-20.0f, 20.0f));
+                const FIntPoint startCell = GetCell(start);
+                const FIntPoint endCell = GetCell(end);
+                if (!TestTrue(TEXT("Clear"), Trace(start, end)))
+                    return;
+                // Random segments all but never pass exactly through a corner, so each step crosses one cell boundary.
+                const int32 numCellsBetween = FMath::Max(FMath::Abs(endCell.X - startCell.X) + FMath::Abs(endCell.Y - startCell.Y) - 1, 0);
+                TestEqual(TEXT("Number of cells tested"), TestedCells.Num(), numCellsBetween);
+                FIntPoint previous = startCell;
+                for (const FIntPoint& cell : TestedCells)
+                {
+                    const FIntPoint step = cell - previous;
+                    if (FMath::Abs(step.X) + FMath::Abs(step.Y) != 1)
+                        AddError(FString::Printf(TEXT("Step from %s to %s isn't to a neighbouring cell."), *previous.ToString(), *cell.ToString()));
+                    previous = cell;
+                }
+                for (int s = 0; s <= 1000; ++s)
+                {
+                    const FIntPoint sampledCell = GetCell(FMath::Lerp(start, end, s / 1000.0f));
+                    if (sampledCell != startCell && sampledCell != endCell && !TestedCells.Contains(sampledCell))
+                        AddError(FString::Printf(TEXT("Trace from %s to %s missed cell %s."), *start.ToString(), *end.ToString(), *sampledCell.ToString()));
+                }
+            }
+        });
+    });
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
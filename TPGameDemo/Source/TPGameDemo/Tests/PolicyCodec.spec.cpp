@@ -0,0 +1,136 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/AutomationTest.h"
+#include "PolicyCodec.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+BEGIN_DEFINE_SPEC(FPolicyCodecSpec, "TPGameDemo.PolicyCodec", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+    const FIntPoint RoomSize { 9, 7 };
+    TArray<BehaviourMap> BehaviourMaps;
+
+    /* One map per cell of the room. Every third target shares the same random plane, every other fifth is a single run of its own mask
+       (longer than the 16 cells a run byte holds), and the rest are random. */
+    void MakeBehaviourMaps(int32 seed)
+    {
+        FRandomStream randomStream(seed);
+        BehaviourMap sharedMap;
+        InitialiseBehaviourMap(sharedMap, RoomSize.X, RoomSize.Y);
+        for (int x = 0; x < RoomSize.X; ++x)
+            for (int y = 0; y < RoomSize.Y; ++y)
+                sharedMap[x][y] = FDirectionSet((uint8)randomStream.RandHelper(16));
+        BehaviourMaps.Reset();
+        for (int t = 0; t < RoomSize.X * RoomSize.Y; ++t)
+        {
+            if (t % 3 == 0)
+            {
+                BehaviourMaps.Add(sharedMap);
+                continue;
+            }
+            BehaviourMap& behaviourMap = BehaviourMaps.AddDefaulted_GetRef();
+            InitialiseBehaviourMap(behaviourMap, RoomSize.X, RoomSize.Y);
+            const uint8 runMask = (uint8)((t / 5) % 16);
+            for (int x = 0; x < RoomSize.X; ++x)
+                for (int y = 0; y < RoomSize.Y; ++y)
+                    behaviourMap[x][y] = FDirectionSet(t % 5 == 0 ? runMask : (uint8)randomStream.RandHelper(16));
+        }
+    }
+
+    bool MapsMatch(const TArray<BehaviourMap>& decodedMaps)
+    {
+        if (!TestEqual(TEXT("Number of maps"), decodedMaps.Num(), BehaviourMaps.Num()))
+            return false;
+        for (int t = 0; t < BehaviourMaps.Num(); ++t)
+            for (int x = 0; x < RoomSize.X; ++x)
+                for (int y = 0; y < RoomSize.Y; ++y)
+                    if (decodedMaps[t][x][y].DirectionsMask != BehaviourMaps[t][x][y].DirectionsMask)
+                        return false;
+        return true;
+    }
+END_DEFINE_SPEC(FPolicyCodecSpec)
+
+void FPolicyCodecSpec::Define()
+{
+    BeforeEach([this]()
+    {
+        MakeBehaviourMaps(7);
+    });
+
+    Describe("Encode", [this]()
+    {
+        It("should decode to the maps it encoded", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            TestEqual(TEXT("Room size"), policy.GetRoomSize(), RoomSize);
+            TestEqual(TEXT("Number of targets"), policy.GetNumTargets(), BehaviourMaps.Num());
+            TArray<BehaviourMap> decodedMaps;
+            TestTrue(TEXT("Decoded"), policy.Decode(decodedMaps));
+            TestTrue(TEXT("Decoded maps match"), MapsMatch(decodedMaps));
+        });
+
+        It("should store identical planes once", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            int numDistinctTargets = 0;
+            for (int t = 0; t < BehaviourMaps.Num(); ++t)
+                numDistinctTargets += t % 3 != 0 ? 1 : 0;
+            TestEqual(TEXT("Number of planes"), policy.GetNumPlanes(), numDistinctTargets + 1);
+        });
+
+        It("should read single cells without decoding", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            for (int t = 0; t < BehaviourMaps.Num(); ++t)
+                for (int x = 0; x < RoomSize.X; ++x)
+                    for (int y = 0; y < RoomSize.Y; ++y)
+                        if (policy.GetOptimalActions(t, FIntPoint(x, y)).DirectionsMask != BehaviourMaps[t][x][y].DirectionsMask)
+                            AddError(FString::Printf(TEXT("Target %d, cell (%d, %d) doesn't match."), t, x, y));
+            TestFalse(TEXT("Cell outside the room"), policy.GetOptimalActions(0, RoomSize).IsValid());
+            TestFalse(TEXT("Target out of range"), policy.GetOptimalActions(BehaviourMaps.Num(), FIntPoint(0, 0)).IsValid());
+        });
+    });
+
+    Describe("SetBytes", [this]()
+    {
+        It("should accept the bytes of an encoded policy", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            TArray<uint8> bytes = policy.GetBytes();
+            EncodedRoomPolicy loadedPolicy;
+            TestTrue(TEXT("Valid bytes"), loadedPolicy.SetBytes(MoveTemp(bytes)));
+            TestTrue(TEXT("Same bytes"), loadedPolicy.GetBytes() == policy.GetBytes());
+            TArray<BehaviourMap> decodedMaps;
+            TestTrue(TEXT("Decoded"), loadedPolicy.Decode(decodedMaps));
+            TestTrue(TEXT("Decoded maps match"), MapsMatch(decodedMaps));
+        });
+
+        It("should reject truncated bytes", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            TArray<uint8> bytes = policy.GetBytes();
+            bytes.Pop();
+            EncodedRoomPolicy loadedPolicy;
+            TestFalse(TEXT("Valid bytes"), loadedPolicy.SetBytes(MoveTemp(bytes)));
+            TestTrue(TEXT("Policy left empty"), loadedPolicy.IsEmpty());
+        });
+
+        It("should reject a plane index outside the dictionary", [this]()
+        {
+            EncodedRoomPolicy policy;
+            policy.Encode(RoomSize, BehaviourMaps);
+            TArray<uint8> bytes = policy.GetBytes();
+            const uint16 badPlaneIndex = (uint16)policy.GetNumPlanes();
+            FMemory::Memcpy(bytes.GetData() + sizeof(EncodedRoomPolicy::Header), &badPlaneIndex, sizeof(badPlaneIndex));
+            EncodedRoomPolicy loadedPolicy;
+            TestFalse(TEXT("Valid bytes"), loadedPolicy.SetBytes(MoveTemp(bytes)));
+        });
+    });
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "Misc/AutomationTest.h"
+#include "SessionRecording.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+using namespace SessionRecording;
+
+BEGIN_DEFINE_SPEC(FSessionRecordingSpec, "TPGameDemo.SessionRecording", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+    TArray<uint8> Bytes;
+END_DEFINE_SPEC(FSessionRecordingSpec)
+
+void FSessionRecordingSpec::Define()
+{
+    BeforeEach([this]()
+    {
+        Bytes.Reset();
+    });
+
+    Describe("VarUInt", [this]()
+    {
+        It("should round trip values at every byte length boundary", [this]()
+        {
+            const uint32 values[] = { 0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0x1FFFFF, 0x200000, 0xFFFFFFF, 0x10000000, MAX_uint32 };
+            ByteWriter writer(Bytes);
+            for (uint32 value : values)
+                writer.WriteVarUInt(value);
+            ByteReader reader(Bytes, 0);
+            for (uint32 value : values)
+                TestEqual(FString::Printf(TEXT("%u"), value), reader.ReadVarUInt(), value);
+            TestFalse(TEXT("Reader error"), reader.HasError());
+            TestTrue(TEXT("Reader at end"), reader.IsAtEnd());
+        });
+
+        It("should write 7 bits per byte", [this]()
+        {
+            const TPair<uint32, int32> valueLengths[] = { { 0, 1 }, { 0x7F, 1 }, { 0x80, 2 }, { 0x3FFF, 2 }, { 0x4000, 3 }, { MAX_uint32, 5 } };
+            for (const TPair<uint32, int32>& valueLength : valueLengths)
+            {
+                Bytes.Reset();
+                ByteWriter(Bytes).WriteVarUInt(valueLength.Key);
+                TestEqual(FString::Printf(TEXT("Bytes for %u"), valueLength.Key), Bytes.Num(), valueLength.Value);
+            }
+        });
+
+        It("should flag a value cut off by the end of the stream", [this]()
+        {
+            ByteWriter(Bytes).WriteVarUInt(0x4000);
+            Bytes.Pop();
+            ByteReader reader(Bytes, 0);
+            reader.ReadVarUInt();
+            TestTrue(TEXT("Reader error"), reader.HasError());
+        });
+
+        It("should flag a value longer than 5 bytes", [this]()
+        {
+            Bytes = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+            ByteReader reader(Bytes, 0);
+            TestEqual(TEXT("Value"), (int64)reader.ReadVarUInt(), (int64)0);
+            TestTrue(TEXT("Reader error"), reader.HasError());
+        });
+    });
+
+    Describe("VarInt", [this]()
+    {
+        It("should round trip signed values, including the extremes", [this]()
+        {
+            const int32 values[] = { 0, -1, 1, -64, 63, -65, 64, -8192, 8191, MIN_int32, MAX_int32 };
+            ByteWriter writer(Bytes);
+            for (int32 value : values)
+                writer.WriteVarInt(value);
+            ByteReader reader(Bytes, 0);
+            for (int32 value : values)
+                TestEqual(FString::Printf(TEXT("%d"), value), reader.ReadVarInt(), value);
+            TestFalse(TEXT("Reader error"), reader.HasError());
+        });
+
+        It("should zigzag encode, so that small negative values take one byte", [this]()
+        {
+            const TPair<int32, uint32> zigzags[] = { { 0, 0 }, { -1, 1 }, { 1, 2 }, { -2, 3 }, { -64, 127 }, { 64, 128 }, { MAX_int32, 0xFFFFFFFE }, { MIN_int32, MAX_uint32 } };
+            for (const TPair<int32, uint32>& zigzag : zigzags)
+            {
+                Bytes.Reset();
+                ByteWriter(Bytes).WriteVarInt(zigzag.Key);
+                TestEqual(FString::Printf(TEXT("Zigzag of %d"), zigzag.Key), ByteReader(Bytes, 0).ReadVarUInt(), zigzag.Value);
+            }
+            Bytes.Reset();
+            ByteWriter(Bytes).WriteVarInt(-64);
+            TestEqual(TEXT("Bytes for -64"), Bytes.Num(), 1);
+        });
+    });
+
+    Describe("Deltas", [this]()
+    {
+        It("should track room coords and cells through the delta state", [this]()
+        {
+            const FIntPoint rooms[] = { FIntPoint(0, 0), FIntPoint(-3, 2), FIntPoint(-3, 2), FIntPoint(4, -5) };
+            const FRoomPositionPair from { FIntPoint(1, -1), FIntPoint(3, 7) };
+            const FRoomPositionPair to { FIntPoint(0, 2), FIntPoint(8, 0) };
+            DeltaState writeDeltas;
+            ByteWriter writer(Bytes);
+            for (const FIntPoint& room : rooms)
+                writer.WriteRoomCoords(writeDeltas, room);
+            writer.WriteCellDelta(from, to);
+
+            DeltaState readDeltas;
+            ByteReader reader(Bytes, 0);
+            for (const FIntPoint& room : rooms)
+                TestEqual(TEXT("Room coords"), reader.ReadRoomCoords(readDeltas), room);
+            const FRoomPositionPair readTo = reader.ReadCellDelta(from);
+            TestEqual(TEXT("Cell room"), readTo.RoomCoords, to.RoomCoords);
+            TestEqual(TEXT("Cell position"), readTo.PositionInRoom, to.PositionInRoom);
+            TestTrue(TEXT("Reader at end"), reader.IsAtEnd());
+        });
+    });
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TrainingBudgetTuner.h"
+
+//====================================================================================================
+// TrainingMeasurements
+//====================================================================================================
+
+void TrainingMeasurements::GetGoalDistances(const NavigationEnvironment& navEnvironment, FIntPoint goalPosition, TArray<TArray<int>>& distances)
+{
+    const int sizeX = navEnvironment.Num();
+    const int sizeY = sizeX > 0 ? navEnvironment[0].Num() : 0;
+    distances.SetNum(sizeX);
+    for (int x = 0; x < sizeX; ++x)
+    {
+        distances[x].SetNum(sizeY);
+        for (int y = 0; y < sizeY; ++y)
+            distances[x][y] = INDEX_NONE;
+    }
+    if (!LevelBuilderHelpers::GridPositionIsValid(goalPosition, sizeX, sizeY) || !Get_ActionTargets(navEnvironment, goalPosition).IsStateValid())
+        return;
+
+    // Moves between open cells are symmetric, so a breadth first search outwards from the goal gives the distance to the goal.
+    TArray<FIntPoint> frontier;
+    frontier.Reserve(sizeX * sizeY);
+    frontier.Add(goalPosition);
+    distances[goalPosition.X][goalPosition.Y] = 0;
+    for (int i = 0; i < frontier.Num(); ++i)
+    {
+        const FIntPoint position = frontier[i];
+        const ActionTargets& targets = Get_ActionTargets(navEnvironment, position);
+        for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
+        {
+            const FIntPoint target = targets.GetActionTarget((EDirectionType)a).PositionInRoom;
+            if (target == position || !LevelBuilderHelpers::GridPositionIsValid(target, sizeX, sizeY))
+                continue;
+            if (distances[target.X][target.Y] == INDEX_NONE && Get_ActionTargets(navEnvironment, target).IsStateValid())
+            {
+                distances[target.X][target.Y] = distances[position.X][position.Y] + 1;
+                frontier.Add(target);
+            }
+        }
+    }
+}
+
+bool TrainingMeasurements::IsPolicyOptimalFromPosition(const NavigationEnvironment& navEnvironment, const QValuesRewardsSet& qValuesRewards,
+                                                       FIntPoint startPosition, const TArray<TArray<int>>& distances)
+{
+    const int sizeX = navEnvironment.Num();
+    const int sizeY = navEnvironment[0].Num();
+    FIntPoint position = startPosition;
+    int distance = distances[position.X][position.Y];
+    if (distance == INDEX_NONE)
+        return false;
+    while (distance > 0)
+    {
+        FDirectionSet optimalActions;
+        Get_ActionQValuesAndRewards(qValuesRewards, position).GetOptimalQValueAndActions(optimalActions);
+        const ActionTargets& targets = Get_ActionTargets(navEnvironment, position);
+        FIntPoint next = position;
+        for (int a = 0; a < (int)EDirectionType::NumDirectionTypes; ++a)
+        {
+            if (!optimalActions.CheckDirection((EDirectionType)a))
+                continue;
+            const FIntPoint target = targets.GetActionTarget((EDirectionType)a).PositionInRoom;
+            if (!LevelBuilderHelpers::GridPositionIsValid(target, sizeX, sizeY) || distances[target.X][target.Y] != distance - 1)
+                return false;
+            next = target;
+        }
+        if (next == position)
+            return false;
+        position = next;
+        --distance;
+    }
+    return true;
+}
+
+//====================================================================================================
+// TrainingBudgetTuner
+//====================================================================================================
+
+void TrainingBudgetTuner::Reset(const FTrainingBudget& budget)
+{
+    FScopeLock lock(&TunerSection);
+    Budget = budget;
+    Budget.NumSimulationsForGoalDistance.Empty();
+    Samples.Empty();
+    NumRoomsMeasured = 0;
+    Tuning = Budget.bAutoTune;
+}
+
+bool TrainingBudgetTuner::IsTuning() const
+{
+    FScopeLock lock(&TunerSection);
+    return Tuning;
+}
+
+FTrainingBudget TrainingBudgetTuner::GetBudget() const
+{
+    FScopeLock lock(&TunerSection);
+    return Budget;
+}
+
+void TrainingBudgetTuner::AddSample(int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun)
+{
+    FScopeLock lock(&TunerSection);
+    if (Tuning && goalDistance > 0)
+        Samples.Add({ goalDistance, numSimulationsToOptimal, longestGoalReachingRun });
+}
+
+void TrainingBudgetTuner::RoomMeasured()
+{
+    FScopeLock lock(&TunerSection);
+    if (!Tuning)
+        return;
+    ++NumRoomsMeasured;
+    if (NumRoomsMeasured >= Budget.NumTuningRooms)
+    {
+        ComputeTunedBudget();
+        Tuning = false;
+    }
+}
+
+void TrainingBudgetTuner::ComputeTunedBudget()
+{
+    if (Samples.Num() == 0)
+        return;
+
+    const float target = FMath::Clamp(Budget.OptimalityTarget, 0.0f, 1.0f);
+    auto GetQuantile = [target](TArray<int>& values)
+    {
+        values.Sort();
+        const int index = FMath::Clamp(FMath::CeilToInt(target * values.Num()) - 1, 0, values.Num() - 1);
+        return values[index];
+    };
+
+    int maxGoalDistance = 0;
+    for (const ConvergenceSample& sample : Samples)
+        maxGoalDistance = FMath::Max(maxGoalDistance, sample.GoalDistance);
+
+    // Positions that never became optimal count as needing more than the full budget, in which case the full budget is kept.
+    const int unconverged = Budget.NumTrainingSimulations + 1;
+    Budget.NumSimulationsForGoalDistance.SetNum(maxGoalDistance + 1);
+    Budget.NumSimulationsForGoalDistance[0] = Budget.NumTrainingSimulations;
+    int previousNumSimulations = 1;
+    for (int distance = 1; distance <= maxGoalDistance; ++distance)
+    {
+        TArray<int> simulationCounts;
+        for (const ConvergenceSample& sample : Samples)
+            if (sample.GoalDistance == distance)
+                simulationCounts.Add(sample.NumSimulationsToOptimal == INDEX_NONE ? unconverged : sample.NumSimulationsToOptimal);
+
+        int numSimulations = simulationCounts.Num() > 0 ? GetQuantile(simulationCounts) : previousNumSimulations;
+        // Positions further from the goal should never get a smaller budget than closer ones.
+        numSimulations = FMath::Clamp(FMath::Max(numSimulations, previousNumSimulations), 1, Budget.NumTrainingSimulations);
+        Budget.NumSimulationsForGoalDistance[distance] = numSimulations;
+        previousNumSimulations = numSimulations;
+    }
+
+    TArray<int> runLengths;
+    for (const ConvergenceSample& sample : Samples)
+        runLengths.Add(sample.LongestGoalReachingRun > 0 ? sample.LongestGoalReachingRun : Budget.MaxNumMovementsPerSimulation);
+    // The configured maximum wins if it is already shorter than the furthest goal distance.
+    const int minNumMovements = FMath::Min(maxGoalDistance, Budget.MaxNumMovementsPerSimulation);
+    Budget.MaxNumMovementsPerSimulation = FMath::Clamp(GetQuantile(runLengths), minNumMovements, Budget.MaxNumMovementsPerSimulation);
+
+    UE_LOG(LogTemp, Log, TEXT("Training budget tuned from %d samples: %d movements per simulation, %d simulations for the furthest positions."),
+           Samples.Num(), Budget.MaxNumMovementsPerSimulation, Budget.NumSimulationsForGoalDistance.Last());
+    Samples.Empty();
+}
@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+namespace TrainingMeasurements
+{
+    /* Fills distances with the number of moves needed to reach the goal from each position in the room. Unreachable positions are set to INDEX_NONE. */
+    void GetGoalDistances(const NavigationEnvironment& navEnvironment, FIntPoint goalPosition, TArray<TArray<int>>& distances);
+
+    /* Returns true if following the greedy policy from startPosition reaches the goal in the minimum number of moves, for every optimal action along the way. */
+    bool IsPolicyOptimalFromPosition(const NavigationEnvironment& navEnvironment, const QValuesRewardsSet& qValuesRewards,
+                                     FIntPoint startPosition, const TArray<TArray<int>>& distances);
+};
+
+/*
+Picks the training budget for the LevelTrainerComponent.
+
+While tuning, trainers report one sample per (goal, starting position) pair: how many simulations it took until the greedy policy
+from the starting position was optimal, and the longest run that reached the goal in the meantime. Once NumTuningRooms rooms have
+been measured, the smallest simulation counts that reach the OptimalityTarget are stored per goal distance, and the maximum number
+of movements per simulation is reduced to the longest goal-reaching run needed at the same target.
+
+Samples are added from the trainer threads, so all access is guarded.
+*/
+class TrainingBudgetTuner
+{
+public:
+    struct ConvergenceSample
+    {
+        int GoalDistance;
+        int NumSimulationsToOptimal;
+        int LongestGoalReachingRun;
+    };
+
+    void Reset(const FTrainingBudget& budget);
+
+    bool IsTuning() const;
+    FTrainingBudget GetBudget() const;
+
+    /* numSimulationsToOptimal should be INDEX_NONE if the policy never became optimal within the budget. */
+    void AddSample(int goalDistance, int numSimulationsToOptimal, int longestGoalReachingRun);
+    void RoomMeasured();
+
+private:
+    void ComputeTunedBudget();
+
+    mutable FCriticalSection TunerSection;
+    FTrainingBudget Budget;
+    TArray<ConvergenceSample> Samples;
+    int NumRoomsMeasured = 0;
+    bool Tuning = false;
+};
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TPGameDemo.h"
+#include "TPGameDemoGameState.h"
+#include "WorldSnapshot.h"
+
+DEFINE_LOG_CATEGORY(LogWorldSnapshot);
+
+FString WorldSnapshotFormat::GetSnapshotPath(const FString& fileName)
+{
+    if (FPaths::IsRelative(fileName))
+        return FPaths::ProjectSavedDir() / TEXT("Snapshots") / fileName;
+    return fileName;
+}
+
+//====================================================================================================
+// Console commands
+//====================================================================================================
+
+namespace
+{
+    ATPGameDemoGameState* GetSnapshotGameState(UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = world != nullptr ? world->GetGameState<ATPGameDemoGameState>() : nullptr;
+        if (gameState == nullptr)
+            UE_LOG(LogWorldSnapshot, Warning, TEXT("No TPGameDemo game state in this world."));
+        return gameState;
+    }
+
+    void SaveWorldCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetSnapshotGameState(world);
+        if (gameState != nullptr)
+            gameState->SaveWorldSnapshot(args.Num() > 0 ? args[0] : TEXT("World.tpworld"));
+    }
+
+    void LoadWorldCommand(const TArray<FString>& args, UWorld* world)
+    {
+        ATPGameDemoGameState* gameState = GetSnapshotGameState(world);
+        if (gameState != nullptr)
+            gameState->LoadWorldSnapshot(args.Num() > 0 ? args[0] : TEXT("World.tpworld"));
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs SaveWorldConsoleCommand(
+        TEXT("TPGameDemo.SaveWorld"),
+        TEXT("Saves the world to Saved/Snapshots, with its trained rooms in a policy archive beside it. Arguments: [FileName]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SaveWorldCommand));
+
+    FAutoConsoleCommandWithWorldAndArgs LoadWorldConsoleCommand(
+        TEXT("TPGameDemo.LoadWorld"),
+        TEXT("Replaces the world with a snapshot saved by TPGameDemo.SaveWorld. Arguments: [FileName]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LoadWorldCommand));
+};
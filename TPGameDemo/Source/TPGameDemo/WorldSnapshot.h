@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TPGameDemo.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogWorldSnapshot, Log, All);
+
+/*
+A world snapshot holds the whole persistent state of ATPGameDemoGameState in one binary file, so a run can be resumed without
+retraining its rooms (see ATPGameDemoGameState::SaveWorldSnapshot).
+
+    FileHeader
+    RoomRecord[NumRoomRecords]              one per room state, in [x][y] index order, including rooms that don't exist
+    PlacementRoom[NumPlacementRooms]        each followed by the room's packed buildable placement nibbles (PlacementBytesPerRoom)
+
+The qvalue tables of trained rooms are not in the snapshot. They are saved to a PolicyArchive next to it (PolicyArchiveName),
+and the snapshot keeps the archive's entries checksum so that a mismatched archive is detected on load.
+All records are fixed size and read in place. All values are little-endian.
+*/
+namespace WorldSnapshotFormat
+{
+    constexpr uint32 FileMagic = 0x53575054;
+    constexpr uint32 FileVersion = 1;
+    constexpr int32 MaxArchiveNameLength = 128;
+
+    struct FileHeader
+    {
+        uint32 Magic = FileMagic;
+        uint32 Version = FileVersion;
+        uint32 BodyChecksum = 0;
+        int32 NumGridUnitsX = 0;
+        int32 NumGridUnitsY = 0;
+        int32 NumGridsXY = 0;
+        int32 WorldSeed = 0;
+        int32 CurrentPerimeter = 1;
+        int32 NumPerimeterRoomsConnected = 0;
+        float SignalStrength = 0.0f;
+        float MaxSignalStrength = 0.0f;
+        uint32 NumRoomRecords = 0;
+        uint32 NumPlacementRooms = 0;
+        uint32 PlacementBytesPerRoom = 0;
+        uint32 PolicyArchiveChecksum = 0;
+        uint32 NumTrainedRooms = 0;
+        ANSICHAR PolicyArchiveName[MaxArchiveNameLength] = {};
+    };
+
+    struct WallRecord
+    {
+        int32 DoorPosition = -1;
+        uint8 DoorState = 0;
+        uint8 bWallExists = 0;
+        uint8 bDoorExists = 0;
+        uint8 Padding = 0;
+    };
+    static_assert(sizeof(WallRecord) == 8, "Snapshot records are read in place.");
+
+    struct RoomRecord
+    {
+        uint8 Status = 0;
+        uint8 Padding[3] = {};
+        WallRecord SouthWall;
+        WallRecord WestWall;
+        float Health = 0.0f;
+        float Complexity = 0.0f;
+        float Density = 0.0f;
+        float TrainingProgress = 0.0f;
+        int32 SignalPointX = -1;
+        int32 SignalPointY = -1;
+        uint32 InnerNumX = 0;
+        uint32 InnerNumY = 0;
+        RoomBitboard::RowType InnerRows[RoomBitboard::MaxSide] = {};
+    };
+    static_assert(sizeof(RoomRecord) % alignof(RoomRecord) == 0 && sizeof(FileHeader) % alignof(RoomRecord) == 0,
+                  "Snapshot records are read in place.");
+
+    struct PlacementRoom
+    {
+        int32 RoomX = 0;
+        int32 RoomY = 0;
+    };
+
+    inline WallRecord ToWallRecord(const WallState& wall)
+    {
+        WallRecord record;
+        record.DoorPosition = wall.DoorPosition;
+        record.DoorState = (uint8)wall.DoorState;
+        record.bWallExists = wall.bWallExists;
+        record.bDoorExists = wall.bDoorExists;
+        return record;
+    }
+
+    inline void FromWallRecord(const WallRecord& record, WallState& wall)
+    {
+        wall.DoorPosition = record.DoorPosition;
+        wall.DoorState = record.DoorState < (uint8)EDoorState::NumStates ? (EDoorState)record.DoorState : EDoorState::Closed;
+        wall.bWallExists = record.bWallExists != 0;
+        wall.bDoorExists = record.bDoorExists != 0;
+    }
+
+    /* Relative file names are resolved against Saved/Snapshots. */
+    FString GetSnapshotPath(const FString& fileName);
+};